@@ -1,10 +1,20 @@
 #include "CardIO.h"
+#include "CardModel/CardImageDiff.h"
 #include "CardModel/CardMemoryLayout.h"
+#include "CardModel/CardTopology.h"
 #include "CardModel/DesfireMemoryLayout.h"
 #include "CardModel/TrailerConfig.h"
 #include "CardProtocol/DesfireCommands.h"
 #include "CardProtocol/DesfireAuth.h"
+#include "CardProtocol/DesfireKeyDiversification.h"
+#include "CardProtocol/DesfireProfile.h"
 #include "CardProtocol/DesfireSession.h"
+#include "CardProtocol/DesfireSecureMessaging.h"
+#include "CardProtocol/DesfireSnapshot.h"
+#include "CardProtocol/DesfireTransaction.h"
+#include "DesfireMetadataCache.h"
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -14,7 +24,9 @@
 CardIO::CardIO(Reader& reader, CardType ct)
 	: reader_(reader), card_(ct)
 {
-	keys_.push_back(KeyInfo{});
+	keys_[0]  = KeyInfo{};
+	keyCount_ = 1;
+	invalidateKeyPlan();
 	if (card_.isDesfire())
 		desfireSession_ = std::make_unique<DesfireSession>();
 }
@@ -34,40 +46,51 @@ CardIO::~CardIO() = default;
 void CardIO::setDefaultKey(const KEYBYTES& key, KeyStructure ks,
 						   BYTE slot, KeyType kt)
 {
-	keys_.clear();
-	keys_.push_back({ key, kt, ks, slot, "DefaultKey" });
-	slotContents_.clear();
+	keys_[0]  = { key, kt, ks, slot, "DefaultKey" };
+	keyCount_ = 1;
+	slotLoaded_ = 0;
+	invalidateKeyPlan();
 }
 
 void CardIO::setKeys(const KEYBYTES& keyA, BYTE slotA,
 					 const KEYBYTES& keyB, BYTE slotB,
 					 KeyStructure ks)
 {
-	keys_.clear();
-	keys_.push_back({ keyA, KeyType::A, ks, slotA, "KeyA" });
-	keys_.push_back({ keyB, KeyType::B, ks, slotB, "KeyB" });
-	slotContents_.clear();
-
+	// Geçersiz key'de registerKey throw eder → tablo değişmeden önce
 	card_.registerKey(KeyType::A, keyA, ks, slotA, "KeyA");
 	card_.registerKey(KeyType::B, keyB, ks, slotB, "KeyB");
+
+	keys_[0]  = { keyA, KeyType::A, ks, slotA, "KeyA" };
+	keys_[1]  = { keyB, KeyType::B, ks, slotB, "KeyB" };
+	keyCount_ = 2;
+	slotLoaded_ = 0;
+	invalidateKeyPlan();
 }
 
 void CardIO::addKey(const KeyInfo& ki)
 {
-	for (auto& existing : keys_) {
+	invalidateKeyPlan();
+	for (int i = 0; i < keyCount_; ++i) {
+		KeyInfo& existing = keys_[i];
 		if (existing.kt == ki.kt && existing.slot == ki.slot) {
 			existing = ki;
-			slotContents_.erase(ki.slot);
+			if (ki.slot < KEY_CAPACITY) slotLoaded_ &= ~(1u << ki.slot);
 			return;
 		}
 	}
-	keys_.push_back(ki);
+	if (keyCount_ >= KEY_CAPACITY) {
+		PcscError::make(CardError::InvalidData,
+			"Key table full (" + std::to_string(KEY_CAPACITY) + " keys)").throwIfError();
+		return;
+	}
+	keys_[keyCount_++] = ki;
 }
 
 void CardIO::clearKeys()
 {
-	keys_.clear();
-	keys_.push_back(KeyInfo{});
+	keys_[0]  = KeyInfo{};
+	keyCount_ = 1;
+	invalidateKeyPlan();
 	invalidateAuth();
 }
 
@@ -86,9 +109,9 @@ Result<void, PcscError> CardIO::tryEnsureAuth(int sector, AuthPurpose purpose)
 	if (card_.isUltralight()) return R::Err(Error<PcscError>(CardError::NotDesfire));
 
 	if (sector == lastAuthSector_) {
-		if (!isMultiKey()) return R::Err(Error<PcscError>(CardError::Unknown));
+		if (!isMultiKey()) return R::Ok();
 		const KeyInfo& lastKey = findKey(lastAuthKT_);
-		if (canKeyPerform(lastKey, sector, purpose)) return R::Err(Error<PcscError>(DesfireError::AuthMismatch));
+		if (canKeyPerform(lastKey, sector, purpose)) return R::Ok();
 	}
 
 	const KeyInfo& chosen = chooseKey(sector, purpose);
@@ -97,10 +120,11 @@ Result<void, PcscError> CardIO::tryEnsureAuth(int sector, AuthPurpose purpose)
 	if (is_ok) return result;
 
 	if (isMultiKey()) {
-		for (const auto& ki : keys_) {
+		for (int i = 0; i < keyCount_; ++i) {
+			const KeyInfo& ki = keys_[i];
 			if (&ki == &chosen) continue;
 			result = tryDoAuth(sector, ki);
-			if (result.Ok()) return result;
+			if (result.is_ok()) return result;
 		}
 	}
 
@@ -117,11 +141,10 @@ Result<void, PcscError> CardIO::tryDoAuth(int sector, const KeyInfo& ki)
 {
 	int trailer = card_.getTrailerBlockOfSector(sector);
 
-	auto it = slotContents_.find(ki.slot);
-	if (it == slotContents_.end() || it->second != ki.key) {
+	if (!isKeyLoaded(ki)) {
 		auto lr = reader_.tryLoadKey(ki.key.data(), ki.ks, ki.slot);
 		if (!lr) return lr;
-		slotContents_[ki.slot] = ki.key;
+		markKeyLoaded(ki);
 	}
 
 	auto ar = reader_.tryAuth(static_cast<BYTE>(trailer), ki.kt, ki.slot);
@@ -134,28 +157,71 @@ Result<void, PcscError> CardIO::tryDoAuth(int sector, const KeyInfo& ki)
 
 void CardIO::ensureKeyLoaded(const KeyInfo& ki)
 {
-	auto it = slotContents_.find(ki.slot);
-	if (it != slotContents_.end() && it->second == ki.key) return;
+	if (isKeyLoaded(ki)) return;
 
 	reader_.loadKey(ki.key.data(), ki.ks, ki.slot);
+	markKeyLoaded(ki);
+}
+
+bool CardIO::isKeyLoaded(const KeyInfo& ki) const
+{
+	if (ki.slot >= KEY_CAPACITY) return false;   // cache dışı slot → her seferinde yükle
+	return (slotLoaded_ & (1u << ki.slot)) && slotContents_[ki.slot] == ki.key;
+}
+
+void CardIO::markKeyLoaded(const KeyInfo& ki)
+{
+	if (ki.slot >= KEY_CAPACITY) return;
 	slotContents_[ki.slot] = ki.key;
+	slotLoaded_ |= (1u << ki.slot);
 }
 
 void CardIO::invalidateAuth()
 {
 	lastAuthSector_ = -1;
 	lastAuthKT_     = KeyType::A;
-	slotContents_.clear();
+	slotLoaded_     = 0;
+}
+
+void CardIO::invalidateKeyPlan()
+{
+	for (auto& entry : keyPlan_) entry = { NO_PLAN, NO_PLAN };
+}
+
+void CardIO::invalidateKeyPlan(int sector)
+{
+	if (sector >= 0 && sector < MAX_SECTORS)
+		keyPlan_[sector] = { NO_PLAN, NO_PLAN };
+}
+
+void CardIO::onTrailerChanged(int sector)
+{
+	card_.invalidateAccessCache(sector);
+	invalidateKeyPlan(sector);
 }
 
 const KeyInfo& CardIO::chooseKey(int sector, AuthPurpose purpose) const
 {
-	if (keys_.size() == 1) return keys_[0];
+	if (keyCount_ == 1) return keys_[0];
+
+	const int p = (purpose == AuthPurpose::Read) ? 0 : 1;
+	const bool cacheable = sector >= 0 && sector < MAX_SECTORS;
+	if (cacheable) {
+		// Model CardIO dışından değişti (loadMemory, rollback, trailer yazımı) → plan bayat
+		const uint32_t epoch = card_.accessEpoch(sector);
+		if (keyPlanEpoch_[sector] != epoch) {
+			keyPlan_[sector] = { NO_PLAN, NO_PLAN };
+			keyPlanEpoch_[sector] = epoch;
+		}
+		if (keyPlan_[sector][p] != NO_PLAN)
+			return keys_[keyPlan_[sector][p]];
+	}
 
-	const KeyInfo* best = nullptr;
+	int best = 0;
 	int bestScore = 0;
 
-	for (const auto& ki : keys_) {
+	for (int i = 0; i < keyCount_; ++i) {
+		const KeyInfo& ki = keys_[i];
 		bool canR = canKeyPerform(ki, sector, AuthPurpose::Read);
 		bool canW = canKeyPerform(ki, sector, AuthPurpose::Write);
 
@@ -168,25 +234,26 @@ const KeyInfo& CardIO::chooseKey(int sector, AuthPurpose purpose) const
 		int score = (canR && canW) ? 1 : 2;
 
 		if (score > bestScore) {
-			best = &ki;
+			best = i;
 			bestScore = score;
 		}
 	}
 
-	return best ? *best : keys_.front();
+	if (cacheable) keyPlan_[sector][p] = static_cast<int8_t>(best);
+	return keys_[best];
 }
 
 const KeyInfo& CardIO::findKey(KeyType kt) const
 {
-	for (const auto& ki : keys_) {
-		if (ki.kt == kt) return ki;
+	for (int i = 0; i < keyCount_; ++i) {
+		if (keys_[i].kt == kt) return keys_[i];
 	}
-	return keys_.front();
+	return keys_[0];
 }
 
 bool CardIO::isMultiKey() const
 {
-	return keys_.size() > 1;
+	return keyCount_ > 1;
 }
 
 bool CardIO::canKeyPerform(const KeyInfo& ki, int sector, AuthPurpose purpose) const
@@ -221,7 +288,7 @@ void CardIO::authenticate(int sector, KeyType kt, BYTE slot)
 	reader_.auth(static_cast<BYTE>(trailer), kt, slot);
 	lastAuthSector_ = sector;
 	lastAuthKT_     = kt;
-	slotContents_.clear();
+	slotLoaded_     = 0;
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -233,29 +300,38 @@ int CardIO::readCard() { return tryReadCard().unwrap(); }
 Result<int, PcscError> CardIO::tryReadCard() {
 	if (card_.isDesfire()) return Result<int, PcscError>::Ok(0);
 
-	int totalSectors = card_.getTotalSectors();
+	BYTEV rawBuf(card_.getTotalMemory(), 0);
 	int okCount = 0;
-	size_t memSize = card_.getTotalMemory();
-	BYTEV rawBuf(memSize, 0);
 
-	for (int s = 0; s < totalSectors; ++s) {
-		auto authResult = tryEnsureAuth(s);
-		if (!authResult.is_ok()) { invalidateAuth(); continue; }
+	switch (card_.getCardType()) {
+		case CardType::MifareClassic4K:  okCount = readCardAs<CardType::MifareClassic4K>(rawBuf.data());  break;
+		case CardType::MifareUltralight: okCount = readCardAs<CardType::MifareUltralight>(rawBuf.data()); break;
+		default:                         okCount = readCardAs<CardType::MifareClassic1K>(rawBuf.data());  break;
+	}
 
-		int first = card_.getFirstBlockOfSector(s);
-		int last  = card_.getLastBlockOfSector(s);
+	card_.loadMemory(rawBuf.data(), rawBuf.size());
+	return Result<int, PcscError>::Ok(okCount);
+}
+
+template <CardType CT>
+int CardIO::readCardAs(BYTE* raw) {
+	using T = Topology<CT>;
+	int okCount = 0;
 
-		for (int b = first; b <= last; ++b) {
-			auto rr = reader_.tryReadPage(static_cast<BYTE>(b));
+	for (int s = 0; s < T::SECTOR_COUNT; ++s) {
+		if constexpr (T::HAS_TRAILERS) {
+			if (!tryEnsureAuth(s).is_ok()) { invalidateAuth(); continue; }
+		}
+		const int last = T::lastBlockOfSector(s);
+		for (int b = T::firstBlockOfSector(s); b <= last; ++b) {
+			auto rr = reader_.tryReadPage(static_cast<BYTE>(T::pageOfBlock(b)));
 			if (rr && rr.unwrap().size() >= 16) {
-				std::memcpy(&rawBuf[b * 16], rr.unwrap().data(), 16);
+				std::memcpy(raw + b * 16, rr.unwrap().data(), 16);
 				++okCount;
 			}
 		}
 	}
-
-	card_.loadMemory(rawBuf.data(), memSize);
-	return Result<int, PcscError>::Ok(okCount);
+	return okCount;
 }
 
 bool CardIO::readSector(int sector) {
@@ -266,28 +342,41 @@ bool CardIO::readSector(int sector) {
 Result<bool, PcscError> CardIO::tryReadSector(int sector)
 {
 	if (card_.isDesfire()) return Result<bool, PcscError>::Ok(false);
+	if (sector < 0 || sector >= card_.getTotalSectors())
+		return Result<bool, PcscError>::Err(PcscError::make(CardError::InvalidData,
+			"Sector out of range: " + std::to_string(sector)));
 
-	auto authResult = tryEnsureAuth(sector);
-	if (!authResult) {
-		invalidateAuth();
-		return Result<bool, PcscError>::Err(std::move(authResult.error()));
+	if (card_.isClassic()) {
+		auto authResult = tryEnsureAuth(sector);
+		if (!authResult) {
+			invalidateAuth();
+			return Result<bool, PcscError>::Err(std::move(authResult.error()));
+		}
 	}
 
-	int first = card_.getFirstBlockOfSector(sector);
-	int last  = card_.getLastBlockOfSector(sector);
-	bool allOk = true;
-
-	CardMemoryLayout& mem = card_.getMemoryMutable();
-	BYTE* raw = mem.getRawMemory();
+	bool allOk;
+	switch (card_.getCardType()) {
+		case CardType::MifareClassic4K:  allOk = readSectorBlocksAs<CardType::MifareClassic4K>(sector);  break;
+		case CardType::MifareUltralight: allOk = readSectorBlocksAs<CardType::MifareUltralight>(sector); break;
+		default:                         allOk = readSectorBlocksAs<CardType::MifareClassic1K>(sector);  break;
+	}
+	onTrailerChanged(sector);
+	return Result<bool, PcscError>::Ok(allOk);
+}
 
-	for (int b = first; b <= last; ++b) {
-		auto rr = reader_.tryReadPage(static_cast<BYTE>(b));
+template <CardType CT>
+bool CardIO::readSectorBlocksAs(int sector) {
+	using T = Topology<CT>;
+	bool allOk = true;
+	const int last = T::lastBlockOfSector(sector);
+	for (int b = T::firstBlockOfSector(sector); b <= last; ++b) {
+		auto rr = reader_.tryReadPage(static_cast<BYTE>(T::pageOfBlock(b)));
 		if (rr && rr.unwrap().size() >= 16)
-			std::memcpy(raw + b * 16, rr.unwrap().data(), 16);
+			card_.writeBlockData(b, rr.unwrap().data());
 		else
 			allOk = false;
 	}
-	return Result<bool, PcscError>::Ok(allOk);
+	return allOk;
 }
 
 BYTEV CardIO::readBlock(int block)
@@ -305,8 +394,8 @@ Result<BYTEV, PcscError> CardIO::tryReadBlock(int block)
 	if (!rr) return rr;
 
 	if (rr.unwrap().size() >= 16) {
-		CardMemoryLayout& mem = card_.getMemoryMutable();
-		std::memcpy(mem.getRawMemory() + block * 16, rr.unwrap().data(), 16);
+		card_.writeBlockData(block, rr.unwrap().data());
+		if (card_.isTrailerBlock(block)) onTrailerChanged(sector);
 	}
 	return rr;
 }
@@ -327,23 +416,35 @@ Result<void, PcscError> CardIO::tryWriteBlock(int block, const BYTE data[16])
 	if (card_.isTrailerBlock(block))
 		return Result<void, PcscError>::Err(Error<PcscError>(CardError::TrailerBlock));
 
-	int sector = card_.getSectorForBlock(block);
-	auto authResult = tryEnsureAuth(sector, AuthPurpose::Write);
-	if (!authResult) return authResult;
+	switch (card_.getCardType()) {
+		case CardType::MifareClassic4K:  return tryWriteBlockAs<CardType::MifareClassic4K>(block, data);
+		case CardType::MifareUltralight: return tryWriteBlockAs<CardType::MifareUltralight>(block, data);
+		default:                         return tryWriteBlockAs<CardType::MifareClassic1K>(block, data);
+	}
+}
 
-	if (card_.isUltralight()) {
-		int basePage = block * 4;
-		for (int p = 0; p < 4; ++p) {
-			auto wr = reader_.tryWritePage(static_cast<BYTE>(basePage + p), data + p * 4);
-			if (!wr) return wr;
-		}
-	} else {
-		auto wr = reader_.tryWritePage(static_cast<BYTE>(block), data);
+template <CardType CT>
+Result<void, PcscError> CardIO::tryWriteBlockAs(int block, const BYTE data[16])
+{
+	using T = Topology<CT>;
+	if (!T::isValidBlock(block))
+		return Result<void, PcscError>::Err(PcscError::make(CardError::InvalidData,
+			"Block out of range: " + std::to_string(block)));
+
+	if constexpr (T::HAS_TRAILERS) {
+		auto authResult = tryEnsureAuth(T::sectorFromBlock(block), AuthPurpose::Write);
+		if (!authResult) return authResult;
+	}
+
+	// Ultralight: 16 byte = 4 page, her biri ayrı UPDATE
+	const int basePage = T::pageOfBlock(block);
+	for (int p = 0; p < T::PAGES_PER_BLOCK; ++p) {
+		auto wr = reader_.tryWritePage(static_cast<BYTE>(basePage + p),
+		                               data + p * (16 / T::PAGES_PER_BLOCK));
 		if (!wr) return wr;
 	}
 
-	CardMemoryLayout& mem = card_.getMemoryMutable();
-	std::memcpy(mem.getRawMemory() + block * 16, data, 16);
+	card_.writeBlockData(block, data);
 	return Result<void, PcscError>::Ok();
 }
 
@@ -379,8 +480,8 @@ Result<TrailerConfig, PcscError> CardIO::tryReadTrailer(int sector) {
 		return Result<TrailerConfig, PcscError>::Err(std::move(rr.error()));
 	else if (rr.unwrap().size() < 16)
 		return Result<TrailerConfig, PcscError>::Err(Error<PcscError>(IoError::ReadFailed));
-	CardMemoryLayout& mem = card_.getMemoryMutable();
-	std::memcpy(mem.getRawMemory() + trailerBlock * 16, rr.unwrap().data(), 16);
+	card_.writeBlockData(trailerBlock, rr.unwrap().data());
+	onTrailerChanged(sector);
 
 	MifareBlock blk;
 	std::memcpy(blk.raw, rr.unwrap().data(), 16);
@@ -405,11 +506,116 @@ Result<void, PcscError> CardIO::tryWriteTrailer(int sector, const TrailerConfig&
 	auto wr = reader_.tryWritePage(static_cast<BYTE>(trailerBlock), blk.raw);
 	if (!wr) return wr;
 
-	CardMemoryLayout& mem = card_.getMemoryMutable();
-	std::memcpy(mem.getRawMemory() + trailerBlock * 16, blk.raw, 16);
+	card_.writeBlockData(trailerBlock, blk.raw);
+	onTrailerChanged(sector);
 	return Result<void, PcscError>::Ok();
 }
 
+// ════════════════════════════════════════════════════════════════════════════════
+// Diff Write-Back
+// ════════════════════════════════════════════════════════════════════════════════
+
+int CardIO::writeDiff(const CardImageDiff& diff, const CardMemoryLayout& source, bool includeTrailers) {
+	return tryWriteDiff(diff, source, includeTrailers).unwrap();
+}
+
+Result<int, PcscError> CardIO::tryWriteDiff(const CardImageDiff& diff, const CardMemoryLayout& source,
+                                            bool includeTrailers)
+{
+	using R = Result<int, PcscError>;
+	if (card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+	if (diff.cardType != card_.getCardType() || source.cardType != card_.getCardType())
+		return R::Err(PcscError::make(CardError::InvalidData, "Diff/source card type does not match card"));
+
+	const BYTE* src = source.getRawMemory();
+
+	// Plan aşaması: trailer'lar karta tek byte yazılmadan önce çözülür.
+	// Karttan okunmuş imajda key A hep sıfırdır (key B de okunamıyorsa) →
+	// sıfır key alanı "bilinmiyor" sayılır ve sektörün kendi key'i ile
+	// doldurulur. Sektörlerin key'leri farklı olabilir: tablodaki ilk aynı
+	// tip key değil, trailer'ı yazacak key (planTrailerKey) kullanılır. O
+	// key gereken tipte değilse veya iki key de sıfırsa yazma reddedilir:
+	// yanlış/sıfır key'i karta yazmak sektörü erişilemez bırakır.
+	struct TrailerPlan {
+		TrailerConfig tc;
+		bool    fill = false;
+		KeyType kt   = KeyType::A;
+	};
+	std::vector<TrailerPlan> trailers;
+	if (includeTrailers) {
+		for (const BlockDiff& d : diff.blocks) {
+			if (!card_.isTrailerBlock(d.block)) continue;
+			MifareBlock blk;
+			std::memcpy(blk.raw, src + d.block * 16, 16);
+			TrailerPlan tp;
+			tp.tc = TrailerConfig::fromBlock(blk);
+			const bool zeroA = tp.tc.keyA == KEYBYTES{};
+			const bool zeroB = tp.tc.keyB == KEYBYTES{};
+			if (zeroA || zeroB) {
+				const int sector = card_.getSectorForBlock(d.block);
+				const KeyInfo& planned = planTrailerKey(sector, AuthPurpose::Write);
+				tp.fill = true;
+				tp.kt   = zeroA ? KeyType::A : KeyType::B;
+				if ((zeroA && zeroB) || planned.kt != tp.kt) {
+					const KeyType missing = (zeroA && zeroB && planned.kt == KeyType::A) ? KeyType::B : tp.kt;
+					return R::Err(Error<PcscError>(CardError::InvalidData)
+						.detail(std::string("Trailer key ") + (missing == KeyType::A ? "A" : "B")
+							+ " unknown (zero in source image) and not the sector's write key; register it with setKeys")
+						.meta("block", static_cast<int>(d.block)));
+				}
+			}
+			trailers.push_back(tp);
+		}
+	}
+
+	// Hata türü korunur (auth / transport / kart); konum meta'ya eklenir
+	auto located = [](PcscError e, int block, int written) {
+		e.meta.emplace("block", MetaTypes::MetaValue{ static_cast<int64_t>(block) });
+		e.meta.emplace("written", MetaTypes::MetaValue{ static_cast<int64_t>(written) });
+		return e;
+	};
+
+	int written = 0;
+	size_t trailerIdx = 0;
+	// diff blok sırasıyla gelir → aynı sektördeki bloklar tek auth ile yazılır
+	for (const BlockDiff& d : diff.blocks) {
+		const int block = d.block;
+		if (card_.isManufacturerBlock(block)) continue;
+
+		if (card_.isTrailerBlock(block)) {
+			if (!includeTrailers) continue;
+			const int sector = card_.getSectorForBlock(block);
+			TrailerPlan& tp = trailers[trailerIdx++];
+			if (tp.fill) {
+				// Sıfır alan, sektörün gerçekten auth olduğu key ile doldurulur:
+				// plan key'i (tipi plan aşamasında eşleşti) tutmazsa aynı
+				// tipteki diğer key'ler denenir
+				const KeyInfo& planned = planTrailerKey(sector, AuthPurpose::Write);
+				const KeyInfo* authKey = nullptr;
+				auto ar = tryDoAuth(sector, planned);
+				if (ar) authKey = &planned;
+				for (int i = 0; i < keyCount_ && !authKey; ++i) {
+					const KeyInfo& ki = keys_[i];
+					if (&ki == &planned || ki.kt != tp.kt) continue;
+					if (tryDoAuth(sector, ki)) authKey = &ki;
+				}
+				if (!authKey) {
+					invalidateAuth();
+					return R::Err(located(std::move(ar.error()), block, written));
+				}
+				(tp.kt == KeyType::A ? tp.tc.keyA : tp.tc.keyB) = authKey->key;
+			}
+			auto wr = tryWriteTrailer(sector, tp.tc);
+			if (!wr) return R::Err(located(std::move(wr.error()), block, written));
+		} else {
+			auto wr = tryWriteBlock(block, src + block * 16);
+			if (!wr) return R::Err(located(std::move(wr.error()), block, written));
+		}
+		++written;
+	}
+	return R::Ok(written);
+}
+
 // ════════════════════════════════════════════════════════════════════════════════
 // Access Bits Konfigürasyonu
 // ════════════════════════════════════════════════════════════════════════════════
@@ -483,27 +689,184 @@ std::vector<TrailerConfig> CardIO::saveAllTrailers()
 {
 	if (card_.isDesfire()) return {};
 
-	int totalSectors = card_.getTotalSectors();
 	std::vector<TrailerConfig> configs;
-	configs.reserve(totalSectors);
-
-	for (int s = 0; s < totalSectors; ++s) {
-		auto r = tryReadTrailer(s);
-		configs.push_back(r.is_ok() ? r.unwrap() : TrailerConfig::factoryDefault());
-	}
+	(void)tryReadAllTrailers(configs); // hatalı sektörler factoryDefault ile doldurulur
 	return configs;
 }
 
 void CardIO::restoreAllTrailers(const std::vector<TrailerConfig>& configs) {
 	if (card_.isDesfire()) return;
+	(void)tryWriteTrailerBatch(configs, false, true); // best-effort: geçersiz/hatalı sektör atlanır
+}
+
+TrailerBatchReport CardIO::readAllTrailers(std::vector<TrailerConfig>& out, bool verify) {
+	return tryReadAllTrailers(out, verify).unwrap();
+}
+
+TrailerBatchReport CardIO::writeAllTrailers(const std::vector<TrailerConfig>& configs, bool verify) {
+	return tryWriteAllTrailers(configs, verify).unwrap();
+}
+
+const KeyInfo& CardIO::planTrailerKey(int sector, AuthPurpose purpose) const
+{
+	if (!isMultiKey()) return keys_[0];
+
+	// Memory'deki trailer (önceki okuma/yazma) geçerliyse trailer permission'ı kullan
+	const MifareBlock& cached = card_.getBlock(card_.getTrailerBlockOfSector(sector));
+	ACCESSBYTES ab;
+	std::memcpy(ab.data(), cached.trailer.accessBits, 4);
+	if (!AccessBitsCodec::verify(ab)) return chooseKey(sector, purpose);
+
+	TrailerPermission tp = AccessBitsCodec::decode(ab).trailerPermission();
+	for (int i = 0; i < keyCount_; ++i) {
+		const KeyInfo& ki = keys_[i];
+		if (ki.kt != KeyType::A && ki.kt != KeyType::B) continue;
+		bool usable = (purpose == AuthPurpose::Read) ? tp.canRead(ki.kt) : tp.canWrite(ki.kt);
+		if (usable) return ki;
+	}
+	return chooseKey(sector, purpose);
+}
+
+Result<void, PcscError> CardIO::tryAuthTrailer(int sector, AuthPurpose purpose,
+											   TrailerSectorResult& res)
+{
+	const KeyInfo& planned = planTrailerKey(sector, purpose);
+	res.keyType = planned.kt;
+	auto ar = tryDoAuth(sector, planned);
+	if (ar) return ar;
+
+	if (isMultiKey()) {
+		for (int i = 0; i < keyCount_; ++i) {
+			const KeyInfo& ki = keys_[i];
+			if (&ki == &planned) continue;
+			auto fr = tryDoAuth(sector, ki);
+			if (fr) { res.keyType = ki.kt; return fr; }
+		}
+	}
+
+	invalidateAuth();
+	return ar;
+}
+
+Result<TrailerBatchReport, PcscError> CardIO::tryReadAllTrailers(std::vector<TrailerConfig>& out, bool verify)
+{
+	using R = Result<TrailerBatchReport, PcscError>;
+	if (card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+	if (card_.isUltralight()) return R::Err(Error<PcscError>(CardError::TrailerBlock).detail("Ultralight has no sector trailers"));
+
+	int totalSectors = card_.getTotalSectors();
+	TrailerBatchReport report;
+	report.verifyRequested = verify;
+	report.sectors.resize(totalSectors);
+	out.assign(totalSectors, TrailerConfig::factoryDefault());
+
+	for (int s = 0; s < totalSectors; ++s) {
+		TrailerSectorResult& res = report.sectors[s];
+		res.sector = s;
+
+		auto ar = tryAuthTrailer(s, AuthPurpose::Read, res);
+		if (!ar) { res.error = ar.error().message(); continue; }
+		res.authOk = true;
+
+		int trailerBlock = card_.getTrailerBlockOfSector(s);
+		auto rr = reader_.tryReadPage(static_cast<BYTE>(trailerBlock));
+		if (!rr) { res.error = rr.error().message(); continue; }
+		const BYTEV& data = rr.unwrap();
+		if (data.size() < 16) { res.error = "Short trailer read: " + std::to_string(data.size()) + " bytes"; continue; }
+		res.ioOk = true;
+
+		card_.writeBlockData(trailerBlock, data.data());
+		onTrailerChanged(s);
+		MifareBlock blk;
+		std::memcpy(blk.raw, data.data(), 16);
+		out[s] = TrailerConfig::fromBlock(blk);
+
+		if (verify) {
+			ACCESSBYTES ab;
+			std::memcpy(ab.data(), blk.trailer.accessBits, 4);
+			res.verified = AccessBitsCodec::verify(ab);
+			if (!res.verified) res.error = "Access bits integrity check failed";
+		}
+	}
+	return R::Ok(std::move(report));
+}
+
+Result<TrailerBatchReport, PcscError> CardIO::tryWriteAllTrailers(const std::vector<TrailerConfig>& configs, bool verify)
+{
+	return tryWriteTrailerBatch(configs, verify, false);
+}
+
+Result<TrailerBatchReport, PcscError> CardIO::tryWriteTrailerBatch(const std::vector<TrailerConfig>& configs,
+																	bool verify, bool skipInvalid)
+{
+	using R = Result<TrailerBatchReport, PcscError>;
+	if (card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+	if (card_.isUltralight()) return R::Err(Error<PcscError>(CardError::TrailerBlock).detail("Ultralight has no sector trailers"));
 
 	int totalSectors = card_.getTotalSectors();
 	int count = static_cast<int>(configs.size());
 	if (count > totalSectors) count = totalSectors;
 
+	// Plan aşaması: karta tek byte yazmadan önce tüm config'ler doğrulanır.
+	// Geçersiz access bits sektörü kalıcı kilitleyebilir → tüm batch reddedilir
+	// (skipInvalid'de yalnızca o sektör yazılmaz).
+	std::vector<MifareBlock> blocks(count);
+	std::vector<bool>        valid(count, true);
 	for (int s = 0; s < count; ++s) {
-		(void)tryWriteTrailer(s, configs[s]); // best-effort: hata yoksay
+		if (!configs[s].isValid()) {
+			if (!skipInvalid)
+				return R::Err(Error<PcscError>(CardError::InvalidData)
+					.detail("Invalid access bits in trailer config")
+					.meta("sector", s));
+			valid[s] = false;
+			continue;
+		}
+		blocks[s] = configs[s].toBlock();
 	}
+
+	TrailerBatchReport report;
+	report.verifyRequested = verify;
+	report.sectors.resize(count);
+
+	for (int s = 0; s < count; ++s) {
+		TrailerSectorResult& res = report.sectors[s];
+		res.sector = s;
+		if (!valid[s]) { res.error = "Invalid access bits in trailer config"; continue; }
+
+		auto ar = tryAuthTrailer(s, AuthPurpose::Write, res);
+		if (!ar) { res.error = ar.error().message(); continue; }
+		res.authOk = true;
+
+		int trailerBlock = card_.getTrailerBlockOfSector(s);
+		const MifareBlock& blk = blocks[s];
+		auto wr = reader_.tryWritePage(static_cast<BYTE>(trailerBlock), blk.raw);
+		if (!wr) { res.error = wr.error().message(); invalidateAuth(); continue; }
+		res.ioOk = true;
+		card_.writeBlockData(trailerBlock, blk.raw);
+		onTrailerChanged(s);
+
+		if (!verify) continue;
+
+		// Read-back aynı auth oturumunda yapılır. KeyA her zaman 0 okunur;
+		// KeyB yalnızca yeni access bits kullanılan key'e okuma izni veriyorsa karşılaştırılır.
+		auto rr = reader_.tryReadPage(static_cast<BYTE>(trailerBlock));
+		if (!rr || rr.unwrap().size() < 16) {
+			res.error = rr ? "Short trailer read-back" : rr.error().message();
+			continue;
+		}
+		const BYTE* back = rr.unwrap().data();
+		bool match = std::memcmp(back + 6, blk.trailer.accessBits, 4) == 0;
+		TrailerPermission tp = configs[s].access.trailerPermission();
+		bool keyBReadable = (res.keyType == KeyType::A) ? tp.keyBReadA : tp.keyBReadB;
+		if (match && keyBReadable)
+			match = std::memcmp(back + 10, blk.trailer.keyB, 6) == 0;
+		res.verified = match;
+		if (!match) res.error = "Trailer read-back mismatch";
+	}
+
+	// Trailer'lar değişti: sonraki işlemler yeni key/access ile auth yapmalı
+	lastAuthSector_ = -1;
+	return R::Ok(std::move(report));
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -519,28 +882,208 @@ Reader&              CardIO::reader()     { return reader_; }
 // ════════════════════════════════════════════════════════════════════════════════
 
 BYTEV CardIO::desfireTransmit(const BYTEV& apdu) {
-	return reader_.transmit(apdu).raw();
+	return tryDesfireTransmit(apdu).unwrap();
 }
 
 Result<BYTEV, PcscError> CardIO::tryDesfireTransmit(const BYTEV& apdu) {
 	auto result = reader_.tryTransmit(apdu);
-	if (!result) return Result<BYTEV, PcscError>::Err(std::move(result.error()));
+	if (!result) {
+		// Transport hatası: kart alandan çıkmış / değişmiş olabilir → host oturumu geçersiz
+		desfireDropSession();
+		return Result<BYTEV, PcscError>::Err(std::move(result.error()));
+	}
 	return Result<BYTEV, PcscError>::Ok(result.unwrap().raw());
 }
 
+void CardIO::desfireDropSession() {
+	if (desfireSession_) {
+		desfireSession_->reset();
+		desfireSession_->currentAID = DesfireAID::picc();
+	}
+	if (card_.isDesfire()) card_.getDesfireMemoryMutable().selectApplication(DesfireAID::picc());
+}
+
 Result<void, PcscError> CardIO::desfireExec(const BYTEV& apdu)
 {
-	auto tx = tryDesfireTransmit(apdu);
-	if (!tx) return Result<void, PcscError>::Err(std::move(tx.error()));
-
-	auto ev = DesfireCommands::evaluateResponse(tx.unwrap());
-	if (!ev) return Result<void, PcscError>::Err(std::move(ev.error()));
-	else return Result<void, PcscError>::Ok();
+	auto r = desfireQuery(apdu);
+	if (!r) return Result<void, PcscError>::Err(std::move(r.error()));
+	return Result<void, PcscError>::Ok();
 }
 
 Result<BYTEV, PcscError> CardIO::desfireQuery(const BYTEV& apdu) {
+	// EV2 oturumunda yönetim komutları CommMode.MAC ile gider; EV1'de komut düz
+	const DesfireSession* s = desfireSession_.get();
+	const DesfireCommMode mode = (s && s->authenticated && s->isEV2())
+		? DesfireCommMode::MAC : DesfireCommMode::Plain;
+	return desfireSecureTransceive(apdu, SIZE_MAX, mode, mode, 0);
+}
+
+Result<BYTEV, PcscError> CardIO::desfireSecureTransceive(BYTEV apdu, size_t headerLen,
+														 DesfireCommMode cmdMode, DesfireCommMode respMode,
+														 size_t expectedLen) {
+	using R = Result<BYTEV, PcscError>;
 	auto tx = [this](const BYTEV& a) -> Result<BYTEV, PcscError> { return tryDesfireTransmit(a); };
-	return DesfireCommands::tryTransceive(tx, apdu);
+	const bool secured = cmdMode != DesfireCommMode::Plain || respMode != DesfireCommMode::Plain;
+
+	// Açık value/backup/record işlemi: PICC auth'ta bekleyen değişiklikleri atar.
+	// Yeniden auth yapılmaz; oturum kaybı ayrı hata türüyle döner (işlem baştan).
+	auto txLost = [](PcscError e) {
+		e.kind = DesfireError::TransactionLost;
+		e.detail += e.detail.empty() ? "Session lost inside an open transaction — restart it"
+									 : " (session lost inside an open transaction — restart it)";
+		return e;
+	};
+	const bool mayReauth = !desfireTxOpen_ && desfireCanReauth();
+
+	// Süresi dolmuş / düşmüş oturum: saklı key varsa komuttan önce bir kez yenilenir
+	bool reauthed = false;
+	if (const DesfireSession* s0 = desfireSession_.get()) {
+		const bool stale = s0->authenticated ? s0->isExpired() : secured;
+		if (stale && desfireTxOpen_ && desfireCanReauth())
+			return R::Err(txLost(Error<PcscError>(CardError::SessionExpired)));
+		if (stale && mayReauth) {
+			auto a = desfireReauthenticate();
+			if (!a) return R::Err(std::move(a.error()));
+			reauthed = true;
+		}
+	}
+
+	// Kart 0xAE dönerse komut işlenmemiştir → yeniden auth + tek tekrar.
+	// Koruma APDU'yu yerinde değiştirdiği için düz kopya saklanır.
+	bool  canRetry = !reauthed && mayReauth;
+	BYTEV original;
+	if (canRetry) original = apdu;
+	auto retryAfter = [&](PcscError& e) {
+		const DesfireError* d = std::get_if<DesfireError>(&e.kind);
+		if (!d || *d != DesfireError::AuthMismatch) return false;
+		if (desfireTxOpen_) {
+			e = txLost(std::move(e));
+			return false;
+		}
+		if (!canRetry) return false;
+		canRetry = false;
+		if (!desfireReauthenticate()) return false;
+		apdu = std::move(original);
+		return true;
+	};
+
+	for (;;) {
+		DesfireSession* s = desfireSession_.get();
+		if (!s || !s->authenticated) {
+			if (secured)
+				return R::Err(PcscError::make(CardError::NotAuthenticated,
+					"File requires MAC/Full communication — authenticate first"));
+			auto r = DesfireCommands::tryTransceiveChained(tx, apdu, desfireFrameData_);
+			if (!r && retryAfter(r.error())) continue;
+			return r;
+		}
+		if (s->isExpired())
+			return R::Err(Error<PcscError>(CardError::SessionExpired));
+
+		// Komut: IV zinciri + MAC / şifreleme (buffer yerinde büyür)
+		auto p = DesfireSecureMessaging::tryProtectCommand(*s, apdu, headerLen, cmdMode);
+		if (!p) return R::Err(std::move(p.error()));
+
+		auto r = DesfireCommands::tryTransceiveChained(tx, apdu, desfireFrameData_);
+		if (!r) {
+			s->resetKeepApp();
+			if (retryAfter(r.error())) continue;
+			return r;
+		}
+
+		// Yanıt: EV1'de auth sonrası kart her başarılı yanıta CMAC ekler; EV2'de
+		// yanıt komutun modunu izler. Full → şifreli
+		BYTEV& data = r.unwrap();
+		DesfireCommMode rm = respMode;
+		if (!s->isEV2() && rm != DesfireCommMode::Full) rm = DesfireCommMode::MAC;
+		auto u = DesfireSecureMessaging::tryUnwrapInPlace(*s, data, 0x00, rm, expectedLen);
+		if (!u) {
+			s->resetKeepApp();
+			return R::Err(std::move(u.error()));
+		}
+		return r;
+	}
+}
+
+// ── Yeniden Auth ────────────────────────────────────────────────────────────
+
+void CardIO::desfireRememberAuth(const BYTEV& key) {
+	if (!desfireAutoReauth_ || !desfireSession_) return;
+	if (!desfireAuthCache_)
+		desfireAuthCache_ = std::make_unique<DesfireAuthCache>();
+	desfireAuthCache_->remember(*desfireSession_, key);
+}
+
+bool CardIO::desfireCanReauth() const {
+	return desfireAutoReauth_ && desfireAuthCache_ && desfireSession_ &&
+		desfireAuthCache_->find(desfireSession_->currentAID) != nullptr;
+}
+
+Result<void, PcscError> CardIO::desfireReauthenticate() {
+	using R = Result<void, PcscError>;
+	const DesfireAuthRef* ref = desfireCanReauth()
+		? desfireAuthCache_->find(desfireSession_->currentAID) : nullptr;
+	if (!ref) return R::Err(Error<PcscError>(CardError::NotAuthenticated));
+
+	DesfireAuthRef use = *ref;              // remember() girdinin üzerine yazar
+	++desfireReauthCount_;
+	auto r = use.mode == DesfireAuthMode::EV2 ? tryAuthenticateDesfireEV2(use.key, use.keyNo)
+											  : tryAuthenticateDesfire(use.key, use.keyNo, use.keyType);
+	// Kart key'i reddetti (değişmiş) → bir daha denenmez
+	if (!r) {
+		const DesfireError* d = std::get_if<DesfireError>(&r.error().kind);
+		if (d && *d == DesfireError::AuthMismatch) desfireAuthCache_->forget(use.aid);
+	}
+	use.wipe();
+	return r;
+}
+
+void CardIO::setDesfireAutoReauth(bool enabled) {
+	desfireAutoReauth_ = enabled;
+	if (!enabled) forgetDesfireKeys();
+}
+
+void CardIO::forgetDesfireKeys() {
+	if (desfireAuthCache_) desfireAuthCache_->clear();
+}
+
+// ── Metadata Cache ──────────────────────────────────────────────────────────
+
+DesfireApplication* CardIO::desfireCurrentApp() {
+	DesfireMemoryLayout& mem = card_.getDesfireMemoryMutable();
+	if (mem.currentAID.isPICC()) return nullptr;
+	return &mem.ensureApp(mem.currentAID);
+}
+
+void CardIO::desfireCacheFile(BYTE fileNo, const DesfireFileSettings& fs) {
+	DesfireApplication* app = desfireCurrentApp();
+	if (!app) return;
+	DesfireFile& f = app->ensureFile(fileNo);
+	f.settings = fs;
+	f.settingsKnown = true;
+	desfireMetadataChanged();
+}
+
+void CardIO::desfireForgetFile(BYTE fileNo) {
+	DesfireApplication* app = desfireCurrentApp();
+	if (app && app->removeFile(fileNo)) desfireMetadataChanged();
+}
+
+void CardIO::desfireMetadataChanged() {
+	if (desfireMetaCache_) desfireMetaCache_->store(card_.getDesfireMemory());
+}
+
+Result<DesfireCommMode, PcscError> CardIO::desfireFileCommMode(BYTE fileNo) {
+	using R = Result<DesfireCommMode, PcscError>;
+	auto fs = tryGetFileSettings(fileNo);        // model cache'inden veya karttan
+	if (!fs) return R::Err(std::move(fs.error()));
+	return R::Ok(fs.unwrap().commMode);
+}
+
+void CardIO::invalidateDesfireMetadata() {
+	if (!card_.isDesfire()) return;
+	card_.getDesfireMemoryMutable().invalidateMetadata();
+	desfireMetadataChanged();
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -552,10 +1095,19 @@ DesfireVersionInfo CardIO::discoverCard() { return tryDiscoverCard().unwrap(); }
 Result<DesfireVersionInfo, PcscError> CardIO::tryDiscoverCard() {
 	using R = Result<DesfireVersionInfo, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+	// Yeni tap / kart değişimi: kartta oturum ve seçili app yok
+	desfireDropSession();
 	auto tx = [this](const BYTEV& a) -> Result<BYTEV, PcscError> { return tryDesfireTransmit(a); };
 	auto r = DesfireCommands::tryParseGetVersion(tx);
 	if (!r) return R::Err(r.unwrap_error());
-	card_.getDesfireMemoryMutable().initFromVersion(r.unwrap());
+	DesfireMemoryLayout& mem = card_.getDesfireMemoryMutable();
+	// Başka kart → eski metadata geçersiz; cache'te kaydı varsa geri yüklenir
+	if (DesfireMetadataCache::keyOf(mem.versionInfo) != DesfireMetadataCache::keyOf(r.unwrap())) {
+		mem.applications.clear();
+		mem.appListKnown = false;
+	}
+	mem.initFromVersion(r.unwrap());
+	if (desfireMetaCache_) desfireMetaCache_->restore(mem);
 	return R::Ok(r.unwrap());
 }
 
@@ -564,12 +1116,20 @@ void CardIO::selectApplication(const DesfireAID& aid) { trySelectApplication(aid
 Result<void, PcscError> CardIO::trySelectApplication(const DesfireAID& aid) {
 	using R = Result<void, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	auto r = desfireExec(DesfireCommands::selectApplication(aid));
-	if (!r) return r;
-	if (desfireSession_) desfireSession_->resetKeepApp();
-	if (desfireSession_) desfireSession_->currentAID = aid;
-	card_.getDesfireMemoryMutable().currentAID = aid;
-	return r;
+	// Aynı app zaten seçili ve oturum geçerli: Select auth'u düşüreceği için gönderilmez
+	if (desfireSession_ && desfireSession_->isValid() && desfireSession_->currentAID == aid &&
+		card_.getDesfireMemory().currentAID == aid)
+		return R::Ok();
+	// Select auth'u düşürür → yanıt secure messaging'e girmez
+	auto tx = [this](const BYTEV& a) -> Result<BYTEV, PcscError> { return tryDesfireTransmit(a); };
+	auto t = DesfireCommands::tryTransceive(tx, DesfireCommands::selectApplication(aid));
+	if (!t) return R::Err(std::move(t.error()));
+	if (desfireSession_) {
+		desfireSession_->reset();
+		desfireSession_->currentAID = aid;
+	}
+	card_.getDesfireMemoryMutable().selectApplication(aid);
+	return R::Ok();
 }
 
 void CardIO::authenticateDesfire(const BYTEV& key, BYTE keyNo, DesfireKeyType keyType) {
@@ -583,7 +1143,50 @@ Result<void, PcscError> CardIO::tryAuthenticateDesfire(const BYTEV& key, BYTE ke
 		desfireSession_ = std::make_unique<DesfireSession>();
 	DesfireAuth auth;
 	auto tx = [this](const BYTEV& a) -> Result<BYTEV, PcscError> { return tryDesfireTransmit(a); };
-	return auth.tryAuthenticate(*desfireSession_, key, keyNo, keyType, tx);
+	auto r = auth.tryAuthenticate(*desfireSession_, key, keyNo, keyType, tx);
+	if (r) desfireRememberAuth(key);
+	return r;
+}
+
+void CardIO::authenticateDesfireEV2(const BYTEV& key, BYTE keyNo) {
+	tryAuthenticateDesfireEV2(key, keyNo).unwrap();
+}
+
+Result<void, PcscError> CardIO::tryAuthenticateDesfireEV2(const BYTEV& key, BYTE keyNo) {
+	using R = Result<void, PcscError>;
+	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+	if (!desfireSession_)
+		desfireSession_ = std::make_unique<DesfireSession>();
+	DesfireAuth auth;
+	auto tx = [this](const BYTEV& a) -> Result<BYTEV, PcscError> { return tryDesfireTransmit(a); };
+	// Aynı app'te açık EV2 işlemi varsa key değişimi NonFirst ile (TI + sayaç korunur)
+	auto r = (desfireSession_->isEV2() && desfireSession_->isValid())
+		? auth.tryAuthenticateEV2NonFirst(*desfireSession_, key, keyNo, tx)
+		: auth.tryAuthenticateEV2First(*desfireSession_, key, keyNo, tx);
+	if (r) desfireRememberAuth(key);
+	return r;
+}
+
+void CardIO::authenticateDesfireDiversified(DesfireKeyDiversifier& diversifier, BYTE keyNo) {
+	tryAuthenticateDesfireDiversified(diversifier, keyNo).unwrap();
+}
+
+Result<void, PcscError> CardIO::tryAuthenticateDesfireDiversified(DesfireKeyDiversifier& diversifier, BYTE keyNo) {
+	using R = Result<void, PcscError>;
+	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+	const DesfireMemoryLayout& mem = card_.getDesfireMemory();
+	if (!DesfireMetadataCache::cacheable(mem.versionInfo)) {
+		auto v = tryDiscoverCard();
+		if (!v) return R::Err(std::move(v.error()));
+	}
+	if (!DesfireMetadataCache::cacheable(mem.versionInfo))
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Diversified auth needs the card UID (random UID enabled?)"));
+
+	const BYTEV uid(mem.versionInfo.uid, mem.versionInfo.uid + 7);
+	auto key = diversifier.tryDiversify(uid, mem.currentAID);
+	if (!key) return R::Err(std::move(key.error()));
+	return tryAuthenticateDesfire(key.unwrap(), keyNo, diversifier.keyType());
 }
 
 std::vector<DesfireAID> CardIO::getApplicationIDs() { return tryGetApplicationIDs().unwrap(); }
@@ -591,9 +1194,14 @@ std::vector<DesfireAID> CardIO::getApplicationIDs() { return tryGetApplicationID
 Result<std::vector<DesfireAID>, PcscError> CardIO::tryGetApplicationIDs() {
 	using R = Result<std::vector<DesfireAID>, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+	DesfireMemoryLayout& mem = card_.getDesfireMemoryMutable();
+	if (mem.appListKnown) return R::Ok(mem.appIDs());
 	auto r = desfireQuery(DesfireCommands::getApplicationIDs());
 	if (!r) return Result<std::vector<DesfireAID>, PcscError>::Err(std::move(r.error()));
-	return Result<std::vector<DesfireAID>, PcscError>::Ok(DesfireCommands::parseApplicationIDs(r.unwrap()));
+	auto ids = DesfireCommands::parseApplicationIDs(r.unwrap());
+	mem.syncAppIDs(ids);
+	desfireMetadataChanged();
+	return Result<std::vector<DesfireAID>, PcscError>::Ok(std::move(ids));
 }
 
 std::vector<BYTE> CardIO::getFileIDs() { return tryGetFileIDs().unwrap(); }
@@ -601,9 +1209,16 @@ std::vector<BYTE> CardIO::getFileIDs() { return tryGetFileIDs().unwrap(); }
 Result<std::vector<BYTE>, PcscError> CardIO::tryGetFileIDs() {
 	using R = Result<std::vector<BYTE>, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+	DesfireApplication* app = desfireCurrentApp();
+	if (app && app->fileListKnown) return R::Ok(app->fileIDs());
 	auto r = desfireQuery(DesfireCommands::getFileIDs());
 	if (!r) return Result<std::vector<BYTE>, PcscError>::Err(std::move(r.error()));
-	return Result<std::vector<BYTE>, PcscError>::Ok(DesfireCommands::parseFileIDs(r.unwrap()));
+	auto ids = DesfireCommands::parseFileIDs(r.unwrap());
+	if (app) {
+		app->syncFileIDs(ids);
+		desfireMetadataChanged();
+	}
+	return Result<std::vector<BYTE>, PcscError>::Ok(std::move(ids));
 }
 
 DesfireFileSettings CardIO::getFileSettings(BYTE fileNo) { return tryGetFileSettings(fileNo).unwrap(); }
@@ -611,9 +1226,15 @@ DesfireFileSettings CardIO::getFileSettings(BYTE fileNo) { return tryGetFileSett
 Result<DesfireFileSettings, PcscError> CardIO::tryGetFileSettings(BYTE fileNo) {
 	using R = Result<DesfireFileSettings, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+	if (const DesfireApplication* app = desfireCurrentApp()) {
+		const DesfireFile* f = app->findFile(fileNo);
+		if (f && f->settingsKnown) return R::Ok(f->settings);
+	}
 	auto r = desfireQuery(DesfireCommands::getFileSettings(fileNo));
 	if (!r) return Result<DesfireFileSettings, PcscError>::Err(std::move(r.error()));
-	return Result<DesfireFileSettings, PcscError>::Ok(DesfireCommands::parseFileSettings(r.unwrap()));
+	DesfireFileSettings fs = DesfireCommands::parseFileSettings(r.unwrap());
+	desfireCacheFile(fileNo, fs);
+	return Result<DesfireFileSettings, PcscError>::Ok(fs);
 }
 
 BYTEV CardIO::readFileData(BYTE fileNo, uint32_t offset, uint32_t length) {
@@ -623,7 +1244,73 @@ BYTEV CardIO::readFileData(BYTE fileNo, uint32_t offset, uint32_t length) {
 Result<BYTEV, PcscError> CardIO::tryReadFileData(BYTE fileNo, uint32_t offset, uint32_t length) {
 	using R = Result<BYTEV, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireQuery(DesfireCommands::readData(fileNo, offset, length));
+
+	// Boyut biliniyorsa tek allocation; frame'ler doğrudan hedefe eklenir
+	BYTEV out;
+	out.reserve(length);
+	auto r = tryReadFileDataStream(fileNo, offset, length,
+		[&out](uint32_t, const BYTE* p, size_t n) { out.insert(out.end(), p, p + n); });
+	if (!r) return R::Err(std::move(r.error()));
+	return R::Ok(std::move(out));
+}
+
+DesfireStreamResult CardIO::readFileDataStream(BYTE fileNo, uint32_t offset, uint32_t length,
+											   const DesfireDataSink& sink) {
+	return tryReadFileDataStream(fileNo, offset, length, sink).unwrap();
+}
+
+Result<DesfireStreamResult, PcscError> CardIO::tryReadFileDataStream(BYTE fileNo, uint32_t offset, uint32_t length,
+																	 const DesfireDataSink& sink) {
+	DesfireStreamOptions opts;
+	opts.frameData = desfireFrameData_;
+	return tryReadFileDataStream(fileNo, offset, length, sink, opts);
+}
+
+Result<DesfireStreamResult, PcscError> CardIO::tryReadFileDataStream(BYTE fileNo, uint32_t offset, uint32_t length,
+																	 const DesfireDataSink& sink,
+																	 const DesfireStreamOptions& opts) {
+	using R = Result<DesfireStreamResult, PcscError>;
+	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+	if (!desfireSession_ || !desfireSession_->authenticated) {
+		auto mode = desfireFileCommMode(fileNo);
+		if (!mode) return R::Err(std::move(mode.error()));
+		if (mode.unwrap() != DesfireCommMode::Plain)
+			return R::Err(PcscError::make(CardError::NotAuthenticated,
+				"File requires MAC/Full communication — authenticate first"));
+		auto tx = [this](const BYTEV& a) -> Result<BYTEV, PcscError> { return tryDesfireTransmit(a); };
+		return DesfireCommands::tryReadDataStream(tx, fileNo, offset, length, sink, opts);
+	}
+
+	// Oturum açık: chunk başına doğrulama/çözme, retry yok (IV zinciri)
+	auto mode = desfireFileCommMode(fileNo);
+	if (!mode) return R::Err(std::move(mode.error()));
+
+	DesfireStreamResult res;
+	const uint32_t frame = opts.frameData ? opts.frameData : 59;
+	const uint32_t chunk = frame * (opts.framesPerChunk ? opts.framesPerChunk : 1);
+	const uint32_t end   = offset + length;
+	uint32_t pos = offset;
+	while (length == 0 || pos < end) {
+		const uint32_t want = length == 0 ? 0 : std::min(chunk, end - pos);
+		auto r = desfireSecureTransceive(DesfireCommands::readData(fileNo, pos, want), SIZE_MAX,
+			DesfireCommMode::Plain, mode.unwrap(), want);
+		if (!r) {
+			r.error().detail += " (resume at offset " + std::to_string(pos) + ")";
+			return R::Err(std::move(r.error()));
+		}
+		const BYTEV& data = r.unwrap();
+		++res.commands;
+		if (!data.empty()) sink(pos, data.data(), data.size());
+		res.bytesRead += static_cast<uint32_t>(data.size());
+		pos += static_cast<uint32_t>(data.size());
+		if (length == 0) break;
+		// Açık uzunlukta kısa yanıt (dosya sonu / hatalı offset) sessizce kesilmez
+		if (data.size() < want)
+			return R::Err(Error<PcscError>(CardError::InvalidData)
+				.detail("ReadData returned " + std::to_string(data.size()) + " of " + std::to_string(want)
+					+ " bytes (resume at offset " + std::to_string(pos) + ")"));
+	}
+	return R::Ok(res);
 }
 
 void CardIO::writeFileData(BYTE fileNo, uint32_t offset, const BYTEV& data) {
@@ -633,7 +1320,12 @@ void CardIO::writeFileData(BYTE fileNo, uint32_t offset, const BYTEV& data) {
 Result<void, PcscError> CardIO::tryWriteFileData(BYTE fileNo, uint32_t offset, const BYTEV& data) {
 	using R = Result<void, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireExec(DesfireCommands::writeData(fileNo, offset, data));
+	auto mode = desfireFileCommMode(fileNo);
+	if (!mode) return R::Err(std::move(mode.error()));
+	auto r = desfireSecureTransceive(DesfireCommands::writeData(fileNo, offset, data), 7,
+		mode.unwrap(), DesfireCommMode::Plain, 0);
+	if (!r) return R::Err(std::move(r.error()));
+	return R::Ok();
 }
 
 BYTEV CardIO::readRecords(BYTE fileNo, uint32_t offset, uint32_t count) {
@@ -643,7 +1335,49 @@ BYTEV CardIO::readRecords(BYTE fileNo, uint32_t offset, uint32_t count) {
 Result<BYTEV, PcscError> CardIO::tryReadRecords(BYTE fileNo, uint32_t offset, uint32_t count) {
 	using R = Result<BYTEV, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireQuery(DesfireCommands::readRecords(fileNo, offset, count));
+	auto mode = desfireFileCommMode(fileNo);
+	if (!mode) return R::Err(std::move(mode.error()));
+	return desfireSecureTransceive(DesfireCommands::readRecords(fileNo, offset, count), SIZE_MAX,
+		DesfireCommMode::Plain, mode.unwrap(), 0);
+}
+
+DesfireRecordResult CardIO::readRecordPages(BYTE fileNo, const DesfireRecordSink& sink) {
+	return tryReadRecordPages(fileNo, sink).unwrap();
+}
+
+DesfireRecordResult CardIO::readRecordPages(BYTE fileNo, const DesfireRecordSink& sink,
+											const DesfireRecordOptions& opts) {
+	return tryReadRecordPages(fileNo, sink, opts).unwrap();
+}
+
+Result<DesfireRecordResult, PcscError> CardIO::tryReadRecordPages(BYTE fileNo, const DesfireRecordSink& sink) {
+	DesfireRecordOptions opts;
+	opts.frameData = desfireFrameData_;
+	return tryReadRecordPages(fileNo, sink, opts);
+}
+
+Result<DesfireRecordResult, PcscError> CardIO::tryReadRecordPages(BYTE fileNo, const DesfireRecordSink& sink,
+																  const DesfireRecordOptions& opts) {
+	using R = Result<DesfireRecordResult, PcscError>;
+	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+
+	// currentRecords cache'te bir anlık görüntü → varsayılan olarak tazelenir
+	DesfireFileSettings fs;
+	if (opts.refreshCount) {
+		auto q = desfireQuery(DesfireCommands::getFileSettings(fileNo));
+		if (!q) return R::Err(std::move(q.error()));
+		fs = DesfireCommands::parseFileSettings(q.unwrap());
+		desfireCacheFile(fileNo, fs);
+	} else {
+		auto c = tryGetFileSettings(fileNo);
+		if (!c) return R::Err(std::move(c.error()));
+		fs = c.unwrap();
+	}
+
+	auto fetch = [&](const BYTEV& cmd, size_t expected) {
+		return desfireSecureTransceive(cmd, SIZE_MAX, DesfireCommMode::Plain, fs.commMode, expected);
+	};
+	return DesfireCommands::tryReadRecordPages(fetch, fileNo, fs, sink, opts);
 }
 
 void CardIO::appendRecord(BYTE fileNo, const BYTEV& recordData) {
@@ -653,7 +1387,12 @@ void CardIO::appendRecord(BYTE fileNo, const BYTEV& recordData) {
 Result<void, PcscError> CardIO::tryAppendRecord(BYTE fileNo, const BYTEV& recordData) {
 	using R = Result<void, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireExec(DesfireCommands::appendRecord(fileNo, recordData));
+	auto mode = desfireFileCommMode(fileNo);
+	if (!mode) return R::Err(std::move(mode.error()));
+	auto r = desfireSecureTransceive(DesfireCommands::appendRecord(fileNo, recordData), 7,
+		mode.unwrap(), DesfireCommMode::Plain, 0);
+	if (!r) return R::Err(std::move(r.error()));
+	return R::Ok();
 }
 
 size_t CardIO::getFreeMemory() { return tryGetFreeMemory().unwrap(); }
@@ -670,6 +1409,10 @@ bool CardIO::isDesfireAuthenticated() const {
 	return desfireSession_ && desfireSession_->isValid();
 }
 
+void CardIO::setDesfireFrameSize(const DesfireFrameSize& fs) {
+	desfireFrameData_ = fs.payload();
+}
+
 void CardIO::setDesfireSessionTimeout(uint32_t ms) {
 	if (!desfireSession_)
 		desfireSession_ = std::make_unique<DesfireSession>();
@@ -688,14 +1431,27 @@ Result<void, PcscError> CardIO::tryCreateApplication(const DesfireAID& aid, BYTE
 										   BYTE maxKeys, DesfireKeyType keyType) {
 	using R = Result<void, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireExec(DesfireCommands::createApplication(aid, keySettings, maxKeys, keyType));
+	auto r = desfireExec(DesfireCommands::createApplication(aid, keySettings, maxKeys, keyType));
+	if (!r) return r;
+	DesfireApplication& app = card_.getDesfireMemoryMutable().ensureApp(aid);
+	app.keyConfig.keySettings = keySettings;
+	app.keyConfig.keyCount    = maxKeys;
+	app.keyConfig.keyType     = keyType;
+	app.files.clear();
+	app.fileListKnown = true;                  // yeni app boş
+	desfireMetadataChanged();
+	return r;
 }
 
 void CardIO::deleteApplication(const DesfireAID& aid) { tryDeleteApplication(aid).unwrap(); }
 Result<void, PcscError> CardIO::tryDeleteApplication(const DesfireAID& aid) {
 	using R = Result<void, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireExec(DesfireCommands::deleteApplication(aid));
+	auto r = desfireExec(DesfireCommands::deleteApplication(aid));
+	if (!r) return r;
+	if (desfireAuthCache_) desfireAuthCache_->forget(aid);
+	if (card_.getDesfireMemoryMutable().removeApp(aid)) desfireMetadataChanged();
+	return r;
 }
 
 void CardIO::createStdDataFile(BYTE fileNo, DesfireCommMode comm,
@@ -706,7 +1462,16 @@ Result<void, PcscError> CardIO::tryCreateStdDataFile(BYTE fileNo, DesfireCommMod
 										   const DesfireAccessRights& access, uint32_t fileSize) {
 	using R = Result<void, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireExec(DesfireCommands::createStdDataFile(fileNo, comm, access, fileSize));
+	auto r = desfireExec(DesfireCommands::createStdDataFile(fileNo, comm, access, fileSize));
+	if (r) {
+		DesfireFileSettings fs;
+		fs.fileType = DesfireFileType::StandardData;
+		fs.commMode = comm;
+		fs.access   = access;
+		fs.standard.fileSize = fileSize;
+		desfireCacheFile(fileNo, fs);
+	}
+	return r;
 }
 
 void CardIO::createValueFile(BYTE fileNo, DesfireCommMode comm,
@@ -721,8 +1486,20 @@ Result<void, PcscError> CardIO::tryCreateValueFile(BYTE fileNo, DesfireCommMode
 										 bool limitedCredit) {
 	using R = Result<void, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireExec(DesfireCommands::createValueFile(fileNo, comm, access,
-														 lower, upper, value, limitedCredit));
+	auto r = desfireExec(DesfireCommands::createValueFile(fileNo, comm, access,
+												  lower, upper, value, limitedCredit));
+	if (r) {
+		DesfireFileSettings fs;
+		fs.fileType = DesfireFileType::Value;
+		fs.commMode = comm;
+		fs.access   = access;
+		fs.value.lowerLimit = lower;
+		fs.value.upperLimit = upper;
+		fs.value.value      = value;
+		fs.value.limitedCreditEnabled = limitedCredit;
+		desfireCacheFile(fileNo, fs);
+	}
+	return r;
 }
 
 void CardIO::createLinearRecordFile(BYTE fileNo, DesfireCommMode comm,
@@ -735,36 +1512,84 @@ Result<void, PcscError> CardIO::tryCreateLinearRecordFile(BYTE fileNo, DesfireCo
 												uint32_t recordSize, uint32_t maxRecords) {
 	using R = Result<void, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireExec(DesfireCommands::createLinearRecordFile(fileNo, comm, access,
-																recordSize, maxRecords));
+	auto r = desfireExec(DesfireCommands::createLinearRecordFile(fileNo, comm, access,
+														 recordSize, maxRecords));
+	if (r) {
+		DesfireFileSettings fs;
+		fs.fileType = DesfireFileType::LinearRecord;
+		fs.commMode = comm;
+		fs.access   = access;
+		fs.record.recordSize = recordSize;
+		fs.record.maxRecords = maxRecords;
+		desfireCacheFile(fileNo, fs);
+	}
+	return r;
 }
 
 void CardIO::deleteFile(BYTE fileNo) { tryDeleteFile(fileNo).unwrap(); }
 Result<void, PcscError> CardIO::tryDeleteFile(BYTE fileNo) {
 	using R = Result<void, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireExec(DesfireCommands::deleteFile(fileNo));
+	auto r = desfireExec(DesfireCommands::deleteFile(fileNo));
+	if (r) desfireForgetFile(fileNo);
+	return r;
+}
+
+int32_t CardIO::getValue(BYTE fileNo) { return tryGetValue(fileNo).unwrap(); }
+Result<int32_t, PcscError> CardIO::tryGetValue(BYTE fileNo) {
+	using R = Result<int32_t, PcscError>;
+	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+	auto mode = desfireFileCommMode(fileNo);
+	if (!mode) return R::Err(std::move(mode.error()));
+	auto r = desfireSecureTransceive(DesfireCommands::getValue(fileNo), SIZE_MAX,
+		DesfireCommMode::Plain, mode.unwrap(), 4);
+	if (!r) return R::Err(std::move(r.error()));
+	const BYTEV& d = r.unwrap();
+	if (d.size() < 4)
+		return R::Err(PcscError::make(CardError::InvalidData, "GetValue response too short"));
+	const uint32_t u = d[0] | (d[1] << 8) | (d[2] << 16) | (static_cast<uint32_t>(d[3]) << 24);
+	return R::Ok(static_cast<int32_t>(u));
 }
 
 void CardIO::creditValue(BYTE fileNo, int32_t value) { tryCreditValue(fileNo, value).unwrap(); }
 Result<void, PcscError> CardIO::tryCreditValue(BYTE fileNo, int32_t value) {
 	using R = Result<void, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireExec(DesfireCommands::credit(fileNo, value));
+	auto mode = desfireFileCommMode(fileNo);
+	if (!mode) return R::Err(std::move(mode.error()));
+	auto r = desfireSecureTransceive(DesfireCommands::credit(fileNo, value), 1,
+		mode.unwrap(), DesfireCommMode::Plain, 0);
+	if (!r) return R::Err(std::move(r.error()));
+	return R::Ok();
 }
 
 void CardIO::debitValue(BYTE fileNo, int32_t value) { tryDebitValue(fileNo, value).unwrap(); }
 Result<void, PcscError> CardIO::tryDebitValue(BYTE fileNo, int32_t value) {
 	using R = Result<void, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireExec(DesfireCommands::debit(fileNo, value));
+	auto mode = desfireFileCommMode(fileNo);
+	if (!mode) return R::Err(std::move(mode.error()));
+	auto r = desfireSecureTransceive(DesfireCommands::debit(fileNo, value), 1,
+		mode.unwrap(), DesfireCommMode::Plain, 0);
+	if (!r) return R::Err(std::move(r.error()));
+	return R::Ok();
 }
 
 void CardIO::commitTransaction() { tryCommitTransaction().unwrap(); }
 Result<void, PcscError> CardIO::tryCommitTransaction() {
 	using R = Result<void, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireExec(DesfireCommands::commitTransaction());
+	auto r = desfireExec(DesfireCommands::commitTransaction());
+	if (!r) return r;
+	// Record dosyalarının currentRecords anlık görüntüsü artık eski
+	if (DesfireApplication* app = desfireCurrentApp()) {
+		for (auto& f : app->files)
+			if (f.settings.fileType == DesfireFileType::LinearRecord ||
+				f.settings.fileType == DesfireFileType::CyclicRecord)
+				f.settingsKnown = false;
+		desfireMetadataChanged();
+	}
+	return r;
 }
 
 void CardIO::abortTransaction() { tryAbortTransaction().unwrap(); }
@@ -774,6 +1599,153 @@ Result<void, PcscError> CardIO::tryAbortTransaction() {
 	return desfireExec(DesfireCommands::abortTransaction());
 }
 
+DesfireTransactionReport CardIO::runDesfireTransaction(DesfireTransaction& tx) {
+	DesfireTransactionReport rep;
+	tryRunDesfireTransaction(tx, rep).unwrap();
+	return rep;
+}
+
+Result<void, PcscError> CardIO::tryRunDesfireTransaction(DesfireTransaction& tx, DesfireTransactionReport& report) {
+	using R = Result<void, PcscError>;
+	using Clock = std::chrono::steady_clock;
+	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+	report = DesfireTransactionReport{};
+
+	// ── Hazırlık: settings cache'ten (bilinmeyen dosya için GetFileSettings) ──
+	const auto t = Clock::now();
+	const int authKeyNo = isDesfireAuthenticated() ? desfireSession_->authKeyNo : -1;
+	auto p = tx.tryPrepare([this](BYTE fileNo) { return tryGetFileSettings(fileNo); }, authKeyNo);
+	report.prepareMicros = static_cast<uint64_t>(
+		std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t).count());
+	report.totalMicros = report.prepareMicros;
+	if (!p) return p;
+
+	// ── Yürütme: hazır APDU'lar, secure messaging gönderimde ────────────────
+	auto send = [this](const DesfireTxStep& s) -> Result<void, PcscError> {
+		switch (s.op) {
+			case DesfireTxOp::Commit: return tryCommitTransaction();
+			case DesfireTxOp::Abort:  return tryAbortTransaction();
+			default: {
+				auto r = desfireSecureTransceive(s.apdu, s.headerLen, s.mode, DesfireCommMode::Plain, 0);
+				if (!r) return Result<void, PcscError>::Err(std::move(r.error()));
+				return Result<void, PcscError>::Ok();
+			}
+		}
+	};
+	// İşlem açıkken otomatik yeniden auth kapalı (bkz. desfireSecureTransceive)
+	desfireTxOpen_ = true;
+	auto r = tx.tryRun(send, report);
+	desfireTxOpen_ = false;
+	return r;
+}
+
+DesfireScriptReport CardIO::runDesfireScript(const DesfireScript& script, DesfireKeyDiversifier* diversifier) {
+	DesfireScriptReport rep;
+	tryRunDesfireScript(script, rep, diversifier).unwrap();
+	return rep;
+}
+
+Result<void, PcscError> CardIO::tryRunDesfireScript(const DesfireScript& script, DesfireScriptReport& report,
+													DesfireKeyDiversifier* diversifier) {
+	using R = Result<void, PcscError>;
+	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+	report = DesfireScriptReport{};
+
+	// Diversified key'ler kart UID'ine bağlı: betikten önce bir kez
+	if (script.needsDiversifier()) {
+		if (!diversifier || !diversifier->ready())
+			return R::Err(Error<PcscError>(CardError::InvalidData).detail("Script needs a key diversifier"));
+		if (!DesfireMetadataCache::cacheable(card_.getDesfireMemory().versionInfo)) {
+			auto v = tryDiscoverCard();
+			if (!v) return R::Err(std::move(v.error()));
+		}
+		if (!DesfireMetadataCache::cacheable(card_.getDesfireMemory().versionInfo))
+			return R::Err(Error<PcscError>(CardError::InvalidData)
+				.detail("Diversified keys need the card UID (random UID enabled?)"));
+	}
+
+	// ChangeKey: kriptogram oturumdan; auth key'i değişiyorsa yanıt MAC'siz, oturum düşer
+	auto changeKey = [&](const DesfireScriptStep& s) -> R {
+		DesfireSession* ses = desfireSession_.get();
+		if (!ses || !ses->isValid())
+			return R::Err(PcscError::make(CardError::NotAuthenticated, "ChangeKey needs an authenticated session"));
+		BYTEV key = s.key;
+		if (s.diversify) {
+			if (diversifier->keyType() != s.keyType)
+				return R::Err(Error<PcscError>(CardError::InvalidData)
+					.detail("Diversifier key type differs from the application key type"));
+			const BYTE* uid = card_.getDesfireMemory().versionInfo.uid;
+			auto d = diversifier->tryDiversify(BYTEV(uid, uid + 7), s.aid);
+			if (!d) return R::Err(std::move(d.error()));
+			key = std::move(d.unwrap());
+		}
+		const bool ownKey = s.fileNo == ses->authKeyNo;
+		auto apdu = DesfireSecureMessaging::tryChangeKeyCommand(*ses, s.fileNo, s.keyType, key,
+																s.keyVersion, s.oldKey);
+		std::fill(key.begin(), key.end(), 0);
+		if (!apdu) return R::Err(std::move(apdu.error()));
+
+		auto tx = [this](const BYTEV& a) -> Result<BYTEV, PcscError> { return tryDesfireTransmit(a); };
+		auto r = DesfireCommands::tryTransceiveChained(tx, apdu.unwrap(), desfireFrameData_);
+		if (!r || ownKey) {
+			ses->resetKeepApp();
+			if (ownKey && desfireAuthCache_) desfireAuthCache_->forget(s.aid);  // saklı key artık eski
+			if (!r) return R::Err(std::move(r.error()));
+			return R::Ok();
+		}
+		auto u = DesfireSecureMessaging::tryUnwrapInPlace(*ses, r.unwrap(), 0x00, DesfireCommMode::MAC);
+		if (!u) ses->resetKeepApp();
+		return u;
+	};
+
+	// Model: create/format komutlarındaki gibi; dosya settings derlemeden
+	auto modelApp = [&script](const DesfireAID& aid) -> const DesfireApplication* {
+		for (const auto& a : script.applications())
+			if (a.aid == aid) return &a;
+		return nullptr;
+	};
+
+	auto exec = [&](const DesfireScriptStep& s) -> R {
+		DesfireMemoryLayout& mem = card_.getDesfireMemoryMutable();
+		switch (s.op) {
+			case DesfireScriptOp::Select:
+				return trySelectApplication(s.aid);
+			case DesfireScriptOp::Authenticate:
+				return s.ev2 ? tryAuthenticateDesfireEV2(s.key, s.fileNo)
+							 : tryAuthenticateDesfire(s.key, s.fileNo, s.keyType);
+			case DesfireScriptOp::ChangeKey:
+				return changeKey(s);
+			case DesfireScriptOp::WriteData: {
+				auto r = desfireSecureTransceive(s.apdu, s.headerLen, s.mode, DesfireCommMode::Plain, 0);
+				if (!r) return R::Err(std::move(r.error()));
+				return R::Ok();
+			}
+			default:
+				break;
+		}
+
+		auto r = desfireExec(s.apdu);
+		if (!r) return r;
+		if (s.op == DesfireScriptOp::Format) {
+			if (desfireAuthCache_) desfireAuthCache_->keepOnly(DesfireAID::picc());
+			mem.resetApplications();
+		} else if (s.op == DesfireScriptOp::CreateApp) {
+			DesfireApplication& app = mem.ensureApp(s.aid);
+			if (const DesfireApplication* m = modelApp(s.aid)) app.keyConfig = m->keyConfig;
+			app.files.clear();
+			app.fileListKnown = true;              // yeni app boş
+		} else if (s.op == DesfireScriptOp::CreateFile) {
+			const DesfireApplication* m = modelApp(s.aid);
+			const DesfireFile* f = m ? m->findFile(s.fileNo) : nullptr;
+			if (f) desfireCacheFile(s.fileNo, f->settings);
+			return r;
+		}
+		desfireMetadataChanged();
+		return r;
+	};
+	return script.tryRun(exec, report);
+}
+
 BYTE CardIO::getKeyVersion(BYTE keyNo) { return tryGetKeyVersion(keyNo).unwrap(); }
 Result<BYTE, PcscError> CardIO::tryGetKeyVersion(BYTE keyNo) {
 	using R = Result<BYTE, PcscError>;
@@ -787,5 +1759,204 @@ void CardIO::formatPICC() { tryFormatPICC().unwrap(); }
 Result<void, PcscError> CardIO::tryFormatPICC() {
 	using R = Result<void, PcscError>;
 	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
-	return desfireExec(DesfireCommands::formatPICC());
+	auto r = desfireExec(DesfireCommands::formatPICC());
+	if (!r) return r;
+	if (desfireAuthCache_) desfireAuthCache_->keepOnly(DesfireAID::picc());   // app key'leri silindi
+	card_.getDesfireMemoryMutable().resetApplications();
+	desfireMetadataChanged();
+	return r;
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// DESFire — Snapshot (tek çağrıda kart ağacı)
+// ════════════════════════════════════════════════════════════════════════════════
+
+DesfireSnapshotReport CardIO::snapshotDesfire(const DesfireSnapshotOptions& opts) {
+	return trySnapshotDesfire(opts).unwrap();
+}
+
+Result<DesfireSnapshotReport, PcscError> CardIO::trySnapshotDesfire(const DesfireSnapshotOptions& opts) {
+	using R = Result<DesfireSnapshotReport, PcscError>;
+	using Clock = std::chrono::steady_clock;
+	if (!card_.isDesfire()) return R::Err(Error<PcscError>(CardError::NotDesfire));
+
+	DesfireSnapshotReport rep;
+	const auto start = Clock::now();
+	const DesfireAID picc = DesfireAID::picc();
+	DesfireMemoryLayout& mem = card_.getDesfireMemoryMutable();
+
+	// Karta giden her komut süresiyle rapora yazılır; cache'ten gelenler yazılmaz
+	auto timed = [&rep](DesfireSnapshotStep step, const DesfireAID& aid, BYTE fileNo, auto&& fn) {
+		const auto t = Clock::now();
+		auto r = fn();
+		DesfireSnapshotEvent ev;
+		ev.step   = step;
+		ev.aid    = aid;
+		ev.fileNo = fileNo;
+		ev.micros = static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t).count());
+		ev.ok = static_cast<bool>(r);
+		if (!r) ev.error = r.error().message();
+		rep.record(std::move(ev));
+		return r;
+	};
+
+	// Seçili app bilinmiyor (yeni tap olabilir) → ilk ihtiyaçta select
+	bool       selectedKnown = false;
+	DesfireAID selected;
+	auto select = [&](const DesfireAID& aid) -> Result<void, PcscError> {
+		if (selectedKnown && selected == aid) return Result<void, PcscError>::Ok();
+		auto r = timed(DesfireSnapshotStep::Select, aid, 0xFF, [&] { return trySelectApplication(aid); });
+		selectedKnown = static_cast<bool>(r);
+		selected = aid;
+		return r;
+	};
+
+	// Aynı app'te aynı key ile geçerli oturum varsa tekrar auth yapılmaz
+	auto authenticate = [&](const DesfireAID& aid, BYTE keyNo) -> Result<void, PcscError> {
+		if (desfireSession_ && desfireSession_->isValid() &&
+			desfireSession_->currentAID == aid && desfireSession_->authKeyNo == keyNo)
+			return Result<void, PcscError>::Ok();
+		const DesfireKeyEntry* k = opts.keys.find(aid, keyNo);
+		if (!k)
+			return Result<void, PcscError>::Err(Error<PcscError>(CardError::NotAuthenticated)
+				.detail("No key in snapshot key map")
+				.meta("aid", std::to_string(aid.toUint()))
+				.meta("keyNo", std::to_string(keyNo)));
+		if (opts.useEV2Auth && k->keyType == DesfireKeyType::AES128)
+			return timed(DesfireSnapshotStep::Authenticate, aid, 0xFF,
+				[&] { return tryAuthenticateDesfireEV2(k->key, keyNo); });
+		return timed(DesfireSnapshotStep::Authenticate, aid, 0xFF,
+			[&] { return tryAuthenticateDesfire(k->key, keyNo, k->keyType); });
+	};
+
+	// ── 1. Kart ─────────────────────────────────────────────────────────────
+	auto v = timed(DesfireSnapshotStep::Discover, picc, 0xFF, [&] { return tryDiscoverCard(); });
+	if (!v) return R::Err(std::move(v.error()));
+	// Discovery cache'ten geri yükler → refresh ondan sonra, cache kaydıyla birlikte
+	if (opts.refresh) invalidateDesfireMetadata();
+
+	if (opts.freeMemory) {
+		auto f = timed(DesfireSnapshotStep::FreeMemory, picc, 0xFF, [&] { return tryGetFreeMemory(); });
+		if (!f && opts.stopOnError) return R::Err(std::move(f.error()));
+	}
+
+	// ── 2. Uygulama listesi ─────────────────────────────────────────────────
+	std::vector<DesfireAID> targets = opts.apps;
+	if (targets.empty()) {
+		if (!mem.appListKnown) {
+			auto sel = select(picc);
+			if (!sel) return R::Err(std::move(sel.error()));
+			auto ids = timed(DesfireSnapshotStep::ListApps, picc, 0xFF, [&] { return tryGetApplicationIDs(); });
+			if (!ids && opts.keys.find(picc, 0)) {
+				// Free directory listing kapalı → PICC master key ile tekrar
+				auto a = authenticate(picc, 0);
+				if (!a) return R::Err(std::move(a.error()));
+				ids = timed(DesfireSnapshotStep::ListApps, picc, 0xFF, [&] { return tryGetApplicationIDs(); });
+			}
+			if (!ids) return R::Err(std::move(ids.error()));
+		}
+		targets = mem.appIDs();
+	}
+
+	// ── 3. Uygulamalar ──────────────────────────────────────────────────────
+	for (const DesfireAID& aid : targets) {
+		++rep.apps;
+		auto sel = select(aid);
+		if (!sel) {
+			if (opts.stopOnError) return R::Err(std::move(sel.error()));
+			continue;
+		}
+
+		// Dosya listesi (cache geçerliyse karta gitmez)
+		const DesfireApplication* app = mem.findApp(aid);
+		const bool listKnown = app && app->fileListKnown;
+		auto ids = listKnown ? tryGetFileIDs()
+			: timed(DesfireSnapshotStep::ListFiles, aid, 0xFF, [&] { return tryGetFileIDs(); });
+		if (!ids && opts.keys.find(aid, 0)) {
+			auto a = authenticate(aid, 0);          // listeleme master key isteyebilir
+			if (a) ids = timed(DesfireSnapshotStep::ListFiles, aid, 0xFF, [&] { return tryGetFileIDs(); });
+		}
+		if (!ids) {
+			if (opts.stopOnError) return R::Err(std::move(ids.error()));
+			continue;
+		}
+
+		// Ayarlar; okuma planı: serbest dosyalar önce, sonra key numarasına göre
+		struct Planned { BYTE fileNo; BYTE key; DesfireFileSettings fs; };
+		std::vector<Planned> plan;
+		plan.reserve(ids.unwrap().size());
+		for (BYTE fileNo : ids.unwrap()) {
+			++rep.files;
+			app = mem.findApp(aid);
+			const DesfireFile* f = app ? app->findFile(fileNo) : nullptr;
+			auto fs = (f && f->settingsKnown) ? tryGetFileSettings(fileNo)
+				: timed(DesfireSnapshotStep::FileSettings, aid, fileNo, [&] { return tryGetFileSettings(fileNo); });
+			if (!fs) {
+				if (opts.stopOnError) return R::Err(std::move(fs.error()));
+				continue;
+			}
+			plan.push_back({ fileNo, opts.keys.readKeyFor(aid, fs.unwrap().access), fs.unwrap() });
+		}
+		if (!opts.readData) continue;
+		auto rank = [](BYTE key) { return key == 0x0E ? -1 : static_cast<int>(key); };
+		std::stable_sort(plan.begin(), plan.end(), [&rank](const Planned& a, const Planned& b) {
+			return rank(a.key) < rank(b.key);
+		});
+
+		// ── 4. Veri ─────────────────────────────────────────────────────────
+		for (const Planned& p : plan) {
+			if (p.key == 0x0F) {
+				DesfireSnapshotEvent ev;
+				ev.step    = DesfireSnapshotStep::ReadData;
+				ev.aid     = aid;
+				ev.fileNo  = p.fileNo;
+				ev.skipped = true;
+				ev.error   = "no key for read access";
+				rep.record(std::move(ev));
+				continue;
+			}
+			if (p.key != 0x0E) {
+				auto a = authenticate(aid, p.key);
+				if (!a) {
+					if (opts.stopOnError) return R::Err(std::move(a.error()));
+					continue;
+				}
+			}
+
+			auto data = timed(DesfireSnapshotStep::ReadData, aid, p.fileNo, [&]() -> Result<BYTEV, PcscError> {
+				switch (p.fs.fileType) {
+					case DesfireFileType::Value: {
+						auto val = tryGetValue(p.fileNo);
+						if (!val) return Result<BYTEV, PcscError>::Err(std::move(val.error()));
+						const uint32_t u = static_cast<uint32_t>(val.unwrap());
+						return Result<BYTEV, PcscError>::Ok(BYTEV{ static_cast<BYTE>(u), static_cast<BYTE>(u >> 8),
+																	static_cast<BYTE>(u >> 16), static_cast<BYTE>(u >> 24) });
+					}
+					case DesfireFileType::LinearRecord:
+					case DesfireFileType::CyclicRecord:
+						if (p.fs.record.currentRecords == 0) return Result<BYTEV, PcscError>::Ok(BYTEV{});
+						return tryReadRecords(p.fileNo, 0, 0);       // 0 → tüm kayıtlar
+					default: {
+						uint32_t len = p.fs.standard.fileSize;
+						if (opts.maxFileBytes && len > opts.maxFileBytes) len = opts.maxFileBytes;
+						return tryReadFileData(p.fileNo, 0, len);
+					}
+				}
+			});
+			if (!data) {
+				if (opts.stopOnError) return R::Err(std::move(data.error()));
+				continue;
+			}
+			rep.events.back().bytes = static_cast<uint32_t>(data.unwrap().size());
+			rep.bytesRead += data.unwrap().size();
+			if (DesfireApplication* a = mem.findApp(aid))
+				if (DesfireFile* f = a->findFile(p.fileNo))
+					f->data = std::move(data.unwrap());
+		}
+	}
+
+	rep.totalMicros = static_cast<uint64_t>(
+		std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+	return R::Ok(std::move(rep));
 }
@@ -3,9 +3,12 @@
 
 #include "CardInterface.h"
 #include "Reader.h"
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <vector>
-#include <map>
 #include <memory>
+#include <string>
 
 // Forward declares (TrailerConfig.h types — only used in method signatures)
 struct TrailerConfig;
@@ -13,11 +16,28 @@ struct SectorAccessConfig;
 struct DataBlockPermission;
 struct TrailerPermission;
 enum class SectorMode;
+struct CardImageDiff;
 struct DesfireAID;
 struct DesfireSession;
 struct DesfireVersionInfo;
 struct DesfireFileSettings;
 struct DesfireAccessRights;
+struct DesfireStreamOptions;
+struct DesfireFrameSize;
+struct DesfireStreamResult;
+struct DesfireRecordOptions;
+struct DesfireRecordResult;
+template<typename T> class DesfireSpan;
+struct DesfireApplication;
+struct DesfireSnapshotOptions;
+struct DesfireSnapshotReport;
+struct DesfireTransactionReport;
+class DesfireTransaction;
+struct DesfireScriptReport;
+class DesfireScript;
+class DesfireMetadataCache;
+class DesfireKeyDiversifier;
+class DesfireAuthCache;
 enum class DesfireKeyType : BYTE;
 enum class DesfireCommMode : BYTE;
 
@@ -91,6 +111,26 @@ enum class DesfireCommMode : BYTE;
 //   // ... degisiklikler ...
 //   io.restoreAllTrailers(backup);           // geri yükle
 //
+//   // Rapor + doğrulama isteniyorsa batch engine doğrudan kullanılır:
+//   std::vector<TrailerConfig> tcs;
+//   TrailerBatchReport rr = io.readAllTrailers(tcs);
+//   TrailerBatchReport wr = io.writeAllTrailers(tcs, true);   // read-back verify
+//   if (!wr.allOk())
+//       for (const auto& s : wr.sectors) if (!s.ok()) std::cout << s.error;
+//
+// ─── Şablon Diff + Write-Back ──────────────────────────────────────────────
+//
+//   io.readCard();
+//   CardImageDiff diff = CardImageDiff::compare(golden, io.card().getMemory());
+//   if (!diff.empty()) io.writeDiff(diff, golden);  // sadece değişen bloklar
+//
+// ─── DESFire Streaming Okuma ───────────────────────────────────────────────
+//
+//   std::ofstream f("dump.bin", std::ios::binary);
+//   io.readFileDataStream(1, 0, 8192, [&](uint32_t, const BYTE* p, size_t n) {
+//       f.write(reinterpret_cast<const char*>(p), n);   // frame geldikçe
+//   });
+//
 // ─── Alt Model Erisimi ─────────────────────────────────────────────────────
 //
 //   CardInterface& card = io.card();         // in-memory model
@@ -101,6 +141,51 @@ enum class DesfireCommMode : BYTE;
 //
 // ════════════════════════════════════════════════════════════════════════════════
 
+// ────────────────────────────────────────────────────────────────────────────
+// Bulk Trailer Raporu
+// ────────────────────────────────────────────────────────────────────────────
+// Tasarım Notu:
+// Batch engine sektör hatasında durmaz; her sektörün sonucu ayrı raporlanır.
+// Böylece 4K (40 trailer) rekey işleminde hangi sektörün hangi key ile
+// denendiği ve doğrulanıp doğrulanmadığı tek geçişten sonra görülebilir.
+// ────────────────────────────────────────────────────────────────────────────
+
+struct TrailerSectorResult {
+    int         sector   = -1;
+    KeyType     keyType  = KeyType::A;   // auth'ta kullanılan key (plan veya fallback)
+    bool        authOk   = false;
+    bool        ioOk     = false;        // trailer read/write APDU başarılı
+    bool        verified = false;        // verify istenmişse: read-back eşleşti
+    std::string error;                   // boş değilse hata açıklaması
+
+    bool ok() const { return authOk && ioOk; }
+};
+
+struct TrailerBatchReport {
+    std::vector<TrailerSectorResult> sectors;
+    bool verifyRequested = false;
+
+    int okCount() const {
+        int n = 0;
+        for (const auto& s : sectors) if (s.ok()) ++n;
+        return n;
+    }
+
+    bool allOk() const {
+        for (const auto& s : sectors) {
+            if (!s.ok()) return false;
+            if (verifyRequested && !s.verified) return false;
+        }
+        return true;
+    }
+};
+
+// DESFire streaming okuma sink'i: (dosya offset'i, payload, uzunluk)
+using DesfireDataSink = std::function<void(uint32_t offset, const BYTE* data, size_t len)>;
+
+// DESFire record sink'i: (kayıt offset'i — 0 en yeni, kayıt görünümü); false → dur
+using DesfireRecordSink = std::function<bool(uint32_t recordOffset, DesfireSpan<const BYTE> record)>;
+
 class CardIO {
 public:
     // ────────────────────────────────────────────────────────────────────────────
@@ -207,6 +292,28 @@ public:
     // Kaydedilmiş config'leri karta geri yaz (restore)
     void restoreAllTrailers(const std::vector<TrailerConfig>& configs);
 
+    // Batch engine: key'ler sektör başına önceden planlanır, tüm trailer'lar
+    // tek geçişte okunur/yazılır. Sektör hataları rapora yazılır, işlem sürer.
+    //   readAllTrailers : out[s] ← sektör s trailer'ı (hata → factoryDefault)
+    //                     verify → access bits bütünlük kontrolü
+    //   writeAllTrailers: configs[0..n) → sektör 0..n
+    //                     verify → read-back, access bits (+okunabiliyorsa KeyB)
+    TrailerBatchReport readAllTrailers(std::vector<TrailerConfig>& out, bool verify = false);
+    TrailerBatchReport writeAllTrailers(const std::vector<TrailerConfig>& configs, bool verify = true);
+
+    // ────────────────────────────────────────────────────────────────────────────
+    // Diff Write-Back
+    // ────────────────────────────────────────────────────────────────────────────
+
+    // Yalnızca diff'te değişmiş blokları `source` imajından karta yaz.
+    //   Manufacturer bloğu her zaman atlanır.
+    //   Trailer'lar yalnızca includeTrailers ise yazılır. Source'ta sıfır olan
+    //   key alanı (karttan okunmuş imajda key A) key tablosundan doldurulur;
+    //   o tipte key kayıtlı değilse hiçbir blok yazılmadan InvalidData döner.
+    //   Yazma hatası orijinal türüyle (auth / transport) döner, meta: block, written.
+    // @return yazılan blok sayısı
+    int writeDiff(const CardImageDiff& diff, const CardMemoryLayout& source, bool includeTrailers = false);
+
     // ────────────────────────────────────────────────────────────────────────────
     // Erişim
     // ────────────────────────────────────────────────────────────────────────────
@@ -222,23 +329,58 @@ public:
     // Kart keşfi: GetVersion → DesfireMemoryLayout'a yükle
     DesfireVersionInfo discoverCard();
 
-    // Application seç (session düşer, yeniden auth gerekir)
+    // Application seç (session düşer, yeniden auth gerekir). Aynı app zaten
+    // seçili ve oturum geçerliyse Select gönderilmez, oturum korunur.
     void selectApplication(const DesfireAID& aid);
 
     // DESFire 3-pass mutual auth (seçili app üzerinde)
     void authenticateDesfire(const BYTEV& key, BYTE keyNo, DesfireKeyType keyType);
 
+    // EV2/EV3 AES auth. Açık EV2 oturumu yoksa AuthenticateEV2First (yeni TI),
+    // varsa AuthenticateEV2NonFirst: aynı işlem içinde key değişir, TI ve
+    // command counter korunur. Sonraki komutlar EV2 secure messaging kullanır.
+    void authenticateDesfireEV2(const BYTEV& key, BYTE keyNo);
+
+    // AN10922 diversified key ile auth: UID GetVersion'dan (gerekirse
+    // discoverCard), AID seçili uygulamadan alınır; key diversifier'ın
+    // tipiyle authenticateDesfire'a verilir. Random UID'li kartta hata döner.
+    void authenticateDesfireDiversified(DesfireKeyDiversifier& diversifier, BYTE keyNo);
+
     // Dosya bilgisi
     std::vector<BYTE> getFileIDs();
     DesfireFileSettings getFileSettings(BYTE fileNo);
 
-    // Dosya okuma/yazma (PlainText — secure messaging Faz 4)
+    // Dosya okuma/yazma. Dosyanın comm mode'u (GetFileSettings, cache'li)
+    // otomatik uygulanır: Plain → düz, MAC → CMAC, Full → CBC + CRC32.
+    // Auth sonrası tüm komutlar IV zincirine girer ve yanıt CMAC'i doğrulanır.
+    // MAC/Full dosyada oturum yoksa NotAuthenticated döner.
     BYTEV readFileData(BYTE fileNo, uint32_t offset, uint32_t length);
     void  writeFileData(BYTE fileNo, uint32_t offset, const BYTEV& data);
 
+    // Streaming okuma: frame payload'ları geldikçe sink'e verilir, frame
+    // boyutuna hizalı chunk'lar kullanılır, RF hatasında onaylı offset'ten
+    // devam edilir (bkz. DesfireCommands::tryReadDataStream).
+    // Oturum açıkken chunk'lar tek tek doğrulanır/çözülür; IV zinciri
+    // bozulacağı için otomatik retry yapılmaz.
+    DesfireStreamResult readFileDataStream(BYTE fileNo, uint32_t offset, uint32_t length,
+                                           const DesfireDataSink& sink);
+
     // Application discovery
     std::vector<DesfireAID> getApplicationIDs();
 
+    // ── Metadata cache ──────────────────────────────────────────────────────
+    //  GetApplicationIDs / GetFileIDs / GetFileSettings sonuçları
+    //  DesfireMemoryLayout'a yazılır; geçerli girdi varsa karta gidilmez.
+    //  Create/Delete/Format komutları modeli kendisi günceller. Kart dışarıda
+    //  (başka terminalde) değiştirildiyse invalidateDesfireMetadata() çağrılır.
+    //  Record dosyalarının currentRecords değeri bir anlık görüntüdür.
+    void invalidateDesfireMetadata();
+
+    // UID + sürüm başına kalıcı cache (nullptr → kapalı, sahiplik çağıranda).
+    // discoverCard() eşleşen kaydı modele yükler, her metadata değişikliği
+    // cache'e yazılır.
+    void setDesfireMetadataCache(DesfireMetadataCache* cache) { desfireMetaCache_ = cache; }
+
     // Free memory
     size_t getFreeMemory();
 
@@ -248,6 +390,22 @@ public:
     // Session timeout (ms). 0 = sınırsız (varsayılan).
     void setDesfireSessionTimeout(uint32_t ms);
 
+    // Otomatik yeniden auth: son başarılı auth'un key'i app başına saklanır.
+    // Oturum süresi dolmuşsa / düşmüşse veya kart 0xAE dönerse aynı key ile
+    // en fazla bir kez yeniden auth yapılıp komut tekrarlanır (0xAE'de kart
+    // komutu işlememiştir). Saklı key reddedilirse girdi silinir.
+    // Varsayılan açık; kapatmak saklı key'leri siler.
+    void     setDesfireAutoReauth(bool enabled);
+    bool     desfireAutoReauth() const { return desfireAutoReauth_; }
+    void     forgetDesfireKeys();
+    uint32_t desfireReauthCount() const { return desfireReauthCount_; }
+
+    // Frame boyutu (kart FSC / reader FSD). WriteData, AppendRecord ve
+    // CreateFile verisi bu boyutta 0xAF ile zincirlenir; streaming okuma
+    // chunk'ları da buna hizalanır. Varsayılan 64 byte frame (59 byte veri).
+    void     setDesfireFrameSize(const DesfireFrameSize& fs);
+    uint32_t desfireFrameData() const { return desfireFrameData_; }
+
     // ────────────────────────────────────────────────────────────────────────────
     // DESFire Management API (Faz 4)
     // ────────────────────────────────────────────────────────────────────────────
@@ -273,18 +431,47 @@ public:
     BYTEV readRecords(BYTE fileNo, uint32_t offset, uint32_t count);
     void appendRecord(BYTE fileNo, const BYTEV& recordData);
 
+    // Sayfalı okuma: kayıtlar frame'e sığan sayfalarla istenir, her kayıt
+    // recordSize'lık view olarak sink'e verilir (yeniden eskiye). Sink false
+    // dönünce kalan sayfalar istenmez. Kayıt sayısı GetFileSettings'ten
+    // (varsayılan: her çağrıda tazelenir); comm mode otomatik uygulanır.
+    DesfireRecordResult readRecordPages(BYTE fileNo, const DesfireRecordSink& sink);
+    DesfireRecordResult readRecordPages(BYTE fileNo, const DesfireRecordSink& sink,
+                                        const DesfireRecordOptions& opts);
+
+    // Value File
+    int32_t getValue(BYTE fileNo);
+
     // Transaction
     void creditValue(BYTE fileNo, int32_t value);
     void debitValue(BYTE fileNo, int32_t value);
     void commitTransaction();
     void abortTransaction();
 
+    // Çok dosyalı işlem: adımlar cache'li file settings'e karşı önceden
+    // doğrulanır, hazır APDU'lar arka arkaya gönderilir, tek commit yapılır.
+    // Hata olursa AbortTransaction gönderilir; rapor adım sürelerini içerir
+    // (bkz. CardProtocol/DesfireTransaction.h).
+    DesfireTransactionReport runDesfireTransaction(DesfireTransaction& tx);
+
+    // Kişiselleştirme: DesfireProfile'dan bir kez derlenmiş betiği bu karta
+    // uygular (hazır APDU'lar; auth ve ChangeKey kriptogramı oturumdan).
+    // Diversified key'ler için diversifier gerekir (UID GetVersion'dan).
+    // Model create komutlarındaki gibi güncellenir; rapor adım sürelerini
+    // içerir (bkz. CardProtocol/DesfireProfile.h).
+    DesfireScriptReport runDesfireScript(const DesfireScript& script, DesfireKeyDiversifier* diversifier = nullptr);
+
     // Key management
     BYTE getKeyVersion(BYTE keyNo);
 
     // Card-level
     void formatPICC();
 
+    // Tüm kart ağacı tek çağrıda: GetVersion → apps → files → settings → veri.
+    // Sonuç card().getDesfireMemory()'ye yazılır; rapor adım süreleri ve
+    // atlanan/hatalı dosyaları içerir (bkz. CardProtocol/DesfireSnapshot.h).
+    DesfireSnapshotReport snapshotDesfire(const DesfireSnapshotOptions& opts);
+
     // ────────────────────────────────────────────────────────────────────────────
     // Exception-free alternatifler (Result<T> döner)
     // ────────────────────────────────────────────────────────────────────────────
@@ -298,6 +485,9 @@ public:
     Result<void, PcscError>           tryAuthenticate(int sector);
     Result<TrailerConfig, PcscError>  tryReadTrailer(int sector);
     Result<void, PcscError>           tryWriteTrailer(int sector, const TrailerConfig& config);
+    Result<TrailerBatchReport, PcscError> tryReadAllTrailers(std::vector<TrailerConfig>& out, bool verify = false);
+    Result<TrailerBatchReport, PcscError> tryWriteAllTrailers(const std::vector<TrailerConfig>& configs, bool verify = true);
+    Result<int, PcscError>            tryWriteDiff(const CardImageDiff& diff, const CardMemoryLayout& source, bool includeTrailers = false);
 
     // Access Bits
     Result<SectorAccessConfig, PcscError> tryGetAccessConfig(int sector) const;
@@ -309,10 +499,14 @@ public:
     Result<DesfireVersionInfo, PcscError>        tryDiscoverCard();
     Result<void, PcscError>                      trySelectApplication(const DesfireAID& aid);
     Result<void, PcscError>                      tryAuthenticateDesfire(const BYTEV& key, BYTE keyNo, DesfireKeyType keyType);
+    Result<void, PcscError>                      tryAuthenticateDesfireEV2(const BYTEV& key, BYTE keyNo);
+    Result<void, PcscError>                      tryAuthenticateDesfireDiversified(DesfireKeyDiversifier& diversifier, BYTE keyNo);
     Result<std::vector<DesfireAID>, PcscError>   tryGetApplicationIDs();
     Result<std::vector<BYTE>, PcscError>         tryGetFileIDs();
     Result<DesfireFileSettings, PcscError>       tryGetFileSettings(BYTE fileNo);
     Result<BYTEV, PcscError>                     tryReadFileData(BYTE fileNo, uint32_t offset, uint32_t length);
+    Result<DesfireStreamResult, PcscError>       tryReadFileDataStream(BYTE fileNo, uint32_t offset, uint32_t length, const DesfireDataSink& sink);
+    Result<DesfireStreamResult, PcscError>       tryReadFileDataStream(BYTE fileNo, uint32_t offset, uint32_t length, const DesfireDataSink& sink, const DesfireStreamOptions& opts);
     Result<void, PcscError>                      tryWriteFileData(BYTE fileNo, uint32_t offset, const BYTEV& data);
     Result<size_t, PcscError>                    tryGetFreeMemory();
     Result<void, PcscError>                      tryCreateApplication(const DesfireAID& aid, BYTE keySettings, BYTE maxKeys, DesfireKeyType keyType);
@@ -323,12 +517,18 @@ public:
     Result<void, PcscError>                      tryDeleteFile(BYTE fileNo);
     Result<BYTEV, PcscError>                     tryReadRecords(BYTE fileNo, uint32_t offset, uint32_t count);
     Result<void, PcscError>                      tryAppendRecord(BYTE fileNo, const BYTEV& recordData);
+    Result<DesfireRecordResult, PcscError>       tryReadRecordPages(BYTE fileNo, const DesfireRecordSink& sink);
+    Result<DesfireRecordResult, PcscError>       tryReadRecordPages(BYTE fileNo, const DesfireRecordSink& sink, const DesfireRecordOptions& opts);
+    Result<int32_t, PcscError>                   tryGetValue(BYTE fileNo);
     Result<void, PcscError>                      tryCreditValue(BYTE fileNo, int32_t value);
     Result<void, PcscError>                      tryDebitValue(BYTE fileNo, int32_t value);
     Result<void, PcscError>                      tryCommitTransaction();
     Result<void, PcscError>                      tryAbortTransaction();
+    Result<void, PcscError>                      tryRunDesfireTransaction(DesfireTransaction& tx, DesfireTransactionReport& report);
+    Result<void, PcscError>                      tryRunDesfireScript(const DesfireScript& script, DesfireScriptReport& report, DesfireKeyDiversifier* diversifier = nullptr);
     Result<BYTE, PcscError>                      tryGetKeyVersion(BYTE keyNo);
     Result<void, PcscError>                      tryFormatPICC();
+    Result<DesfireSnapshotReport, PcscError>     trySnapshotDesfire(const DesfireSnapshotOptions& opts);
 
 private:
     Reader&        reader_;
@@ -336,21 +536,41 @@ private:
 
     // ── Key Storage ─────────────────────────────────────────────────────────
     //
-    //  keys_: Kayıtlı tüm key'ler (en az 1 tane — constructor garanti eder).
+    //  keys_[0..keyCount_): Kayıtlı key'ler (en az 1 tane — constructor garanti eder).
+    //    Sabit kapasite = reader key slot sayısı (0x00–0x1F) → heap yok,
+    //    tarama tek cache line grubunda kalır.
     //
     //    Mifare Classic  → 1 key (setDefaultKey) veya 2 key (setKeys)
     //    DESFire         → 1–14 key (addKey ile eklenir)
     //
-    //  Tek key varsa (keys_.size() == 1) tüm işlemler o key ile yapılır.
+    //  Tek key varsa (keyCount_ == 1) tüm işlemler o key ile yapılır.
     //  Birden fazla key varsa access bits'e göre otomatik seçim yapılır.
     //
-    std::vector<KeyInfo> keys_;
+    static constexpr int    KEY_CAPACITY = 32;
+    static constexpr int    MAX_SECTORS  = 40;
+    static constexpr int8_t NO_PLAN      = -1;
+
+    std::array<KeyInfo, KEY_CAPACITY> keys_{};
+    int                               keyCount_ = 0;
+
+    // ── Key Plan ────────────────────────────────────────────────────────────
+    //
+    //  keyPlan_[sector][purpose]: chooseKey() sonucunun keys_ index'i.
+    //    İlk sorguda hesaplanır, sonra O(1). Key listesi değişince tamamen,
+    //    sektörün trailer'ı okunup/yazılınca o sektör için düşürülür.
+    //    card().loadMemory() / rollback() / card().writeBlockData(trailer)
+    //    gibi CardIO dışından gelen değişiklikler sektör bazında
+    //    keyPlanEpoch_[sector] ≠ card_.accessEpoch(sector) ile yakalanır.
+    //    purpose: 0 = Read, 1 = Write
+    //
+    mutable std::array<std::array<int8_t, 2>, MAX_SECTORS> keyPlan_{};
+    mutable std::array<uint32_t, MAX_SECTORS> keyPlanEpoch_{};
 
     // ── Auth / LoadKey Cache ────────────────────────────────────────────────
     //
-    //  slotContents_: Reader belleğindeki slot → yüklü key bytes eşlemesi.
-    //    Aynı slot/key zaten yüklü ise loadKey tekrarlanmaz.
-    //    Farklı slot'lardaki key'ler aynı anda loaded kalabilir.
+    //  slotContents_ / slotLoaded_: Reader belleğindeki slot → yüklü key bytes.
+    //    Bit i set ise slotContents_[i] reader'da yüklü. Aynı slot/key zaten
+    //    yüklü ise loadKey tekrarlanmaz. 0x1F üstü slot'lar cache'lenmez.
     //
     //  lastAuthSector_ / lastAuthKT_: Son başarılı auth bilgisi.
     //    Aynı sektör + aynı amaç için yeniden auth atlanır.
@@ -359,13 +579,21 @@ private:
     //
     int            lastAuthSector_ = -1;
     KeyType        lastAuthKT_     = KeyType::A;
-    std::map<BYTE, KEYBYTES> slotContents_;
+    std::array<KEYBYTES, KEY_CAPACITY> slotContents_{};
+    uint32_t                           slotLoaded_ = 0;
 
     // ── Private Helpers ─────────────────────────────────────────────────────
     void ensureAuth(int sector, AuthPurpose purpose = AuthPurpose::Read);
     void doAuth(int sector, const KeyInfo& ki);
     void ensureKeyLoaded(const KeyInfo& ki);
+    bool isKeyLoaded(const KeyInfo& ki) const;
+    void markKeyLoaded(const KeyInfo& ki);
     void invalidateAuth();
+    void invalidateKeyPlan();
+    void invalidateKeyPlan(int sector);
+
+    // Trailer memory'ye okundu/yazıldı → AccessControl cache + key planı düşür
+    void onTrailerChanged(int sector);
     const KeyInfo& chooseKey(int sector, AuthPurpose purpose) const;
     const KeyInfo& findKey(KeyType kt) const;
     bool isMultiKey() const;
@@ -376,16 +604,79 @@ private:
     // Classic → sector access bits, DESFire → KeyInfo::permission
     bool canKeyPerform(const KeyInfo& ki, int sector, AuthPurpose purpose) const;
 
+    // Bulk trailer: sektör için trailer permission'a göre key planı
+    //   Read  → access bits okuyabilen key, Write → access bits yazabilen key
+    //   Memory'deki trailer geçersizse chooseKey()'e düşer.
+    const KeyInfo& planTrailerKey(int sector, AuthPurpose purpose) const;
+
+    // ── Topology-Specialised Transfer Loops ─────────────────────────────────
+    //  Kart türü başına bir kez dispatch edilir (tryReadCard / tryReadSector /
+    //  tryWriteBlock); döngü içinde blok adresleri Topology<CT> tablolarından
+    //  gelir. Ultralight'ta auth yoktur, adres = page (block * 4).
+    template <CardType CT> int  readCardAs(BYTE* raw);
+    template <CardType CT> bool readSectorBlocksAs(int sector);
+    template <CardType CT> Result<void, PcscError> tryWriteBlockAs(int block, const BYTE data[16]);
+
+    // Planlanan key ile auth; başarısızsa diğer key'ler denenir (tek sefer)
+    Result<void, PcscError> tryAuthTrailer(int sector, AuthPurpose purpose,
+                                           TrailerSectorResult& res);
+
+    // writeAllTrailers gövdesi. skipInvalid=false → geçersiz config tüm batch'i
+    // reddeder; true → o sektör raporda hatalı işaretlenip atlanır (restore)
+    Result<TrailerBatchReport, PcscError> tryWriteTrailerBatch(const std::vector<TrailerConfig>& configs,
+                                                               bool verify, bool skipInvalid);
+
     // ── DESFire State ───────────────────────────────────────────────────────
     std::unique_ptr<DesfireSession> desfireSession_;
+    uint32_t desfireFrameData_ = 59;         // DesfireFrameSize{}.payload()
+
+    // ── DESFire Yeniden Auth ────────────────────────────────────────────────
+    //  desfireAuthCache_: app başına son başarılı auth key'i (lazy).
+    //  desfireSecureTransceive süresi dolmuş oturumu komuttan önce, 0xAE
+    //  yanıtını komuttan sonra bir kez yeniler (bkz. setDesfireAutoReauth).
+    std::unique_ptr<DesfireAuthCache> desfireAuthCache_;
+    bool     desfireAutoReauth_  = true;
+    uint32_t desfireReauthCount_ = 0;
+
+    // runDesfireTransaction süresince true: auth bekleyen değişiklikleri
+    // atacağından yeniden auth yerine DesfireError::TransactionLost döner.
+    bool     desfireTxOpen_      = false;
+
+    void desfireRememberAuth(const BYTEV& key);
+    bool desfireCanReauth() const;
+    Result<void, PcscError> desfireReauthenticate();
 
     // Raw APDU transmit through Reader
     BYTEV desfireTransmit(const BYTEV& apdu);
     Result<BYTEV, PcscError> tryDesfireTransmit(const BYTEV& apdu);
 
-    // DESFire helpers — reduce boilerplate
+    // Host oturumu + seçili AID sıfırlanır (discoverCard, transport hatası)
+    void desfireDropSession();
+
+    // DESFire helpers — reduce boilerplate. Hepsi 0xAF chaining yapar ve
+    // oturum açıksa secure messaging'den geçer (tüm veri açık header).
     Result<void, PcscError>  desfireExec(const BYTEV& apdu);
     Result<BYTEV, PcscError> desfireQuery(const BYTEV& apdu);
+
+    // Komut cmdMode ile korunur (ilk headerLen veri byte'ı açık), yanıt
+    // respMode ile çözülür (Plain/MAC → CMAC doğrulama, Full → CBC + CRC32).
+    // Oturum yoksa yalnızca Plain/Plain geçerlidir. Kart hatası / doğrulama
+    // hatası oturumu düşürür (kart da auth'u düşürür). EV2 oturumunda
+    // TI + cmdCounter korumalı MAC/Full kullanılır (bkz. DesfireSecureMessaging).
+    Result<BYTEV, PcscError> desfireSecureTransceive(BYTEV apdu, size_t headerLen,
+                                                     DesfireCommMode cmdMode, DesfireCommMode respMode,
+                                                     size_t expectedLen);
+
+    // ── DESFire Metadata Cache ──────────────────────────────────────────────
+    //  Bilgi DesfireMemoryLayout'ta yaşar (bkz. invalidateDesfireMetadata).
+    //  PICC seviyesinde dosya yoktur → desfireCurrentApp() nullptr döner.
+    DesfireMetadataCache* desfireMetaCache_ = nullptr;
+
+    DesfireApplication* desfireCurrentApp();
+    void desfireCacheFile(BYTE fileNo, const DesfireFileSettings& fs);
+    void desfireForgetFile(BYTE fileNo);
+    void desfireMetadataChanged();
+    Result<DesfireCommMode, PcscError> desfireFileCommMode(BYTE fileNo);
 };
 
 #endif // CARDIO_H
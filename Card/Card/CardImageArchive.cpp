@@ -0,0 +1,565 @@
+#include "CardImageArchive.h"
+#include "CardInterface.h"
+#include "CardModel/CardMemoryLayout.h"
+#include "CardModel/DesfireMemoryLayout.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <ctime>
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char   ARCHIVE_MAGIC[8] = { 'P', 'C', 'S', 'C', 'I', 'M', 'G', '\0' };
+constexpr size_t HEADER_SIZE      = sizeof(CardImageArchiveHeader);
+constexpr size_t RECORD_SIZE      = sizeof(CardImageRecord);
+
+size_t fileBytesFor(uint64_t capacity)
+{
+	return HEADER_SIZE + static_cast<size_t>(capacity) * RECORD_SIZE;
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Platform: dosya aç / boyut / yeniden boyutlandır / kapat
+// ════════════════════════════════════════════════════════════════════════════════
+
+#ifdef _WIN32
+
+intptr_t openFile(const std::string& path, bool writable)
+{
+	HANDLE h = CreateFileA(path.c_str(),
+		writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+		FILE_SHARE_READ, nullptr,
+		writable ? OPEN_ALWAYS : OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	return h == INVALID_HANDLE_VALUE ? -1 : reinterpret_cast<intptr_t>(h);
+}
+
+bool fileSize(intptr_t f, size_t& out)
+{
+	LARGE_INTEGER sz;
+	if (!GetFileSizeEx(reinterpret_cast<HANDLE>(f), &sz)) return false;
+	out = static_cast<size_t>(sz.QuadPart);
+	return true;
+}
+
+bool resizeFile(intptr_t f, size_t bytes)
+{
+	LARGE_INTEGER pos;
+	pos.QuadPart = static_cast<LONGLONG>(bytes);
+	HANDLE h = reinterpret_cast<HANDLE>(f);
+	return SetFilePointerEx(h, pos, nullptr, FILE_BEGIN) && SetEndOfFile(h);
+}
+
+void closeFile(intptr_t f)
+{
+	CloseHandle(reinterpret_cast<HANDLE>(f));
+}
+
+#else
+
+intptr_t openFile(const std::string& path, bool writable)
+{
+	int fd = writable ? ::open(path.c_str(), O_RDWR | O_CREAT, 0644)
+	                  : ::open(path.c_str(), O_RDONLY);
+	return fd;
+}
+
+bool fileSize(intptr_t f, size_t& out)
+{
+	struct stat st;
+	if (::fstat(static_cast<int>(f), &st) != 0) return false;
+	out = static_cast<size_t>(st.st_size);
+	return true;
+}
+
+bool resizeFile(intptr_t f, size_t bytes)
+{
+	return ::ftruncate(static_cast<int>(f), static_cast<off_t>(bytes)) == 0;
+}
+
+void closeFile(intptr_t f)
+{
+	::close(static_cast<int>(f));
+}
+
+#endif
+
+// DesfireVersionInfo ↔ 28 byte (alan sırası sabit)
+void packVersion(const DesfireVersionInfo& vi, BYTE out[28])
+{
+	const BYTE head[14] = {
+		vi.hwVendorID, vi.hwType, vi.hwSubType, vi.hwMajorVer, vi.hwMinorVer, vi.hwStorageSize, vi.hwProtocol,
+		vi.swVendorID, vi.swType, vi.swSubType, vi.swMajorVer, vi.swMinorVer, vi.swStorageSize, vi.swProtocol
+	};
+	std::memcpy(out, head, 14);
+	std::memcpy(out + 14, vi.uid, 7);
+	std::memcpy(out + 21, vi.batchNo, 5);
+	out[26] = vi.productionWeek;
+	out[27] = vi.productionYear;
+}
+
+DesfireVersionInfo unpackVersion(const BYTE in[28])
+{
+	DesfireVersionInfo vi;
+	vi.hwVendorID = in[0];  vi.hwType = in[1];     vi.hwSubType = in[2];
+	vi.hwMajorVer = in[3];  vi.hwMinorVer = in[4]; vi.hwStorageSize = in[5]; vi.hwProtocol = in[6];
+	vi.swVendorID = in[7];  vi.swType = in[8];     vi.swSubType = in[9];
+	vi.swMajorVer = in[10]; vi.swMinorVer = in[11]; vi.swStorageSize = in[12]; vi.swProtocol = in[13];
+	std::memcpy(vi.uid, in + 14, 7);
+	std::memcpy(vi.batchNo, in + 21, 5);
+	vi.productionWeek = in[26];
+	vi.productionYear = in[27];
+	return vi;
+}
+
+} // namespace
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Construction / Open / Close
+// ════════════════════════════════════════════════════════════════════════════════
+
+CardImageArchive::CardImageArchive(std::string path)
+	: path_(std::move(path))
+{
+}
+
+CardImageArchive::~CardImageArchive()
+{
+	close();
+}
+
+void CardImageArchive::open(Mode mode) { tryOpen(mode).unwrap(); }
+
+Result<void, PcscError> CardImageArchive::tryOpen(Mode mode)
+{
+	using R = Result<void, PcscError>;
+	close();
+	mode_ = mode;
+
+	const bool writable = mode == Mode::ReadWrite;
+	file_ = openFile(path_, writable);
+	if (file_ < 0)
+		return R::Err(Error<PcscError>(writable ? IoError::WriteFailed : IoError::ReadFailed)
+			.detail("Cannot open card image archive: " + path_));
+
+	size_t bytes = 0;
+	if (!fileSize(file_, bytes)) {
+		close();
+		return R::Err(Error<PcscError>(IoError::ReadFailed).detail("Cannot stat archive: " + path_));
+	}
+
+	// Yeni arşiv → header + başlangıç kapasitesi
+	if (bytes == 0 && writable) {
+		bytes = fileBytesFor(INITIAL_CAPACITY);
+		if (!resizeFile(file_, bytes)) {
+			close();
+			return R::Err(Error<PcscError>(IoError::WriteFailed).detail("Cannot size archive: " + path_));
+		}
+		auto mr = tryMap(bytes);
+		if (!mr) { close(); return mr; }
+		count_ = 0;
+		return tryInitHeader();
+	}
+
+	if (bytes < HEADER_SIZE) {
+		close();
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Not a card image archive (too small): " + path_));
+	}
+
+	auto mr = tryMap(bytes);
+	if (!mr) { close(); return mr; }
+
+	auto vr = tryValidateHeader();
+	if (!vr) { close(); return vr; }
+
+	// Commit edilmiş ama magic'i olmayan kuyruk kayıtları (eski sürüm /
+	// bozulma) sayılmaz
+	uint64_t count = header()->recordCount;
+	while (count > 0 && !records()[count - 1].isValid()) --count;
+	if (count != header()->recordCount && writable) header()->recordCount = count;
+	count_ = count;
+
+	rebuildIndex();
+	return R::Ok();
+}
+
+void CardImageArchive::close()
+{
+	unmap();
+	if (file_ >= 0) closeFile(file_);
+	file_  = -1;
+	count_ = 0;
+	index_.clear();
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Mapping
+// ════════════════════════════════════════════════════════════════════════════════
+
+Result<void, PcscError> CardImageArchive::tryMap(size_t bytes)
+{
+	using R = Result<void, PcscError>;
+	const bool writable = mode_ == Mode::ReadWrite;
+
+#ifdef _WIN32
+	const DWORD hi = static_cast<DWORD>(static_cast<uint64_t>(bytes) >> 32);
+	const DWORD lo = static_cast<DWORD>(bytes & 0xFFFFFFFFu);
+	HANDLE m = CreateFileMappingA(reinterpret_cast<HANDLE>(file_), nullptr,
+		writable ? PAGE_READWRITE : PAGE_READONLY, hi, lo, nullptr);
+	if (!m)
+		return R::Err(Error<PcscError>(IoError::ReadFailed).detail("CreateFileMapping failed: " + path_));
+	void* p = MapViewOfFile(m, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, bytes);
+	if (!p) {
+		CloseHandle(m);
+		return R::Err(Error<PcscError>(IoError::ReadFailed).detail("MapViewOfFile failed: " + path_));
+	}
+	mapping_ = m;
+#else
+	void* p = ::mmap(nullptr, bytes, writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+	                 MAP_SHARED, static_cast<int>(file_), 0);
+	if (p == MAP_FAILED)
+		return R::Err(Error<PcscError>(IoError::ReadFailed).detail("mmap failed: " + path_));
+#endif
+
+	base_       = static_cast<BYTE*>(p);
+	mappedSize_ = bytes;
+	return R::Ok();
+}
+
+void CardImageArchive::unmap()
+{
+	if (!base_) return;
+#ifdef _WIN32
+	UnmapViewOfFile(base_);
+	if (mapping_) CloseHandle(static_cast<HANDLE>(mapping_));
+	mapping_ = nullptr;
+#else
+	::munmap(base_, mappedSize_);
+#endif
+	base_       = nullptr;
+	mappedSize_ = 0;
+}
+
+Result<void, PcscError> CardImageArchive::tryGrow(uint64_t minCapacity)
+{
+	using R = Result<void, PcscError>;
+	const uint64_t newCap = std::max<uint64_t>(header()->capacity * 2, minCapacity);
+	const size_t   bytes  = fileBytesFor(newCap);
+
+	const size_t oldBytes = mappedSize_;
+
+	// Windows'ta map açıkken dosya boyutu değişmez → önce unmap. Hata yolunda
+	// eski boyut geri map'lenir; arşiv açık ve kayıtlar erişilebilir kalır.
+	unmap();
+	auto restore = [&](PcscError e) -> R {
+		(void)resizeFile(file_, oldBytes);
+		if (!tryMap(oldBytes)) {
+			close();
+			e.detail += " (remap failed, archive closed)";
+		}
+		return R::Err(std::move(e));
+	};
+	if (!resizeFile(file_, bytes))
+		return restore(Error<PcscError>(IoError::WriteFailed).detail("Cannot grow archive: " + path_));
+	auto mr = tryMap(bytes);
+	if (!mr) return restore(std::move(mr.error()));
+
+	header()->capacity = newCap;
+	return R::Ok();
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Header
+// ════════════════════════════════════════════════════════════════════════════════
+
+Result<void, PcscError> CardImageArchive::tryInitHeader()
+{
+	CardImageArchiveHeader* h = header();
+	std::memset(h, 0, HEADER_SIZE);
+	std::memcpy(h->magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+	h->version     = FORMAT_VERSION;
+	h->recordSize  = static_cast<uint32_t>(RECORD_SIZE);
+	h->recordCount = 0;
+	h->capacity    = INITIAL_CAPACITY;
+	return Result<void, PcscError>::Ok();
+}
+
+Result<void, PcscError> CardImageArchive::tryValidateHeader()
+{
+	using R = Result<void, PcscError>;
+	const CardImageArchiveHeader* h = header();
+
+	if (std::memcmp(h->magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0)
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Not a card image archive: " + path_));
+	if (h->version != FORMAT_VERSION)
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Unsupported archive version " + std::to_string(h->version))
+			.meta("expected", std::to_string(FORMAT_VERSION)));
+	if (h->recordSize != RECORD_SIZE)
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Archive record size mismatch: " + std::to_string(h->recordSize)));
+	if (h->recordCount > h->capacity || fileBytesFor(h->capacity) > mappedSize_)
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Archive truncated: " + path_));
+	return R::Ok();
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Index
+// ════════════════════════════════════════════════════════════════════════════════
+
+size_t CardImageArchive::UidKeyHash::operator()(const UidKey& k) const noexcept
+{
+	// FNV-1a 64
+	uint64_t h = 0xCBF29CE484222325ull;
+	for (uint8_t b : k.bytes) {
+		h ^= b;
+		h *= 0x100000001B3ull;
+	}
+	return static_cast<size_t>(h);
+}
+
+CardImageArchive::UidKey CardImageArchive::makeKey(const uint8_t* uid, size_t len)
+{
+	UidKey k;
+	len = std::min(len, CardImageRecord::MAX_UID);
+	k.bytes[0] = static_cast<uint8_t>(len);
+	std::memcpy(k.bytes.data() + 1, uid, len);
+	return k;
+}
+
+void CardImageArchive::rebuildIndex()
+{
+	index_.clear();
+	const uint64_t n = size();
+	index_.reserve(static_cast<size_t>(n));
+	const CardImageRecord* recs = records();
+	for (uint64_t i = 0; i < n; ++i) {
+		if (!recs[i].isValid()) continue;
+		index_[makeKey(recs[i].uid, recs[i].uidLength)] = i;   // sonraki kayıt öncekini ezer
+	}
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Queries
+// ════════════════════════════════════════════════════════════════════════════════
+
+const CardImageRecord* CardImageArchive::records() const
+{
+	return base_ ? reinterpret_cast<const CardImageRecord*>(base_ + HEADER_SIZE) : nullptr;
+}
+
+uint64_t CardImageArchive::size() const
+{
+	return base_ ? count_ : 0;
+}
+
+const CardImageRecord* CardImageArchive::at(uint64_t index) const
+{
+	return index < size() ? records() + index : nullptr;
+}
+
+const CardImageRecord* CardImageArchive::find(const BYTEV& uid) const
+{
+	if (!base_ || uid.size() > CardImageRecord::MAX_UID) return nullptr;
+	auto it = index_.find(makeKey(uid.data(), uid.size()));
+	return it == index_.end() ? nullptr : at(it->second);
+}
+
+Result<void, PcscError> CardImageArchive::trySync()
+{
+	using R = Result<void, PcscError>;
+	if (!base_ || mode_ != Mode::ReadWrite) return R::Ok();
+#ifdef _WIN32
+	const bool ok = FlushViewOfFile(base_, mappedSize_) != 0
+	             && FlushFileBuffers(reinterpret_cast<HANDLE>(file_)) != 0;
+#else
+	const bool ok = ::msync(base_, mappedSize_, MS_SYNC) == 0;
+#endif
+	if (!ok)
+		return R::Err(Error<PcscError>(IoError::WriteFailed).detail("Archive sync failed: " + path_));
+	return R::Ok();
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Append
+// ════════════════════════════════════════════════════════════════════════════════
+
+uint64_t CardImageArchive::append(const BYTEV& uid, const CardInterface& card)
+{
+	return tryAppend(uid, card).unwrap();
+}
+
+Result<uint64_t, PcscError> CardImageArchive::tryAppend(const BYTEV& uid, const CardInterface& card)
+{
+	CardImageRecord rec;
+	auto cr = tryCapture(uid, card, rec);
+	if (!cr) return Result<uint64_t, PcscError>::Err(std::move(cr.error()));
+	return tryAppendRecord(rec);
+}
+
+Result<uint64_t, PcscError> CardImageArchive::tryAppend(const CardInterface& card)
+{
+	return tryAppend(uidOf(card), card);
+}
+
+Result<uint64_t, PcscError> CardImageArchive::tryAppendRecord(const CardImageRecord& record)
+{
+	using R = Result<uint64_t, PcscError>;
+	if (!base_)
+		return R::Err(Error<PcscError>(IoError::WriteFailed).detail("Archive not open"));
+	if (mode_ != Mode::ReadWrite)
+		return R::Err(Error<PcscError>(IoError::WriteFailed).detail("Archive opened read-only"));
+	if (record.uidLength > CardImageRecord::MAX_UID || record.imageSize > CardImageRecord::MAX_IMAGE)
+		return R::Err(Error<PcscError>(CardError::InvalidData).detail("Malformed card image record"));
+
+	const uint64_t n = count_;
+	if (n >= header()->capacity) {
+		auto gr = tryGrow(n + 1);
+		if (!gr) return R::Err(std::move(gr.error()));
+	}
+
+	CardImageRecord* dst = reinterpret_cast<CardImageRecord*>(base_ + HEADER_SIZE) + n;
+	std::memcpy(dst, &record, RECORD_SIZE);
+	dst->magic    = CardImageRecord::MAGIC;
+	dst->sequence = n;
+
+	// Kayıt tamamen yazılmadan recordCount görünmesin
+	std::atomic_thread_fence(std::memory_order_release);
+	header()->recordCount = n + 1;
+	count_ = n + 1;
+
+	index_[makeKey(dst->uid, dst->uidLength)] = n;
+	return R::Ok(n);
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Kayıt ↔ Model
+// ════════════════════════════════════════════════════════════════════════════════
+
+Result<void, PcscError> CardImageArchive::tryCapture(const BYTEV& uid, const CardInterface& card,
+                                                     CardImageRecord& out)
+{
+	using R = Result<void, PcscError>;
+	if (uid.empty() || uid.size() > CardImageRecord::MAX_UID)
+		return R::Err(PcscError::make(CardError::InvalidData,
+			"UID must be 1-" + std::to_string(CardImageRecord::MAX_UID) + " bytes, got "
+			+ std::to_string(uid.size())));
+
+	std::memset(&out, 0, RECORD_SIZE);
+	out.magic      = CardImageRecord::MAGIC;
+	out.cardType   = static_cast<uint8_t>(card.getCardType());
+	out.uidLength  = static_cast<uint8_t>(uid.size());
+	out.capturedAt = static_cast<uint64_t>(std::time(nullptr));
+	std::memcpy(out.uid, uid.data(), uid.size());
+
+	if (card.isDesfire()) {
+		const DesfireMemoryLayout& d = card.getDesfireMemory();
+		CardImageDesfireMeta& m = out.desfire;
+		packVersion(d.versionInfo, m.version);
+		m.totalMemory     = static_cast<uint32_t>(d.totalMemory);
+		m.freeMemory      = static_cast<uint32_t>(d.freeMemory);
+		m.variant         = static_cast<BYTE>(d.variant);
+		m.piccKeySettings = d.piccKeyConfig.keySettings;
+		m.piccKeyCount    = d.piccKeyConfig.keyCount;
+
+		// Kayıt sabit boyutlu: fazla app sessizce kesilirse restore eksik model üretir
+		const size_t apps = d.applications.size();
+		if (apps > static_cast<size_t>(CardImageDesfireMeta::MAX_APPS))
+			return R::Err(Error<PcscError>(CardError::InvalidData)
+				.detail("DESFire card has " + std::to_string(apps) + " applications; archive record holds at most "
+					+ std::to_string(CardImageDesfireMeta::MAX_APPS))
+				.meta("apps", static_cast<int>(apps)));
+		m.appCount = static_cast<BYTE>(apps);
+		for (size_t i = 0; i < apps; ++i) {
+			const DesfireApplication& app = d.applications[i];
+			CardImageDesfireApp& a = m.apps[i];
+			std::memcpy(a.aid, app.aid.aid, 3);
+			a.keySettings = app.keyConfig.keySettings;
+			a.keyCount    = app.keyConfig.keyCount;
+			a.keyType     = static_cast<BYTE>(app.keyConfig.keyType);
+			a.fileCount   = static_cast<BYTE>(std::min<size_t>(app.files.size(), 0xFF));
+		}
+		out.flags |= CardImageRecord::FLAG_DESFIRE;
+		return R::Ok();
+	}
+
+	const CardMemoryLayout& mem = card.getMemory();
+	out.imageSize = static_cast<uint32_t>(mem.memorySize());
+	std::memcpy(out.image, mem.getRawMemory(), out.imageSize);
+	return R::Ok();
+}
+
+void CardImageArchive::restore(const CardImageRecord& record, CardInterface& card)
+{
+	tryRestore(record, card).unwrap();
+}
+
+Result<void, PcscError> CardImageArchive::tryRestore(const CardImageRecord& record, CardInterface& card)
+{
+	using R = Result<void, PcscError>;
+	if (!record.isValid())
+		return R::Err(Error<PcscError>(CardError::InvalidData).detail("Invalid card image record"));
+	if (record.type() != card.getCardType())
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Card type mismatch")
+			.meta("record", std::to_string(record.cardType))
+			.meta("card", std::to_string(static_cast<int>(card.getCardType()))));
+
+	if (card.isDesfire()) {
+		if (!(record.flags & CardImageRecord::FLAG_DESFIRE)) return R::Ok();
+		const CardImageDesfireMeta& m = record.desfire;
+		DesfireMemoryLayout& d = card.getDesfireMemoryMutable();
+		d.initFromVersion(unpackVersion(m.version));
+		d.totalMemory = m.totalMemory;
+		d.freeMemory  = m.freeMemory;
+		d.variant     = static_cast<DesfireVariant>(m.variant);
+		d.piccKeyConfig.keySettings = m.piccKeySettings;
+		d.piccKeyConfig.keyCount    = m.piccKeyCount;
+
+		d.applications.clear();
+		const int apps = std::min<int>(m.appCount, CardImageDesfireMeta::MAX_APPS);
+		for (int i = 0; i < apps; ++i) {
+			const CardImageDesfireApp& a = m.apps[i];
+			DesfireApplication app;
+			std::memcpy(app.aid.aid, a.aid, 3);
+			app.keyConfig.keySettings = a.keySettings;
+			app.keyConfig.keyCount    = a.keyCount;
+			app.keyConfig.keyType     = static_cast<DesfireKeyType>(a.keyType);
+			d.applications.push_back(std::move(app));   // dosya içerikleri arşivlenmez
+		}
+		return R::Ok();
+	}
+
+	if (record.imageSize != card.getMemory().memorySize())
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Image size mismatch: " + std::to_string(record.imageSize)));
+	card.loadMemory(record.image, record.imageSize);
+	return R::Ok();
+}
+
+BYTEV CardImageArchive::uidOf(const CardInterface& card)
+{
+	if (card.isDesfire()) {
+		const BYTE* uid = card.getDesfireMemory().versionInfo.uid;
+		return BYTEV(uid, uid + 7);
+	}
+	const BYTE* raw = card.getMemory().getRawMemory();
+	if (card.isUltralight())                    // SN0-SN2 (page 0) + SN3-SN6 (page 1)
+		return BYTEV{ raw[0], raw[1], raw[2], raw[4], raw[5], raw[6], raw[7] };
+	return BYTEV(raw, raw + 4);                 // Classic: NUID (7-byte UID → uid'i açıkça ver)
+}
@@ -0,0 +1,231 @@
+#ifndef CARDIMAGEARCHIVE_H
+#define CARDIMAGEARCHIVE_H
+
+#include "CardDataTypes.h"
+#include "Result.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+class CardInterface;
+struct DesfireMemoryLayout;
+
+// ════════════════════════════════════════════════════════════════════════════════
+// CardImageArchive — Memory-Mapped, Sabit Kayıtlı Kart İmajı Arşivi
+// ════════════════════════════════════════════════════════════════════════════════
+//
+// Basılan her kartın bellek imajı (Classic 1K/4K, Ultralight) ve DESFire
+// metadata'sı tek bir binary dosyada sabit boyutlu kayıtlar halinde tutulur.
+// Dosya bütünüyle map edilir: audit işleri `begin()..end()` üzerinden kayıtları
+// deserialize etmeden, doğrudan bellekten tarar.
+//
+// ─── Dosya Formatı (v1, little-endian, native hizalama) ───────────────────
+//
+//   [0    .. 64)                    CardImageArchiveHeader
+//   [64 + i*RECORD_SIZE .. )        CardImageRecord i   (i < recordCount)
+//   [.. capacity*RECORD_SIZE)       ayrılmış, henüz kullanılmamış alan
+//
+//   Kayıtlar 64 byte'a hizalıdır (cache line). Dosya kapasitesi ikiye
+//   katlanarak büyür; büyüme remap gerektirir.
+//
+// ─── Tutarlılık ─────────────────────────────────────────────────────────────
+//
+//   Append: kayıt önce yazılır, ardından header.recordCount artırılır.
+//   Process crash'inde yarım kayıt sayılmaz. Açılışta recordCount içindeki
+//   son kayıtların magic'i doğrulanır; bozuk kuyruk kesilir.
+//   Güç kesintisine karşı kalıcılık için trySync() (msync / FlushViewOfFile).
+//
+// ─── Index ─────────────────────────────────────────────────────────────────
+//
+//   UID → kayıt index'i hash map'te tutulur (açılışta tek geçişte kurulur).
+//   Aynı UID tekrar eklenirse index en yeni kaydı gösterir; eski imajlar
+//   arşivde kalır (audit geçmişi).
+//
+// ─── Kullanım ──────────────────────────────────────────────────────────────
+//
+//   CardImageArchive archive("issued_cards.img");
+//   archive.open(CardImageArchive::Mode::ReadWrite);
+//   archive.append(uid, io.card());               // okunan imaj arşive
+//
+//   if (const CardImageRecord* rec = archive.find(uid))
+//       CardImageArchive::restore(*rec, card);
+//
+//   for (const CardImageRecord& rec : archive)    // audit taraması
+//       if (rec.cardType == ...) ...
+//
+// DİKKAT: find()/at()/begin() pointer'ları sonraki append'te (remap) geçersiz
+// olabilir. Tek yazıcı varsayılır; aynı dosyayı ReadOnly açan başka process'ler
+// yalnızca açılış anındaki recordCount'a kadar okur.
+//
+// ════════════════════════════════════════════════════════════════════════════════
+
+// ── DESFire Metadata (kayıt içi, sabit boyut) ──────────────────────────────
+
+struct CardImageDesfireApp {
+    BYTE aid[3];
+    BYTE keySettings;
+    BYTE keyCount;
+    BYTE keyType;           // DesfireKeyType
+    BYTE fileCount;
+    BYTE reserved;
+};
+
+struct CardImageDesfireMeta {
+    BYTE     version[28];   // DesfireVersionInfo alan sırası (hw 7, sw 7, uid 7, batch 5, week, year)
+    uint32_t totalMemory;
+    uint32_t freeMemory;
+    BYTE     variant;       // DesfireVariant
+    BYTE     piccKeySettings;
+    BYTE     piccKeyCount;
+    BYTE     appCount;      // ≤ MAX_APPS
+    CardImageDesfireApp apps[28];
+
+    static constexpr int MAX_APPS = 28;
+};
+
+// ── Kayıt ──────────────────────────────────────────────────────────────────
+
+struct CardImageRecord {
+    static constexpr uint32_t MAGIC           = 0x31474D49;   // "IMG1"
+    static constexpr size_t   MAX_UID         = 10;
+    static constexpr size_t   MAX_IMAGE       = 4096;         // Classic 4K
+    static constexpr uint16_t FLAG_DESFIRE    = 0x0001;       // desfire alanı dolu
+
+    // Kayıt başlığı (64 byte)
+    uint32_t magic;
+    uint8_t  cardType;      // CardType
+    uint8_t  uidLength;
+    uint16_t flags;
+    uint8_t  uid[MAX_UID];
+    uint8_t  reserved0[2];
+    uint32_t imageSize;     // 64 / 1024 / 4096, DESFire → 0
+    uint64_t capturedAt;    // unix zamanı (saniye)
+    uint64_t sequence;      // arşiv içi sıra no
+    uint8_t  reserved1[24];
+
+    CardImageDesfireMeta desfire;
+    uint8_t  reserved2[248];
+
+    uint8_t  image[MAX_IMAGE];
+
+    bool isValid() const { return magic == MAGIC; }
+    CardType type() const { return static_cast<CardType>(cardType); }
+    BYTEV uidBytes() const { return BYTEV(uid, uid + uidLength); }
+};
+
+struct CardImageArchiveHeader {
+    char     magic[8];      // "PCSCIMG\0"
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t recordCount;   // commit edilmiş kayıt sayısı
+    uint64_t capacity;      // dosyada yer ayrılmış kayıt sayısı
+    uint8_t  reserved[32];
+};
+
+static_assert(sizeof(CardImageDesfireMeta) == 264, "CardImageDesfireMeta layout");
+static_assert(sizeof(CardImageRecord) == 4672, "CardImageRecord layout");
+static_assert(sizeof(CardImageRecord) % 64 == 0, "CardImageRecord must stay cache-line sized");
+static_assert(offsetof(CardImageRecord, image) % 64 == 0, "image must be cache-line aligned");
+static_assert(sizeof(CardImageArchiveHeader) == 64, "CardImageArchiveHeader layout");
+
+// ────────────────────────────────────────────────────────────────────────────
+// CardImageArchive
+// ────────────────────────────────────────────────────────────────────────────
+
+class CardImageArchive {
+public:
+    enum class Mode { ReadOnly, ReadWrite };
+
+    static constexpr uint32_t FORMAT_VERSION   = 1;
+    static constexpr uint64_t INITIAL_CAPACITY = 1024;
+
+    explicit CardImageArchive(std::string path);
+    ~CardImageArchive();
+
+    CardImageArchive(const CardImageArchive&) = delete;
+    CardImageArchive& operator=(const CardImageArchive&) = delete;
+
+    // ReadWrite: dosya yoksa oluşturulur. ReadOnly: dosya mevcut olmalı.
+    void open(Mode mode = Mode::ReadWrite);
+    Result<void, PcscError> tryOpen(Mode mode = Mode::ReadWrite);
+    void close();
+    bool isOpen() const { return base_ != nullptr; }
+
+    // ── Append ──────────────────────────────────────────────────────────────
+    // @return yeni kaydın index'i
+
+    uint64_t append(const BYTEV& uid, const CardInterface& card);
+    Result<uint64_t, PcscError> tryAppend(const BYTEV& uid, const CardInterface& card);
+
+    // UID karttan türetilir (Classic: NUID, Ultralight: 7 byte SN, DESFire: GetVersion UID)
+    Result<uint64_t, PcscError> tryAppend(const CardInterface& card);
+
+    // Hazır kayıt (magic/sequence arşiv tarafından doldurulur)
+    Result<uint64_t, PcscError> tryAppendRecord(const CardImageRecord& record);
+
+    // ── Sorgular ────────────────────────────────────────────────────────────
+
+    uint64_t size() const;
+    const CardImageRecord* at(uint64_t index) const;          // index ≥ size → nullptr
+    const CardImageRecord* find(const BYTEV& uid) const;      // en yeni kayıt
+    bool contains(const BYTEV& uid) const { return find(uid) != nullptr; }
+
+    const CardImageRecord* begin() const { return records(); }
+    const CardImageRecord* end() const { return records() + size(); }
+
+    const std::string& path() const { return path_; }
+
+    Result<void, PcscError> trySync();
+
+    // ── Kayıt ↔ Model ───────────────────────────────────────────────────────
+
+    // Karttan kayıt doldur (uid ≤ MAX_UID)
+    static Result<void, PcscError> tryCapture(const BYTEV& uid, const CardInterface& card,
+                                              CardImageRecord& out);
+
+    // Kayıttaki imajı karta yükle (kart türü eşleşmeli). DESFire'da yalnızca
+    // version/kapasite ve uygulama key konfigürasyonu geri yüklenir.
+    static void restore(const CardImageRecord& record, CardInterface& card);
+    static Result<void, PcscError> tryRestore(const CardImageRecord& record, CardInterface& card);
+
+    // Kart modelinden UID (tryAppend(card) ile aynı kural)
+    static BYTEV uidOf(const CardInterface& card);
+
+private:
+    struct UidKey {
+        std::array<uint8_t, CardImageRecord::MAX_UID + 1> bytes{};   // [0] = uzunluk
+        bool operator==(const UidKey& o) const { return bytes == o.bytes; }
+    };
+    struct UidKeyHash {
+        size_t operator()(const UidKey& k) const noexcept;
+    };
+
+    std::string path_;
+    Mode        mode_ = Mode::ReadOnly;
+
+    // Platform handle'ları (POSIX: fd, Windows: HANDLE)
+    intptr_t file_    = -1;
+    void*    mapping_ = nullptr;       // Windows file mapping handle
+    BYTE*    base_    = nullptr;
+    size_t   mappedSize_ = 0;
+    uint64_t count_      = 0;          // doğrulanmış kayıt sayısı
+
+    std::unordered_map<UidKey, uint64_t, UidKeyHash> index_;
+
+    CardImageArchiveHeader*       header()       { return reinterpret_cast<CardImageArchiveHeader*>(base_); }
+    const CardImageArchiveHeader* header() const { return reinterpret_cast<const CardImageArchiveHeader*>(base_); }
+    const CardImageRecord* records() const;
+
+    static UidKey makeKey(const uint8_t* uid, size_t len);
+
+    Result<void, PcscError> tryMap(size_t bytes);
+    void unmap();
+    Result<void, PcscError> tryGrow(uint64_t minCapacity);
+    Result<void, PcscError> tryInitHeader();
+    Result<void, PcscError> tryValidateHeader();
+    void rebuildIndex();
+};
+
+#endif // CARDIMAGEARCHIVE_H
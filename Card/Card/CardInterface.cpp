@@ -6,9 +6,28 @@
 #include "CardProtocol/KeyManagement.h"
 #include "CardProtocol/AuthenticationState.h"
 #include "Result.h"
+#include <algorithm>
+#include <bitset>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
 
+// ────────────────────────────────────────────────────────────────────────────
+// Snapshot — copy-on-write undo kaydı
+// ────────────────────────────────────────────────────────────────────────────
+//   saved[i]  : blocks[i] bloğunun snapshot anındaki içeriği
+//   touched   : hangi blokların kaydedildiği (4K = 256 blok)
+//   desfire   : DESFire modeli ilk mutable erişimde kopyalanır; o anda
+//               kopyası olmayan snapshot'lar aynı kopyayı paylaşır
+// ────────────────────────────────────────────────────────────────────────────
+
+struct CardInterface::Snapshot {
+    std::bitset<256>                      touched;
+    std::vector<uint16_t>                 blocks;
+    std::vector<MifareBlock>              saved;
+    std::shared_ptr<DesfireMemoryLayout>  desfire;
+};
+
 // ════════════════════════════════════════════════════════════════════════════════
 // Construction / Destruction
 // ════════════════════════════════════════════════════════════════════════════════
@@ -47,7 +66,18 @@ void CardInterface::loadMemory(const BYTE* data, size_t size) {
             "Invalid memory size for card type").throwIfError();
         return;
     }
-    else std::memcpy(memory_->getRawMemory(), data, size);
+    else {
+        // Aktif snapshot varsa yalnızca içeriği değişecek bloklar kaydedilir
+        if (!snapshots_.empty()) {
+            const BYTE* cur = memory_->getRawMemory();
+            for (size_t b = 0; b * 16 < size; ++b)
+                if (std::memcmp(cur + b * 16, data + b * 16, 16) != 0)
+                    saveBlockForSnapshots(static_cast<int>(b));
+        }
+        std::memcpy(memory_->getRawMemory(), data, size);
+        if (accessControl_) accessControl_->invalidateAll();
+        ++accessEpoch_;
+    }
 }
 
 const CardMemoryLayout& CardInterface::getMemory() const {
@@ -58,6 +88,18 @@ CardMemoryLayout& CardInterface::getMemoryMutable() {
     return *memory_;
 }
 
+void CardInterface::touchBlock(int block) {
+    if (!snapshots_.empty()) saveBlockForSnapshots(block);
+}
+
+void CardInterface::writeBlockData(int block, const BYTE data[16]) {
+    topology_->validateBlock(block);
+    touchBlock(block);
+    std::memcpy(memory_->getRawMemory() + block * 16, data, 16);
+    if (accessControl_ && topology_->isTrailerBlock(block))
+        invalidateAccessCache(topology_->sectorFromBlock(block));
+}
+
 BYTEV CardInterface::exportMemory() const {
     if (isDesfire()) {
 		PcscError::make(CardError::NotDesfire,
@@ -133,6 +175,28 @@ bool CardInterface::canWriteDataBlocks(int sector, KeyType kt) const {
 	return isUltralight() || isDesfire() ? true : accessControl_->canWriteDataBlock(sector, kt);
 }
 
+void CardInterface::invalidateAccessCache(int sector) {
+	if (!accessControl_) return;
+	if (sector < 0) {
+		accessControl_->invalidateAll();
+		++accessEpoch_;
+	}
+	else {
+		accessControl_->invalidate(sector);
+		if (sector < static_cast<int>(sectorEpoch_.size())) ++sectorEpoch_[sector];
+	}
+}
+
+uint32_t CardInterface::accessEpoch() const {
+	return accessEpoch_;
+}
+
+uint32_t CardInterface::accessEpoch(int sector) const {
+	// Toplam: global veya sektör sayacından biri artınca değişir
+	if (sector < 0 || sector >= static_cast<int>(sectorEpoch_.size())) return accessEpoch_;
+	return accessEpoch_ + sectorEpoch_[sector];
+}
+
 // ════════════════════════════════════════════════════════════════════════════════
 // Topology Queries
 // ════════════════════════════════════════════════════════════════════════════════
@@ -298,5 +362,101 @@ DesfireMemoryLayout& CardInterface::getDesfireMemoryMutable() {
     if (!desfire_) {
 		PcscError::make(CardError::NotDesfire, "Not a DESFire card").throwIfError();
     }
+    // Kopyası olmayanlar her zaman yığının üst kısmıdır → tek kopya, paylaşılır
+    if (desfireSaved_ < snapshots_.size()) {
+        auto copy = std::make_shared<DesfireMemoryLayout>(*desfire_);
+        for (size_t i = desfireSaved_; i < snapshots_.size(); ++i)
+            snapshots_[i]->desfire = copy;
+        desfireSaved_ = snapshots_.size();
+    }
     return *desfire_;
 }
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Snapshots
+// ════════════════════════════════════════════════════════════════════════════════
+
+void CardInterface::saveBlockForSnapshots(int block) {
+    if (block < 0 || block >= topology_->totalBlocks()) return;
+    const MifareBlock& cur = memory_->getBlock(block);
+    for (auto& snap : snapshots_) {
+        if (snap->touched.test(block)) continue;
+        snap->touched.set(block);
+        snap->blocks.push_back(static_cast<uint16_t>(block));
+        snap->saved.push_back(cur);
+    }
+}
+
+bool CardInterface::isValidSnapshot(SnapshotId id) const {
+    return id >= 0 && id < static_cast<int>(snapshots_.size());
+}
+
+CardInterface::SnapshotId CardInterface::snapshot() {
+    snapshots_.push_back(std::make_unique<Snapshot>());
+    return static_cast<SnapshotId>(snapshots_.size() - 1);
+}
+
+int CardInterface::snapshotDepth() const {
+    return static_cast<int>(snapshots_.size());
+}
+
+void CardInterface::rollback(SnapshotId id) {
+    tryRollback(id).unwrap();
+}
+
+Result<void, PcscError> CardInterface::tryRollback(SnapshotId id) {
+    using R = Result<void, PcscError>;
+    if (!isValidSnapshot(id))
+        return R::Err(PcscError::make(CardError::InvalidData,
+            "Invalid snapshot id: " + std::to_string(id)));
+
+    // Snapshot id, kendisinden sonra ilk kez yazılan her bloğun orijinalini
+    // tutar → iç snapshot'lara bakmaya gerek yok.
+    Snapshot& snap = *snapshots_[id];
+    BYTE* raw = memory_->getRawMemory();
+    for (size_t i = 0; i < snap.blocks.size(); ++i) {
+        const int block = snap.blocks[i];
+        std::memcpy(raw + block * 16, snap.saved[i].raw, 16);
+        if (accessControl_ && topology_->isTrailerBlock(block))
+            accessControl_->invalidate(topology_->sectorFromBlock(block));
+    }
+    if (snap.desfire && desfire_) {
+        if (snap.desfire.use_count() == 1) *desfire_ = std::move(*snap.desfire);
+        else                               *desfire_ = *snap.desfire;
+    }
+    if (!snap.blocks.empty()) ++accessEpoch_;
+
+    snapshots_.resize(id);
+    desfireSaved_ = std::min(desfireSaved_, snapshots_.size());
+    return R::Ok();
+}
+
+void CardInterface::release(SnapshotId id) {
+    if (!isValidSnapshot(id)) return;
+    snapshots_.resize(id);
+    desfireSaved_ = std::min(desfireSaved_, snapshots_.size());
+}
+
+CardImageDiff CardInterface::diffSinceSnapshot(SnapshotId id) const {
+    CardImageDiff diff;
+    diff.cardType = cardType_;
+    if (!isValidSnapshot(id)) return diff;
+
+    const Snapshot& snap = *snapshots_[id];
+    const BYTE* raw = memory_->getRawMemory();
+    diff.comparedBlocks = static_cast<int>(snap.blocks.size());
+    for (size_t i = 0; i < snap.blocks.size(); ++i) {
+        const int block = snap.blocks[i];
+        uint16_t mask = 0;
+        for (int b = 0; b < 16; ++b)
+            if (raw[block * 16 + b] != snap.saved[i].raw[b]) mask |= static_cast<uint16_t>(1u << b);
+        if (mask) diff.blocks.push_back(BlockDiff{ static_cast<uint16_t>(block), mask });
+    }
+    std::sort(diff.blocks.begin(), diff.blocks.end(),
+              [](const BlockDiff& a, const BlockDiff& b) { return a.block < b.block; });
+    return diff;
+}
+
+bool CardInterface::desfireTouchedSinceSnapshot(SnapshotId id) const {
+    return isValidSnapshot(id) && snapshots_[id]->desfire != nullptr;
+}
@@ -2,6 +2,9 @@
 #define CARDINTERFACE_H
 
 #include "CardDataTypes.h"
+#include "CardModel/CardImageDiff.h"
+#include "Result.h"
+#include <array>
 #include <memory>
 #include <vector>
 
@@ -77,6 +80,13 @@ struct DesfireMemoryLayout;
 //   // 9) Bellegi geri al:
 //   BYTEV exported = card.exportMemory();        // 1024 byte kopyasi
 //
+//   // 10) Spekülatif düzenleme (copy-on-write snapshot):
+//   auto snap = card.snapshot();
+//   card.writeBlockData(8, profileBlock);       // yalnızca blok 8 kaydedilir
+//   CardImageDiff d = card.diffSinceSnapshot(snap);
+//   if (!valid) card.rollback(snap);            // O(değişen blok)
+//   else        card.release(snap);             // değişiklikler kalır
+//
 // ════════════════════════════════════════════════════════════════════════════════
 
 class CardInterface {
@@ -108,6 +118,42 @@ public:
     // Export memory to raw bytes
     BYTEV exportMemory() const;
 
+    // Tek blok yaz (snapshot-aware). Trailer ise access cache düşürülür.
+    // getMemoryMutable() ile ham yazma yapan kod, yazmadan önce touchBlock()
+    // çağırmalıdır; aksi halde aktif snapshot o bloğu geri alamaz.
+    void writeBlockData(int block, const BYTE data[16]);
+    void touchBlock(int block);
+
+    // ────────────────────────────────────────────────────────────────────────────
+    // Snapshots (block-granular copy-on-write)
+    // ────────────────────────────────────────────────────────────────────────────
+    // Tasarım Notu:
+    // Snapshot almak bellek kopyalamaz. Snapshot aktifken bir blok ilk kez
+    // yazılacağında orijinal 16 byte o snapshot'a kaydedilir (copy-on-write).
+    // Böylece spekülatif düzenleme yalnızca dokunulan blokları, rollback ise
+    // O(değişen blok) maliyetlidir. Kayıt yalnızca yazma yollarında olur
+    // (writeBlockData, loadMemory, touchBlock); mutable getBlock kaydetmez.
+    //
+    // DESFire modeli blok granüler değildir, bütün olarak kaydedilir: snapshot
+    // sonrası ilk getDesfireMemoryMutable() modeli BİR kez kopyalar ve o anda
+    // kopyası olmayan tüm snapshot'lar bu kopyayı paylaşır. Sonraki çağrılar
+    // kopyalamaz (O(1) kontrol).
+    //
+    // Snapshot'lar yığın şeklindedir: rollback/release(id), id ve ondan sonra
+    // alınmış tüm snapshot'ları kapatır.
+
+    using SnapshotId = int;
+
+    SnapshotId snapshot();
+    void rollback(SnapshotId id);
+    Result<void, PcscError> tryRollback(SnapshotId id);
+    void release(SnapshotId id);                  // değişiklikleri koru
+    int  snapshotDepth() const;
+
+    // Snapshot'tan bu yana gerçekten değişmiş bloklar (maske yok, blok sıralı)
+    CardImageDiff diffSinceSnapshot(SnapshotId id) const;
+    bool desfireTouchedSinceSnapshot(SnapshotId id) const;   // mutable erişim oldu mu
+
     // ────────────────────────────────────────────────────────────────────────────
     // Key Management
     // ────────────────────────────────────────────────────────────────────────────
@@ -153,11 +199,24 @@ public:
     bool canReadDataBlocks(int sector, KeyType kt) const;
     bool canWriteDataBlocks(int sector, KeyType kt) const;
 
+    // Trailer memory'de doğrudan değiştirildiyse decode edilmiş izinleri düşür
+    // (loadMemory bunu otomatik yapar). sector < 0 → tüm sektörler.
+    void invalidateAccessCache(int sector = -1);
+
+    // Toplu model değişikliğinde artar (loadMemory, rollback, tüm access
+    // cache'inin düşürülmesi). İzinlerden türetilmiş dış cache'ler (CardIO
+    // key planı) kendi epoch'larıyla karşılaştırıp yeniden hesaplar.
+    // accessEpoch(sector) ayrıca o sektörün trailer'ı writeBlockData ile
+    // yazıldığında veya invalidateAccessCache(sector) çağrıldığında artar.
+    uint32_t accessEpoch() const;
+    uint32_t accessEpoch(int sector) const;
+
     // ────────────────────────────────────────────────────────────────────────────
     // Topology Queries
     // ────────────────────────────────────────────────────────────────────────────
 
-    // Get block information
+    // Get block information — mutable referansla yazacak kod önce
+    // touchBlock() çağırmalıdır (snapshot kaydı yalnızca yazma yollarında)
     MifareBlock& getBlock(int blockNum);
     const MifareBlock& getBlock(int blockNum) const;
 
@@ -221,6 +280,16 @@ private:
     std::unique_ptr<DesfireMemoryLayout> desfire_;
 
     CardType cardType_;
+    uint32_t accessEpoch_ = 0;
+    std::array<uint32_t, 40> sectorEpoch_{};   // 4K: 32 + 8 sektör
+
+    // Aktif snapshot yığını (tanım CardInterface.cpp'de)
+    struct Snapshot;
+    std::vector<std::unique_ptr<Snapshot>> snapshots_;
+    size_t desfireSaved_ = 0;   // DESFire kopyası olan snapshot'lar: [0, desfireSaved_)
+
+    void saveBlockForSnapshots(int block);
+    bool isValidSnapshot(SnapshotId id) const;
 };
 
 #endif // CARDINTERFACE_H
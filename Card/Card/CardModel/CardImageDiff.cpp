@@ -0,0 +1,131 @@
+#include "CardImageDiff.h"
+#include "CardMemoryLayout.h"
+#include "CardTopology.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define CARD_DIFF_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	#include <arm_neon.h>
+	#define CARD_DIFF_NEON 1
+#endif
+
+namespace {
+
+// ════════════════════════════════════════════════════════════════════════════════
+// 16-byte karşılaştırma → "farklı byte" maskesi
+// ════════════════════════════════════════════════════════════════════════════════
+
+inline uint16_t neqMask16(const BYTE* a, const BYTE* b)
+{
+#if defined(CARD_DIFF_SSE2)
+	const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+	const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+	return static_cast<uint16_t>(~_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)));
+#elif defined(CARD_DIFF_NEON)
+	static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128,
+	                                     1, 2, 4, 8, 16, 32, 64, 128 };
+	const uint8x16_t ne   = vmvnq_u8(vceqq_u8(vld1q_u8(a), vld1q_u8(b)));
+	const uint8x16_t bits = vandq_u8(ne, vld1q_u8(weights));
+	return static_cast<uint16_t>(vaddv_u8(vget_low_u8(bits))
+	                          | (vaddv_u8(vget_high_u8(bits)) << 8));
+#else
+	uint64_t a0, a1, b0, b1;
+	std::memcpy(&a0, a, 8); std::memcpy(&a1, a + 8, 8);
+	std::memcpy(&b0, b, 8); std::memcpy(&b1, b + 8, 8);
+	if (a0 == b0 && a1 == b1) return 0;         // hızlı yol: blok aynı
+	uint16_t m = 0;
+	for (int i = 0; i < 16; ++i)
+		if (a[i] != b[i]) m |= static_cast<uint16_t>(1u << i);
+	return m;
+#endif
+}
+
+inline bool isZero6(const BYTE* p)
+{
+	return (p[0] | p[1] | p[2] | p[3] | p[4] | p[5]) == 0;
+}
+
+constexpr uint16_t KEY_A_BITS = 0x003F;     // byte 0-5
+constexpr uint16_t KEY_B_BITS = 0xFC00;     // byte 10-15
+constexpr uint16_t UL_UID_BITS = 0x01FF;    // Ultralight page 0-1 + BCC1 (byte 0-8)
+
+// ────────────────────────────────────────────────────────────────────────────
+// Topology<CT> ile özelleşmiş tarama döngüsü
+// ────────────────────────────────────────────────────────────────────────────
+
+template <CardType CT>
+void diffAs(const BYTE* a, const BYTE* b, CardImageDiff& out, const CardImageDiff::Options& opts)
+{
+	using T = Topology<CT>;
+	out.comparedBlocks = T::TOTAL_BLOCKS;
+
+	for (int blk = 0; blk < T::TOTAL_BLOCKS; ++blk) {
+		const BYTE* pa = a + blk * 16;
+		const BYTE* pb = b + blk * 16;
+		uint16_t m = neqMask16(pa, pb);
+		if (!m) continue;                       // tipik durum: tek compare + branch
+
+		if (blk == 0 && opts.maskManufacturer)
+			m &= T::HAS_TRAILERS ? 0 : static_cast<uint16_t>(~UL_UID_BITS);
+
+		if (T::HAS_TRAILERS && opts.maskZeroKeys && T::isTrailerBlock(blk)) {
+			if (isZero6(pa) || isZero6(pb))           m &= static_cast<uint16_t>(~KEY_A_BITS);
+			if (isZero6(pa + 10) || isZero6(pb + 10)) m &= static_cast<uint16_t>(~KEY_B_BITS);
+		}
+
+		if (m) out.blocks.push_back(BlockDiff{ static_cast<uint16_t>(blk), m });
+	}
+}
+
+} // namespace
+
+// ════════════════════════════════════════════════════════════════════════════════
+// CardImageDiff
+// ════════════════════════════════════════════════════════════════════════════════
+
+bool CardImageDiff::contains(int block) const
+{
+	for (const BlockDiff& d : blocks) {
+		if (d.block == block) return true;
+		if (d.block > block) break;             // sıralı
+	}
+	return false;
+}
+
+int CardImageDiff::compareRaw(CardType ct, const BYTE* a, const BYTE* b, CardImageDiff& out,
+                              const Options& opts)
+{
+	out.blocks.clear();
+	out.cardType = ct;
+
+	switch (ct) {
+		case CardType::MifareClassic4K:  diffAs<CardType::MifareClassic4K>(a, b, out, opts);  break;
+		case CardType::MifareUltralight: diffAs<CardType::MifareUltralight>(a, b, out, opts); break;
+		case CardType::MifareDesfire:    out.comparedBlocks = 0; break;
+		default:                         diffAs<CardType::MifareClassic1K>(a, b, out, opts);  break;
+	}
+	return static_cast<int>(out.blocks.size());
+}
+
+CardImageDiff CardImageDiff::compare(const CardMemoryLayout& a, const CardMemoryLayout& b,
+                                     const Options& opts)
+{
+	return tryCompare(a, b, opts).unwrap();
+}
+
+Result<CardImageDiff, PcscError> CardImageDiff::tryCompare(const CardMemoryLayout& a,
+                                                           const CardMemoryLayout& b,
+                                                           const Options& opts)
+{
+	using R = Result<CardImageDiff, PcscError>;
+	if (a.cardType != b.cardType)
+		return R::Err(PcscError::make(CardError::InvalidData, "Cannot diff images of different card types"));
+	if (a.isDesfire())
+		return R::Err(PcscError::make(CardError::NotDesfire, "DESFire has no flat image to diff"));
+
+	CardImageDiff diff;
+	compareRaw(a.cardType, a.getRawMemory(), b.getRawMemory(), diff, opts);
+	return R::Ok(std::move(diff));
+}
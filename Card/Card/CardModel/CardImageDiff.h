@@ -0,0 +1,82 @@
+#ifndef CARDIMAGEDIFF_H
+#define CARDIMAGEDIFF_H
+
+#include "../CardDataTypes.h"
+#include "Result.h"
+#include <cstdint>
+#include <vector>
+
+struct CardMemoryLayout;
+
+// ════════════════════════════════════════════════════════════════════════════════
+// CardImageDiff — Blok Bazlı Vektörel İmaj Karşılaştırma
+// ════════════════════════════════════════════════════════════════════════════════
+//
+// İki kart imajını (veya imaj ↔ golden şablon) 16 byte'lık bloklar halinde
+// karşılaştırır. Her blok tek vektör karşılaştırmasıyla (SSE2 / NEON, yoksa
+// 2×64-bit scalar) 16-bit "farklı byte" maskesine indirgenir; sonuç yalnızca
+// değişen blokları içeren kompakt bir listedir.
+//
+// ─── Maskeleme ─────────────────────────────────────────────────────────────
+//
+//   maskManufacturer   Classic blok 0 (UID + üretici verisi) tamamen,
+//                      Ultralight blok 0'da UID byte'ları (page 0-1 + BCC1)
+//                      karşılaştırılmaz → kart başına farklı olan alanlar
+//                      şablonla diff üretmez.
+//   maskZeroKeys       Trailer'da Key A / Key B alanı taraflardan birinde
+//                      tamamen 0 ise (PCSC okumada okunamayan key 00 döner)
+//                      o alan karşılaştırılmaz. Access bits + GPB her zaman
+//                      karşılaştırılır.
+//
+// ─── Kullanım ──────────────────────────────────────────────────────────────
+//
+//   CardImageDiff diff = CardImageDiff::compare(golden, card.getMemory());
+//   for (const BlockDiff& d : diff.blocks) ...     // sadece değişenler
+//   io.tryWriteDiff(diff, golden);                 // değişen blokları yaz
+//
+//   // Filo denetimi — arşiv kayıtları üzerinde kopyasız, buffer tekrar kullanılır:
+//   CardImageDiff diff;
+//   for (const CardImageRecord& rec : archive)
+//       CardImageDiff::compareRaw(rec.type(), golden.getRawMemory(), rec.image, diff);
+//
+// ════════════════════════════════════════════════════════════════════════════════
+
+struct BlockDiff {
+    uint16_t block;         // blok numarası
+    uint16_t byteMask;      // bit i set → byte i farklı (maskeler uygulanmış)
+};
+
+struct CardImageDiffOptions {
+    bool maskManufacturer = true;
+    bool maskZeroKeys     = true;
+};
+
+struct CardImageDiff {
+    using Options = CardImageDiffOptions;
+
+    CardType               cardType = CardType::MifareClassic1K;
+    int                    comparedBlocks = 0;
+    std::vector<BlockDiff> blocks;              // artan blok sırasıyla
+
+    bool empty() const { return blocks.empty(); }
+    size_t size() const { return blocks.size(); }
+    bool contains(int block) const;
+    void clear() { blocks.clear(); comparedBlocks = 0; }
+
+    // ── Karşılaştırma ───────────────────────────────────────────────────────
+
+    // a ve b aynı kart türünde olmalı (DESFire desteklenmez)
+    static CardImageDiff compare(const CardMemoryLayout& a, const CardMemoryLayout& b,
+                                 const Options& opts = Options{});
+    static Result<CardImageDiff, PcscError> tryCompare(const CardMemoryLayout& a,
+                                                       const CardMemoryLayout& b,
+                                                       const Options& opts = Options{});
+
+    // Ham imajlar (ör. CardImageArchive kayıtları). `out` temizlenip doldurulur;
+    // kapasitesi korunur → toplu denetimde allocation yok.
+    // @return değişen blok sayısı
+    static int compareRaw(CardType ct, const BYTE* a, const BYTE* b, CardImageDiff& out,
+                          const Options& opts = Options{});
+};
+
+#endif // CARDIMAGEDIFF_H
@@ -0,0 +1,134 @@
+#include "CardImageView.h"
+#include "CardMemoryLayout.h"
+#include "TrailerConfig.h"
+#include <algorithm>
+#include <cstring>
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Construction
+// ════════════════════════════════════════════════════════════════════════════════
+
+CardImageView::CardImageView(CardType ct, const BYTE* data)
+	: topology_(ct), data_(data)
+{
+	if (ct == CardType::MifareDesfire)
+		PcscError::make(CardError::NotDesfire, "DESFire has no flat image view").throwIfError();
+}
+
+CardImageView CardImageView::of(const CardMemoryLayout& mem)
+{
+	return CardImageView(mem.cardType, mem.getRawMemory());
+}
+
+Result<CardImageView, PcscError> CardImageView::tryFrom(CardType ct, const BYTE* data, size_t size)
+{
+	using R = Result<CardImageView, PcscError>;
+	if (ct == CardType::MifareDesfire)
+		return R::Err(PcscError::make(CardError::NotDesfire, "DESFire has no flat image view"));
+	if (!data)
+		return R::Err(PcscError::make(CardError::InvalidData, "Null image buffer"));
+
+	CardImageView v(ct, data);
+	if (size < v.memorySize())
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Image buffer too small for card type")
+			.meta("size", std::to_string(size))
+			.meta("expected", std::to_string(v.memorySize())));
+	return R::Ok(v);
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Veri
+// ════════════════════════════════════════════════════════════════════════════════
+
+const MifareBlock& CardImageView::block(int index) const
+{
+	topology_.validateBlock(index);
+	return *reinterpret_cast<const MifareBlock*>(data_ + topology_.blockByteOffset(index));
+}
+
+KEYBYTES CardImageView::uid() const
+{
+	KEYBYTES uid{};
+	if (topology_.isUltralight()) {
+		// page 0: SN0-SN2 + BCC0, page 1: SN3-SN6
+		uid[0] = data_[0]; uid[1] = data_[1]; uid[2] = data_[2];
+		uid[3] = data_[4]; uid[4] = data_[5]; uid[5] = data_[6];
+	} else {
+		std::copy(data_, data_ + 4, uid.begin());
+	}
+	return uid;
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Trailer
+// ════════════════════════════════════════════════════════════════════════════════
+
+const BYTE* CardImageView::trailer(int sector) const
+{
+	if (!topology_.hasTrailers())
+		PcscError::make(CardError::TrailerBlock, "Card type has no sector trailers").throwIfError();
+	topology_.validateSector(sector);
+	return data_ + topology_.blockByteOffset(topology_.trailerBlockOfSector(sector));
+}
+
+KEYBYTES CardImageView::keyA(int sector) const
+{
+	KEYBYTES k;
+	std::memcpy(k.data(), trailer(sector), 6);
+	return k;
+}
+
+KEYBYTES CardImageView::keyB(int sector) const
+{
+	KEYBYTES k;
+	std::memcpy(k.data(), trailer(sector) + 10, 6);
+	return k;
+}
+
+ACCESSBYTES CardImageView::accessBits(int sector) const
+{
+	ACCESSBYTES ab;
+	std::memcpy(ab.data(), trailer(sector) + 6, 4);
+	return ab;
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Yetki
+// ════════════════════════════════════════════════════════════════════════════════
+
+bool CardImageView::allowed(int block, KeyType kt, bool isWrite) const
+{
+	if (!topology_.hasTrailers()) return true;
+	if (!topology_.isValidBlock(block)) return false;
+
+	const int sector = topology_.sectorFromBlock(block);
+	const SectorAccessConfig cfg = AccessBitsCodec::decode(accessBits(sector));
+	if (topology_.isTrailerBlock(block)) {
+		TrailerPermission tp = cfg.trailerPermission();
+		return isWrite ? tp.canWrite(kt) : tp.canRead(kt);
+	}
+	// 4K extended sektör: data blok 0-14 → access slot min(idx, 2)
+	DataBlockPermission dp = cfg.dataPermission(std::min(topology_.blockIndexInSector(block), 2));
+	return isWrite ? dp.canWrite(kt) : dp.canRead(kt);
+}
+
+bool CardImageView::canRead(int block, KeyType kt) const
+{
+	return allowed(block, kt, false);
+}
+
+bool CardImageView::canWrite(int block, KeyType kt) const
+{
+	return allowed(block, kt, true);
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Dönüşüm
+// ════════════════════════════════════════════════════════════════════════════════
+
+void CardImageView::copyTo(CardMemoryLayout& out) const
+{
+	out.cardType = cardType();
+	std::memcpy(out.getRawMemory(), data_, memorySize());
+}
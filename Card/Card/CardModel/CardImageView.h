@@ -0,0 +1,87 @@
+#ifndef CARDIMAGEVIEW_H
+#define CARDIMAGEVIEW_H
+
+#include "../CardDataTypes.h"
+#include "BlockDefinition.h"
+#include "CardTopology.h"
+#include "Result.h"
+
+struct CardMemoryLayout;
+
+// ════════════════════════════════════════════════════════════════════════════════
+// CardImageView — Harici Buffer Üzerinde Salt-Okunur Kart Görünümü
+// ════════════════════════════════════════════════════════════════════════════════
+//
+// CardMemoryLayout her kart türü için 4K'lık union taşır; view ise yalnızca
+// (kart türü, buffer pointer) çiftidir ve kart türünün gerçek bellek boyutu
+// kadar veriye işaret eder. Kopyalama yapmaz, sahiplik almaz.
+//
+// Kaynak olabilecek buffer'lar:
+//   - CardMemoryLayout::getRawMemory()          (CardImageView::of)
+//   - CardImageRecord::image (mmap arşiv)       (kopyasız audit)
+//   - CompactCardStore arena'sı                 (filo modeli)
+//
+// Topoloji Topology<CT> tablolarından (CardLayoutTopology) gelir; access
+// bitleri her sorguda trailer'dan decode edilir (cache yok — view geçicidir).
+//
+// ─── Kullanım ──────────────────────────────────────────────────────────────
+//
+//   CardImageView v(rec.type(), rec.image);
+//   if (v.canRead(8, KeyType::A)) use(v.block(8));
+//   KEYBYTES keyB = v.keyB(2);
+//
+// DİKKAT: Buffer view'dan uzun yaşamalıdır.
+//
+// ════════════════════════════════════════════════════════════════════════════════
+
+class CardImageView {
+public:
+    CardImageView() = default;
+
+    // data en az Topology<ct>::MEMORY_SIZE byte olmalı (DESFire desteklenmez)
+    CardImageView(CardType ct, const BYTE* data);
+
+    static CardImageView of(const CardMemoryLayout& mem);
+    static Result<CardImageView, PcscError> tryFrom(CardType ct, const BYTE* data, size_t size);
+
+    // ── Topoloji ────────────────────────────────────────────────────────────
+
+    bool     valid() const noexcept { return data_ != nullptr; }
+    CardType cardType() const noexcept { return topology_.cardType(); }
+    const CardLayoutTopology& topology() const noexcept { return topology_; }
+
+    size_t memorySize() const noexcept { return topology_.totalMemoryBytes(); }
+    int    totalBlocks() const noexcept { return topology_.totalBlocks(); }
+    int    sectorCount() const noexcept { return topology_.sectorCount(); }
+
+    // ── Veri ────────────────────────────────────────────────────────────────
+
+    const BYTE* raw() const noexcept { return data_; }
+    const MifareBlock& block(int index) const;          // geçersiz index → throw
+    KEYBYTES uid() const;                               // CardInterface::getUID() ile aynı kural
+
+    // ── Trailer (yalnızca Classic) ──────────────────────────────────────────
+
+    KEYBYTES    keyA(int sector) const;
+    KEYBYTES    keyB(int sector) const;
+    ACCESSBYTES accessBits(int sector) const;
+
+    // ── Yetki (AccessControl ile aynı anlam, cache'siz) ─────────────────────
+    // Ultralight: access bit yok → her zaman true (CardInterface ile aynı).
+
+    bool canRead(int block, KeyType kt) const;
+    bool canWrite(int block, KeyType kt) const;
+
+    // ── Dönüşüm ─────────────────────────────────────────────────────────────
+
+    void copyTo(CardMemoryLayout& out) const;           // kart türü ayarlanır
+
+private:
+    CardLayoutTopology topology_{ CardType::MifareClassic1K };
+    const BYTE*        data_ = nullptr;
+
+    const BYTE* trailer(int sector) const;
+    bool allowed(int block, KeyType kt, bool isWrite) const;
+};
+
+#endif // CARDIMAGEVIEW_H
@@ -270,20 +270,14 @@ struct CardMemoryLayout {
 
     // ── Raw memory access ───────────────────────────────────────────────────
 
+    // Her layout'un `raw` görünümü union'ın başında durur → adres kart
+    // türünden bağımsızdır; per-block döngülerde switch gerekmez.
     BYTE* getRawMemory() {
-        switch (cardType) {
-            case CardType::MifareClassic4K:  return data.card4K.raw;
-            case CardType::MifareUltralight: return data.ultralight.raw;
-            default:                         return data.card1K.raw;
-        }
+        return data.card4K.raw;
     }
 
     const BYTE* getRawMemory() const {
-        switch (cardType) {
-            case CardType::MifareClassic4K:  return data.card4K.raw;
-            case CardType::MifareUltralight: return data.ultralight.raw;
-            default:                         return data.card1K.raw;
-        }
+        return data.card4K.raw;
     }
 
     // ── Block access (transparent for all card types) ───────────────────────
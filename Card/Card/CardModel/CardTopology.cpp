@@ -4,12 +4,30 @@
 // Construction
 // ════════════════════════════════════════════════════════════════════════════════
 
+template <CardType CT>
+void CardLayoutTopology::bind() noexcept {
+    using T = Topology<CT>;
+    sectorOfBlock_ = T::table.sectorOfBlock.data();
+    firstBlock_    = T::table.firstBlock.data();
+    blockCount_    = T::table.blockCount.data();
+    totalBlocks_   = T::TOTAL_BLOCKS;
+    sectorCount_   = T::SECTOR_COUNT;
+    memoryBytes_   = T::MEMORY_SIZE;
+    trailers_      = T::HAS_TRAILERS;
+}
+
 CardLayoutTopology::CardLayoutTopology(CardType ct)
     : cardType_(ct) {
+    switch (ct) {
+        case CardType::MifareClassic4K:  bind<CardType::MifareClassic4K>();  break;
+        case CardType::MifareUltralight: bind<CardType::MifareUltralight>(); break;
+        case CardType::MifareDesfire:    break;   // runtime: GetVersion / DesfireMemoryLayout
+        default:                         bind<CardType::MifareClassic1K>();  break;
+    }
 }
 
 CardLayoutTopology::CardLayoutTopology(bool is4K)
-    : cardType_(is4K ? CardType::MifareClassic4K : CardType::MifareClassic1K) {
+    : CardLayoutTopology(is4K ? CardType::MifareClassic4K : CardType::MifareClassic1K) {
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -17,58 +35,37 @@ CardLayoutTopology::CardLayoutTopology(bool is4K)
 // ════════════════════════════════════════════════════════════════════════════════
 
 size_t CardLayoutTopology::totalMemoryBytes() const noexcept {
-    switch (cardType_) {
-        case CardType::MifareClassic4K:  return 4096;
-        case CardType::MifareUltralight: return 64;
-        case CardType::MifareDesfire:    return 0;   // runtime: GetVersion
-        default:                         return 1024;
-    }
+    return memoryBytes_;
 }
 
 int CardLayoutTopology::totalBlocks() const noexcept {
-    switch (cardType_) {
-        case CardType::MifareClassic4K:  return 256;
-        case CardType::MifareUltralight: return 4;
-        case CardType::MifareDesfire:    return 0;   // virtual blocks via DesfireMemoryLayout
-        default:                         return 64;
-    }
+    return totalBlocks_;
 }
 
 int CardLayoutTopology::sectorCount() const noexcept {
-    switch (cardType_) {
-        case CardType::MifareClassic4K:  return 40;
-        case CardType::MifareUltralight: return 1;   // tüm kart = 1 sanal sektör
-        case CardType::MifareDesfire:    return 0;   // app-based, no sectors
-        default:                         return 16;
-    }
+    return sectorCount_;
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
 // Sector Information
 // ════════════════════════════════════════════════════════════════════════════════
+// Geçersiz sektör/blok (ve DESFire) → blocksPerSector 0, diğerleri -1.
 
 int CardLayoutTopology::blocksPerSector(int sector) const noexcept {
-    if (isUltralight()) return 4;           // tek sektör, 4 blok
-    if (isDesfire())    return 0;           // no sectors
-    if (!is4K()) return 4;                  // 1K: tüm sektörler 4 blok
-    return sector < 32 ? 4 : 16;           // 4K: karma
+    return isValidSector(sector) ? blockCount_[sector] : 0;
 }
 
 int CardLayoutTopology::firstBlockOfSector(int sector) const noexcept {
-    if (isUltralight()) return 0;
-    if (isDesfire())    return -1;          // no sectors
-    if (!is4K()) return sector * 4;
-    if (sector < 32) return sector * 4;
-    return 128 + (sector - 32) * 16;
+    return isValidSector(sector) ? firstBlock_[sector] : -1;
 }
 
 int CardLayoutTopology::lastBlockOfSector(int sector) const noexcept {
-    return firstBlockOfSector(sector) + blocksPerSector(sector) - 1;
+    if (!isValidSector(sector)) return -1;
+    return firstBlock_[sector] + blockCount_[sector] - 1;
 }
 
 int CardLayoutTopology::trailerBlockOfSector(int sector) const noexcept {
-    if (isUltralight()) return -1;          // Ultralight'ta trailer yok
-    if (isDesfire())    return -1;          // DESFire'da trailer yok
+    if (!trailers_) return -1;              // Ultralight / DESFire: trailer yok
     return lastBlockOfSector(sector);
 }
 
@@ -77,24 +74,18 @@ int CardLayoutTopology::trailerBlockOfSector(int sector) const noexcept {
 // ════════════════════════════════════════════════════════════════════════════════
 
 int CardLayoutTopology::sectorFromBlock(int block) const noexcept {
-    if (isUltralight()) return 0;           // tüm bloklar sektör 0
-    if (isDesfire())    return -1;          // no sectors
-    if (!is4K()) return block / 4;
-    if (block < 128) return block / 4;
-    return 32 + (block - 128) / 16;
+    return isValidBlock(block) ? sectorOfBlock_[block] : -1;
 }
 
 int CardLayoutTopology::blockIndexInSector(int block) const noexcept {
-    int sector = sectorFromBlock(block);
-    int firstBlock = firstBlockOfSector(sector);
-    return block - firstBlock;
+    if (!isValidBlock(block)) return -1;
+    return block - firstBlock_[sectorOfBlock_[block]];
 }
 
 bool CardLayoutTopology::isTrailerBlock(int block) const noexcept {
-    if (isUltralight()) return false;       // Ultralight'ta trailer yok
-    if (isDesfire())    return false;       // DESFire'da trailer yok
-    int sector = sectorFromBlock(block);
-    return block == trailerBlockOfSector(sector);
+    if (!trailers_ || !isValidBlock(block)) return false;
+    const int sector = sectorOfBlock_[block];
+    return block == firstBlock_[sector] + blockCount_[sector] - 1;
 }
 
 bool CardLayoutTopology::isDataBlock(int block) const noexcept {
@@ -126,11 +117,3 @@ void CardLayoutTopology::validateSector(int sector) const {
             "Sector out of range: " + std::to_string(sector)).throwIfError();
     }
 }
-
-// ════════════════════════════════════════════════════════════════════════════════
-// Internal Helpers
-// ════════════════════════════════════════════════════════════════════════════════
-
-bool CardLayoutTopology::isExtendedSector(int sector) const noexcept {
-    return is4K() && sector >= 32;
-}
@@ -3,6 +3,8 @@
 
 #include "../CardDataTypes.h"
 #include "Result.h"
+#include <array>
+#include <cstdint>
 
 // ════════════════════════════════════════════════════════════════════════════════
 // CardLayoutTopology - Pure Card Layout Information
@@ -34,6 +36,100 @@
 //
 // ════════════════════════════════════════════════════════════════════════════════
 
+// ════════════════════════════════════════════════════════════════════════════════
+// Topology<CardType> - Compile-Time Layout Tables
+// ════════════════════════════════════════════════════════════════════════════════
+// Tasarım Notu:
+// Blok → sektör ve sektör → ilk blok eşlemeleri derleme zamanında tabloya
+// dökülür. Kart türü template parametresi olduğundan per-block döngülerde
+// `switch(cardType)` kalmaz; runtime dispatch kart başına bir kez yapılır
+// (bkz. CardIO::tryReadCard). CardLayoutTopology aynı tabloları işaret eder.
+//
+//   static_assert(Topology<CardType::MifareClassic4K>::sectorFromBlock(128) == 32);
+//
+// pageOfBlock(): READ/UPDATE BINARY adresi. Classic'te blok numarasının
+// kendisi, Ultralight'ta virtual block'un ilk page'i (block * 4).
+// ════════════════════════════════════════════════════════════════════════════════
+
+namespace topology_detail {
+
+template <int Blocks, int Sectors>
+struct Table {
+    std::array<uint8_t, Blocks>  sectorOfBlock{};
+    std::array<uint8_t, Sectors> firstBlock{};
+    std::array<uint8_t, Sectors> blockCount{};
+};
+
+// İlk `smallSectors` sektör `smallSize` blok, kalanlar `largeSize` blok
+template <int Blocks, int Sectors>
+constexpr Table<Blocks, Sectors> makeTable(int smallSectors, int smallSize, int largeSize) {
+    Table<Blocks, Sectors> t{};
+    int block = 0;
+    for (int s = 0; s < Sectors; ++s) {
+        const int n = s < smallSectors ? smallSize : largeSize;
+        t.firstBlock[s] = static_cast<uint8_t>(block);
+        t.blockCount[s] = static_cast<uint8_t>(n);
+        for (int i = 0; i < n; ++i)
+            t.sectorOfBlock[block + i] = static_cast<uint8_t>(s);
+        block += n;
+    }
+    return t;
+}
+
+template <int Blocks, int Sectors, int SmallSectors, int SmallSize, int LargeSize,
+          bool Trailers, int PagesPerBlock>
+struct TopologyBase {
+    static constexpr int    TOTAL_BLOCKS    = Blocks;
+    static constexpr int    SECTOR_COUNT    = Sectors;
+    static constexpr size_t MEMORY_SIZE     = static_cast<size_t>(Blocks) * 16;
+    static constexpr bool   HAS_TRAILERS    = Trailers;
+    static constexpr int    PAGES_PER_BLOCK = PagesPerBlock;
+
+    static constexpr Table<Blocks, Sectors> table =
+        makeTable<Blocks, Sectors>(SmallSectors, SmallSize, LargeSize);
+
+    // Sınır kontrolü yok — çağıran isValidBlock/isValidSector ile doğrular
+    static constexpr int sectorFromBlock(int block) noexcept { return table.sectorOfBlock[block]; }
+    static constexpr int firstBlockOfSector(int sector) noexcept { return table.firstBlock[sector]; }
+    static constexpr int blocksPerSector(int sector) noexcept { return table.blockCount[sector]; }
+    static constexpr int lastBlockOfSector(int sector) noexcept {
+        return table.firstBlock[sector] + table.blockCount[sector] - 1;
+    }
+    static constexpr int trailerBlockOfSector(int sector) noexcept {
+        return Trailers ? lastBlockOfSector(sector) : -1;
+    }
+    static constexpr bool isTrailerBlock(int block) noexcept {
+        return Trailers && block == lastBlockOfSector(table.sectorOfBlock[block]);
+    }
+    static constexpr int pageOfBlock(int block) noexcept { return block * PagesPerBlock; }
+
+    static constexpr bool isValidBlock(int block) noexcept { return block >= 0 && block < Blocks; }
+    static constexpr bool isValidSector(int sector) noexcept { return sector >= 0 && sector < Sectors; }
+};
+
+} // namespace topology_detail
+
+template <CardType CT> struct Topology;
+
+template <> struct Topology<CardType::MifareClassic1K>
+    : topology_detail::TopologyBase<64, 16, 16, 4, 4, true, 1> {};
+
+template <> struct Topology<CardType::MifareClassic4K>
+    : topology_detail::TopologyBase<256, 40, 32, 4, 16, true, 1> {};
+
+// Ultralight: tüm kart tek sanal sektör, 4 virtual block × 4 page
+template <> struct Topology<CardType::MifareUltralight>
+    : topology_detail::TopologyBase<4, 1, 1, 4, 4, false, 4> {};
+
+// ════════════════════════════════════════════════════════════════════════════════
+// CardLayoutTopology - Runtime Facade
+// ════════════════════════════════════════════════════════════════════════════════
+// Tasarım Notu:
+// Kart türü constructor'da bir kez çözülür ve ilgili Topology<CT> tablolarına
+// pointer tutulur; sorgular switch yerine tablo okumasıdır. DESFire için
+// tablo yoktur (sectorCount 0, sektör sorguları -1).
+// ════════════════════════════════════════════════════════════════════════════════
+
 class CardLayoutTopology {
 public:
     // ────────────────────────────────────────────────────────────────────────────
@@ -132,12 +228,16 @@ public:
 private:
     CardType cardType_;
 
-    // ────────────────────────────────────────────────────────────────────────────
-    // Internal Helpers
-    // ────────────────────────────────────────────────────────────────────────────
+    // Topology<CT>::table alanlarına pointer (DESFire → nullptr)
+    const uint8_t* sectorOfBlock_ = nullptr;
+    const uint8_t* firstBlock_    = nullptr;
+    const uint8_t* blockCount_    = nullptr;
+    int    totalBlocks_ = 0;
+    int    sectorCount_ = 0;
+    size_t memoryBytes_ = 0;
+    bool   trailers_    = false;
 
-    // Check if sector is extended (16 blocks) - only for 4K
-    bool isExtendedSector(int sector) const noexcept;
+    template <CardType CT> void bind() noexcept;
 };
 
 #endif // CARDTOPOLOGY_H
@@ -2,10 +2,12 @@
 #define DESFIREMEMORYLAYOUT_H
 
 #include "../CardDataTypes.h"
+#include <algorithm>
 #include <array>
 #include <vector>
 #include <cstdint>
 #include <cstring>
+#include <type_traits>
 
 // ════════════════════════════════════════════════════════════════════════════════
 // DESFire Memory Layout — Dosya Sistemi Tabanlı Dinamik Model
@@ -246,13 +248,69 @@ struct DesfireFileSettings {
 //   Fark: boyut sabit değil, dosya oluşturulurken belirlenir.
 //
 
+// ── Byte Görünümleri ────────────────────────────────────────────────────────
+//
+//   (pointer, uzunluk) çifti: kopya yok, sahiplik yok (C++17'de std::span
+//   yok). Sınırlar oluşturulurken bilinir; subspan/block aralığı kırpar.
+//   DİKKAT: kaynak vector yeniden boyutlanırsa/taşınırsa view geçersizdir.
+//
+//   DesfireDataView  v = file.view();                  // salt-okunur
+//   DesfireDataSpan  s = mem.virtualBlockSpan(2, 4);   // bloklar 2..5, yerinde
+//
+
+template<typename T>
+class DesfireSpan {
+public:
+    static constexpr size_t BLOCK = 16;             // virtual block boyutu
+
+    DesfireSpan() = default;
+    DesfireSpan(T* data, size_t size) : data_(data), size_(size) {}
+
+    // BYTE → const BYTE dönüşümü
+    template<typename U, typename = std::enable_if_t<std::is_convertible<U*, T*>::value>>
+    DesfireSpan(const DesfireSpan<U>& o) : data_(o.data()), size_(o.size()) {}
+
+    T*     data()  const { return data_; }
+    size_t size()  const { return size_; }
+    bool   empty() const { return size_ == 0; }
+    T*     begin() const { return data_; }
+    T*     end()   const { return data_ + size_; }
+    T&     operator[](size_t i) const { return data_[i]; }
+
+    // [offset, offset + count) — sınır dışı kısım kırpılır
+    DesfireSpan subspan(size_t offset, size_t count = SIZE_MAX) const {
+        if (offset >= size_) return {};
+        return { data_ + offset, std::min(count, size_ - offset) };
+    }
+
+    // 16-byte virtual block'lar (son blok kısa olabilir)
+    size_t      blockCount() const { return (size_ + BLOCK - 1) / BLOCK; }
+    DesfireSpan block(size_t index) const { return subspan(index * BLOCK, BLOCK); }
+
+    BYTEV toBytes() const { return BYTEV(begin(), end()); }
+
+private:
+    T*     data_ = nullptr;
+    size_t size_ = 0;
+};
+
+using DesfireDataView = DesfireSpan<const BYTE>;
+using DesfireDataSpan = DesfireSpan<BYTE>;
+
 struct DesfireFile {
     BYTE                fileNo = 0;
     DesfireFileSettings settings;
     BYTEV               data;               // okuma sonrası cache
+    bool                settingsKnown = false;  // settings karttan/create'ten geldi mi
+
+    // Not: record dosyalarında settings.record.currentRecords bir anlık görüntüdür;
+    // CommitTransaction sonrası settingsKnown düşürülür.
 
     bool isEmpty() const { return data.empty(); }
 
+    DesfireDataView view() const { return { data.data(), data.size() }; }
+    DesfireDataSpan span()       { return { data.data(), data.size() }; }
+
     void allocate() {
         data.resize(settings.dataCapacity(), 0);
     }
@@ -272,6 +330,119 @@ struct DesfireKeyConfig {
     bool allowConfigChangeable()   const { return keySettings & 0x08; }
 };
 
+// ── Konum İndeksleri ────────────────────────────────────────────────────────
+//
+//   files[] / applications[] public vector olarak kalır (doğrudan push_back,
+//   atama vb. serbest). İndeks bağlı olduğu vector'ün data()/size() ikilisini
+//   saklar; değişmişse veya aday girdi eşleşmiyorsa sorgu indeksi yeniden
+//   kurar (O(n), eski doğrusal taramayla aynı). Kararlı listede sorgu O(1).
+//   Iskalamada da bir kez yeniden kurulup tekrar bakılır → yerinde
+//   değiştirilmiş listede yanlış "yok" dönmez.
+//
+//   const sorgular indeksi günceller (mutable): aynı model üzerinde
+//   eşzamanlı okuma için dış kilit gerekir.
+//
+
+// fileNo 0x00..0x1F → files[] konumu (doğrudan tablo)
+struct DesfireFileIndex {
+    static constexpr size_t SLOTS = 32;
+    static constexpr BYTE   NONE  = 0xFF;
+
+    std::array<BYTE, SLOTS> pos;
+    const void* base  = nullptr;
+    size_t      count = 0;
+
+    DesfireFileIndex() { pos.fill(NONE); }
+
+    // files[] içindeki konum, yoksa -1
+    template<typename Files>
+    int find(const Files& files, BYTE fileNo) {
+        if (fileNo >= SLOTS || files.size() >= NONE) return scan(files, fileNo);
+        if (base == files.data() && count == files.size()) {
+            const BYTE p = pos[fileNo];
+            if (p != NONE && p < files.size() && files[p].fileNo == fileNo) return p;
+        }
+        rebuild(files);
+        return pos[fileNo] == NONE ? -1 : pos[fileNo];
+    }
+
+    template<typename Files>
+    void rebuild(const Files& files) {
+        pos.fill(NONE);
+        for (size_t i = 0; i < files.size() && i < NONE; ++i) {
+            const BYTE no = files[i].fileNo;
+            if (no < SLOTS && pos[no] == NONE) pos[no] = static_cast<BYTE>(i);   // ilk eşleşme
+        }
+        base  = files.data();
+        count = files.size();
+    }
+
+    template<typename Files>
+    static int scan(const Files& files, BYTE fileNo) {
+        for (size_t i = 0; i < files.size(); ++i)
+            if (files[i].fileNo == fileNo) return static_cast<int>(i);
+        return -1;
+    }
+};
+
+// AID → applications[] konumu: 64 slotluk açık adresli tablo (28 app → yük ≤ %44)
+struct DesfireAppIndex {
+    static constexpr size_t SLOTS    = 64;
+    static constexpr size_t MAX_APPS = 32;      // üstünde doğrusal taramaya düşer
+    static constexpr BYTE   NONE     = 0xFF;
+
+    std::array<BYTE, SLOTS> pos;
+    const void* base  = nullptr;
+    size_t      count = 0;
+
+    DesfireAppIndex() { pos.fill(NONE); }
+
+    static size_t slotOf(const DesfireAID& aid) {
+        return (aid.toUint() * 0x9E3779B1u) >> 26;      // üst 6 bit (Fibonacci hash)
+    }
+
+    template<typename Apps>
+    int find(const Apps& apps, const DesfireAID& aid) {
+        if (apps.size() > MAX_APPS) return scan(apps, aid);
+        if (base == apps.data() && count == apps.size()) {
+            const int p = probe(apps, aid);
+            if (p >= 0) return p;
+        }
+        rebuild(apps);
+        return probe(apps, aid);
+    }
+
+    template<typename Apps>
+    void rebuild(const Apps& apps) {
+        pos.fill(NONE);
+        for (size_t i = 0; i < apps.size() && i < MAX_APPS; ++i) {
+            if (probe(apps, apps[i].aid) >= 0) continue;  // ilk eşleşme
+            size_t h = slotOf(apps[i].aid);
+            while (pos[h] != NONE) h = (h + 1) & (SLOTS - 1);
+            pos[h] = static_cast<BYTE>(i);
+        }
+        base  = apps.data();
+        count = apps.size();
+    }
+
+    template<typename Apps>
+    int probe(const Apps& apps, const DesfireAID& aid) const {
+        for (size_t h = slotOf(aid), n = 0; n < SLOTS; h = (h + 1) & (SLOTS - 1), ++n) {
+            const BYTE p = pos[h];
+            if (p == NONE) return -1;
+            if (p < apps.size() && apps[p].aid == aid) return p;
+        }
+        return -1;
+    }
+
+    template<typename Apps>
+    static int scan(const Apps& apps, const DesfireAID& aid) {
+        for (size_t i = 0; i < apps.size(); ++i)
+            if (apps[i].aid == aid) return static_cast<int>(i);
+        return -1;
+    }
+};
+
 // ── Uygulama — Key config + Dosyalar ────────────────────────────────────────
 //
 //   Classic'teki "sektör" karşılığı bir nevi — ama çok daha esnek.
@@ -282,25 +453,65 @@ struct DesfireApplication {
     DesfireAID       aid;
     DesfireKeyConfig keyConfig;
     std::vector<DesfireFile> files;         // max 32 dosya
+    bool             fileListKnown = false; // files[] kartın GetFileIDs listesiyle aynı mı
 
     // ── Dosya Sorguları ─────────────────────────────────────────────────────
 
+    // fileNo → konum doğrudan tablodan (bkz. DesfireFileIndex)
     DesfireFile* findFile(BYTE fileNo) {
-        for (auto& f : files) {
-            if (f.fileNo == fileNo) return &f;
-        }
-        return nullptr;
+        const int i = fileIndex_.find(files, fileNo);
+        return i < 0 ? nullptr : &files[i];
     }
 
     const DesfireFile* findFile(BYTE fileNo) const {
-        for (const auto& f : files) {
-            if (f.fileNo == fileNo) return &f;
-        }
-        return nullptr;
+        const int i = fileIndex_.find(files, fileNo);
+        return i < 0 ? nullptr : &files[i];
     }
 
+    int fileSlot(BYTE fileNo) const { return fileIndex_.find(files, fileNo); }
+
     bool hasFile(BYTE fileNo) const { return findFile(fileNo) != nullptr; }
 
+    // ── Metadata cache bakımı ───────────────────────────────────────────────
+
+    DesfireFile& ensureFile(BYTE fileNo) {
+        if (auto* f = findFile(fileNo)) return *f;
+        DesfireFile f;
+        f.fileNo = fileNo;
+        files.push_back(std::move(f));
+        return files.back();
+    }
+
+    bool removeFile(BYTE fileNo) {
+        auto it = std::find_if(files.begin(), files.end(),
+                               [fileNo](const DesfireFile& f) { return f.fileNo == fileNo; });
+        if (it == files.end()) return false;
+        files.erase(it);
+        return true;
+    }
+
+    // Kartın döndürdüğü ID listesiyle eşitle: listede olmayanlar silinir,
+    // yeni gelenler settingsKnown=false ile eklenir, bilinen settings korunur.
+    void syncFileIDs(const BYTEV& ids) {
+        files.erase(std::remove_if(files.begin(), files.end(), [&ids](const DesfireFile& f) {
+                        return std::find(ids.begin(), ids.end(), f.fileNo) == ids.end();
+                    }), files.end());
+        for (BYTE id : ids) ensureFile(id);
+        fileListKnown = true;
+    }
+
+    BYTEV fileIDs() const {
+        BYTEV ids;
+        ids.reserve(files.size());
+        for (const auto& f : files) ids.push_back(f.fileNo);
+        return ids;
+    }
+
+    void invalidateMetadata() {
+        fileListKnown = false;
+        for (auto& f : files) f.settingsKnown = false;
+    }
+
     // ── Toplam veri kapasitesi ──────────────────────────────────────────────
 
     uint32_t totalDataSize() const {
@@ -308,6 +519,9 @@ struct DesfireApplication {
         for (const auto& f : files) sum += f.settings.dataCapacity();
         return sum;
     }
+
+private:
+    mutable DesfireFileIndex fileIndex_;
 };
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -348,6 +562,7 @@ struct DesfireMemoryLayout {
     // ── Uygulamalar ─────────────────────────────────────────────────────────
 
     std::vector<DesfireApplication> applications;   // max 28
+    bool appListKnown = false;              // applications[] kartın GetApplicationIDs listesiyle aynı mı
 
     // ── Aktif bağlam (virtual block erişimi için) ───────────────────────────
 
@@ -365,32 +580,105 @@ struct DesfireMemoryLayout {
 
     // ── Uygulama Sorguları ──────────────────────────────────────────────────
 
+    // AID → konum açık adresli tablodan (bkz. DesfireAppIndex)
     DesfireApplication* findApp(const DesfireAID& aid) {
-        for (auto& a : applications) {
-            if (a.aid == aid) return &a;
-        }
-        return nullptr;
+        const int i = appIndex_.find(applications, aid);
+        return i < 0 ? nullptr : &applications[i];
     }
 
     const DesfireApplication* findApp(const DesfireAID& aid) const {
-        for (const auto& a : applications) {
-            if (a.aid == aid) return &a;
-        }
-        return nullptr;
+        const int i = appIndex_.find(applications, aid);
+        return i < 0 ? nullptr : &applications[i];
     }
 
     bool hasApp(const DesfireAID& aid) const { return findApp(aid) != nullptr; }
 
-    // ── Aktif bağlamdaki dosyaya erişim ─────────────────────────────────────
+    // ── Metadata cache bakımı ───────────────────────────────────────────────
+    //
+    //   CardIO discovery komutlarının (GetApplicationIDs / GetFileIDs /
+    //   GetFileSettings) sonuçlarını bu ağaca yazar ve tekrar sorulduğunda
+    //   karta gitmeden buradan cevaplar. Geçerlilik girdi başınadır:
+    //     appListKnown → fileListKnown → settingsKnown
+    //   Create/Delete/Format komutları ilgili girdiyi günceller veya siler.
+    //
+
+    DesfireApplication& ensureApp(const DesfireAID& aid) {
+        if (auto* a = findApp(aid)) return *a;
+        DesfireApplication a;
+        a.aid = aid;
+        applications.push_back(std::move(a));
+        return applications.back();
+    }
+
+    bool removeApp(const DesfireAID& aid) {
+        auto it = std::find_if(applications.begin(), applications.end(),
+                               [&aid](const DesfireApplication& a) { return a.aid == aid; });
+        if (it == applications.end()) return false;
+        applications.erase(it);
+        return true;
+    }
+
+    void syncAppIDs(const std::vector<DesfireAID>& ids) {
+        applications.erase(std::remove_if(applications.begin(), applications.end(),
+                               [&ids](const DesfireApplication& a) {
+                                   return std::find(ids.begin(), ids.end(), a.aid) == ids.end();
+                               }), applications.end());
+        for (const auto& id : ids) ensureApp(id);
+        appListKnown = true;
+    }
+
+    std::vector<DesfireAID> appIDs() const {
+        std::vector<DesfireAID> ids;
+        ids.reserve(applications.size());
+        for (const auto& a : applications) ids.push_back(a.aid);
+        return ids;
+    }
+
+    // Tüm geçerlilik bayraklarını düşür (girdiler ipucu olarak kalır)
+    void invalidateMetadata() {
+        appListKnown = false;
+        for (auto& a : applications) a.invalidateMetadata();
+    }
+
+    // Kart boşaltıldı (FormatPICC): liste kesin olarak boş
+    void resetApplications() {
+        applications.clear();
+        appListKnown = true;
+    }
+
+    // ── Aktif bağlam ────────────────────────────────────────────────────────
+    //
+    //   selectApplication / selectFile bağlamı değiştirir ve aktif dosyanın
+    //   konumunu önbelleğe alır. activeFile() önbelleği O(1) doğrular
+    //   (konum sınırda mı, AID / fileNo hâlâ eşleşiyor mu); currentAID /
+    //   currentFile doğrudan değiştirilmişse veya liste değişmişse indeksle
+    //   yeniden çözülür.
+    //
+
+    void selectApplication(const DesfireAID& aid) {
+        currentAID = aid;
+        resolveActive();
+    }
+
+    void selectFile(BYTE fileNo) {
+        currentFile = fileNo;
+        resolveActive();
+    }
 
     DesfireFile* activeFile() {
-        auto* app = findApp(currentAID);
-        return app ? app->findFile(currentFile) : nullptr;
+        return const_cast<DesfireFile*>(static_cast<const DesfireMemoryLayout&>(*this).activeFile());
     }
 
     const DesfireFile* activeFile() const {
-        const auto* app = findApp(currentAID);
-        return app ? app->findFile(currentFile) : nullptr;
+        const ActiveCache& c = active_;
+        if (c.app >= 0 && c.aid == currentAID && c.fileNo == currentFile
+            && static_cast<size_t>(c.app) < applications.size()) {
+            const DesfireApplication& app = applications[c.app];
+            if (app.aid == currentAID && static_cast<size_t>(c.file) < app.files.size()
+                && app.files[c.file].fileNo == currentFile)
+                return &app.files[c.file];
+        }
+        return resolveActive();
     }
 
     // ── Virtual Block Erişimi ───────────────────────────────────────────────
@@ -404,37 +692,80 @@ struct DesfireMemoryLayout {
     //
 
     int virtualBlockCount() const {
+        return static_cast<int>(activeView().blockCount());
+    }
+
+    // ── Kopyasız görünümler ─────────────────────────────────────────────────
+    //
+    //   Aktif dosyanın tamamı veya [first, first + count) blok aralığı;
+    //   aktif dosya yoksa / aralık dışındaysa boş. Son blok kısa olabilir
+    //   (dolgu yok — readVirtualBlock'tan farkı).
+    //
+
+    DesfireDataView activeView() const {
         const auto* f = activeFile();
-        if (!f || f->data.empty()) return 0;
-        return static_cast<int>((f->data.size() + 15) / 16);
+        return f ? f->view() : DesfireDataView{};
+    }
+
+    DesfireDataSpan activeSpan() {
+        auto* f = activeFile();
+        return f ? f->span() : DesfireDataSpan{};
+    }
+
+    DesfireDataView virtualBlockView(int first, int count = 1) const {
+        if (first < 0 || count <= 0) return {};
+        return activeView().subspan(static_cast<size_t>(first) * DesfireDataView::BLOCK,
+                                    static_cast<size_t>(count) * DesfireDataView::BLOCK);
+    }
+
+    DesfireDataSpan virtualBlockSpan(int first, int count = 1) {
+        if (first < 0 || count <= 0) return {};
+        return activeSpan().subspan(static_cast<size_t>(first) * DesfireDataSpan::BLOCK,
+                                    static_cast<size_t>(count) * DesfireDataSpan::BLOCK);
     }
 
     // 16-byte virtual block'u hedefe kopyala; kısa blokta kalan byte sıfır
     bool readVirtualBlock(int blockIndex, BYTE out[16]) const {
-        const auto* f = activeFile();
-        if (!f) return false;
-
-        size_t offset = static_cast<size_t>(blockIndex) * 16;
-        if (offset >= f->data.size()) return false;
+        const DesfireDataView b = virtualBlockView(blockIndex);
+        if (b.empty()) return false;
 
-        std::memset(out, 0, 16);
-        size_t toCopy = std::min<size_t>(16, f->data.size() - offset);
-        std::memcpy(out, f->data.data() + offset, toCopy);
+        std::memcpy(out, b.data(), b.size());
+        if (b.size() < 16) std::memset(out + b.size(), 0, 16 - b.size());
         return true;
     }
 
     // 16-byte virtual block yaz
     bool writeVirtualBlock(int blockIndex, const BYTE in[16]) {
-        auto* f = activeFile();
-        if (!f) return false;
-
-        size_t offset = static_cast<size_t>(blockIndex) * 16;
-        if (offset >= f->data.size()) return false;
+        const DesfireDataSpan b = virtualBlockSpan(blockIndex);
+        if (b.empty()) return false;
 
-        size_t toCopy = std::min<size_t>(16, f->data.size() - offset);
-        std::memcpy(f->data.data() + offset, in, toCopy);
+        std::memcpy(b.data(), in, b.size());
         return true;
     }
+
+private:
+    struct ActiveCache {
+        DesfireAID aid;
+        BYTE fileNo = 0;
+        int  app  = -1;         // applications[] konumu (-1 → geçersiz)
+        int  file = -1;         // files[] konumu
+    };
+
+    mutable DesfireAppIndex appIndex_;
+    mutable ActiveCache     active_;
+
+    const DesfireFile* resolveActive() const {
+        active_ = ActiveCache{};
+        const int a = appIndex_.find(applications, currentAID);
+        if (a < 0) return nullptr;
+        const int f = applications[a].fileSlot(currentFile);
+        if (f < 0) return nullptr;
+        active_.aid    = currentAID;
+        active_.fileNo = currentFile;
+        active_.app    = a;
+        active_.file   = f;
+        return &applications[a].files[f];
+    }
 };
 
 #endif // DESFIREMEMORYLAYOUT_H
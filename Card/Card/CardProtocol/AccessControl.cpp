@@ -49,32 +49,20 @@ static int sectorOf(int block, bool is4K) {
 // ════════════════════════════════════════════════════════════════════════════════
 
 bool AccessControl::canReadDataBlock(int sector, KeyType kt) const {
-    ACCESSBYTES bits = getAccessBits(sector);
-    SectorAccessConfig cfg = getSectorConfig(bits);
     // Tüm data blokları aynı izinde mi diye bakıyoruz, block 0 kullanıyoruz
-    DataBlockPermission perm = cfg.dataPermission(0);
-    return perm.canRead(kt);
+    return hasPermission(sector, 0, kt, false);
 }
 
 bool AccessControl::canWriteDataBlock(int sector, KeyType kt) const {
-    ACCESSBYTES bits = getAccessBits(sector);
-    SectorAccessConfig cfg = getSectorConfig(bits);
-    DataBlockPermission perm = cfg.dataPermission(0);
-    return perm.canWrite(kt);
+    return hasPermission(sector, 0, kt, true);
 }
 
 bool AccessControl::canReadTrailer(int sector, KeyType kt) const {
-    ACCESSBYTES bits = getAccessBits(sector);
-    SectorAccessConfig cfg = getSectorConfig(bits);
-    TrailerPermission perm = cfg.trailerPermission();
-    return perm.canRead(kt);
+    return hasPermission(sector, TRAILER_SLOT, kt, false);
 }
 
 bool AccessControl::canWriteTrailer(int sector, KeyType kt) const {
-    ACCESSBYTES bits = getAccessBits(sector);
-    SectorAccessConfig cfg = getSectorConfig(bits);
-    TrailerPermission perm = cfg.trailerPermission();
-    return perm.canWrite(kt);
+    return hasPermission(sector, TRAILER_SLOT, kt, true);
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -84,31 +72,73 @@ bool AccessControl::canWriteTrailer(int sector, KeyType kt) const {
 bool AccessControl::canRead(int block, KeyType kt) const {
     int sector = sectorOf(block, cardMemory_.is4K());
     int idxInSec = blockInSector(block, cardMemory_.is4K());
-    ACCESSBYTES bits = getAccessBits(sector);
-    SectorAccessConfig cfg = getSectorConfig(bits);
 
     // Trailer blok: sektördeki son blok
     int bps = cardMemory_.is4K() ? (sector < 32 ? 4 : 16) : 4;
     if (idxInSec == bps - 1) {
-        return cfg.trailerPermission().canRead(kt);
+        return hasPermission(sector, TRAILER_SLOT, kt, false);
     }
     // Data blok (4K extended: index 0-14 hepsi aynı access → min(idx,2) kullan)
     int dataIdx = (idxInSec < 3) ? idxInSec : 2;
-    return cfg.dataPermission(dataIdx).canRead(kt);
+    return hasPermission(sector, dataIdx, kt, false);
 }
 
 bool AccessControl::canWrite(int block, KeyType kt) const {
     int sector = sectorOf(block, cardMemory_.is4K());
     int idxInSec = blockInSector(block, cardMemory_.is4K());
-    ACCESSBYTES bits = getAccessBits(sector);
-    SectorAccessConfig cfg = getSectorConfig(bits);
 
     int bps = cardMemory_.is4K() ? (sector < 32 ? 4 : 16) : 4;
     if (idxInSec == bps - 1) {
-        return cfg.trailerPermission().canWrite(kt);
+        return hasPermission(sector, TRAILER_SLOT, kt, true);
     }
     int dataIdx = (idxInSec < 3) ? idxInSec : 2;
-    return cfg.dataPermission(dataIdx).canWrite(kt);
+    return hasPermission(sector, dataIdx, kt, true);
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Permission Cache
+// ════════════════════════════════════════════════════════════════════════════════
+
+void AccessControl::invalidate(int sector) {
+    if (sector >= 0 && sector < MAX_SECTORS)
+        permValid_ &= ~(uint64_t(1) << sector);
+}
+
+void AccessControl::invalidateAll() {
+    permValid_ = 0;
+}
+
+uint16_t AccessControl::permissions(int sector) const {
+    if (sector < 0 || sector >= MAX_SECTORS)
+        return buildPermissions(getAccessBits(sector));
+
+    const uint64_t mask = uint64_t(1) << sector;
+    if (!(permValid_ & mask)) {
+        perm_[sector] = buildPermissions(getAccessBits(sector));
+        permValid_ |= mask;
+    }
+    return perm_[sector];
+}
+
+uint16_t AccessControl::buildPermissions(const ACCESSBYTES& bits) {
+    SectorAccessConfig cfg = getSectorConfig(bits);
+    uint16_t m = 0;
+    auto set = [&m](int slot, KeyType kt, bool isWrite, bool allowed) {
+        if (allowed) m |= static_cast<uint16_t>(1u << permBit(slot, kt, isWrite));
+    };
+    for (int slot = 0; slot < 3; ++slot) {
+        DataBlockPermission dp = cfg.dataPermission(slot);
+        for (KeyType kt : { KeyType::A, KeyType::B }) {
+            set(slot, kt, false, dp.canRead(kt));
+            set(slot, kt, true,  dp.canWrite(kt));
+        }
+    }
+    TrailerPermission tp = cfg.trailerPermission();
+    for (KeyType kt : { KeyType::A, KeyType::B }) {
+        set(TRAILER_SLOT, kt, false, tp.canRead(kt));
+        set(TRAILER_SLOT, kt, true,  tp.canWrite(kt));
+    }
+    return m;
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -271,4 +301,5 @@ void AccessControl::writeAccessBits(int sector, const ACCESSBYTES& bits) {
         trailer = &cardMemory_.data.card1K.detailed.sector[sector].trailerBlock;
     }
     std::memcpy(trailer->trailer.accessBits, bits.data(), 4);
+    invalidate(sector);
 }
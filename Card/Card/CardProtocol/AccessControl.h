@@ -3,6 +3,7 @@
 
 #include "../CardDataTypes.h"
 #include <array>
+#include <cstdint>
 #include <string>
 
 // Forward declares
@@ -29,6 +30,16 @@ struct MifareBlock;
 // 2. Decodes permissions
 // 3. Checks if operation is allowed
 //
+// Permission Cache:
+// Decode edilmiş izinler sektör başına 16-bit maskede tutulur:
+//   bit = slot*4 + (KeyB ? 2 : 0) + (write ? 1 : 0)
+//   slot 0..2 = data blok 0..2, slot 3 = trailer (access bits R/W)
+// Maske ilk sorguda hesaplanır ve yalnızca trailer değiştiğinde düşürülür:
+//   - kendi writeAccessBits() yazımları     → otomatik
+//   - CardInterface::loadMemory()           → invalidateAll()
+//   - CardIO trailer okuma/yazma            → invalidate(sector)
+// Trailer'ı ham bellek üzerinden değiştiren kod invalidate() çağırmalıdır.
+//
 // ════════════════════════════════════════════════════════════════════════════════
 
 class AccessControl {
@@ -59,6 +70,22 @@ public:
     bool canRead(int block, KeyType kt) const;
     bool canWrite(int block, KeyType kt) const;
 
+    // ────────────────────────────────────────────────────────────────────────────
+    // Permission Cache
+    // ────────────────────────────────────────────────────────────────────────────
+
+    // Trailer memory'de değişti → sektörün decode edilmiş izinlerini düşür
+    void invalidate(int sector);
+    void invalidateAll();
+
+    // Cache'i dışarıda tutan kod için (ör. CompactCardStore): access bitleri
+    // yukarıdaki 16-bit maskeye decode et / maskeyi sorgula.
+    static constexpr int TRAILER_SLOT = 3;
+    static uint16_t decodePermissions(const ACCESSBYTES& bits) { return buildPermissions(bits); }
+    static bool maskAllows(uint16_t mask, int slot, KeyType kt, bool isWrite) {
+        return (mask >> permBit(slot, kt, isWrite)) & 1u;
+    }
+
     // ────────────────────────────────────────────────────────────────────────────
     // Permission Setting (Modify access bits)
     // ────────────────────────────────────────────────────────────────────────────
@@ -100,6 +127,21 @@ public:
 private:
     CardMemoryLayout& cardMemory_;
 
+    static constexpr int MAX_SECTORS  = 40;
+
+    mutable std::array<uint16_t, MAX_SECTORS> perm_{};
+    mutable uint64_t                          permValid_ = 0;   // bit s → perm_[s] geçerli
+
+    // Sektör maskesi (gerekirse decode edip cache'ler)
+    uint16_t permissions(int sector) const;
+    static uint16_t buildPermissions(const ACCESSBYTES& bits);
+    static int permBit(int slot, KeyType kt, bool isWrite) {
+        return slot * 4 + (kt == KeyType::B ? 2 : 0) + (isWrite ? 1 : 0);
+    }
+    bool hasPermission(int sector, int slot, KeyType kt, bool isWrite) const {
+        return (permissions(sector) >> permBit(slot, kt, isWrite)) & 1u;
+    }
+
     // Helper: write access bits to trailer in memory
     void writeAccessBits(int sector, const ACCESSBYTES& bits);
 
@@ -4,15 +4,23 @@
 #include <iostream>
 #include <algorithm>
 
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
 // ════════════════════════════════════════════════════════════════════════════════
 // Construction
 // ════════════════════════════════════════════════════════════════════════════════
 
 AuthenticationState::AuthenticationState(const CardMemoryLayout& cardMemory,
-                                         std::chrono::milliseconds defaultTimeout)
+                                         milliseconds defaultTimeout)
     : cardMemory_(cardMemory), 
-      defaultTimeout_(defaultTimeout),
+      defaultTimeoutMs_(defaultTimeout.count()),
       cachingEnabled_(true) {
+    for (int s = 0; s < MAX_SECTORS; ++s) {
+        slots_[s].store(0, std::memory_order_relaxed);
+        timeoutMs_[s].store(defaultTimeout.count(), std::memory_order_relaxed);
+    }
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -25,105 +33,119 @@ void AuthenticationState::markAuthenticated(int sector, KeyType kt) {
 			"Invalid sector: " + std::to_string(sector)).throwIfError();
 		return;
 	}
-    else if (cachingEnabled_) {
-        sessions_[sector] = AuthSession(sector, kt, defaultTimeout_);
+    else if (cachingEnabled_.load(std::memory_order_relaxed)) {
+        store(sector, kt == KeyType::B,
+              defaultTimeoutMs_.load(std::memory_order_relaxed), nowTicks());
     }
 }
 
 void AuthenticationState::invalidate(int sector) {
     if (isValidSector(sector)) {
-        sessions_.erase(sector);
+        slots_[sector].store(0, std::memory_order_release);
     }
 }
 
 void AuthenticationState::clearAll() {
-    sessions_.clear();
+    for (auto& slot : slots_) slot.store(0, std::memory_order_release);
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
 // Authentication Queries
 // ════════════════════════════════════════════════════════════════════════════════
+// Geçersiz sektörler için slot hep 0'dır (markAuthenticated reddeder); bu
+// yüzden sorgularda yalnızca dizi sınırı kontrol edilir.
 
 bool AuthenticationState::isAuthenticated(int sector) const {
-    if (!cachingEnabled_) return false;
-    
-    auto it = sessions_.find(sector);
-    if (it == sessions_.end()) return false;
-    
-    return !it->second.isExpired();
+    if (static_cast<unsigned>(sector) >= MAX_SECTORS) return false;
+    return isLive(slots_[sector].load(std::memory_order_acquire), nowTicks());
 }
 
 bool AuthenticationState::isAuthenticatedWith(int sector, KeyType kt) const {
-    if (!isAuthenticated(sector)) return false;
-    
-    auto it = sessions_.find(sector);
-    return it->second.keyUsed == kt;
+    if (static_cast<unsigned>(sector) >= MAX_SECTORS) return false;
+    const uint64_t slot = slots_[sector].load(std::memory_order_acquire);
+    return isLive(slot, nowTicks()) && ((slot & KEY_B_BIT) != 0) == (kt == KeyType::B);
 }
 
-const AuthSession* AuthenticationState::getSession(int sector) const {
-    auto it = sessions_.find(sector);
-    if (it == sessions_.end()) return nullptr;
-    
-    if (it->second.isExpired()) {
-        return nullptr;
-    }
-    
-    return &it->second;
+std::optional<AuthSession> AuthenticationState::getSession(int sector) const {
+    if (static_cast<unsigned>(sector) >= MAX_SECTORS) return std::nullopt;
+    const uint64_t slot = slots_[sector].load(std::memory_order_acquire);
+    if (!isLive(slot, nowTicks())) return std::nullopt;
+
+    AuthSession session;
+    session.sector   = sector;
+    session.keyUsed  = (slot & KEY_B_BIT) ? KeyType::B : KeyType::A;
+    session.timeout  = milliseconds(timeoutMs_[sector].load(std::memory_order_relaxed));
+    session.authTime = steady_clock::time_point(
+        std::chrono::duration_cast<steady_clock::duration>(nanoseconds(slot & DEADLINE_MASK)))
+        - session.timeout;
+    session.isValid  = true;
+    return session;
 }
 
-const KeyType* AuthenticationState::getAuthenticatedKey(int sector) const {
-    auto session = getSession(sector);
-    if (session == nullptr) return nullptr;
-    return &session->keyUsed;
+std::optional<KeyType> AuthenticationState::getAuthenticatedKey(int sector) const {
+    if (static_cast<unsigned>(sector) >= MAX_SECTORS) return std::nullopt;
+    const uint64_t slot = slots_[sector].load(std::memory_order_acquire);
+    if (!isLive(slot, nowTicks())) return std::nullopt;
+    return (slot & KEY_B_BIT) ? KeyType::B : KeyType::A;
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
 // Batch Queries
 // ════════════════════════════════════════════════════════════════════════════════
 
+uint64_t AuthenticationState::authenticatedMask() const {
+    const uint64_t now = nowTicks();
+    uint64_t mask = 0;
+    for (int s = 0; s < MAX_SECTORS; ++s) {
+        if (isLive(slots_[s].load(std::memory_order_acquire), now))
+            mask |= 1ull << s;
+    }
+    return mask;
+}
+
 std::vector<int> AuthenticationState::getAuthenticatedSectors() const {
     std::vector<int> result;
-    for (const auto& pair : sessions_) {
-        if (!pair.second.isExpired()) {
-            result.push_back(pair.first);
-        }
+    const uint64_t mask = authenticatedMask();
+    for (int s = 0; s < MAX_SECTORS; ++s) {
+        if (mask & (1ull << s)) result.push_back(s);
     }
     return result;
 }
 
 void AuthenticationState::printAuthenticationStatus() const {
+    const uint64_t now = nowTicks();
+    int stored = 0;
+    for (const auto& slot : slots_)
+        if (slot.load(std::memory_order_acquire) & VALID_BIT) ++stored;
+
     std::cout << "=== Authentication Status ===\n";
-    std::cout << "Caching: " << (cachingEnabled_ ? "Enabled" : "Disabled") << "\n";
-    std::cout << "Sessions: " << sessions_.size() << " stored\n\n";
+    std::cout << "Caching: " << (isCachingEnabled() ? "Enabled" : "Disabled") << "\n";
+    std::cout << "Sessions: " << stored << " stored\n\n";
     
-    if (sessions_.empty()) {
+    if (stored == 0) {
         std::cout << "No authenticated sectors\n";
         return;
     }
     
     int sectorCount = cardMemory_.is4K() ? 40 : 16;
     for (int s = 0; s < sectorCount; ++s) {
-        auto it = sessions_.find(s);
-        if (it != sessions_.end()) {
-            std::cout << "Sector " << s << ": ";
-            if (it->second.isExpired()) {
-                std::cout << "EXPIRED (";
-            } else {
-                std::cout << "AUTH (" << (it->second.keyUsed == KeyType::A ? "A" : "B") << ", ";
-                auto remaining = getTimeRemaining(s);
-                std::cout << remaining.count() << "ms remaining)\n";
-            }
+        const uint64_t slot = slots_[s].load(std::memory_order_acquire);
+        if (!(slot & VALID_BIT)) continue;
+        std::cout << "Sector " << s << ": ";
+        if (!isLive(slot, now)) {
+            std::cout << "EXPIRED\n";
+        } else {
+            std::cout << "AUTH (" << ((slot & KEY_B_BIT) ? "B" : "A") << ", ";
+            auto remaining = getTimeRemaining(s);
+            std::cout << remaining.count() << "ms remaining)\n";
         }
     }
 }
 
 int AuthenticationState::countAuthenticated() const {
+    uint64_t mask = authenticatedMask();
     int count = 0;
-    for (const auto& pair : sessions_) {
-        if (!pair.second.isExpired()) {
-            count++;
-        }
-    }
+    for (; mask; mask &= mask - 1) ++count;
     return count;
 }
 
@@ -131,27 +153,26 @@ int AuthenticationState::countAuthenticated() const {
 // Configuration
 // ════════════════════════════════════════════════════════════════════════════════
 
-void AuthenticationState::setDefaultTimeout(std::chrono::milliseconds timeout) {
-    defaultTimeout_ = timeout;
+void AuthenticationState::setDefaultTimeout(milliseconds timeout) {
+    defaultTimeoutMs_.store(timeout.count(), std::memory_order_relaxed);
 }
 
-void AuthenticationState::setSectorTimeout(int sector, std::chrono::milliseconds timeout) {
-    auto it = sessions_.find(sector);
-    if (it != sessions_.end()) {
-        it->second.timeout = timeout;
-        it->second.refresh();
-    }
+void AuthenticationState::setSectorTimeout(int sector, milliseconds timeout) {
+    if (static_cast<unsigned>(sector) >= MAX_SECTORS) return;
+    const uint64_t slot = slots_[sector].load(std::memory_order_relaxed);
+    if (slot & VALID_BIT)
+        store(sector, (slot & KEY_B_BIT) != 0, timeout.count(), nowTicks());
 }
 
 void AuthenticationState::enableCaching(bool enable) {
-    cachingEnabled_ = enable;
+    cachingEnabled_.store(enable, std::memory_order_relaxed);
     if (!enable) {
         clearAll();
     }
 }
 
 bool AuthenticationState::isCachingEnabled() const {
-    return cachingEnabled_;
+    return cachingEnabled_.load(std::memory_order_relaxed);
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -159,34 +180,29 @@ bool AuthenticationState::isCachingEnabled() const {
 // ════════════════════════════════════════════════════════════════════════════════
 
 void AuthenticationState::refresh(int sector) {
-    auto it = sessions_.find(sector);
-    if (it != sessions_.end()) {
-        it->second.refresh();
-    }
+    if (static_cast<unsigned>(sector) >= MAX_SECTORS) return;
+    const uint64_t slot = slots_[sector].load(std::memory_order_relaxed);
+    if (slot & VALID_BIT)
+        store(sector, (slot & KEY_B_BIT) != 0,
+              timeoutMs_[sector].load(std::memory_order_relaxed), nowTicks());
 }
 
 void AuthenticationState::removeExpiredSessions() {
-    std::vector<int> toRemove;
-    for (const auto& pair : sessions_) {
-        if (pair.second.isExpired()) {
-            toRemove.push_back(pair.first);
-        }
-    }
-    for (int sector : toRemove) {
-        sessions_.erase(sector);
+    const uint64_t now = nowTicks();
+    for (auto& slot : slots_) {
+        const uint64_t v = slot.load(std::memory_order_relaxed);
+        if ((v & VALID_BIT) && !isLive(v, now))
+            slot.store(0, std::memory_order_release);
     }
 }
 
-std::chrono::milliseconds AuthenticationState::getTimeRemaining(int sector) const {
-    auto it = sessions_.find(sector);
-    if (it == sessions_.end()) return std::chrono::milliseconds(0);
-    
-    auto now = std::chrono::system_clock::now();
-    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - it->second.authTime);
-    auto remaining = it->second.timeout - elapsed;
-    
-    if (remaining.count() < 0) return std::chrono::milliseconds(0);
-    return remaining;
+milliseconds AuthenticationState::getTimeRemaining(int sector) const {
+    if (static_cast<unsigned>(sector) >= MAX_SECTORS) return milliseconds(0);
+    const uint64_t slot = slots_[sector].load(std::memory_order_acquire);
+    const uint64_t now  = nowTicks();
+    if (!isLive(slot, now)) return milliseconds(0);
+    return std::chrono::duration_cast<milliseconds>(
+        nanoseconds((slot & DEADLINE_MASK) - now));
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -197,3 +213,20 @@ bool AuthenticationState::isValidSector(int sector) const {
     int maxSector = cardMemory_.is4K() ? 40 : 16;
     return sector >= 0 && sector < maxSector;
 }
+
+uint64_t AuthenticationState::nowTicks() noexcept {
+    auto ns = std::chrono::duration_cast<nanoseconds>(steady_clock::now().time_since_epoch());
+    return static_cast<uint64_t>(ns.count()) & DEADLINE_MASK;
+}
+
+void AuthenticationState::store(int sector, bool keyB, int64_t timeoutMs, uint64_t now) noexcept {
+    if (timeoutMs < 0) timeoutMs = 0;
+    // milliseconds::max() ("süresiz") çarpımda taşıp geçmişe düşmesin
+    constexpr int64_t MAX_TIMEOUT_MS = static_cast<int64_t>(DEADLINE_MASK / 1000000ull);
+    if (timeoutMs > MAX_TIMEOUT_MS) timeoutMs = MAX_TIMEOUT_MS;
+    const uint64_t deadline =
+        std::min<uint64_t>(now + static_cast<uint64_t>(timeoutMs) * 1000000ull, DEADLINE_MASK);
+    timeoutMs_[sector].store(timeoutMs, std::memory_order_relaxed);
+    slots_[sector].store(VALID_BIT | (keyB ? KEY_B_BIT : 0) | deadline,
+                         std::memory_order_release);
+}
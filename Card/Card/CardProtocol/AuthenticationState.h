@@ -2,8 +2,12 @@
 #define AUTHENTICATIONSTATE_H
 
 #include "../CardDataTypes.h"
-#include <map>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
 
 // Forward declare
 struct CardMemoryLayout;
@@ -24,12 +28,23 @@ struct CardMemoryLayout;
 // 3. After sector change: invalidate old sector
 // 4. Timeout handling: automatic expiry
 //
+// Tasarım Notu:
+// - Sektör başına sabit slot (MAX_SECTORS = 40, 4K üst sınırı) → heap yok,
+//   sorgu = tek atomic load + tek karşılaştırma.
+// - Zaman damgaları steady_clock: duvar saati ileri/geri alınsa da oturum
+//   yanlışlıkla düşmez / uzamaz.
+// - Slot tek 64-bit kelimeye paketlenir:
+//     bit 63 valid | bit 62 key B | bit 0-61 deadline (steady_clock ns)
+//   Böylece okuyucu valid/key/deadline'ı tutarlı tek seferde görür.
+// - Thread modeli: tek yazıcı (I/O thread), çok okuyucu (ör. monitoring
+//   thread). Sorgular kilitsizdir; yazıcılar arasında senkronizasyon yoktur.
+//
 // ════════════════════════════════════════════════════════════════════════════════
 
 struct AuthSession {
     int sector;                                          // Which sector
     KeyType keyUsed;                                     // Key A or B
-    std::chrono::system_clock::time_point authTime;     // When authenticated
+    std::chrono::steady_clock::time_point authTime;     // When authenticated
     std::chrono::milliseconds timeout;                  // How long valid
     bool isValid;                                        // Explicitly valid/invalid
 
@@ -37,26 +52,28 @@ struct AuthSession {
     
     AuthSession(int s, KeyType kt, std::chrono::milliseconds t)
         : sector(s), keyUsed(kt), timeout(t), isValid(true) {
-        authTime = std::chrono::system_clock::now();
+        authTime = std::chrono::steady_clock::now();
     }
 
     // Check if session has expired
     bool isExpired() const {
         if (!isValid) return true;
-        auto now = std::chrono::system_clock::now();
+        auto now = std::chrono::steady_clock::now();
         auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - authTime);
         return elapsed > timeout;
     }
 
     // Reset timeout
     void refresh() {
-        authTime = std::chrono::system_clock::now();
+        authTime = std::chrono::steady_clock::now();
         isValid = true;
     }
 };
 
 class AuthenticationState {
 public:
+    static constexpr int MAX_SECTORS = 40;
+
     // ────────────────────────────────────────────────────────────────────────────
     // Constructor
     // ────────────────────────────────────────────────────────────────────────────
@@ -64,6 +81,9 @@ public:
     explicit AuthenticationState(const CardMemoryLayout& cardMemory,
                                  std::chrono::milliseconds defaultTimeout = std::chrono::milliseconds(5000));
 
+    AuthenticationState(const AuthenticationState&) = delete;
+    AuthenticationState& operator=(const AuthenticationState&) = delete;
+
     // ────────────────────────────────────────────────────────────────────────────
     // Authentication Management
     // ────────────────────────────────────────────────────────────────────────────
@@ -78,7 +98,7 @@ public:
     void clearAll();
 
     // ────────────────────────────────────────────────────────────────────────────
-    // Authentication Queries
+    // Authentication Queries (lock-free, herhangi bir thread'den çağrılabilir)
     // ────────────────────────────────────────────────────────────────────────────
 
     // Is sector currently authenticated?
@@ -87,11 +107,11 @@ public:
     // Is sector authenticated with specific key?
     bool isAuthenticatedWith(int sector, KeyType kt) const;
 
-    // Get current session info
-    const AuthSession* getSession(int sector) const;
+    // Get current session info (snapshot; expired/yok → nullopt)
+    std::optional<AuthSession> getSession(int sector) const;
 
     // Get authenticated key type (if authenticated)
-    const KeyType* getAuthenticatedKey(int sector) const;
+    std::optional<KeyType> getAuthenticatedKey(int sector) const;
 
     // ────────────────────────────────────────────────────────────────────────────
     // Batch Queries
@@ -100,6 +120,9 @@ public:
     // Get all authenticated sectors
     std::vector<int> getAuthenticatedSectors() const;
 
+    // Bit s set → sektör s authenticated (tek now() okumasıyla snapshot)
+    uint64_t authenticatedMask() const;
+
     // Get authentication status for all sectors
     void printAuthenticationStatus() const;
 
@@ -135,12 +158,17 @@ public:
     std::chrono::milliseconds getTimeRemaining(int sector) const;
 
 private:
+    static constexpr uint64_t VALID_BIT     = 1ull << 63;
+    static constexpr uint64_t KEY_B_BIT     = 1ull << 62;
+    static constexpr uint64_t DEADLINE_MASK = KEY_B_BIT - 1;
+
     const CardMemoryLayout& cardMemory_;
-    std::chrono::milliseconds defaultTimeout_;
-    bool cachingEnabled_;
+    std::atomic<int64_t> defaultTimeoutMs_;
+    std::atomic<bool>    cachingEnabled_;
 
-    // Storage: Sector -> AuthSession
-    std::map<int, AuthSession> sessions_;
+    // Storage: sector → paketlenmiş slot / slot timeout'u (ms)
+    std::array<std::atomic<uint64_t>, MAX_SECTORS> slots_;
+    std::array<std::atomic<int64_t>,  MAX_SECTORS> timeoutMs_;
 
     // ────────────────────────────────────────────────────────────────────────────
     // Internal Helpers
@@ -148,6 +176,15 @@ private:
 
     // Check if sector is valid for card
     bool isValidSector(int sector) const;
+
+    // Monotonic saat → ns (deadline alanı)
+    static uint64_t nowTicks() noexcept;
+
+    static bool isLive(uint64_t slot, uint64_t now) noexcept {
+        return (slot & VALID_BIT) && now <= (slot & DEADLINE_MASK);
+    }
+
+    void store(int sector, bool keyB, int64_t timeoutMs, uint64_t now) noexcept;
 };
 
 #endif // AUTHENTICATIONSTATE_H
@@ -1,28 +1,49 @@
 #include "DesfireAuth.h"
 #include "DesfireCrypto.h"
 #include "BlockCipher.h"
+#include <algorithm>
+#include <cstring>
 
 // ════════════════════════════════════════════════════════════════════════════════
 // APDU Construction
 // ════════════════════════════════════════════════════════════════════════════════
 
 BYTEV DesfireAuth::buildAuthCmd(BYTE keyNo, DesfireKeyType keyType) {
+	BYTEV apdu;
+	buildAuthCmdInto(apdu, keyNo, keyType);
+	return apdu;
+}
+
+void DesfireAuth::buildAuthCmdInto(BYTEV& apdu, BYTE keyNo, DesfireKeyType keyType) {
 	BYTE ins = (keyType == DesfireKeyType::AES128) ? CMD_AUTH_AES : CMD_AUTH_ISO;
-	return { 0x90, ins, 0x00, 0x00, 0x01, keyNo, 0x00 };
+	const BYTE cmd[] = { 0x90, ins, 0x00, 0x00, 0x01, keyNo, 0x00 };
+	apdu.assign(cmd, cmd + sizeof(cmd));
+}
+
+BYTEV DesfireAuth::buildAuthEV2Cmd(BYTE keyNo, bool first) {
+	if (first)
+		return { 0x90, CMD_AUTH_EV2_FIRST, 0x00, 0x00, 0x02, keyNo, 0x00, 0x00 };   // LenCap = 0
+	return { 0x90, CMD_AUTH_EV2_NONFIRST, 0x00, 0x00, 0x01, keyNo, 0x00 };
 }
 
 BYTEV DesfireAuth::buildAdditionalFrame(const BYTEV& payload) {
 	BYTEV apdu;
-	apdu.push_back(0x90);
-	apdu.push_back(CMD_MORE_DATA);
-	apdu.push_back(0x00);
-	apdu.push_back(0x00);
-	apdu.push_back(static_cast<BYTE>(payload.size()));
-	apdu.insert(apdu.end(), payload.begin(), payload.end());
-	apdu.push_back(0x00);
+	buildAdditionalFrameInto(apdu, payload.data(), payload.size());
 	return apdu;
 }
 
+void DesfireAuth::buildAdditionalFrameInto(BYTEV& apdu, const BYTE* payload, size_t len) {
+	// Kapasite yetiyorsa yeniden ayırma yok (auth tamponu oturumlar arası korunur)
+	apdu.resize(5 + len + 1);
+	apdu[0] = 0x90;
+	apdu[1] = CMD_MORE_DATA;
+	apdu[2] = 0x00;
+	apdu[3] = 0x00;
+	apdu[4] = static_cast<BYTE>(len);
+	if (len) std::memcpy(apdu.data() + 5, payload, len);
+	apdu[5 + len] = 0x00;
+}
+
 // ════════════════════════════════════════════════════════════════════════════════
 // Response Parsing (legacy extractors — kept for test/debug)
 // ════════════════════════════════════════════════════════════════════════════════
@@ -77,13 +98,9 @@ Result<StatusWord, PcscError> DesfireAuth::evaluateAuthSW(const BYTEV& resp, BYT
 }
 
 BYTEV DesfireAuth::decryptNonce(const BYTEV& encRndB, const BYTEV& key, DesfireKeyType keyType) {
-	BYTEV zeroIV(DesfireCrypto::blockSize(keyType), 0);
-	if (keyType == DesfireKeyType::AES128)
-		return crypto::block::decryptAesCbc(key, zeroIV, encRndB);
-	else if (keyType == DesfireKeyType::ThreeDES)
-		return crypto::block::decrypt3K3DesCbc(key, zeroIV, encRndB);
-	else
-		return crypto::block::decrypt2K3DesCbc(key, zeroIV, encRndB);
+	BYTEV rndB(encRndB.size());
+	DesfireCrypto::cbc(keyType, false, key, nullptr, encRndB.data(), encRndB.size(), rndB.data());
+	return rndB;
 }
 
 BYTEV DesfireAuth::buildAuthPayloadInternal(const BYTEV& rndA, const BYTEV& rndB,
@@ -91,3 +108,26 @@ BYTEV DesfireAuth::buildAuthPayloadInternal(const BYTEV& rndA, const BYTEV& rndB
 											 const BYTEV& iv) {
 	return DesfireCrypto::buildAuthPayload(rndA, rndB, key, keyType, iv);
 }
+
+// ════════════════════════════════════════════════════════════════════════════════
+// EV2 — sıfır IV, zincirleme yok
+// ════════════════════════════════════════════════════════════════════════════════
+
+BYTEV DesfireAuth::buildAuthEV2Payload(const BYTEV& rndA, const BYTEV& rndB, const BYTEV& key) {
+	BYTEV plain = rndA;
+	BYTEV rot = DesfireCrypto::rotateLeft(rndB);
+	plain.insert(plain.end(), rot.begin(), rot.end());
+	return crypto::block::encryptAesCbc(key, BYTEV(16, 0), plain);
+}
+
+bool DesfireAuth::verifyAuthEV2Response(const BYTEV& enc, const BYTEV& rndA, const BYTEV& key,
+										bool first, std::array<BYTE, 4>& ti) {
+	const size_t expected = first ? 32 : 16;
+	if (enc.size() != expected || rndA.size() != 16) return false;
+	BYTEV plain = crypto::block::decryptAesCbc(key, BYTEV(16, 0), enc);
+	const BYTE* rotA = plain.data() + (first ? 4 : 0);
+	if (!std::equal(rotA, rotA + 15, rndA.begin() + 1) || rotA[15] != rndA[0])
+		return false;
+	if (first) std::copy(plain.begin(), plain.begin() + 4, ti.begin());
+	return true;
+}
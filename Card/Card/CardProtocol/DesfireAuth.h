@@ -4,6 +4,7 @@
 #include "DesfireSession.h"
 #include "DesfireCrypto.h"
 #include "Result.h"
+#include <array>
 
 // ════════════════════════════════════════════════════════════════════════════════
 // DesfireAuth — 3-pass Mutual Authentication State Machine
@@ -38,6 +39,18 @@
 //
 //   bool ok = auth.authenticate(session, key, keyNo, keyType, transmit);
 //
+// ─── EV2 (AuthenticateEV2First 0x71 / NonFirst 0x77, yalnızca AES) ────────
+//
+//   Step 1: Host → Card  :  0x71 keyNo LenCap=0   (NonFirst: 0x77 keyNo)
+//           Card → Host  :  E(K, RndB)                       IV = 0
+//   Step 2: Host → Card  :  AF + E(K, RndA || rotL(RndB))    IV = 0
+//           Card → Host  :  First   : E(K, TI || rotL(RndA) || PDcap2 || PCDcap2)
+//                           NonFirst: E(K, rotL(RndA))
+//   Step 3: KSesAuthENC / KSesAuthMAC = CMAC(K, SV1 / SV2)
+//
+//   First yeni bir işlem başlatır (TI atanır, cmdCounter = 0). NonFirst aynı
+//   işlem içinde key değiştirir: TI ve cmdCounter korunur, yanıt 16 byte kısa.
+//
 // ════════════════════════════════════════════════════════════════════════════════
 
 class DesfireAuth {
@@ -66,12 +79,30 @@ public:
 									 DesfireKeyType keyType,
 									 TryTransmitFn&& transmit);
 
+	// EV2: First → yeni TI; NonFirst → session EV2 ve geçerli olmalı
+	template<typename TryTransmitFn>
+	PcscResultVoid tryAuthenticateEV2First(DesfireSession& session,
+										   const BYTEV& key, BYTE keyNo,
+										   TryTransmitFn&& transmit)
+	{
+		return tryAuthenticateEV2(session, key, keyNo, true, transmit);
+	}
+
+	template<typename TryTransmitFn>
+	PcscResultVoid tryAuthenticateEV2NonFirst(DesfireSession& session,
+											  const BYTEV& key, BYTE keyNo,
+											  TryTransmitFn&& transmit)
+	{
+		return tryAuthenticateEV2(session, key, keyNo, false, transmit);
+	}
+
 	// ── Individual steps (test/debug) ───────────────────────────────────────
 
 	// Step 1: Build auth command APDU
 	//   AES: {0x90, 0xAA, 0x00, 0x00, 0x01, keyNo, 0x00}
 	//   2K3DES: {0x90, 0x1A, 0x00, 0x00, 0x01, keyNo, 0x00}
 	static BYTEV buildAuthCmd(BYTE keyNo, DesfireKeyType keyType);
+	static void  buildAuthCmdInto(BYTEV& apdu, BYTE keyNo, DesfireKeyType keyType);
 
 	// Step 2: Parse card's first response → extract encrypted RndB
 	//   Response format: [ek(RndB) ... ] [SW1] [SW2]
@@ -81,6 +112,7 @@ public:
 	// Step 3: Build additional frame APDU
 	//   {0x90, 0xAF, 0x00, 0x00, Lc, payload..., 0x00}
 	static BYTEV buildAdditionalFrame(const BYTEV& payload);
+	static void  buildAdditionalFrameInto(BYTEV& apdu, const BYTE* payload, size_t len);
 
 	// Step 4: Parse card's second response → extract encrypted rotated RndA
 	//   Response format: [ek(rotL(RndA))] [SW1] [SW2]
@@ -99,6 +131,20 @@ public:
 	static constexpr BYTE CMD_AUTH_ISO   = 0x1A;  // 2K3DES
 	static constexpr BYTE CMD_AUTH_AES   = 0xAA;  // AES-128
 	static constexpr BYTE CMD_MORE_DATA  = 0xAF;  // Additional frame
+	static constexpr BYTE CMD_AUTH_EV2_FIRST    = 0x71;
+	static constexpr BYTE CMD_AUTH_EV2_NONFIRST = 0x77;
+
+	// ── EV2 helpers ─────────────────────────────────────────────────────────
+
+	// First: {90 71 00 00 02 keyNo 00 00}, NonFirst: {90 77 00 00 01 keyNo 00}
+	static BYTEV buildAuthEV2Cmd(BYTE keyNo, bool first);
+
+	// E(K, RndA || rotL(RndB)), IV = 0
+	static BYTEV buildAuthEV2Payload(const BYTEV& rndA, const BYTEV& rndB, const BYTEV& key);
+
+	// Kartın son yanıtını çöz ve rotL(RndA)'yı doğrula; First ise TI'yı çıkar
+	static bool verifyAuthEV2Response(const BYTEV& enc, const BYTEV& rndA, const BYTEV& key,
+									  bool first, std::array<BYTE, 4>& ti);
 
 	// Non-template crypto helpers (defined in .cpp)
 	static BYTEV decryptNonce(const BYTEV& encRndB, const BYTEV& key, DesfireKeyType keyType);
@@ -106,6 +152,12 @@ public:
 										   const BYTEV& key, DesfireKeyType keyType,
 										   const BYTEV& iv);
 	static Result<StatusWord, PcscError> evaluateAuthSW(const BYTEV& resp, BYTE expectedSW2);
+
+private:
+	template<typename TryTransmitFn>
+	PcscResultVoid tryAuthenticateEV2(DesfireSession& session,
+									  const BYTEV& key, BYTE keyNo, bool first,
+									  TryTransmitFn&& transmit);
 };
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -117,38 +169,43 @@ PcscResultVoid DesfireAuth::tryAuthenticate(DesfireSession& session,
 										const BYTEV& key, BYTE keyNo,
 										DesfireKeyType keyType,
 										TryTransmitFn&& transmit) {
+	// Nonce, payload ve session key yığında (DesfireCrypto sabit tamponları);
+	// APDU'lar session.authApdu'nun kapasitesini yeniden kullanır → host
+	// tarafı el sıkışma heap'e gitmez (yanıt tamponu transmit'e aittir).
 	session.reset();
 	session.keyType = keyType;
+	const size_t n  = DesfireCrypto::nonceSize(keyType);
+	const size_t bs = DesfireCrypto::blockSize(keyType);
 
 	// Step 1: Send auth cmd, receive ek(RndB)
-	auto r1 = transmit(DesfireAuth::buildAuthCmd(keyNo, keyType));
+	buildAuthCmdInto(session.authApdu, keyNo, keyType);
+	auto r1 = transmit(session.authApdu);
 	if (!r1) {
-		session.reset();							 
+		session.reset();
 		return PcscResultVoid::Err(r1.unwrap_error());
 	}
 	auto e1 = evaluateAuthSW(r1.unwrap(), DesfireAuth::SW2_AF);
-	if (!e1.is_ok())
-	{
+	if (!e1.is_ok()) {
 		session.reset();
-		return PcscResultVoid::Err(r1.unwrap_error());
+		return PcscResultVoid::Err(e1.unwrap_error());
 	}
-
-	size_t expected = DesfireCrypto::nonceSize(keyType);
-	if (r1.unwrap().size() - 2 != expected) {
+	if (r1.unwrap().size() - 2 != n) {
 		session.reset();
 		return PcscResultVoid::Err(Error<PcscError>(CardError::InvalidData));
 	}
-	BYTEV encRndB(r1.unwrap().begin(), r1.unwrap().begin() + expected);
+	const BYTE* encRndB = r1.unwrap().data();
 
-	// Step 2: Decrypt, build payload
-	size_t bs = DesfireCrypto::blockSize(keyType);
-	BYTEV rndB = decryptNonce(encRndB, key, keyType);
-	BYTEV rndA = DesfireCrypto::generateRndA(keyType);
-	BYTEV iv2(encRndB.end() - bs, encRndB.end());
-	BYTEV payload = buildAuthPayloadInternal(rndA, rndB, key, keyType, iv2);
+	// Step 2: Decrypt RndB, build ek(RndA || rotL(RndB)) — IV = ek(RndB) son bloğu
+	DesfireNonce rndA, rndB;
+	rndB.resize(n);
+	DesfireCrypto::cbc(keyType, false, key, nullptr, encRndB, n, rndB.data());
+	DesfireCrypto::generateRndA(keyType, rndA);
+	DesfireAuthBlock payload;
+	DesfireCrypto::buildAuthPayload(rndA, rndB, key, keyType, encRndB + n - bs, payload);
 
 	// Step 3: Send payload, receive ek(rotL(RndA))
-	auto r2 = transmit(buildAdditionalFrame(payload));
+	buildAdditionalFrameInto(session.authApdu, payload.data(), payload.size());
+	auto r2 = transmit(session.authApdu);
 	if (!r2) {
 		session.reset();
 		return PcscResultVoid::Err(r2.unwrap_error());
@@ -158,26 +215,86 @@ PcscResultVoid DesfireAuth::tryAuthenticate(DesfireSession& session,
 		session.reset();
 		return PcscResultVoid::Err(e2.unwrap_error());
 	}
-
-	if (r2.unwrap().size() - 2 != expected) {
+	if (r2.unwrap().size() - 2 != n) {
 		session.reset();
 		return PcscResultVoid::Err(Error<PcscError>(CardError::InvalidData));
 	}
-	BYTEV encRndArot(r2.unwrap().begin(), r2.unwrap().begin() + expected);
-	BYTEV iv3(payload.end() - bs, payload.end());
-	bool ok = DesfireCrypto::verifyAuthResponse(encRndArot, rndA, key, keyType, iv3);
+	const bool ok = DesfireCrypto::verifyAuthResponse(r2.unwrap().data(), rndA, key, keyType,
+													  payload.data() + payload.size() - bs);
 	if (!ok) {
+		rndA.wipe();
+		rndB.wipe();
 		session.reset();
 		return PcscResultVoid::Err(Error<PcscError>(DesfireError::AuthMismatch));
 	}
+
+	DesfireSessionKey sk;
+	DesfireCrypto::deriveSessionKey(rndA, rndB, keyType, sk);
+	rndA.wipe();
+	rndB.wipe();
 	session.authenticated = true;
 	session.authKeyNo = keyNo;
 	session.keyType = keyType;
-	session.sessionKey = DesfireCrypto::deriveSessionKey(rndA, rndB, keyType);
-	session.iv = BYTEV(bs, 0);
+	session.sessionKey.assign(sk.begin(), sk.end());
+	sk.wipe();
+	session.macEngine();						// K1/K2 auth anında hazırlanır
+	session.iv.assign(bs, 0);
 	session.cmdCounter = 0;
 	session.touchAuthTime();
 	return Result<void, PcscError>::Ok();
 }
 
+template<typename TryTransmitFn>
+PcscResultVoid DesfireAuth::tryAuthenticateEV2(DesfireSession& session,
+											   const BYTEV& key, BYTE keyNo, bool first,
+											   TryTransmitFn&& transmit) {
+	auto fail = [&session](PcscError e) {
+		session.reset();
+		return PcscResultVoid::Err(std::move(e));
+	};
+	if (key.size() != 16)
+		return fail(PcscError::make(CardError::InvalidData, "EV2 auth requires a 16-byte AES key"));
+	if (!first && !(session.isEV2() && session.isValid()))
+		return fail(PcscError::make(CardError::NotAuthenticated, "AuthenticateEV2NonFirst needs an EV2 session"));
+
+	// Step 1: ek(RndB)
+	auto r1 = transmit(buildAuthEV2Cmd(keyNo, first));
+	if (!r1) return fail(r1.unwrap_error());
+	auto e1 = evaluateAuthSW(r1.unwrap(), SW2_AF);
+	if (!e1.is_ok()) return fail(e1.unwrap_error());
+	if (r1.unwrap().size() != 16 + 2)
+		return fail(Error<PcscError>(CardError::InvalidData).detail("EV2 auth step 1: size mismatch"));
+	BYTEV encRndB(r1.unwrap().begin(), r1.unwrap().begin() + 16);
+
+	// Step 2: E(K, RndA || RndB')
+	BYTEV rndB = decryptNonce(encRndB, key, DesfireKeyType::AES128);
+	BYTEV rndA = DesfireCrypto::generateRndA(DesfireKeyType::AES128);
+	auto r2 = transmit(buildAdditionalFrame(buildAuthEV2Payload(rndA, rndB, key)));
+	if (!r2) return fail(r2.unwrap_error());
+	auto e2 = evaluateAuthSW(r2.unwrap(), SW2_OK);
+	if (!e2.is_ok()) return fail(e2.unwrap_error());
+	const size_t expected = first ? 32 : 16;
+	if (r2.unwrap().size() != expected + 2)
+		return fail(Error<PcscError>(CardError::InvalidData).detail("EV2 auth step 2: size mismatch"));
+
+	// Step 3: doğrula, key'leri türet
+	std::array<BYTE, 4> ti = session.ti;
+	BYTEV enc(r2.unwrap().begin(), r2.unwrap().begin() + expected);
+	if (!verifyAuthEV2Response(enc, rndA, key, first, ti))
+		return fail(Error<PcscError>(DesfireError::AuthMismatch));
+
+	const uint16_t counter = first ? 0 : session.cmdCounter;
+	session.resetKeepApp();
+	DesfireCrypto::deriveSessionKeysEV2(rndA, rndB, key, session.sessionKey, session.sessionMacKey);
+	session.authenticated = true;
+	session.authMode = DesfireAuthMode::EV2;
+	session.authKeyNo = keyNo;
+	session.keyType = DesfireKeyType::AES128;
+	session.ti = ti;
+	session.cmdCounter = counter;
+	session.macEngine();
+	session.touchAuthTime();
+	return PcscResultVoid::Ok();
+}
+
 #endif // DESFIRE_AUTH_H
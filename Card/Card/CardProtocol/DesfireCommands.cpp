@@ -19,6 +19,15 @@ void DesfireCommands::writeLE24(BYTE* p, uint32_t v) {
 	p[2] = static_cast<BYTE>((v >> 16) & 0xFF);
 }
 
+// ════════════════════════════════════════════════════════════════════════════════
+// Frame Size
+// ════════════════════════════════════════════════════════════════════════════════
+
+uint16_t DesfireFrameSize::fromIndex(BYTE index) {
+	static const uint16_t sizes[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
+	return index < 9 ? sizes[index] : 256;
+}
+
 // ════════════════════════════════════════════════════════════════════════════════
 // APDU Construction
 // ════════════════════════════════════════════════════════════════════════════════
@@ -266,6 +275,14 @@ BYTEV DesfireCommands::readRecords(BYTE fileNo, uint32_t offset, uint32_t count)
 	return wrapCommand(0xBB, data);
 }
 
+uint32_t DesfireCommands::recordsPerPage(uint32_t recordSize, uint32_t frameData, DesfireCommMode respMode) {
+	uint32_t overhead = 0;
+	if (respMode == DesfireCommMode::MAC)  overhead = 8;
+	if (respMode == DesfireCommMode::Full) overhead = 4 + 15;     // CRC32 + en kötü dolgu
+	const uint32_t avail = frameData > overhead ? frameData - overhead : 0;
+	return recordSize ? std::max<uint32_t>(1, avail / recordSize) : 1;
+}
+
 BYTEV DesfireCommands::appendRecord(BYTE fileNo, const BYTEV& recordData) {
 	BYTEV data;
 	data.push_back(fileNo);
@@ -4,6 +4,8 @@
 #include "CardDataTypes.h"
 #include "Result.h"
 #include "../CardModel/DesfireMemoryLayout.h"
+#include <algorithm>
+#include <string>
 #include <vector>
 #include <cstring>
 
@@ -23,6 +25,67 @@
 //
 // ════════════════════════════════════════════════════════════════════════════════
 
+// ── Streaming ReadData ──────────────────────────────────────────────────────
+// Tasarım Notu:
+// Büyük dosyalar tek ReadData + sınırsız 0xAF zinciri yerine frame boyutuna
+// hizalı chunk'larla okunur; her frame'in payload'ı geldiği anda sink'e
+// verilir (ara BYTEV birikmez). RF/transport hatasında okuma, sink'e teslim
+// edilmiş son byte'tan (onaylı offset) yeni bir ReadData ile devam eder.
+// Kartın döndürdüğü status hataları (permission, boundary …) tekrar denenmez.
+
+// ── Frame boyutu (ISO 14443-4 FSC/FSD) ─────────────────────────────────────
+// Kart (FSC, ATS T0 FSCI) ve reader (FSD, RATS FSDI) frame boyutlarının
+// küçüğü kullanılır. Frame başına komut/yanıt payload'ı:
+//   frameSize − PCB(1) − INS(1) − CRC(2) − CID(1)   → 64 byte frame = 59 byte
+
+struct DesfireFrameSize {
+    uint16_t fsc = 64;
+    uint16_t fsd = 64;
+
+    // FSCI/FSDI → byte (0..8: 16,24,32,40,48,64,96,128,256; üstü 256)
+    static uint16_t fromIndex(BYTE index);
+
+    uint16_t frameSize() const { return std::min(fsc, fsd); }
+    uint32_t payload() const { return frameSize() > 6 ? frameSize() - 5u : 1u; }
+};
+
+struct DesfireStreamOptions {
+    uint32_t frameData      = 59;   // PICC frame başına payload (FSC 64 − PCB/INS/CRC)
+    uint32_t framesPerChunk = 16;   // ReadData başına frame → chunk = 944 byte
+    int      maxRetries     = 2;    // ilerleme olmadan art arda transport hatası
+};
+
+struct DesfireStreamResult {
+    uint32_t bytesRead = 0;
+    uint32_t commands  = 0;         // gönderilen ReadData sayısı
+    uint32_t frames    = 0;         // payload taşıyan frame sayısı
+    int      retries   = 0;         // toplam resume sayısı
+};
+
+// ── Sayfalı ReadRecords ─────────────────────────────────────────────────────
+// Tasarım Notu:
+// ReadRecords(offset, 0) tüm log'u tek 0xAF zincirinde döndürür; yarıda kopan
+// okuma her şeyi kaybettirir ve çağıran recordSize ile elle dilimler. Burada
+// kayıtlar frame payload'ına sığan sayfalarla istenir ve her kayıt
+// recordSize'lık bir DesfireDataView olarak sink'e verilir (kopya yok).
+// Offset 0 en yeni kayıttır → iterasyon yeniden eskiye; sink false dönerse
+// kalan sayfalar istenmez. Hata detail'inde devam offset'i bulunur.
+
+struct DesfireRecordOptions {
+    uint32_t offset         = 0;    // atlanacak en yeni kayıt sayısı
+    uint32_t count          = 0;    // 0 → kalan tüm kayıtlar
+    uint32_t recordsPerPage = 0;    // 0 → frame payload'ına sığan kadar (en az 1)
+    uint32_t frameData      = 59;   // PICC frame başına payload
+    bool     refreshCount   = true; // CardIO: currentRecords için GetFileSettings tekrarlanır
+};
+
+struct DesfireRecordResult {
+    uint32_t records    = 0;        // sink'e verilen kayıt
+    uint32_t pages      = 0;        // gönderilen ReadRecords
+    uint32_t nextOffset = 0;        // sıradaki okunmamış kayıt (devam noktası)
+    bool     stopped    = false;    // sink erken durdurdu
+};
+
 class DesfireCommands {
 public:
     // ── Status codes ────────────────────────────────────────────────────────
@@ -160,6 +223,10 @@ public:
     //   count:  number of records to read (0 = all from offset)
     static BYTEV readRecords(BYTE fileNo, uint32_t offset, uint32_t count);
 
+    // Frame payload'ına sığan kayıt sayısı (en az 1). MAC yanıtı 8 byte CMAC,
+    // Full yanıtı CRC32 + blok dolgusu taşır; bunlar payload'dan düşülür.
+    static uint32_t recordsPerPage(uint32_t recordSize, uint32_t frameData, DesfireCommMode respMode);
+
     // AppendRecord: INS=0x3B
     //   data = fileNo(1) + offset(3 LE, must be 0) + length(3 LE) + recordData
     static BYTEV appendRecord(BYTE fileNo, const BYTEV& recordData);
@@ -193,6 +260,43 @@ public:
     template<typename TryTransmitFn>
     static Result<BYTEV, PcscError> tryTransceive(TryTransmitFn&& transmit, const BYTEV& cmd);
 
+    // Her frame payload'ı sink(const BYTE* data, size_t len)'e kopyasız verilir.
+    // @return toplam payload byte'ı
+    template<typename TryTransmitFn, typename Sink>
+    static Result<size_t, PcscError> tryTransceiveFrames(TryTransmitFn&& transmit, const BYTEV& cmd, Sink&& sink);
+
+    // ── Command chaining (PCD → PICC) ───────────────────────────────────────
+
+    // `cmd` (wrapCommand çıktısı) verisi frameData byte'lık parçalara bölünür:
+    // ilk frame asıl INS, devamı INS=0xAF ile gönderilir; kart ara frame'lerde
+    // 91AF döner. Veri tek frame'e sığıyorsa cmd olduğu gibi gönderilir.
+    // Komut verisi APDU boyutundan alınır (Lc > 255 taşması etkilemez).
+    template<typename TryTransmitFn>
+    static Result<BYTEV, PcscError> tryTransceiveChained(TryTransmitFn&& transmit, const BYTEV& cmd,
+                                                         uint32_t frameData);
+
+    // ── Streaming ReadData ──────────────────────────────────────────────────
+
+    // sink(uint32_t fileOffset, const BYTE* data, size_t len). length = 0 →
+    // dosya sonuna kadar (tek ReadData, resume yine çalışır).
+    // Hata dönerse sink'e verilen son offset+len onaylıdır; çağrı oradan
+    // tekrarlanabilir (hata detail'inde "resume at offset N").
+    template<typename TryTransmitFn, typename Sink>
+    static Result<DesfireStreamResult, PcscError> tryReadDataStream(
+        TryTransmitFn&& transmit, BYTE fileNo, uint32_t offset, uint32_t length,
+        Sink&& sink, const DesfireStreamOptions& opts = DesfireStreamOptions{});
+
+    // ── Sayfalı ReadRecords ─────────────────────────────────────────────────
+
+    // fetch(const BYTEV& cmd, size_t expectedLen) → Result<BYTEV, PcscError>:
+    // zincirlenmiş ve (oturum varsa) doğrulanmış/çözülmüş veri.
+    // sink(uint32_t recordOffset, DesfireDataView record) → false = dur.
+    // Üst sınır fs.record.currentRecords'tur (kart fazlasına BOUNDARY döner).
+    template<typename FetchFn, typename Sink>
+    static Result<DesfireRecordResult, PcscError> tryReadRecordPages(
+        FetchFn&& fetch, BYTE fileNo, const DesfireFileSettings& fs,
+        Sink&& sink, const DesfireRecordOptions& opts = DesfireRecordOptions{});
+
     // ── High-level Parsing ──────────────────────────────────────────────────
 
     template<typename TransmitFn>
@@ -241,32 +345,188 @@ Result<BYTEV, PcscError> DesfireCommands::tryTransceive(
     TryTransmitFn&& transmit,
     const BYTEV& cmd)
 {
-	auto txResult = transmit(cmd);
-	if (!txResult) return Result<BYTEV, PcscError>::Err(std::move(txResult.error()));
+	BYTEV result;
+	auto r = tryTransceiveFrames(transmit, cmd, [&result](const BYTE* p, size_t n) {
+		result.insert(result.end(), p, p + n);
+	});
+	if (!r) return Result<BYTEV, PcscError>::Err(std::move(r.error()));
+	return Result<BYTEV, PcscError>::Ok(std::move(result));
+}
 
-	auto resp = txResult.unwrap();
+template<typename TryTransmitFn, typename Sink>
+Result<size_t, PcscError> DesfireCommands::tryTransceiveFrames(
+    TryTransmitFn&& transmit,
+    const BYTEV& cmd,
+    Sink&& sink)
+{
+	using R = Result<size_t, PcscError>;
+	size_t total = 0;
 
-	auto check = evaluateResponse(resp);
-	if (!check) return Result<BYTEV, PcscError>::Err(std::move(check.error()));
+	auto txResult = transmit(cmd);
+	for (;;) {
+		if (!txResult) return R::Err(std::move(txResult.error()));
+		const BYTEV& resp = txResult.unwrap();
 
-	BYTEV result = extractData(resp);
+		auto check = evaluateResponse(resp);
+		if (!check) return R::Err(std::move(check.error()));
 
-	while (hasMore(resp)) {
-		txResult = transmit(additionalFrame());
-		if (!txResult)
-			return Result<BYTEV, PcscError>::Err(std::move(txResult.error()));
+		const size_t n = resp.size() - 2;
+		if (n) sink(resp.data(), n);
+		total += n;
 
-		resp = txResult.unwrap();
+		if (!hasMore(resp)) break;
+		txResult = transmit(additionalFrame());
+	}
+	return R::Ok(total);
+}
 
-		check = evaluateResponse(resp);
-		if (!check)
-			return Result<BYTEV, PcscError>::Err(std::move(check.error()));
+template<typename TryTransmitFn>
+Result<BYTEV, PcscError> DesfireCommands::tryTransceiveChained(
+    TryTransmitFn&& transmit,
+    const BYTEV& cmd,
+    uint32_t frameData)
+{
+	using R = Result<BYTEV, PcscError>;
+
+	// 90 INS 00 00 Lc [data] 00
+	const size_t dataLen = cmd.size() > 6 ? cmd.size() - 6 : 0;
+	if (frameData == 0) frameData = 1;
+	if (dataLen <= frameData) return tryTransceive(transmit, cmd);
+
+	const BYTE* data = cmd.data() + 5;
+	BYTEV apdu;
+	apdu.reserve(frameData + 6);            // tüm frame'ler aynı buffer'da
+
+	size_t pos = 0;
+	for (;;) {
+		const size_t n = std::min<size_t>(frameData, dataLen - pos);
+		apdu.assign({ 0x90, pos == 0 ? cmd[1] : MORE, 0x00, 0x00, static_cast<BYTE>(n) });
+		apdu.insert(apdu.end(), data + pos, data + pos + n);
+		apdu.push_back(0x00);
+		pos += n;
+
+		if (pos == dataLen)                 // son frame: yanıt (çok frame'li olabilir)
+			return tryTransceive(transmit, apdu);
+
+		auto tx = transmit(apdu);
+		if (!tx) return R::Err(std::move(tx.error()));
+		auto check = evaluateResponse(tx.unwrap());
+		if (!check) return R::Err(std::move(check.error()));
+		if (!hasMore(tx.unwrap()))
+			return R::Err(Error<PcscError>(DesfireError::Generic)
+				.detail("PICC ended command chain early at byte " + std::to_string(pos)));
+	}
+}
 
-		BYTEV chunk = extractData(resp);
-		result.insert(result.end(), chunk.begin(), chunk.end());
+template<typename TryTransmitFn, typename Sink>
+Result<DesfireStreamResult, PcscError> DesfireCommands::tryReadDataStream(
+    TryTransmitFn&& transmit, BYTE fileNo, uint32_t offset, uint32_t length,
+    Sink&& sink, const DesfireStreamOptions& opts)
+{
+	using R = Result<DesfireStreamResult, PcscError>;
+	DesfireStreamResult res;
+
+	const uint32_t frame = opts.frameData ? opts.frameData : 59;
+	const uint32_t chunk = frame * (opts.framesPerChunk ? opts.framesPerChunk : 1);
+	const uint32_t end   = offset + length;
+	uint32_t pos = offset;                  // onaylı offset
+	int failures = 0;                       // ilerlemesiz art arda transport hatası
+
+	bool transportFailed = false;
+	auto tx = [&](const BYTEV& apdu) {
+		auto r = transmit(apdu);
+		transportFailed = !r;
+		return r;
+	};
+
+	while (length == 0 || pos < end) {
+		const uint32_t want = length == 0 ? 0 : std::min(chunk, end - pos);
+		uint32_t got = 0;
+		++res.commands;
+		auto r = tryTransceiveFrames(tx, readData(fileNo, pos, want),
+			[&](const BYTE* p, size_t n) {
+				sink(pos + got, p, n);
+				got += static_cast<uint32_t>(n);
+				++res.frames;
+			});
+		pos += got;
+		res.bytesRead += got;
+		if (got) failures = 0;
+
+		if (r) {
+			if (length == 0) break;
+			if (got == 0)
+				return R::Err(Error<PcscError>(DesfireError::Generic)
+					.detail("ReadData returned no data at offset " + std::to_string(pos)));
+			continue;
+		}
+		if (!transportFailed || failures >= opts.maxRetries) {
+			PcscError e = std::move(r.error());
+			e.detail += " (resume at offset " + std::to_string(pos) + ")";
+			return R::Err(std::move(e));
+		}
+		++failures;
+		++res.retries;
 	}
+	return R::Ok(res);
+}
 
-	return Result<BYTEV, PcscError>::Ok(result);
+template<typename FetchFn, typename Sink>
+Result<DesfireRecordResult, PcscError> DesfireCommands::tryReadRecordPages(
+    FetchFn&& fetch, BYTE fileNo, const DesfireFileSettings& fs,
+    Sink&& sink, const DesfireRecordOptions& opts)
+{
+	using R = Result<DesfireRecordResult, PcscError>;
+	if (fs.fileType != DesfireFileType::LinearRecord && fs.fileType != DesfireFileType::CyclicRecord)
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("ReadRecords: not a record file")
+			.meta("fileNo", std::to_string(fileNo)));
+	const uint32_t rs = fs.record.recordSize;
+	if (rs == 0)
+		return R::Err(Error<PcscError>(CardError::InvalidData).detail("ReadRecords: record size is 0"));
+
+	DesfireRecordResult res;
+	res.nextOffset = opts.offset;
+	const uint32_t total = fs.record.currentRecords;
+	if (opts.offset >= total) return R::Ok(res);
+
+	const uint32_t perPage = opts.recordsPerPage ? opts.recordsPerPage
+		: recordsPerPage(rs, opts.frameData, fs.commMode);
+	uint32_t left = total - opts.offset;
+	if (opts.count) left = std::min(left, opts.count);
+
+	uint32_t pos = opts.offset;
+	while (left) {
+		const uint32_t n = std::min(perPage, left);
+		auto r = fetch(readRecords(fileNo, pos, n), static_cast<size_t>(n) * rs);
+		++res.pages;
+		if (!r) {
+			PcscError e = std::move(r.error());
+			e.detail += " (resume at record " + std::to_string(pos) + ")";
+			return R::Err(std::move(e));
+		}
+		const BYTEV& page = r.unwrap();
+		const uint32_t got = static_cast<uint32_t>(page.size() / rs);
+		if (got == 0 || got > n || page.size() % rs != 0)
+			return R::Err(Error<PcscError>(CardError::InvalidData)
+				.detail("ReadRecords: page is not a whole number of records")
+				.meta("bytes", std::to_string(page.size()))
+				.meta("recordSize", std::to_string(rs)));
+
+		const DesfireDataView v(page.data(), page.size());
+		for (uint32_t i = 0; i < got; ++i) {
+			++res.records;
+			res.nextOffset = pos + i + 1;
+			if (!sink(pos + i, v.subspan(static_cast<size_t>(i) * rs, rs))) {
+				res.stopped = true;
+				return R::Ok(res);
+			}
+		}
+		pos  += got;
+		left -= got;
+		if (got < n) break;                 // kart beklenenden az kayıt tuttu
+	}
+	return R::Ok(res);
 }
 
 template<typename TransmitFn>
@@ -1,8 +1,10 @@
 #include "DesfireCrypto.h"
 #include "BlockCipher.h"
+#include "Cmac.h"
 #include "Random.h"
 #include "Result.h"
 #include <cstring>
+#include <initializer_list>
 
 // ════════════════════════════════════════════════════════════════════════════════
 // Sizes
@@ -40,25 +42,52 @@ BYTEV DesfireCrypto::generateRndA(DesfireKeyType kt) {
     return crypto::randomBytes(nonceSize(kt));
 }
 
+void DesfireCrypto::generateRndA(DesfireKeyType kt, DesfireNonce& out) {
+    out.resize(nonceSize(kt));
+    crypto::randomBytes(out.data(), out.size());
+}
+
 // ════════════════════════════════════════════════════════════════════════════════
 // Rotate
 // ════════════════════════════════════════════════════════════════════════════════
 
 BYTEV DesfireCrypto::rotateLeft(const BYTEV& data) {
-    if (data.empty()) return data;
-    BYTEV r(data.begin() + 1, data.end());
-    r.push_back(data[0]);
+    BYTEV r = data;
+    rotateLeft(r.data(), r.size());
     return r;
 }
 
 BYTEV DesfireCrypto::rotateRight(const BYTEV& data) {
-    if (data.empty()) return data;
-    BYTEV r;
-    r.push_back(data.back());
-    r.insert(r.end(), data.begin(), data.end() - 1);
+    BYTEV r = data;
+    rotateRight(r.data(), r.size());
     return r;
 }
 
+void DesfireCrypto::rotateLeft(BYTE* data, size_t len) {
+    if (len < 2) return;
+    const BYTE first = data[0];
+    std::memmove(data, data + 1, len - 1);
+    data[len - 1] = first;
+}
+
+void DesfireCrypto::rotateRight(BYTE* data, size_t len) {
+    if (len < 2) return;
+    const BYTE last = data[len - 1];
+    std::memmove(data + 1, data, len - 1);
+    data[0] = last;
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// CBC
+// ════════════════════════════════════════════════════════════════════════════════
+
+void DesfireCrypto::cbc(DesfireKeyType kt, bool encrypt, const BYTEV& key, const BYTE* iv,
+                        const BYTE* in, size_t len, BYTE* out) {
+    using crypto::block::CbcAlgo;
+    crypto::block::cbcInto(kt == DesfireKeyType::AES128 ? CbcAlgo::AES128 : CbcAlgo::TDES,
+                           encrypt, key.data(), key.size(), iv, in, len, out);
+}
+
 // ════════════════════════════════════════════════════════════════════════════════
 // Auth Payload
 // ════════════════════════════════════════════════════════════════════════════════
@@ -66,37 +95,46 @@ BYTEV DesfireCrypto::rotateRight(const BYTEV& data) {
 BYTEV DesfireCrypto::buildAuthPayload(const BYTEV& rndA, const BYTEV& rndBdecrypted,
                                        const BYTEV& key, DesfireKeyType kt,
                                        const BYTEV& iv) {
-    // Concat: RndA || rotateLeft(RndB)
-    BYTEV rndBrot = rotateLeft(rndBdecrypted);
-    BYTEV plain;
-    plain.insert(plain.end(), rndA.begin(), rndA.end());
-    plain.insert(plain.end(), rndBrot.begin(), rndBrot.end());
-
-    // Encrypt
-    if (kt == DesfireKeyType::AES128) {
-        return crypto::block::encryptAesCbc(key, iv, plain);
-    } else if (kt == DesfireKeyType::ThreeDES) {
-        return crypto::block::encrypt3K3DesCbc(key, iv, plain);
-    } else {
-        return crypto::block::encrypt2K3DesCbc(key, iv, plain);
-    }
+    DesfireNonce a, b;
+    a.assign(rndA.data(), rndA.size());
+    b.assign(rndBdecrypted.data(), rndBdecrypted.size());
+    DesfireAuthBlock out;
+    buildAuthPayload(a, b, key, kt, iv.data(), out);
+    return out.toBytes();
 }
 
 bool DesfireCrypto::verifyAuthResponse(const BYTEV& encryptedResponse,
                                         const BYTEV& rndA,
                                         const BYTEV& key, DesfireKeyType kt,
                                         const BYTEV& iv) {
-    BYTEV decrypted;
-    if (kt == DesfireKeyType::AES128) {
-        decrypted = crypto::block::decryptAesCbc(key, iv, encryptedResponse);
-    } else if (kt == DesfireKeyType::ThreeDES) {
-        decrypted = crypto::block::decrypt3K3DesCbc(key, iv, encryptedResponse);
-    } else {
-        decrypted = crypto::block::decrypt2K3DesCbc(key, iv, encryptedResponse);
-    }
+    if (encryptedResponse.size() != rndA.size() || rndA.size() != nonceSize(kt)) return false;
+    DesfireNonce a;
+    a.assign(rndA.data(), rndA.size());
+    return verifyAuthResponse(encryptedResponse.data(), a, key, kt, iv.data());
+}
+
+void DesfireCrypto::buildAuthPayload(const DesfireNonce& rndA, const DesfireNonce& rndB,
+                                     const BYTEV& key, DesfireKeyType kt, const BYTE* iv,
+                                     DesfireAuthBlock& out) {
+    // RndA || rotateLeft(RndB) — yerinde birleştir, yerinde şifrele
+    const size_t n = rndA.size();
+    out.resize(n + rndB.size());
+    std::memcpy(out.data(), rndA.data(), n);
+    std::memcpy(out.data() + n, rndB.data(), rndB.size());
+    rotateLeft(out.data() + n, rndB.size());
+    cbc(kt, true, key, iv, out.data(), out.size(), out.data());
+}
 
-    BYTEV expected = rotateLeft(rndA);
-    return decrypted == expected;
+bool DesfireCrypto::verifyAuthResponse(const BYTE* encryptedResponse, const DesfireNonce& rndA,
+                                       const BYTEV& key, DesfireKeyType kt, const BYTE* iv) {
+    // Decrypted should equal rotateLeft(RndA)
+    DesfireNonce dec;
+    dec.resize(rndA.size());
+    cbc(kt, false, key, iv, encryptedResponse, dec.size(), dec.data());
+    rotateRight(dec.data(), dec.size());
+    const bool ok = dec.equals(rndA.data(), rndA.size());
+    dec.wipe();
+    return ok;
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -105,31 +143,44 @@ bool DesfireCrypto::verifyAuthResponse(const BYTEV& encryptedResponse,
 
 BYTEV DesfireCrypto::deriveSessionKey(const BYTEV& rndA, const BYTEV& rndB,
                                        DesfireKeyType kt) {
-    BYTEV sk;
+    DesfireNonce a, b;
+    a.assign(rndA.data(), rndA.size());
+    b.assign(rndB.data(), rndB.size());
+    DesfireSessionKey sk;
+    deriveSessionKey(a, b, kt, sk);
+    return sk.toBytes();
+}
+
+void DesfireCrypto::deriveSessionKey(const DesfireNonce& rndA, const DesfireNonce& rndB,
+                                     DesfireKeyType kt, DesfireSessionKey& out) {
+    // 4 byte'lık parçalar: RndA[i..i+3] || RndB[i..i+3] her offset için
+    auto take = [&](std::initializer_list<size_t> offsets) {
+        out.resize(offsets.size() * 8);
+        BYTE* p = out.data();
+        for (size_t off : offsets) {
+            std::memcpy(p,     rndA.data() + off, 4);
+            std::memcpy(p + 4, rndB.data() + off, 4);
+            p += 8;
+        }
+    };
 
     if (kt == DesfireKeyType::AES128) {
         // AES-128 session key:
         //   SK = RndA[0..3] || RndB[0..3] || RndA[12..15] || RndB[12..15]
         if (rndA.size() < 16 || rndB.size() < 16) {
 			PcscError::make(CardError::InvalidData, "AES nonces must be 16 bytes").throwIfError();
-            return {};
+            return;
         }
-        sk.insert(sk.end(), rndA.begin(),      rndA.begin() + 4);
-        sk.insert(sk.end(), rndB.begin(),      rndB.begin() + 4);
-        sk.insert(sk.end(), rndA.begin() + 12, rndA.begin() + 16);
-        sk.insert(sk.end(), rndB.begin() + 12, rndB.begin() + 16);
+        take({ 0, 12 });
     }
     else if (kt == DesfireKeyType::TwoDES) {
         // 2K3DES session key:
         //   SK = RndA[0..3] || RndB[0..3] || RndA[4..7] || RndB[4..7]
         if (rndA.size() < 8 || rndB.size() < 8) {
 			PcscError::make(CardError::InvalidData, "2K3DES nonces must be 8 bytes").throwIfError();
-            return {};
+            return;
         }
-        sk.insert(sk.end(), rndA.begin(),     rndA.begin() + 4);
-        sk.insert(sk.end(), rndB.begin(),     rndB.begin() + 4);
-        sk.insert(sk.end(), rndA.begin() + 4, rndA.begin() + 8);
-        sk.insert(sk.end(), rndB.begin() + 4, rndB.begin() + 8);
+        take({ 0, 4 });
     }
     else if (kt == DesfireKeyType::ThreeDES) {
         // 3K3DES session key (24 bytes):
@@ -138,19 +189,38 @@ BYTEV DesfireCrypto::deriveSessionKey(const BYTEV& rndA, const BYTEV& rndB,
         //        RndA[12..15]|| RndB[12..15]
         if (rndA.size() < 16 || rndB.size() < 16) {
 			PcscError::make(CardError::InvalidData, "3K3DES nonces must be 16 bytes").throwIfError();
-            return {};
+            return;
         }
-        sk.insert(sk.end(), rndA.begin(),      rndA.begin() + 4);
-        sk.insert(sk.end(), rndB.begin(),      rndB.begin() + 4);
-        sk.insert(sk.end(), rndA.begin() + 6,  rndA.begin() + 10);
-        sk.insert(sk.end(), rndB.begin() + 6,  rndB.begin() + 10);
-        sk.insert(sk.end(), rndA.begin() + 12, rndA.begin() + 16);
-        sk.insert(sk.end(), rndB.begin() + 12, rndB.begin() + 16);
+        take({ 0, 6, 12 });
     }
     else {
 		PcscError::make(CardError::InvalidData, "Unsupported key type for session key derivation").throwIfError();
-        return {};
+    }
+}
+
+void DesfireCrypto::deriveSessionKeysEV2(const BYTEV& rndA, const BYTEV& rndB, const BYTEV& key,
+                                         BYTEV& encKey, BYTEV& macKey) {
+    if (rndA.size() != 16 || rndB.size() != 16) {
+		PcscError::make(CardError::InvalidData, "EV2 nonces must be 16 bytes").throwIfError();
+        return;
     }
 
-    return sk;
+    // SV = label(2) || 00 01 00 80 || 26 byte RndA/RndB karışımı (big-endian sıra)
+    BYTE sv[32] = { 0xA5, 0x5A, 0x00, 0x01, 0x00, 0x80 };
+    sv[6] = rndA[0];
+    sv[7] = rndA[1];
+    for (int i = 0; i < 6; ++i)  sv[8 + i]  = rndA[2 + i] ^ rndB[i];
+    for (int i = 0; i < 10; ++i) sv[14 + i] = rndB[6 + i];
+    for (int i = 0; i < 8; ++i)  sv[24 + i] = rndA[8 + i];
+
+    crypto::block::Cmac mac(crypto::block::CmacAlgo::AES128, key);
+    BYTE out[16];
+    mac.compute(nullptr, sv, sizeof(sv), out);
+    encKey.assign(out, out + 16);
+
+    sv[0] = 0x5A;
+    sv[1] = 0xA5;
+    mac.compute(nullptr, sv, sizeof(sv), out);
+    macKey.assign(out, out + 16);
+    std::memset(sv, 0, sizeof(sv));
 }
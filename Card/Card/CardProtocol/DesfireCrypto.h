@@ -3,8 +3,10 @@
 
 #include "CardDataTypes.h"
 #include "../CardModel/DesfireMemoryLayout.h"
-#include <vector>
+#include <array>
 #include <cstddef>
+#include <cstring>
+#include <vector>
 
 // ════════════════════════════════════════════════════════════════════════════════
 // DesfireCrypto — DESFire'a özgü kriptografik yardımcılar
@@ -19,14 +21,52 @@
 // Bu sınıf CngBlockCipher'ı kullanır (Cipher projesinde).
 // Stateless — tüm methodlar static.
 //
+// ─── Sabit boyutlu tamponlar ──────────────────────────────────────────────
+//
+// Nonce 8/16, session key 16/24, auth payload 16/32 byte: üst sınır bilinir.
+// DesfireNonce / DesfireSessionKey / DesfireAuthBlock yığında yaşar; rotate
+// ve birleştirme yerinde yapılır. Bu overload'larla auth el sıkışması (bkz.
+// DesfireAuth::tryAuthenticate) host tarafında heap'e gitmez. BYTEV
+// overload'ları geriye uyumluluk için aynı çekirdeği sarar.
+//
 // ════════════════════════════════════════════════════════════════════════════════
 
+template<size_t N>
+struct DesfireFixedBytes {
+    std::array<BYTE, N> bytes{};
+    size_t len = 0;
+
+    static constexpr size_t capacity() { return N; }
+
+    BYTE*       data()        { return bytes.data(); }
+    const BYTE* data()  const { return bytes.data(); }
+    size_t      size()  const { return len; }
+    BYTE*       begin()       { return bytes.data(); }
+    BYTE*       end()         { return bytes.data() + len; }
+    const BYTE* begin() const { return bytes.data(); }
+    const BYTE* end()   const { return bytes.data() + len; }
+    BYTE&       operator[](size_t i)       { return bytes[i]; }
+    const BYTE& operator[](size_t i) const { return bytes[i]; }
+
+    void resize(size_t n) { len = n < N ? n : N; }
+    void assign(const BYTE* p, size_t n) { resize(n); std::memcpy(bytes.data(), p, len); }
+    void wipe() { bytes.fill(0); len = 0; }
+
+    bool  equals(const BYTE* p, size_t n) const { return n == len && std::memcmp(bytes.data(), p, n) == 0; }
+    BYTEV toBytes() const { return BYTEV(begin(), end()); }
+};
+
+using DesfireNonce      = DesfireFixedBytes<16>;    // RndA / RndB
+using DesfireSessionKey = DesfireFixedBytes<24>;    // AES 16, 2K3DES 16, 3K3DES 24
+using DesfireAuthBlock  = DesfireFixedBytes<32>;    // ek(RndA || rotL(RndB))
+
 class DesfireCrypto {
 public:
     // ── Nonce ───────────────────────────────────────────────────────────────
 
     // Kriptografik rastgele nonce üret (16 byte AES, 8 byte DES)
     static BYTEV generateRndA(DesfireKeyType kt);
+    static void  generateRndA(DesfireKeyType kt, DesfireNonce& out);
 
     // ── Rotate ──────────────────────────────────────────────────────────────
 
@@ -36,6 +76,16 @@ public:
     // 1-byte right rotate (rotate undo): {b,c,d,a} → {a,b,c,d}
     static BYTEV rotateRight(const BYTEV& data);
 
+    // Yerinde: kopya yok
+    static void rotateLeft(BYTE* data, size_t len);
+    static void rotateRight(BYTE* data, size_t len);
+
+    // ── CBC (ayrılmasız) ────────────────────────────────────────────────────
+
+    // Key tipine göre AES / 3DES CBC; in == out olabilir, iv nullptr → sıfır
+    static void cbc(DesfireKeyType kt, bool encrypt, const BYTEV& key, const BYTE* iv,
+                    const BYTE* in, size_t len, BYTE* out);
+
     // ── Auth Challenge-Response ─────────────────────────────────────────────
 
     // Host→Card auth payload: encrypt(RndA || RndB')
@@ -53,12 +103,28 @@ public:
                                     const BYTEV& key, DesfireKeyType kt,
                                     const BYTEV& iv);
 
+    // Ayrılmasız varyantlar: nonce'lar nonceSize(kt) byte, iv blockSize(kt) byte.
+    // encryptedResponse nonceSize(kt) byte okunur.
+    static void buildAuthPayload(const DesfireNonce& rndA, const DesfireNonce& rndB,
+                                 const BYTEV& key, DesfireKeyType kt, const BYTE* iv,
+                                 DesfireAuthBlock& out);
+    static bool verifyAuthResponse(const BYTE* encryptedResponse, const DesfireNonce& rndA,
+                                   const BYTEV& key, DesfireKeyType kt, const BYTE* iv);
+
     // ── Session Key Derivation ──────────────────────────────────────────────
 
     // AES-128:  SK = RndA[0..3] || RndB[0..3] || RndA[12..15] || RndB[12..15]
     // 2K3DES:   SK = RndA[0..3] || RndB[0..3] || RndA[4..7] || RndB[4..7]
     static BYTEV deriveSessionKey(const BYTEV& rndA, const BYTEV& rndB,
                                    DesfireKeyType kt);
+    static void  deriveSessionKey(const DesfireNonce& rndA, const DesfireNonce& rndB,
+                                  DesfireKeyType kt, DesfireSessionKey& out);
+
+    // EV2 (AES-128): SV1/SV2 = A55A/5AA5 || 00 01 00 80 || RndA[0..1] ||
+    //   (RndA[2..7] ⊕ RndB[0..5]) || RndB[6..15] || RndA[8..15]
+    //   KSesAuthENC = CMAC(K, SV1), KSesAuthMAC = CMAC(K, SV2)
+    static void deriveSessionKeysEV2(const BYTEV& rndA, const BYTEV& rndB, const BYTEV& key,
+                                     BYTEV& encKey, BYTEV& macKey);
 
     // ── Block/Nonce sizes ───────────────────────────────────────────────────
 
@@ -0,0 +1,179 @@
+#include "DesfireKeyDiversification.h"
+#include <cstring>
+
+namespace {
+
+using crypto::block::CmacAlgo;
+
+// Diversification sabitleri (C) — her biri bir CMAC bloğu üretir
+struct DivConstants {
+	BYTE   c[3];
+	size_t count;
+};
+
+DivConstants constantsFor(DesfireKeyType kt)
+{
+	switch (kt) {
+		case DesfireKeyType::TwoDES:   return { { 0x21, 0x22, 0x00 }, 2 };
+		case DesfireKeyType::ThreeDES: return { { 0x31, 0x32, 0x33 }, 3 };
+		default:                       return { { 0x01, 0x00, 0x00 }, 1 };
+	}
+}
+
+} // namespace
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Construction
+// ════════════════════════════════════════════════════════════════════════════════
+
+DesfireKeyDiversifier::DesfireKeyDiversifier(const BYTEV& masterKey, DesfireKeyType keyType,
+											 const BYTEV& systemIdentifier)
+{
+	setMasterKey(masterKey, keyType, systemIdentifier);
+}
+
+void DesfireKeyDiversifier::setMasterKey(const BYTEV& masterKey, DesfireKeyType keyType,
+										 const BYTEV& systemIdentifier)
+{
+	trySetMasterKey(masterKey, keyType, systemIdentifier).unwrap();
+}
+
+Result<void, PcscError> DesfireKeyDiversifier::trySetMasterKey(const BYTEV& masterKey, DesfireKeyType keyType,
+															   const BYTEV& systemIdentifier)
+{
+	using R = Result<void, PcscError>;
+	CmacAlgo algo;
+	size_t expected;
+	switch (keyType) {
+		case DesfireKeyType::AES128:   algo = CmacAlgo::AES128; expected = 16; break;
+		case DesfireKeyType::TwoDES:   algo = CmacAlgo::TDES2K; expected = 16; break;
+		case DesfireKeyType::ThreeDES: algo = CmacAlgo::TDES3K; expected = 24; break;
+		default:
+			return R::Err(Error<PcscError>(CardError::InvalidData)
+				.detail("AN10922: single DES master keys are not supported"));
+	}
+	if (masterKey.size() != expected)
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("AN10922: master key size mismatch")
+			.meta("expected", std::to_string(expected))
+			.meta("got", std::to_string(masterKey.size())));
+	if (UID_SIZE + 3 + systemIdentifier.size() > maxInputSize(keyType))
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("AN10922: system identifier too long")
+			.meta("max", std::to_string(maxInputSize(keyType) - UID_SIZE - 3)));
+
+	cmac_.setKey(algo, masterKey);
+	keyType_ = keyType;
+	sysId_   = systemIdentifier;
+	return R::Ok();
+}
+
+size_t DesfireKeyDiversifier::keySize() const
+{
+	return keyType_ == DesfireKeyType::ThreeDES ? 24 : 16;
+}
+
+size_t DesfireKeyDiversifier::maxInputSize(DesfireKeyType keyType)
+{
+	return keyType == DesfireKeyType::AES128 ? 31 : 15;
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Türetme
+// ════════════════════════════════════════════════════════════════════════════════
+
+void DesfireKeyDiversifier::diversifyInput(const BYTE* m, size_t mLen, BYTE* out)
+{
+	const size_t bs    = cmac_.blockSize();
+	const size_t padTo = 2 * bs;
+	const DivConstants dc = constantsFor(keyType_);
+
+	BYTE d[2 * crypto::block::Cmac::MAX_BLOCK];
+	std::memcpy(d + 1, m, mLen);
+	const size_t len = 1 + mLen;
+	if (len < padTo) {
+		d[len] = 0x80;
+		std::memset(d + len + 1, 0, padTo - len - 1);
+	}
+
+	for (size_t i = 0; i < dc.count; ++i, out += bs) {
+		d[0] = dc.c[i];
+		cmac_.reset();
+		cmac_.update(d, padTo);
+		if (len == padTo) cmac_.final(out);
+		else              cmac_.finalPadded(out);
+	}
+	std::memset(d, 0, sizeof(d));
+}
+
+BYTEV DesfireKeyDiversifier::diversify(const BYTEV& uid, const DesfireAID& aid)
+{
+	return tryDiversify(uid, aid).unwrap();
+}
+
+Result<BYTEV, PcscError> DesfireKeyDiversifier::tryDiversify(const BYTEV& uid, const DesfireAID& aid)
+{
+	using R = Result<BYTEV, PcscError>;
+	if (!ready())
+		return R::Err(Error<PcscError>(CardError::InvalidData).detail("AN10922: no master key"));
+	if (uid.size() != UID_SIZE)
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("AN10922: UID must be 7 bytes")
+			.meta("got", std::to_string(uid.size())));
+
+	BYTEV out(keySize());
+	diversifyBatch(uid.data(), 1, aid, out.data());
+	return R::Ok(std::move(out));
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Toplu türetme
+// ════════════════════════════════════════════════════════════════════════════════
+
+void DesfireKeyDiversifier::diversifyBatch(const BYTE* uids, size_t count, const DesfireAID& aid, BYTE* out)
+{
+	// M = UID || AID || SysID — AID ve SysID döngü dışında bir kez yazılır
+	BYTE m[31];
+	std::memcpy(m + UID_SIZE, aid.aid, 3);
+	if (!sysId_.empty()) std::memcpy(m + UID_SIZE + 3, sysId_.data(), sysId_.size());
+	const size_t mLen = UID_SIZE + 3 + sysId_.size();
+	const size_t ks   = keySize();
+
+	for (size_t i = 0; i < count; ++i) {
+		std::memcpy(m, uids + i * UID_SIZE, UID_SIZE);
+		diversifyInput(m, mLen, out + i * ks);
+	}
+}
+
+std::vector<BYTEV> DesfireKeyDiversifier::diversifyBatch(const std::vector<BYTEV>& uids, const DesfireAID& aid)
+{
+	return tryDiversifyBatch(uids, aid).unwrap();
+}
+
+Result<std::vector<BYTEV>, PcscError> DesfireKeyDiversifier::tryDiversifyBatch(const std::vector<BYTEV>& uids,
+																				const DesfireAID& aid)
+{
+	using R = Result<std::vector<BYTEV>, PcscError>;
+	if (!ready())
+		return R::Err(Error<PcscError>(CardError::InvalidData).detail("AN10922: no master key"));
+
+	BYTEV flat;
+	flat.reserve(uids.size() * UID_SIZE);
+	for (size_t i = 0; i < uids.size(); ++i) {
+		if (uids[i].size() != UID_SIZE)
+			return R::Err(Error<PcscError>(CardError::InvalidData)
+				.detail("AN10922: UID must be 7 bytes")
+				.meta("index", std::to_string(i)));
+		flat.insert(flat.end(), uids[i].begin(), uids[i].end());
+	}
+
+	const size_t ks = keySize();
+	BYTEV keys(uids.size() * ks);
+	diversifyBatch(flat.data(), uids.size(), aid, keys.data());
+
+	std::vector<BYTEV> out;
+	out.reserve(uids.size());
+	for (size_t i = 0; i < uids.size(); ++i)
+		out.emplace_back(keys.begin() + i * ks, keys.begin() + (i + 1) * ks);
+	return R::Ok(std::move(out));
+}
@@ -0,0 +1,89 @@
+#ifndef DESFIRE_KEY_DIVERSIFICATION_H
+#define DESFIRE_KEY_DIVERSIFICATION_H
+
+#include "CardDataTypes.h"
+#include "Result.h"
+#include "Cmac.h"
+#include "../CardModel/DesfireMemoryLayout.h"
+#include <cstddef>
+#include <vector>
+
+// ════════════════════════════════════════════════════════════════════════════════
+// DesfireKeyDiversifier — NXP AN10922 Kart Başına Key Türetme
+// ════════════════════════════════════════════════════════════════════════════════
+//
+// Kart key'i = CMAC(MasterKey, C || M), M = UID(7) || AID(3) || SystemIdentifier.
+// Dolgu her zaman iki bloğa tamamlanır (80 00..) ve son blok K2 ile kapanır;
+// M tam iki bloğu dolduruyorsa standart CMAC (K1) uygulanır.
+//
+//   AES-128 : C = 01                  → 16 byte   (M en fazla 31 byte)
+//   2K3DES  : C = 21, 22 → 8 + 8      → 16 byte   (M en fazla 15 byte)
+//   3K3DES  : C = 31, 32, 33 → 3 × 8  → 24 byte   (M en fazla 15 byte)
+//
+// Master key schedule ve K1/K2 nesne ömrü boyunca bir kez hazırlanır (Cmac);
+// her türetme yalnızca 2-6 blok şifrelemedir. Nesne durum taşır (CMAC
+// zinciri) → thread başına bir kopya kullanılmalı.
+//
+// 3DES key'lerinin parity bit'leri (DESFire key version) değiştirilmez;
+// ChangeKey'de versiyon gerekiyorsa çağıran ayarlar.
+//
+// ─── Kullanım ──────────────────────────────────────────────────────────────
+//
+//   DesfireKeyDiversifier div(masterKey, DesfireKeyType::AES128, sysId);
+//   io.selectApplication(aid);
+//   io.authenticateDesfireDiversified(div, 1);        // UID GetVersion'dan
+//
+//   // Ön kişiselleştirme: binlerce UID tek döngüde
+//   BYTEV keys(uids.size() / 7 * div.keySize());
+//   div.diversifyBatch(uids.data(), uids.size() / 7, aid, keys.data());
+//
+// ════════════════════════════════════════════════════════════════════════════════
+
+class DesfireKeyDiversifier {
+public:
+    static constexpr size_t UID_SIZE = 7;
+
+    DesfireKeyDiversifier() = default;
+    DesfireKeyDiversifier(const BYTEV& masterKey, DesfireKeyType keyType,
+                          const BYTEV& systemIdentifier = {});
+
+    // Master key / sistem tanımlayıcı değişimi: CMAC alt anahtarları yeniden hesaplanır
+    void setMasterKey(const BYTEV& masterKey, DesfireKeyType keyType,
+                      const BYTEV& systemIdentifier = {});
+    Result<void, PcscError> trySetMasterKey(const BYTEV& masterKey, DesfireKeyType keyType,
+                                            const BYTEV& systemIdentifier = {});
+
+    bool           ready() const { return cmac_.ready(); }
+    DesfireKeyType keyType() const { return keyType_; }
+    size_t         keySize() const;                     // türetilen key: 16 / 16 / 24
+    const BYTEV&   systemIdentifier() const { return sysId_; }
+
+    // M'nin üst sınırı: AES 31, 3DES 15 byte
+    static size_t maxInputSize(DesfireKeyType keyType);
+
+    // ── Tek kart ────────────────────────────────────────────────────────────
+
+    // M = UID || AID || SystemIdentifier
+    BYTEV diversify(const BYTEV& uid, const DesfireAID& aid);
+    Result<BYTEV, PcscError> tryDiversify(const BYTEV& uid, const DesfireAID& aid);
+
+    // Ham giriş (M çağırandan): out en az keySize() byte. Sınır kontrolü yok.
+    void diversifyInput(const BYTE* m, size_t mLen, BYTE* out);
+
+    // ── Toplu (ön kişiselleştirme) ──────────────────────────────────────────
+
+    // uids: count × 7 byte bitişik; out: count × keySize() byte bitişik.
+    // M tamponu bir kez kurulur, döngüde yalnızca UID kısmı değişir.
+    void diversifyBatch(const BYTE* uids, size_t count, const DesfireAID& aid, BYTE* out);
+
+    std::vector<BYTEV> diversifyBatch(const std::vector<BYTEV>& uids, const DesfireAID& aid);
+    Result<std::vector<BYTEV>, PcscError> tryDiversifyBatch(const std::vector<BYTEV>& uids,
+                                                            const DesfireAID& aid);
+
+private:
+    crypto::block::Cmac cmac_;
+    DesfireKeyType      keyType_ = DesfireKeyType::AES128;
+    BYTEV               sysId_;
+};
+
+#endif // DESFIRE_KEY_DIVERSIFICATION_H
@@ -0,0 +1,492 @@
+#include "DesfireProfile.h"
+#include "DesfireCommands.h"
+#include "DesfireCrypto.h"
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+
+namespace {
+
+constexpr BYTE     MAX_APPS   = 28;
+constexpr BYTE     MAX_FILES  = 32;
+constexpr uint32_t MAX_SIZE   = 0xFFFFFF;      // 3 byte LE alanlar
+constexpr uint32_t ALLOC_UNIT = 32;            // kart belleği ayırma birimi
+
+PcscError invalid(const char* what, const DesfireAID& aid)
+{
+	return Error<PcscError>(CardError::InvalidData)
+		.detail(what)
+		.meta("app", std::to_string(aid.toUint()));
+}
+
+PcscError invalidFile(const char* what, const DesfireAID& aid, BYTE fileNo)
+{
+	return Error<PcscError>(CardError::InvalidData)
+		.detail(what)
+		.meta("app", std::to_string(aid.toUint()))
+		.meta("file", std::to_string(fileNo));
+}
+
+// Access rights'taki key numarası: app'te var olmalı veya 0x0E/0x0F
+bool keyInRange(BYTE key, BYTE keyCount)
+{
+	return key < keyCount || key >= 0x0E;
+}
+
+// Kişiselleştirme oturumu app master key'i (0) ile açılır
+bool masterAllows(BYTE key)
+{
+	return key == 0x0E || key == 0x00;
+}
+
+BYTEV createCommand(BYTE fileNo, const DesfireFileSettings& fs)
+{
+	switch (fs.fileType) {
+		case DesfireFileType::StandardData:
+			return DesfireCommands::createStdDataFile(fileNo, fs.commMode, fs.access, fs.standard.fileSize);
+		case DesfireFileType::BackupData:
+			return DesfireCommands::createBackupDataFile(fileNo, fs.commMode, fs.access, fs.standard.fileSize);
+		case DesfireFileType::Value:
+			return DesfireCommands::createValueFile(fileNo, fs.commMode, fs.access, fs.value.lowerLimit,
+													fs.value.upperLimit, fs.value.value, fs.value.limitedCreditEnabled);
+		case DesfireFileType::LinearRecord:
+			return DesfireCommands::createLinearRecordFile(fileNo, fs.commMode, fs.access,
+														   fs.record.recordSize, fs.record.maxRecords);
+		default:
+			return DesfireCommands::createCyclicRecordFile(fileNo, fs.commMode, fs.access,
+														   fs.record.recordSize, fs.record.maxRecords);
+	}
+}
+
+DesfireScriptStep makeAuth(const DesfireAID& aid, BYTE keyNo, DesfireKeyType keyType, const BYTEV& key, bool ev2)
+{
+	DesfireScriptStep s;
+	s.op      = DesfireScriptOp::Authenticate;
+	s.aid     = aid;
+	s.fileNo  = keyNo;
+	s.keyType = keyType;
+	s.key     = key;
+	s.ev2     = ev2 && keyType == DesfireKeyType::AES128;
+	return s;
+}
+
+DesfireScriptStep makeCommand(DesfireScriptOp op, const DesfireAID& aid, BYTE fileNo, BYTEV apdu)
+{
+	DesfireScriptStep s;
+	s.op     = op;
+	s.aid    = aid;
+	s.fileNo = fileNo;
+	s.apdu   = std::move(apdu);
+	return s;
+}
+
+} // namespace
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Profil builder
+// ════════════════════════════════════════════════════════════════════════════════
+
+DesfireProfileApp& DesfireProfile::addApp(const DesfireAID& aid, BYTE keySettings, BYTE keyCount,
+										  DesfireKeyType keyType)
+{
+	DesfireProfileApp app;
+	app.aid = aid;
+	app.keyConfig.keySettings = keySettings;
+	app.keyConfig.keyCount    = keyCount;
+	app.keyConfig.keyType     = keyType;
+	apps.push_back(std::move(app));
+	return apps.back();
+}
+
+DesfireProfileApp& DesfireProfileApp::addFile(BYTE fileNo, const DesfireFileSettings& fs, const BYTEV& initialData)
+{
+	DesfireProfileFile f;
+	f.fileNo      = fileNo;
+	f.settings    = fs;
+	f.initialData = initialData;
+	files.push_back(std::move(f));
+	return *this;
+}
+
+DesfireProfileApp& DesfireProfileApp::addStdDataFile(BYTE fileNo, DesfireCommMode comm,
+													 const DesfireAccessRights& access, uint32_t fileSize,
+													 const BYTEV& initialData)
+{
+	DesfireFileSettings fs;
+	fs.fileType = DesfireFileType::StandardData;
+	fs.commMode = comm;
+	fs.access   = access;
+	fs.standard.fileSize = fileSize;
+	return addFile(fileNo, fs, initialData);
+}
+
+DesfireProfileApp& DesfireProfileApp::addBackupDataFile(BYTE fileNo, DesfireCommMode comm,
+														const DesfireAccessRights& access, uint32_t fileSize,
+														const BYTEV& initialData)
+{
+	DesfireFileSettings fs;
+	fs.fileType = DesfireFileType::BackupData;
+	fs.commMode = comm;
+	fs.access   = access;
+	fs.standard.fileSize = fileSize;
+	return addFile(fileNo, fs, initialData);
+}
+
+DesfireProfileApp& DesfireProfileApp::addValueFile(BYTE fileNo, DesfireCommMode comm,
+												   const DesfireAccessRights& access, int32_t lower,
+												   int32_t upper, int32_t value, bool limitedCredit)
+{
+	DesfireFileSettings fs;
+	fs.fileType = DesfireFileType::Value;
+	fs.commMode = comm;
+	fs.access   = access;
+	fs.value.lowerLimit = lower;
+	fs.value.upperLimit = upper;
+	fs.value.value      = value;
+	fs.value.limitedCreditEnabled = limitedCredit;
+	return addFile(fileNo, fs);
+}
+
+DesfireProfileApp& DesfireProfileApp::addLinearRecordFile(BYTE fileNo, DesfireCommMode comm,
+														  const DesfireAccessRights& access,
+														  uint32_t recordSize, uint32_t maxRecords)
+{
+	DesfireFileSettings fs;
+	fs.fileType = DesfireFileType::LinearRecord;
+	fs.commMode = comm;
+	fs.access   = access;
+	fs.record.recordSize = recordSize;
+	fs.record.maxRecords = maxRecords;
+	return addFile(fileNo, fs);
+}
+
+DesfireProfileApp& DesfireProfileApp::addCyclicRecordFile(BYTE fileNo, DesfireCommMode comm,
+														  const DesfireAccessRights& access,
+														  uint32_t recordSize, uint32_t maxRecords)
+{
+	DesfireFileSettings fs;
+	fs.fileType = DesfireFileType::CyclicRecord;
+	fs.commMode = comm;
+	fs.access   = access;
+	fs.record.recordSize = recordSize;
+	fs.record.maxRecords = maxRecords;
+	return addFile(fileNo, fs);
+}
+
+DesfireProfileApp& DesfireProfileApp::addKey(BYTE keyNo, const BYTEV& newKey, BYTE keyVersion, const BYTEV& oldKey)
+{
+	DesfireProfileKey k;
+	k.keyNo      = keyNo;
+	k.newKey     = newKey;
+	k.keyVersion = keyVersion;
+	k.oldKey     = oldKey;
+	keys.push_back(std::move(k));
+	return *this;
+}
+
+DesfireProfileApp& DesfireProfileApp::addDiversifiedKey(BYTE keyNo, BYTE keyVersion, const BYTEV& oldKey)
+{
+	DesfireProfileKey k;
+	k.keyNo      = keyNo;
+	k.keyVersion = keyVersion;
+	k.oldKey     = oldKey;
+	k.diversify  = true;
+	keys.push_back(std::move(k));
+	return *this;
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Doğrulama
+// ════════════════════════════════════════════════════════════════════════════════
+
+uint32_t DesfireScript::footprint(const DesfireFileSettings& fs)
+{
+	uint64_t bytes = 0;
+	switch (fs.fileType) {
+		case DesfireFileType::StandardData: bytes = fs.standard.fileSize; break;
+		case DesfireFileType::BackupData:   bytes = fs.standard.fileSize; break;
+		case DesfireFileType::Value:        bytes = 4; break;
+		default: bytes = static_cast<uint64_t>(fs.record.recordSize) * fs.record.maxRecords; break;
+	}
+	bytes = (bytes + ALLOC_UNIT - 1) / ALLOC_UNIT * ALLOC_UNIT;
+	if (fs.fileType == DesfireFileType::BackupData) bytes *= 2;    // ayna kopya
+	return bytes > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(bytes);
+}
+
+Result<void, PcscError> DesfireScript::validate(const DesfireProfile& profile, const DesfireMemoryLayout& target)
+{
+	using R = Result<void, PcscError>;
+	const DesfireAID picc = DesfireAID::picc();
+
+	if (profile.apps.empty() && !profile.format)
+		return R::Err(Error<PcscError>(CardError::InvalidData).detail("Profile is empty"));
+	if (profile.format && profile.piccKey.empty())
+		return R::Err(invalid("FormatPICC needs the PICC master key", picc));
+	if (!profile.piccKey.empty() && profile.piccKey.size() != DesfireCrypto::keySize(profile.piccKeyType))
+		return R::Err(invalid("PICC key size does not match its key type", picc));
+
+	// Kart seviyesi: app sayısı, çakışan AID'ler
+	const bool known = target.appListKnown && !profile.format;
+	const size_t existing = known ? target.applications.size() : 0;
+	if (existing + profile.apps.size() > MAX_APPS)
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Too many applications for the card")
+			.meta("existing", std::to_string(existing))
+			.meta("profile", std::to_string(profile.apps.size())));
+
+	uint64_t required = 0;
+	for (size_t i = 0; i < profile.apps.size(); ++i) {
+		const DesfireProfileApp& app = profile.apps[i];
+		const DesfireKeyConfig&  kc  = app.keyConfig;
+		if (app.aid.isPICC()) return R::Err(invalid("Application AID must not be the PICC AID", app.aid));
+		for (size_t j = 0; j < i; ++j)
+			if (profile.apps[j].aid == app.aid) return R::Err(invalid("Duplicate application AID", app.aid));
+		if (known && target.hasApp(app.aid))
+			return R::Err(invalid("Application already exists on the card", app.aid));
+		if (kc.keyCount < 1 || kc.keyCount > 14)
+			return R::Err(invalid("Application key count must be 1..14", app.aid));
+
+		// Dosyalar
+		if (app.files.size() > MAX_FILES) return R::Err(invalid("Too many files", app.aid));
+		for (size_t f = 0; f < app.files.size(); ++f) {
+			const DesfireProfileFile&  pf = app.files[f];
+			const DesfireFileSettings& fs = pf.settings;
+			const DesfireAccessRights& a  = fs.access;
+			if (pf.fileNo >= MAX_FILES) return R::Err(invalidFile("File number must be below 32", app.aid, pf.fileNo));
+			for (size_t g = 0; g < f; ++g)
+				if (app.files[g].fileNo == pf.fileNo)
+					return R::Err(invalidFile("Duplicate file number", app.aid, pf.fileNo));
+			if (!keyInRange(a.readKey, kc.keyCount) || !keyInRange(a.writeKey, kc.keyCount) ||
+				!keyInRange(a.readWriteKey, kc.keyCount) || !keyInRange(a.changeKey, kc.keyCount))
+				return R::Err(invalidFile("Access rights name a key the application does not have",
+										  app.aid, pf.fileNo));
+
+			switch (fs.fileType) {
+				case DesfireFileType::StandardData:
+				case DesfireFileType::BackupData:
+					if (fs.standard.fileSize == 0 || fs.standard.fileSize > MAX_SIZE)
+						return R::Err(invalidFile("File size must be 1..0xFFFFFF", app.aid, pf.fileNo));
+					if (pf.initialData.size() > fs.standard.fileSize)
+						return R::Err(invalidFile("Initial data exceeds file size", app.aid, pf.fileNo));
+					break;
+				case DesfireFileType::Value:
+					if (fs.value.lowerLimit > fs.value.upperLimit ||
+						fs.value.value < fs.value.lowerLimit || fs.value.value > fs.value.upperLimit)
+						return R::Err(invalidFile("Value must lie within lower..upper limit", app.aid, pf.fileNo));
+					break;
+				case DesfireFileType::LinearRecord:
+				case DesfireFileType::CyclicRecord:
+					if (fs.record.recordSize == 0 || fs.record.recordSize > MAX_SIZE ||
+						fs.record.maxRecords == 0 || fs.record.maxRecords > MAX_SIZE)
+						return R::Err(invalidFile("Record size and count must be 1..0xFFFFFF", app.aid, pf.fileNo));
+					if (fs.fileType == DesfireFileType::CyclicRecord && fs.record.maxRecords < 2)
+						return R::Err(invalidFile("Cyclic record file needs at least 2 records", app.aid, pf.fileNo));
+					break;
+				default:
+					return R::Err(invalidFile("Unknown file type", app.aid, pf.fileNo));
+			}
+			if (!pf.initialData.empty()) {
+				if (fs.fileType != DesfireFileType::StandardData && fs.fileType != DesfireFileType::BackupData)
+					return R::Err(invalidFile("Initial data is only supported for data files", app.aid, pf.fileNo));
+				if (!masterAllows(a.writeKey) && !masterAllows(a.readWriteKey))
+					return R::Err(Error<PcscError>(DesfireError::PermissionDenied)
+						.detail("Initial data needs write access for the application master key")
+						.meta("app", std::to_string(app.aid.toUint()))
+						.meta("file", std::to_string(pf.fileNo)));
+			}
+			required += footprint(fs);
+		}
+
+		// Key'ler: oturum app master key'i (0) ile açık
+		const size_t ks = DesfireCrypto::keySize(kc.keyType);
+		for (size_t k = 0; k < app.keys.size(); ++k) {
+			const DesfireProfileKey& pk = app.keys[k];
+			if (pk.keyNo >= kc.keyCount) return R::Err(invalidFile("Key number exceeds key count", app.aid, pk.keyNo));
+			for (size_t m = 0; m < k; ++m)
+				if (app.keys[m].keyNo == pk.keyNo)
+					return R::Err(invalidFile("Duplicate key number", app.aid, pk.keyNo));
+			if (!pk.diversify && pk.newKey.size() != ks)
+				return R::Err(invalidFile("Key size does not match the application key type", app.aid, pk.keyNo));
+			if (pk.diversify && kc.keyType == DesfireKeyType::DES)
+				return R::Err(invalidFile("Single DES keys cannot be diversified", app.aid, pk.keyNo));
+			if (!pk.oldKey.empty() && pk.oldKey.size() != ks)
+				return R::Err(invalidFile("Old key size does not match the application key type", app.aid, pk.keyNo));
+			if (pk.keyNo == 0 && !kc.allowChangeMasterKey())
+				return R::Err(Error<PcscError>(DesfireError::PermissionDenied)
+					.detail("Key settings freeze the application master key")
+					.meta("app", std::to_string(app.aid.toUint())));
+			if (pk.keyNo != 0 && (kc.keySettings >> 4) != 0)
+				return R::Err(Error<PcscError>(DesfireError::PermissionDenied)
+					.detail("Key settings must let the master key change application keys")
+					.meta("app", std::to_string(app.aid.toUint()))
+					.meta("key", std::to_string(pk.keyNo)));
+		}
+	}
+
+	// Kapasite: format → tüm bellek, aksi halde GetFreeMemory
+	const size_t available = profile.format ? target.totalMemory : target.freeMemory;
+	if (available && required > available)
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Profile exceeds card memory")
+			.meta("required", std::to_string(required))
+			.meta("available", std::to_string(available)));
+	return R::Ok();
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Derleme
+// ════════════════════════════════════════════════════════════════════════════════
+
+DesfireScript DesfireScript::compile(const DesfireProfile& profile, const DesfireMemoryLayout& target)
+{
+	return tryCompile(profile, target).unwrap();
+}
+
+Result<DesfireScript, PcscError> DesfireScript::tryCompile(const DesfireProfile& profile,
+														   const DesfireMemoryLayout& target)
+{
+	using R = Result<DesfireScript, PcscError>;
+	auto v = validate(profile, target);
+	if (!v) return R::Err(std::move(v.error()));
+
+	DesfireScript sc;
+	std::vector<DesfireScriptStep>& out = sc.steps_;
+	const DesfireAID picc = DesfireAID::picc();
+	sc.format_ = profile.format;
+
+	// ── PICC seviyesi: auth → format → tüm app'ler tek auth altında ─────────
+	if (!profile.piccKey.empty()) {
+		out.push_back(makeCommand(DesfireScriptOp::Select, picc, 0xFF, DesfireCommands::selectApplication(picc)));
+		out.push_back(makeAuth(picc, 0, profile.piccKeyType, profile.piccKey, profile.useEV2Auth));
+	}
+	if (profile.format)
+		out.push_back(makeCommand(DesfireScriptOp::Format, picc, 0xFF, DesfireCommands::formatPICC()));
+	for (const auto& app : profile.apps) {
+		const DesfireKeyConfig& kc = app.keyConfig;
+		out.push_back(makeCommand(DesfireScriptOp::CreateApp, app.aid, 0xFF,
+			DesfireCommands::createApplication(app.aid, kc.keySettings, kc.keyCount, kc.keyType)));
+	}
+
+	// ── App seviyesi ────────────────────────────────────────────────────────
+	sc.apps_.reserve(profile.apps.size());
+	for (const auto& app : profile.apps) {
+		const DesfireKeyConfig& kc = app.keyConfig;
+		out.push_back(makeCommand(DesfireScriptOp::Select, app.aid, 0xFF, DesfireCommands::selectApplication(app.aid)));
+		out.push_back(makeAuth(app.aid, 0, kc.keyType, BYTEV(DesfireCrypto::keySize(kc.keyType), 0x00),
+							   profile.useEV2Auth));
+
+		DesfireApplication model;
+		model.aid           = app.aid;
+		model.keyConfig     = kc;
+		model.fileListKnown = true;
+		for (const auto& pf : app.files) {
+			out.push_back(makeCommand(DesfireScriptOp::CreateFile, app.aid, pf.fileNo,
+									  createCommand(pf.fileNo, pf.settings)));
+			DesfireFile& f  = model.ensureFile(pf.fileNo);
+			f.settings      = pf.settings;
+			f.settingsKnown = true;
+			sc.requiredMemory_ += footprint(pf.settings);
+		}
+
+		bool backupWritten = false;
+		for (const auto& pf : app.files) {
+			if (pf.initialData.empty()) continue;
+			DesfireScriptStep s = makeCommand(DesfireScriptOp::WriteData, app.aid, pf.fileNo,
+											  DesfireCommands::writeData(pf.fileNo, 0, pf.initialData));
+			s.headerLen = 7;
+			s.mode      = pf.settings.commMode;
+			out.push_back(std::move(s));
+			backupWritten |= pf.settings.fileType == DesfireFileType::BackupData;
+		}
+		if (backupWritten)
+			out.push_back(makeCommand(DesfireScriptOp::Commit, app.aid, 0xFF, DesfireCommands::commitTransaction()));
+
+		// Key'ler: diğerleri numara sırasıyla, master (auth key'i) en son
+		std::vector<const DesfireProfileKey*> keys;
+		for (const auto& k : app.keys) keys.push_back(&k);
+		std::sort(keys.begin(), keys.end(), [](const DesfireProfileKey* a, const DesfireProfileKey* b) {
+			return (a->keyNo == 0 ? 0x100 : a->keyNo) < (b->keyNo == 0 ? 0x100 : b->keyNo);
+		});
+		for (const DesfireProfileKey* k : keys) {
+			DesfireScriptStep s;
+			s.op         = DesfireScriptOp::ChangeKey;
+			s.aid        = app.aid;
+			s.fileNo     = k->keyNo;
+			s.keyType    = kc.keyType;
+			s.key        = k->newKey;
+			s.oldKey     = k->oldKey;
+			s.keyVersion = k->keyVersion;
+			s.diversify  = k->diversify;
+			sc.diversify_ |= k->diversify;
+			out.push_back(std::move(s));
+		}
+		sc.apps_.push_back(std::move(model));
+	}
+	return R::Ok(std::move(sc));
+}
+
+void DesfireScript::wipeKeys()
+{
+	for (auto& s : steps_) {
+		std::fill(s.key.begin(), s.key.end(), 0);
+		std::fill(s.oldKey.begin(), s.oldKey.end(), 0);
+	}
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Rapor
+// ════════════════════════════════════════════════════════════════════════════════
+
+const char* desfireScriptOpName(DesfireScriptOp op)
+{
+	switch (op) {
+		case DesfireScriptOp::Select:       return "Select";
+		case DesfireScriptOp::Authenticate: return "Authenticate";
+		case DesfireScriptOp::Format:       return "Format";
+		case DesfireScriptOp::CreateApp:    return "CreateApp";
+		case DesfireScriptOp::CreateFile:   return "CreateFile";
+		case DesfireScriptOp::WriteData:    return "WriteData";
+		case DesfireScriptOp::Commit:       return "Commit";
+		case DesfireScriptOp::ChangeKey:    return "ChangeKey";
+		default:                            return "?";
+	}
+}
+
+uint64_t DesfireScriptReport::micros(DesfireScriptOp op) const
+{
+	uint64_t t = 0;
+	for (const auto& e : events)
+		if (e.op == op) t += e.micros;
+	return t;
+}
+
+uint32_t DesfireScriptReport::count(DesfireScriptOp op) const
+{
+	uint32_t n = 0;
+	for (const auto& e : events)
+		if (e.op == op) ++n;
+	return n;
+}
+
+void DesfireScriptReport::print(std::ostream& os) const
+{
+	char line[128];
+	std::snprintf(line, sizeof(line), "DESFire script: %s, %zu cmd, total %llu us\n",
+				  completed ? "completed" : "FAILED", events.size(), static_cast<unsigned long long>(totalMicros));
+	os << line;
+	for (const auto& e : events) {
+		std::snprintf(line, sizeof(line), "  %-13s %06X", desfireScriptOpName(e.op), e.aid.toUint());
+		os << line;
+		if (e.fileNo != 0xFF) {
+			std::snprintf(line, sizeof(line), " %s %-3d", e.op == DesfireScriptOp::CreateFile ||
+						  e.op == DesfireScriptOp::WriteData ? "file" : "key ", e.fileNo);
+			os << line;
+		} else {
+			os << "         ";
+		}
+		std::snprintf(line, sizeof(line), " %10llu us", static_cast<unsigned long long>(e.micros));
+		os << line;
+		if (!e.ok) os << "  FAIL " << e.error;
+		os << "\n";
+	}
+}
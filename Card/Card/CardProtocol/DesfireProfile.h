@@ -0,0 +1,249 @@
+#ifndef DESFIRE_PROFILE_H
+#define DESFIRE_PROFILE_H
+
+#include "CardDataTypes.h"
+#include "Result.h"
+#include "../CardModel/DesfireMemoryLayout.h"
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// ════════════════════════════════════════════════════════════════════════════════
+// DesfireProfile — Bildirimsel Kişiselleştirme, Derlenmiş APDU Betiği
+// ════════════════════════════════════════════════════════════════════════════════
+//
+// Seri kişiselleştirmede her kart aynı ağacı alır: (format) → uygulamalar →
+// dosyalar → başlangıç verisi → key değişimi. Profil bu ağacı veri olarak
+// tanımlar; DesfireScript::tryCompile onu bir kez doğrular ve düz APDU
+// dizisine çevirir. Karttan karta yalnızca hazır komutlar gönderilir.
+//
+//   1. Doğrulama (tryCompile): AID/dosya/key numaraları, dosya parametreleri,
+//      access rights'taki key numaraları (keyCount'a göre), başlangıç verisi
+//      için yazma hakkı, key değişim izinleri (keySettings) ve hedef modelin
+//      bellek kapasitesi (dosya başına 32 byte'lık bloklar, backup × 2).
+//      Hata varsa betik üretilmez.
+//   2. Derleme: Select / Create* / WriteData / Commit APDU'ları hazırlanır.
+//      Sıra: PICC auth → format → tüm CreateApplication'lar → app başına
+//      Select, fabrika key'iyle auth, dosyalar, veri, key'ler (master en son).
+//   3. Yürütme (CardIO::tryRunDesfireScript): hazır komutlar sırayla; model
+//      create komutlarında olduğu gibi güncellenir.
+//
+// Oturuma bağlı kısımlar önceden üretilemez: auth el sıkışması ve ChangeKey
+// kriptogramı (session key + IV zinciri) yürütmede doldurulur; diversified
+// key'ler (AN10922) kart UID'inden yürütmede türetilir. Secure messaging
+// (MAC / Full) DesfireTransaction'daki gibi gönderim anında uygulanır.
+//
+// PICC master key değişimi profil kapsamında değildir (kartı kilitleme riski).
+//
+// ─── Kullanım ──────────────────────────────────────────────────────────────
+//
+//   DesfireProfile p;
+//   p.piccKey = piccMaster;  p.format = true;
+//   DesfireProfileApp& app = p.addApp(DesfireAID::fromUint(0x010203), 0x0B, 3);
+//   app.addStdDataFile(1, DesfireCommMode::Full, acc, 64, header);
+//   app.addValueFile(2, DesfireCommMode::MAC, acc, 0, 10000, 0);
+//   app.addKey(1, readKey).addKey(0, appMaster);
+//
+//   auto script = DesfireScript::tryCompile(p, io.card().getDesfireMemory());
+//   DesfireScriptReport rep;
+//   for (each card) io.tryRunDesfireScript(script.unwrap(), rep);
+//
+// ════════════════════════════════════════════════════════════════════════════════
+
+// ── Profil ──────────────────────────────────────────────────────────────────
+
+struct DesfireProfileFile {
+    BYTE                fileNo = 0;
+    DesfireFileSettings settings;           // tip, comm mode, access, boyutlar
+    BYTEV               initialData;        // Std/Backup: offset 0'a yazılır
+};
+
+struct DesfireProfileKey {
+    BYTE  keyNo      = 0;
+    BYTEV newKey;                           // diversify → boş bırakılabilir
+    BYTE  keyVersion = 0;                   // AES; (3)DES'te parity bit'lerinde
+    BYTEV oldKey;                           // boş → fabrika key'i (sıfır)
+    bool  diversify  = false;               // yeni key = AN10922(UID, AID)
+};
+
+struct DesfireProfileApp {
+    DesfireAID                      aid;
+    DesfireKeyConfig                keyConfig;
+    std::vector<DesfireProfileFile> files;
+    std::vector<DesfireProfileKey>  keys;   // sıra önemsiz, master en son değişir
+
+    DesfireProfileApp& addFile(BYTE fileNo, const DesfireFileSettings& fs, const BYTEV& initialData = {});
+    DesfireProfileApp& addStdDataFile(BYTE fileNo, DesfireCommMode comm, const DesfireAccessRights& access,
+                                      uint32_t fileSize, const BYTEV& initialData = {});
+    DesfireProfileApp& addBackupDataFile(BYTE fileNo, DesfireCommMode comm, const DesfireAccessRights& access,
+                                         uint32_t fileSize, const BYTEV& initialData = {});
+    DesfireProfileApp& addValueFile(BYTE fileNo, DesfireCommMode comm, const DesfireAccessRights& access,
+                                    int32_t lower, int32_t upper, int32_t value, bool limitedCredit = false);
+    DesfireProfileApp& addLinearRecordFile(BYTE fileNo, DesfireCommMode comm, const DesfireAccessRights& access,
+                                           uint32_t recordSize, uint32_t maxRecords);
+    DesfireProfileApp& addCyclicRecordFile(BYTE fileNo, DesfireCommMode comm, const DesfireAccessRights& access,
+                                           uint32_t recordSize, uint32_t maxRecords);
+    DesfireProfileApp& addKey(BYTE keyNo, const BYTEV& newKey, BYTE keyVersion = 0, const BYTEV& oldKey = {});
+    DesfireProfileApp& addDiversifiedKey(BYTE keyNo, BYTE keyVersion = 0, const BYTEV& oldKey = {});
+};
+
+struct DesfireProfile {
+    BYTEV          piccKey;                 // boş → PICC auth yok (serbest create)
+    DesfireKeyType piccKeyType = DesfireKeyType::AES128;
+    bool           format      = false;     // FormatPICC (piccKey gerekir)
+    bool           useEV2Auth  = false;     // AES key'lerde EV2First (EV2/EV3 kart)
+    std::vector<DesfireProfileApp> apps;
+
+    DesfireProfileApp& addApp(const DesfireAID& aid, BYTE keySettings, BYTE keyCount,
+                              DesfireKeyType keyType = DesfireKeyType::AES128);
+};
+
+// ── Betik ───────────────────────────────────────────────────────────────────
+
+enum class DesfireScriptOp : BYTE {
+    Select = 0,
+    Authenticate,
+    Format,
+    CreateApp,
+    CreateFile,
+    WriteData,
+    Commit,
+    ChangeKey,
+    Count
+};
+
+const char* desfireScriptOpName(DesfireScriptOp op);
+
+struct DesfireScriptStep {
+    DesfireScriptOp op        = DesfireScriptOp::Select;
+    DesfireAID      aid;                    // adımın çalıştığı / oluşturduğu app
+    BYTE            fileNo    = 0xFF;       // dosya veya key numarası (0xFF → yok)
+    BYTEV           apdu;                   // hazır düz komut (auth/ChangeKey hariç)
+    size_t          headerLen = 0;          // Full modda açık kalan veri byte'ı
+    DesfireCommMode mode      = DesfireCommMode::Plain;     // WriteData
+    DesfireKeyType  keyType   = DesfireKeyType::AES128;     // Authenticate / ChangeKey
+    BYTEV           key;                    // auth key'i / yeni key
+    BYTEV           oldKey;                 // ChangeKey
+    BYTE            keyVersion = 0;
+    bool            diversify  = false;     // ChangeKey: key yürütmede türetilir
+    bool            ev2        = false;     // Authenticate: EV2First
+};
+
+// ── Rapor ───────────────────────────────────────────────────────────────────
+
+struct DesfireScriptEvent {
+    DesfireScriptOp op     = DesfireScriptOp::Select;
+    DesfireAID      aid;
+    BYTE            fileNo = 0xFF;
+    uint64_t        micros = 0;
+    bool            ok     = true;
+    std::string     error;
+};
+
+struct DesfireScriptReport {
+    std::vector<DesfireScriptEvent> events; // karta giden her adım, sırayla
+    uint64_t totalMicros = 0;
+    int      failedStep  = -1;              // başarısız adım (steps() index'i)
+    bool     completed   = false;
+
+    void     record(DesfireScriptEvent ev) { events.push_back(std::move(ev)); }
+    uint64_t micros(DesfireScriptOp op) const;
+    uint32_t count(DesfireScriptOp op) const;
+
+    void print(std::ostream& os) const;
+};
+
+class DesfireScript {
+public:
+    DesfireScript() = default;
+    DesfireScript(const DesfireScript&) = default;
+    DesfireScript(DesfireScript&&) = default;
+    DesfireScript& operator=(const DesfireScript&) = default;
+    DesfireScript& operator=(DesfireScript&&) = default;
+    ~DesfireScript() { wipeKeys(); }
+
+    // Profil → betik. target: kişiselleştirilecek kartın modeli (kapasite,
+    // mevcut app'ler); totalMemory/freeMemory 0 ise kapasite denetlenmez.
+    static DesfireScript compile(const DesfireProfile& profile, const DesfireMemoryLayout& target);
+    static Result<DesfireScript, PcscError> tryCompile(const DesfireProfile& profile,
+                                                       const DesfireMemoryLayout& target);
+
+    // Yalnızca doğrulama (tryCompile'ın ilk aşaması)
+    static Result<void, PcscError> validate(const DesfireProfile& profile, const DesfireMemoryLayout& target);
+
+    // Dosyanın karttaki yeri: 32 byte'lık bloklara yuvarlanır, backup iki kopya
+    static uint32_t footprint(const DesfireFileSettings& fs);
+
+    const std::vector<DesfireScriptStep>& steps() const { return steps_; }
+    size_t size()  const { return steps_.size(); }
+    bool   empty() const { return steps_.empty(); }
+
+    bool formats()             const { return format_; }
+    bool needsDiversifier()    const { return diversify_; }
+    uint32_t requiredMemory()  const { return requiredMemory_; }
+
+    // Betik başarıyla bittiğinde karttaki app'ler (keyConfig + dosya settings)
+    const std::vector<DesfireApplication>& applications() const { return apps_; }
+
+    // exec(const DesfireScriptStep&) → Result<void, PcscError>. İlk hatada
+    // durur; hata "script step N" bilgisiyle döner. rep her durumda doldurulur.
+    template<typename ExecFn>
+    Result<void, PcscError> tryRun(ExecFn&& exec, DesfireScriptReport& rep) const;
+
+    void wipeKeys();
+
+private:
+    std::vector<DesfireScriptStep>  steps_;
+    std::vector<DesfireApplication> apps_;
+    uint32_t requiredMemory_ = 0;
+    bool     format_    = false;
+    bool     diversify_ = false;
+};
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Template implementations
+// ════════════════════════════════════════════════════════════════════════════════
+
+template<typename ExecFn>
+Result<void, PcscError> DesfireScript::tryRun(ExecFn&& exec, DesfireScriptReport& rep) const
+{
+	using R = Result<void, PcscError>;
+	using Clock = std::chrono::steady_clock;
+	if (steps_.empty())
+		return R::Err(Error<PcscError>(CardError::InvalidData).detail("Script has no steps"));
+
+	const auto start = Clock::now();
+	auto finish = [&] {
+		rep.totalMicros += static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+	};
+
+	for (size_t i = 0; i < steps_.size(); ++i) {
+		const DesfireScriptStep& s = steps_[i];
+		const auto t = Clock::now();
+		auto r = exec(s);
+		DesfireScriptEvent ev;
+		ev.op     = s.op;
+		ev.aid    = s.aid;
+		ev.fileNo = s.fileNo;
+		ev.micros = static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t).count());
+		ev.ok = static_cast<bool>(r);
+		if (!r) ev.error = r.error().message();
+		rep.record(std::move(ev));
+		if (r) continue;
+
+		rep.failedStep = static_cast<int>(i);
+		finish();
+		PcscError e = std::move(r.error());
+		e.detail += " (script step " + std::to_string(i) + ": " + desfireScriptOpName(s.op) + ")";
+		return R::Err(std::move(e));
+	}
+	rep.completed = true;
+	finish();
+	return R::Ok();
+}
+
+#endif // DESFIRE_PROFILE_H
@@ -1,7 +1,170 @@
 #include "DesfireSecureMessaging.h"
+#include "DesfireCrypto.h"
 #include "BlockCipher.h"
 #include "Result.h"
+#include <algorithm>
 #include <cstring>
+#include <string>
+
+namespace {
+
+// Session key tipine göre ham CBC (dolgusuz). DES tek key → 2K3DES (K1 = K2).
+BYTEV cbc(const DesfireSession& s, const BYTEV& iv, const BYTE* data, size_t len, bool encrypt)
+{
+    switch (s.keyType) {
+    case DesfireKeyType::AES128:
+        return encrypt ? crypto::block::encryptAesCbc(s.sessionKey, iv, data, len)
+                       : crypto::block::decryptAesCbc(s.sessionKey, iv, data, len);
+    case DesfireKeyType::ThreeDES:
+        return encrypt ? crypto::block::encrypt3K3DesCbc(s.sessionKey, iv, data, len)
+                       : crypto::block::decrypt3K3DesCbc(s.sessionKey, iv, data, len);
+    default: {
+        BYTEV key = s.sessionKey;
+        if (key.size() == 8) key.insert(key.end(), s.sessionKey.begin(), s.sessionKey.end());
+        return encrypt ? crypto::block::encrypt2K3DesCbc(key, iv, data, len)
+                       : crypto::block::decrypt2K3DesCbc(key, iv, data, len);
+    }
+    }
+}
+
+// Geçerli zincir IV'ı (boş / yanlış boyut → sıfır IV)
+BYTEV chainIV(const DesfireSession& s, size_t bs)
+{
+    return s.iv.size() == bs ? s.iv : BYTEV(bs, 0);
+}
+
+// Session'ın CMAC motorunu zincir IV'ı ile başlat; parçalar kopyasız eklenir
+crypto::block::Cmac& beginMac(DesfireSession& s)
+{
+    crypto::block::Cmac& mac = s.macEngine();
+    mac.reset(s.iv.size() == mac.blockSize() ? s.iv.data() : nullptr);
+    return mac;
+}
+
+// Tam MAC'i full'a yaz, IV = full MAC; dönen değer blok boyutu
+size_t finishMac(DesfireSession& s, crypto::block::Cmac& mac, BYTE* full)
+{
+    const size_t bs = mac.blockSize();
+    mac.final(full);
+    s.iv.assign(full, full + bs);
+    return bs;
+}
+
+// EV1 iletilen MAC: CMAC'in ilk 8 byte'ı (AES'te 16'nın ilk yarısı, 3DES'te tamamı).
+// Tek index'li byte'lar (MACt) yalnızca EV2'dedir → macEV2.
+size_t wireMac(const BYTE* full, size_t bs, BYTE* out)
+{
+    const size_t n = bs < 8 ? bs : 8;
+    std::memcpy(out, full, n);
+    return n;
+}
+
+void putLE32(BYTE* p, uint32_t v)
+{
+    p[0] = static_cast<BYTE>(v);
+    p[1] = static_cast<BYTE>(v >> 8);
+    p[2] = static_cast<BYTE>(v >> 16);
+    p[3] = static_cast<BYTE>(v >> 24);
+}
+
+uint32_t getLE32(const BYTE* p)
+{
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+Result<void, PcscError> macMismatch(const char* what)
+{
+    return Result<void, PcscError>::Err(Error<PcscError>(DesfireError::AuthMismatch)
+        .detail(std::string("SecureMessaging: ") + what + " verification failed"));
+}
+
+// ── EV2 ─────────────────────────────────────────────────────────────────────
+
+// IV = E(KSesAuthENC, label(2) || TI || CmdCtr(LE) || 0^8)
+//   komut: A5 5A + CmdCtr, yanıt: 5A A5 + CmdCtr+1
+BYTEV ivEV2(const DesfireSession& s, BYTE l0, BYTE l1, uint16_t ctr)
+{
+    BYTE blk[16] = { l0, l1, s.ti[0], s.ti[1], s.ti[2], s.ti[3],
+                     static_cast<BYTE>(ctr), static_cast<BYTE>(ctr >> 8) };
+    return crypto::block::encryptAesCbc(s.sessionKey, BYTEV(16, 0), blk, 16);
+}
+
+// MACt(KSesAuthMAC, head || CmdCtr || TI || data) — 8 byte (tek index'ler)
+void macEV2(DesfireSession& s, BYTE head, uint16_t ctr, const BYTE* data, size_t len, BYTE out[8])
+{
+    crypto::block::Cmac& mac = s.macEngine();
+    mac.reset();
+    const BYTE c[2] = { static_cast<BYTE>(ctr), static_cast<BYTE>(ctr >> 8) };
+    mac.update(&head, 1);
+    mac.update(c, 2);
+    mac.update(s.ti.data(), s.ti.size());
+    mac.update(data, len);
+    BYTE full[crypto::block::Cmac::MAX_BLOCK];
+    mac.final(full);
+    for (size_t i = 0; i < 8; ++i) out[i] = full[2 * i + 1];     // MACt: tek index'li byte'lar
+}
+
+Result<void, PcscError> protectEV2(DesfireSession& s, BYTEV& apdu, size_t headerLen, DesfireCommMode mode)
+{
+    using R = Result<void, PcscError>;
+    if (mode == DesfireCommMode::Plain) return R::Ok();      // sayaç yanıtta artar
+
+    const BYTE ins = apdu[1];
+    const size_t dataLen = apdu.size() > 6 ? apdu.size() - 6 : 0;
+    if (headerLen > dataLen) headerLen = dataLen;
+    if (apdu.size() == 5) apdu.push_back(0x00);
+    apdu.pop_back();                                         // Le
+
+    if (mode == DesfireCommMode::Full && dataLen > headerLen) {
+        // E(KSesAuthENC, data || 80 00..) — ISO 9797-1 M2, her zaman dolgu
+        const size_t encLen = (dataLen - headerLen) / 16 * 16 + 16;
+        apdu.reserve(5 + headerLen + encLen + 8 + 1);
+        apdu.push_back(0x80);
+        apdu.resize(5 + headerLen + encLen, 0x00);
+        BYTEV c = crypto::block::encryptAesCbc(s.sessionKey, ivEV2(s, 0xA5, 0x5A, s.cmdCounter),
+                                               apdu.data() + 5 + headerLen, encLen);
+        std::memcpy(apdu.data() + 5 + headerLen, c.data(), encLen);
+    }
+
+    BYTE m[8];
+    macEV2(s, ins, s.cmdCounter, apdu.data() + 5, apdu.size() - 5, m);
+    apdu.insert(apdu.end(), m, m + 8);
+    apdu[4] = static_cast<BYTE>(apdu.size() - 5);
+    apdu.push_back(0x00);
+    return R::Ok();
+}
+
+Result<void, PcscError> unwrapEV2(DesfireSession& s, BYTEV& resp, BYTE status, DesfireCommMode mode,
+                                  size_t expectedLen)
+{
+    using R = Result<void, PcscError>;
+    const uint16_t ctr = ++s.cmdCounter;                     // yanıt CmdCtr+1 ile korunur
+    if (mode == DesfireCommMode::Plain) return R::Ok();
+
+    if (resp.size() < 8) return macMismatch("CMAC length");
+    const size_t dataLen = resp.size() - 8;
+    BYTE expected[8];
+    macEV2(s, status, ctr, resp.data(), dataLen, expected);
+    if (!std::equal(expected, expected + 8, resp.begin() + dataLen))
+        return macMismatch("CMAC");
+    resp.resize(dataLen);
+
+    if (mode != DesfireCommMode::Full || resp.empty()) return R::Ok();
+    if (resp.size() % 16 != 0) return macMismatch("ciphertext length");
+    BYTEV p = crypto::block::decryptAesCbc(s.sessionKey, ivEV2(s, 0x5A, 0xA5, ctr), resp.data(), resp.size());
+    std::memcpy(resp.data(), p.data(), resp.size());
+
+    // M2 dolgusu: ... 80 00..00
+    size_t len = resp.size();
+    while (len && resp[len - 1] == 0x00) --len;
+    if (!len || resp[len - 1] != 0x80 || resp.size() - len >= 16) return macMismatch("padding");
+    --len;
+    if (expectedLen && expectedLen != len) return macMismatch("padding");
+    resp.resize(len);
+    return R::Ok();
+}
+
+} // namespace
 
 // ════════════════════════════════════════════════════════════════════════════════
 // CMAC Calculation + IV Update
@@ -14,13 +177,15 @@ BYTEV DesfireSecureMessaging::calculateCMAC(DesfireSession& session,
         return {};
     }
 
-    // CMAC with current session key
-    BYTEV fullMAC = crypto::block::cmacAes128(session.sessionKey, data);
+    // CMAC (OMAC1) — zincir session.iv'dan başlar (IV = 0 → standart CMAC).
+    // K1/K2 ve key schedule session'ın motorunda saklıdır.
+    crypto::block::Cmac& mac = beginMac(session);
+    mac.update(data.data(), data.size());
 
     // IV = full CMAC (for next operation's IV chaining)
-    session.iv = fullMAC;
-
-    return fullMAC;
+    BYTE full[crypto::block::Cmac::MAX_BLOCK];
+    const size_t bs = finishMac(session, mac, full);
+    return BYTEV(full, full + bs);
 }
 
 BYTEV DesfireSecureMessaging::truncateCMAC(const BYTEV& fullCMAC) {
@@ -33,6 +198,108 @@ BYTEV DesfireSecureMessaging::truncateCMAC(const BYTEV& fullCMAC) {
     return trunc;
 }
 
+BYTEV DesfireSecureMessaging::commandMAC(const DesfireSession& session, const BYTEV& fullCMAC) {
+    if (session.isEV2()) return truncateCMAC(fullCMAC);
+    return BYTEV(fullCMAC.begin(), fullCMAC.begin() + std::min<size_t>(8, fullCMAC.size()));
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Full Mode Primitives — CRC32 + CBC
+// ════════════════════════════════════════════════════════════════════════════════
+
+uint32_t DesfireSecureMessaging::crc32(const BYTE* data, size_t len, uint32_t crc) {
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; ++b)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+    return crc;
+}
+
+size_t DesfireSecureMessaging::blockSize(const DesfireSession& session) {
+    return DesfireCrypto::blockSize(session.keyType);
+}
+
+void DesfireSecureMessaging::encipher(DesfireSession& session, BYTE* data, size_t len) {
+    const size_t bs = blockSize(session);
+    BYTEV c = cbc(session, chainIV(session, bs), data, len, true);
+    std::memcpy(data, c.data(), len);
+    session.iv.assign(data + len - bs, data + len);
+}
+
+void DesfireSecureMessaging::decipher(DesfireSession& session, BYTE* data, size_t len) {
+    const size_t bs = blockSize(session);
+    BYTEV nextIV(data + len - bs, data + len);
+    BYTEV p = cbc(session, chainIV(session, bs), data, len, false);
+    std::memcpy(data, p.data(), len);
+    session.iv = std::move(nextIV);
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// ChangeKey
+// ════════════════════════════════════════════════════════════════════════════════
+
+Result<BYTEV, PcscError> DesfireSecureMessaging::tryChangeKeyCommand(DesfireSession& session, BYTE keyNo,
+                                                                     DesfireKeyType keyType, const BYTEV& newKey,
+                                                                     BYTE keyVersion, const BYTEV& oldKey) {
+    using R = Result<BYTEV, PcscError>;
+    if (session.sessionKey.empty())
+        return R::Err(PcscError::make(CardError::NotAuthenticated, "ChangeKey: no session key"));
+    const size_t ks = DesfireCrypto::keySize(keyType);
+    if (newKey.size() != ks || (!oldKey.empty() && oldKey.size() != ks))
+        return R::Err(Error<PcscError>(CardError::InvalidData)
+            .detail("ChangeKey: key size mismatch")
+            .meta("expected", std::to_string(ks))
+            .meta("got", std::to_string(newKey.size())));
+
+    // Tek DES → K || K; eski key yoksa fabrika (sıfır) key'i
+    BYTEV key = newKey;
+    BYTEV old = oldKey.empty() ? BYTEV(ks, 0x00) : oldKey;
+    if (ks == 8) {
+        key.insert(key.end(), newKey.begin(), newKey.end());
+        old.resize(16);
+        std::copy(old.begin(), old.begin() + 8, old.begin() + 8);
+    }
+    const bool sameKey = (keyNo & 0x0F) == session.authKeyNo;
+
+    BYTEV data(key);
+    if (!sameKey)
+        for (size_t i = 0; i < data.size(); ++i) data[i] ^= old[i];
+    if (keyType == DesfireKeyType::AES128) data.push_back(keyVersion);
+
+    BYTE crcNew[4];
+    putLE32(crcNew, crc32(key.data(), key.size()));
+    std::fill(key.begin(), key.end(), 0);
+    std::fill(old.begin(), old.end(), 0);
+
+    // Auth key'i veya EV2: standart Full koruma (keyNo açık kalır)
+    if (sameKey || session.isEV2()) {
+        if (!sameKey) data.insert(data.end(), crcNew, crcNew + 4);
+        BYTEV apdu = DesfireCommands::changeKey(keyNo, data);
+        std::fill(data.begin(), data.end(), 0);
+        auto p = tryProtectCommand(session, apdu, 1, DesfireCommMode::Full);
+        if (!p) return R::Err(std::move(p.error()));
+        return R::Ok(std::move(apdu));
+    }
+
+    // Legacy, başka key: iki CRC (komut + yeni key), sıfır dolgu
+    const BYTE ins = 0xC4;
+    uint32_t crc = crc32(&ins, 1);
+    crc = crc32(&keyNo, 1, crc);
+    crc = crc32(data.data(), data.size(), crc);
+    const size_t bs = blockSize(session);
+    const size_t plainLen = data.size() + 8;
+    const size_t encLen = (plainLen + bs - 1) / bs * bs;
+    data.resize(data.size() + 4);
+    putLE32(data.data() + data.size() - 4, crc);
+    data.insert(data.end(), crcNew, crcNew + 4);
+    data.resize(encLen, 0x00);
+    encipher(session, data.data(), encLen);
+
+    BYTEV apdu = DesfireCommands::changeKey(keyNo, data);
+    return R::Ok(std::move(apdu));
+}
+
 // ════════════════════════════════════════════════════════════════════════════════
 // Command Wrapping
 // ════════════════════════════════════════════════════════════════════════════════
@@ -52,8 +319,8 @@ BYTEV DesfireSecureMessaging::wrapCommand(DesfireSession& session,
     BYTEV fullMAC = calculateCMAC(session, cmacInput);
 
     if (commMode == DesfireCommMode::MAC) {
-        // Append 8-byte truncated CMAC to command data
-        BYTEV tMAC = truncateCMAC(fullMAC);
+        // Append 8-byte CMAC to command data (EV1: first 8 bytes)
+        BYTEV tMAC = commandMAC(session, fullMAC);
         BYTEV wrappedData = cmdData;
         wrappedData.insert(wrappedData.end(), tMAC.begin(), tMAC.end());
 
@@ -70,6 +337,60 @@ BYTEV DesfireSecureMessaging::wrapCommand(DesfireSession& session,
     return cmdHeader;
 }
 
+Result<void, PcscError> DesfireSecureMessaging::tryProtectCommand(DesfireSession& session, BYTEV& apdu,
+                                                                  size_t headerLen, DesfireCommMode commMode) {
+    using R = Result<void, PcscError>;
+    if (session.sessionKey.empty())
+        return R::Err(PcscError::make(CardError::NotAuthenticated, "SecureMessaging: no session key"));
+    if (apdu.size() < 5)
+        return R::Err(PcscError::make(CardError::InvalidData, "SecureMessaging: malformed APDU"));
+    if (session.isEV2())
+        return protectEV2(session, apdu, headerLen, commMode);
+
+    // 90 INS 00 00 Lc [data] 00
+    const BYTE ins = apdu[1];
+    const size_t dataLen = apdu.size() > 6 ? apdu.size() - 6 : 0;
+    if (headerLen > dataLen) headerLen = dataLen;
+    const size_t bs = blockSize(session);
+
+    if (apdu.size() == 5) apdu.push_back(0x00);             // Le'siz kısa form
+    apdu.pop_back();                                         // Le — en sonda geri eklenir
+
+    if (commMode == DesfireCommMode::Full) {
+        // E(data || CRC32(INS || header || data) || 0-pad); header açık kalır
+        uint32_t crc = crc32(&ins, 1);
+        crc = crc32(apdu.data() + 5, dataLen, crc);
+
+        const size_t plainLen = dataLen - headerLen + 4;
+        const size_t encLen = (plainLen + bs - 1) / bs * bs;
+        apdu.reserve(5 + headerLen + encLen + 1);
+        apdu.resize(5 + dataLen + 4);
+        putLE32(apdu.data() + 5 + dataLen, crc);
+        apdu.resize(5 + headerLen + encLen, 0x00);
+        encipher(session, apdu.data() + 5 + headerLen, encLen);
+    }
+    else {
+        // CMAC(INS || data) — her modda IV'ı ilerletir
+        crypto::block::Cmac& mac = beginMac(session);
+        mac.update(&ins, 1);
+        mac.update(apdu.data() + 5, dataLen);
+        BYTE full[crypto::block::Cmac::MAX_BLOCK];
+        finishMac(session, mac, full);
+
+        if (commMode == DesfireCommMode::MAC) {
+            BYTE wire[crypto::block::Cmac::MAX_BLOCK];
+            const size_t n = wireMac(full, bs, wire);
+            apdu.reserve(apdu.size() + n + 1);
+            apdu.insert(apdu.end(), wire, wire + n);
+        }
+    }
+
+    if (apdu.size() == 5) return R::Ok();                   // veri yok → 90 INS 00 00 Le
+    apdu[4] = static_cast<BYTE>(apdu.size() - 5);           // Lc (chaining boyutu APDU'dan alır)
+    apdu.push_back(0x00);
+    return R::Ok();
+}
+
 // ════════════════════════════════════════════════════════════════════════════════
 // Response Unwrapping
 // ════════════════════════════════════════════════════════════════════════════════
@@ -78,34 +399,87 @@ BYTEV DesfireSecureMessaging::unwrapResponse(DesfireSession& session,
                                               const BYTEV& responseData,
                                               BYTE statusCode,
                                               DesfireCommMode commMode) {
-    if (commMode == DesfireCommMode::MAC && responseData.size() >= 8) {
-        // Last 8 bytes = truncated CMAC from card
-        size_t dataLen = responseData.size() - 8;
-        BYTEV pureData(responseData.begin(), responseData.begin() + dataLen);
-        BYTEV receivedMAC(responseData.begin() + dataLen, responseData.end());
-
-        // CMAC input: data + status code
-        BYTEV cmacInput = pureData;
-        cmacInput.push_back(statusCode);
-
-        BYTEV fullMAC = calculateCMAC(session, cmacInput);
-        BYTEV expectedMAC = truncateCMAC(fullMAC);
-
-        if (receivedMAC != expectedMAC) {
-			PcscError::make(DesfireError::AuthMismatch,
-                "SecureMessaging: CMAC verification failed").throwIfError();
-            return {};
+    return tryUnwrapResponse(session, responseData, statusCode, commMode).unwrap();
+}
+
+Result<BYTEV, PcscError> DesfireSecureMessaging::tryUnwrapResponse(DesfireSession& session,
+                                                                   const BYTEV& responseData,
+                                                                   BYTE statusCode,
+                                                                   DesfireCommMode commMode) {
+    BYTEV data = responseData;
+    auto r = tryUnwrapInPlace(session, data, statusCode, commMode);
+    if (!r) return Result<BYTEV, PcscError>::Err(std::move(r.error()));
+    return Result<BYTEV, PcscError>::Ok(std::move(data));
+}
+
+Result<void, PcscError> DesfireSecureMessaging::tryUnwrapInPlace(DesfireSession& session, BYTEV& response,
+                                                                 BYTE statusCode, DesfireCommMode commMode,
+                                                                 size_t expectedLen) {
+    using R = Result<void, PcscError>;
+    if (session.sessionKey.empty())
+        return R::Err(PcscError::make(CardError::NotAuthenticated, "SecureMessaging: no session key"));
+    if (session.isEV2())
+        return unwrapEV2(session, response, statusCode, commMode, expectedLen);
+
+    const size_t bs = blockSize(session);
+
+    if (commMode == DesfireCommMode::Full) {
+        if (response.empty() || response.size() % bs != 0)
+            return macMismatch("ciphertext length");
+        decipher(session, response.data(), response.size());
+
+        // data || CRC32(data || status) || dolgu (0x80? 00..)
+        auto matches = [&](size_t len) {
+            if (len + 4 > response.size() || response.size() - (len + 4) >= bs) return false;
+            for (size_t i = len + 4; i < response.size(); ++i) {
+                const BYTE b = response[i];
+                if (b != 0x00 && !(b == 0x80 && i == len + 4)) return false;
+            }
+            const uint32_t crc = crc32(&statusCode, 1, crc32(response.data(), len));
+            return crc == getLE32(response.data() + len);
+        };
+
+        if (expectedLen) {
+            if (!matches(expectedLen)) return macMismatch("CRC32");
+            response.resize(expectedLen);
+            return R::Ok();
+        }
+        for (size_t len = response.size() - 4 + 1; len-- > 0; ) {
+            if (response.size() - (len + 4) >= bs) break;
+            if (matches(len)) {
+                response.resize(len);
+                return R::Ok();
+            }
         }
+        return macMismatch("CRC32");
+    }
+
+    if (commMode == DesfireCommMode::MAC) {
+        // Son MAC byte'ları kartın CMAC'i: CMAC(data || status)
+        const size_t macLen = bs == 16 ? 8 : bs;
+        if (response.size() < macLen) return macMismatch("CMAC length");
+        const size_t dataLen = response.size() - macLen;
 
-        return pureData;
+        crypto::block::Cmac& mac = beginMac(session);
+        mac.update(response.data(), dataLen);
+        mac.update(&statusCode, 1);
+        BYTE full[crypto::block::Cmac::MAX_BLOCK], expected[crypto::block::Cmac::MAX_BLOCK];
+        finishMac(session, mac, full);
+        wireMac(full, bs, expected);
+        if (!std::equal(expected, expected + macLen, response.begin() + dataLen))
+            return macMismatch("CMAC");
+
+        response.resize(dataLen);
+        return R::Ok();
     }
 
     // Plain mode: calculate CMAC for IV update but don't verify
-    if (!responseData.empty()) {
-        BYTEV cmacInput = responseData;
-        cmacInput.push_back(statusCode);
-        calculateCMAC(session, cmacInput);
+    if (!response.empty()) {
+        crypto::block::Cmac& mac = beginMac(session);
+        mac.update(response.data(), response.size());
+        mac.update(&statusCode, 1);
+        BYTE full[crypto::block::Cmac::MAX_BLOCK];
+        finishMac(session, mac, full);
     }
-
-    return responseData;
+    return R::Ok();
 }
@@ -3,6 +3,7 @@
 
 #include "DesfireSession.h"
 #include "DesfireCommands.h"
+#include "Result.h"
 #include <vector>
 #include <functional>
 
@@ -18,13 +19,30 @@
 // CommMode bazlı davranış:
 //   Plain   → CMAC yok (ama IV yine güncellenir)
 //   MAC     → 8-byte truncated CMAC eklenir/doğrulanır
-//   Full    → Veri şifrelenir + CMAC (EV2+, burada temel destek)
+//   Full    → data || CRC32 || 0-pad, session key ile CBC şifrelenir
 //
-// Kullanım:
-//   DesfireSecureMessaging sm;
-//   BYTEV wrappedCmd = sm.wrapCommand(session, rawCmd);
+// IV zinciri: CMAC, session.iv'dan başlayan CBC-MAC'tir (ilk komutta 0);
+// sonuç yeni IV olur. Full modda IV son ciphertext bloğudur. Key tipine
+// göre blok 16 (AES) veya 8 byte (2K3DES / 3K3DES); 3DES MAC'i 8 byte'ın
+// tamamıdır, AES'te CMAC'in ilk 8 byte'ı iletilir (tek index'li MACt
+// kısaltması yalnızca EV2'de).
+//
+// Kullanım (tek seferlik):
+//   BYTEV wrappedCmd = DesfireSecureMessaging::wrapCommand(session, hdr, data, mode);
 //   BYTEV response = transmit(wrappedCmd);
-//   BYTEV data = sm.unwrapResponse(session, response);
+//   BYTEV data = DesfireSecureMessaging::unwrapResponse(session, response, sw2, mode);
+//
+// EV2 oturumu (session.isEV2()) — IV zinciri yok, command counter var:
+//   Plain → koruma yok           MAC → MACt(Cmd || CmdCtr || TI || data)
+//   Full  → data || 80 00.. E(KSesAuthENC, IV = E(A55A || TI || CmdCtr)), + MACt
+//   Yanıt: CmdCtr+1 ile MACt(RC || CmdCtr+1 || TI || data) doğrulanır,
+//   Full'de IV = E(5AA5 || TI || CmdCtr+1), dolgu atılır. Sayaç yanıtta artar.
+//
+// Kullanım (yerinde — CardIO dosya komutları):
+//   BYTEV apdu = DesfireCommands::writeData(fileNo, off, payload);
+//   tryProtectCommand(session, apdu, 7, DesfireCommMode::Full);   // header 7 byte açık
+//   BYTEV resp = transceive(apdu).unwrap();
+//   tryUnwrapInPlace(session, resp, 0x00, DesfireCommMode::MAC);
 //
 // ════════════════════════════════════════════════════════════════════════════════
 
@@ -56,10 +74,66 @@ public:
     // CMAC hesapla ve session IV'ı güncelle (her iki yönde kullanılır)
     static BYTEV calculateCMAC(DesfireSession& session, const BYTEV& data);
 
-    // 16-byte CMAC'tan 8-byte truncated CMAC üret
+    // EV2 MACt: 16-byte CMAC'tan 8-byte truncated CMAC üret (EV1 ilk 8 byte'ı kullanır)
     // Tek byte'lar alınır: mac[1], mac[3], mac[5], mac[7], mac[9], mac[11], mac[13], mac[15]
     static BYTEV truncateCMAC(const BYTEV& fullCMAC);
 
+    // ── Result API ──────────────────────────────────────────────────────────
+
+    // unwrapResponse'un exception-free hali (MAC/CRC hatası → AuthMismatch)
+    static Result<BYTEV, PcscError> tryUnwrapResponse(DesfireSession& session,
+                                                      const BYTEV& responseData,
+                                                      BYTE statusCode,
+                                                      DesfireCommMode commMode);
+
+    // ── In-place APDU koruması ──────────────────────────────────────────────
+    //
+    // `apdu` DesfireCommands::wrapCommand çıktısıdır (90 INS 00 00 Lc data 00).
+    // data'nın ilk headerLen byte'ı her modda açık kalır (fileNo, offset, len).
+    //   Plain → CMAC(INS || data) yalnızca IV için, APDU değişmez
+    //   MAC   → CMAC(INS || data) MAC'i Le'den önce eklenir
+    //   Full  → data[headerLen..] || CRC32(INS || data) || 0-pad şifrelenir
+    // Buffer tek reserve ile büyür; chaining tryTransceiveChained'e bırakılır.
+    static Result<void, PcscError> tryProtectCommand(DesfireSession& session, BYTEV& apdu,
+                                                     size_t headerLen, DesfireCommMode commMode);
+
+    // Yanıt verisini (status hariç, frame'ler birleşik) yerinde doğrula/çöz.
+    //   Plain → CMAC yalnızca IV için      MAC → son MAC byte'ları doğrulanıp atılır
+    //   Full  → çöz, CRC32(data || status) doğrula, CRC + dolgu atılır
+    // expectedLen = 0 → Full modda uzunluk CRC taramasıyla bulunur.
+    static Result<void, PcscError> tryUnwrapInPlace(DesfireSession& session, BYTEV& response,
+                                                    BYTE statusCode, DesfireCommMode commMode,
+                                                    size_t expectedLen = 0);
+
+    // ── Full mode primitive'leri ────────────────────────────────────────────
+
+    // DESFire EV1 CRC32: yansıtılmış 0xEDB88320, init 0xFFFFFFFF, final XOR yok
+    static uint32_t crc32(const BYTE* data, size_t len, uint32_t crc = 0xFFFFFFFF);
+
+    // Session key tipine göre şifre bloğu (AES 16, 3DES 8)
+    static size_t blockSize(const DesfireSession& session);
+
+    // Session key ile yerinde CBC; len blok katı olmalı. IV ← son ciphertext bloğu.
+    static void encipher(DesfireSession& session, BYTE* data, size_t len);
+    static void decipher(DesfireSession& session, BYTE* data, size_t len);
+
+    // İletilen MAC: EV2 → truncateCMAC, EV1 → ilk 8 byte (3DES'te CMAC'in tamamı)
+    static BYTEV commandMAC(const DesfireSession& session, const BYTEV& fullCMAC);
+
+    // ── ChangeKey kriptogramı ───────────────────────────────────────────────
+    //
+    // Korunmuş ChangeKey APDU'su (90 C4 00 00 Lc keyNo E(...) [MAC] 00).
+    // keyNo açık kalır (PICC key'inde tip bayrakları çağırandan). keyType yeni
+    // key'in tipi; AES'te versiyon byte'ı eklenir, (3)DES'te versiyon parity
+    // bit'lerindedir. Tek DES key 16 byte'a (K || K) açılır. oldKey boş → sıfır.
+    //   Legacy, auth key     → E(new || ver || CRC32(INS || keyNo || new || ver))
+    //   Legacy, başka key    → E(new^old || ver || CRC32(INS || keyNo || ..) || CRC32(new))
+    //   EV2                  → Full mod; başka key'de new^old || ver || CRC32(new)
+    // Auth key'i değiştiriliyorsa kart yanıtı MAC'siz döner ve oturum düşer.
+    static Result<BYTEV, PcscError> tryChangeKeyCommand(DesfireSession& session, BYTE keyNo,
+                                                        DesfireKeyType keyType, const BYTEV& newKey,
+                                                        BYTE keyVersion, const BYTEV& oldKey = {});
+
 private:
     DesfireSecureMessaging() = delete;
 };
@@ -3,6 +3,9 @@
 
 #include "CardDataTypes.h"
 #include "../CardModel/DesfireMemoryLayout.h"
+#include "Cmac.h"
+#include <algorithm>
+#include <array>
 #include <vector>
 #include <chrono>
 
@@ -15,7 +18,8 @@
 //
 // Ömür:
 //   - Auth başarılı → session oluşur
-//   - SelectApplication → session düşer (yeniden auth gerekir)
+//   - SelectApplication → session düşer (yeniden auth gerekir); CardIO aynı
+//     app zaten seçiliyse Select göndermez
 //   - Kart çıkartılırsa → session düşer
 //   - Timeout süresi dolduğunda → session düşer
 //
@@ -25,10 +29,29 @@
 //   - isExpired() ile kontrol edilir
 //   - Her auth başarılı olduğunda authTime_ güncellenir
 //
+// CMAC motoru:
+//   - macEngine() session key'e bağlı Cmac nesnesini döndürür; key schedule
+//     ve K1/K2 key değişene kadar saklanır (APDU başına birkaç blok şifreleme)
+//   - sessionKey doğrudan atanabilir; motor ilk kullanımda yeniden bağlanır
+//
+// EV2 oturumu (AuthenticateEV2First / NonFirst):
+//   - sessionKey = KSesAuthENC, sessionMacKey = KSesAuthMAC (yalnızca AES)
+//   - ti: kartın verdiği 4 byte Transaction Identifier; First'te atanır,
+//     NonFirst'te korunur
+//   - cmdCounter her komut/yanıt çiftinde bir artar; MAC ve Full mod IV'ı
+//     ondan türetilir (IV zinciri kullanılmaz)
+//
 // ════════════════════════════════════════════════════════════════════════════════
 
+// Oturumu açan auth komutu → secure messaging biçimi
+enum class DesfireAuthMode : BYTE {
+    Legacy = 0,             // 0x1A / 0xAA — EV1 CMAC + IV zinciri
+    EV2    = 1              // 0x71 / 0x77 — TI + command counter
+};
+
 struct DesfireSession {
     bool   authenticated = false;
+    DesfireAuthMode authMode = DesfireAuthMode::Legacy;
 
     // Auth parametreleri
     BYTE   authKeyNo = 0;
@@ -46,6 +69,22 @@ struct DesfireSession {
     // Command counter (EV2+ secure messaging için)
     uint16_t cmdCounter = 0;
 
+    // EV2: Transaction Identifier + MAC session key
+    std::array<BYTE, 4> ti{};
+    BYTEV  sessionMacKey;
+
+    bool isEV2() const { return authMode == DesfireAuthMode::EV2; }
+
+    // CMAC key'i: EV2 → KSesAuthMAC, legacy → session key
+    const BYTEV& macKey() const { return isEV2() ? sessionMacKey : sessionKey; }
+
+    // Session key'e bağlı CMAC motoru (lazy — bkz. macEngine())
+    crypto::block::Cmac cmac;
+
+    // Auth el sıkışması APDU tamponu: reset() içeriği değil yalnızca oturumu
+    // siler, kapasite korunur → tekrar auth heap'e gitmez
+    BYTEV  authApdu;
+
     // ── Timeout ─────────────────────────────────────────────────────────────
 
     using Clock = std::chrono::steady_clock;
@@ -77,13 +116,35 @@ struct DesfireSession {
         return authenticated && !isExpired();
     }
 
+    // ── CMAC ────────────────────────────────────────────────────────────────
+
+    static crypto::block::CmacAlgo cmacAlgo(DesfireKeyType kt) {
+        switch (kt) {
+            case DesfireKeyType::AES128:   return crypto::block::CmacAlgo::AES128;
+            case DesfireKeyType::ThreeDES: return crypto::block::CmacAlgo::TDES3K;
+            default:                       return crypto::block::CmacAlgo::TDES2K;
+        }
+    }
+
+    // macKey() / keyType değiştiyse yeniden bağlanır (boş key → throw)
+    crypto::block::Cmac& macEngine() {
+        const auto algo = cmacAlgo(keyType);
+        if (!cmac.boundTo(algo, macKey()))
+            cmac.setKey(algo, macKey());
+        return cmac;
+    }
+
     // ── Helpers ─────────────────────────────────────────────────────────────
 
     void reset() {
         authenticated = false;
+        authMode = DesfireAuthMode::Legacy;
+        ti = {};
+        sessionMacKey.clear();
         authKeyNo = 0;
         sessionKey.clear();
         iv.clear();
+        cmac.clear();
         cmdCounter = 0;
         authTime_ = {};
     }
@@ -101,4 +162,95 @@ struct DesfireSession {
     }
 };
 
+// ════════════════════════════════════════════════════════════════════════════════
+// DesfireAuthCache — Yeniden Auth İçin App Başına Key Referansı
+// ════════════════════════════════════════════════════════════════════════════════
+//
+// CardIO her başarılı auth'tan sonra (AID, keyNo, keyType, auth modu, key)
+// girdisini saklar. Oturum süresi dolduğunda veya kart 0xAE döndüğünde aynı
+// key ile bir kez yeniden auth yapılıp komut tekrarlanır (bkz.
+// CardIO::setDesfireAutoReauth). App başına tek girdi: son kullanılan key.
+//
+// Key byte'ları bellekte durur; forget()/clear() ve yıkıcı üzerine yazar.
+//
+
+struct DesfireAuthRef {
+    DesfireAID      aid;
+    BYTE            keyNo   = 0;
+    DesfireKeyType  keyType = DesfireKeyType::AES128;
+    DesfireAuthMode mode    = DesfireAuthMode::Legacy;
+    BYTEV           key;
+
+    void wipe() {
+        std::fill(key.begin(), key.end(), BYTE(0));
+        key.clear();
+    }
+};
+
+class DesfireAuthCache {
+public:
+    DesfireAuthCache() = default;
+    DesfireAuthCache(const DesfireAuthCache&) = delete;
+    DesfireAuthCache& operator=(const DesfireAuthCache&) = delete;
+    ~DesfireAuthCache() { clear(); }
+
+    // Başarılı auth sonrası: AID / keyNo / tip / mod oturumdan alınır
+    void remember(const DesfireSession& s, const BYTEV& key) {
+        DesfireAuthRef* e = findMutable(s.currentAID);
+        if (!e) {
+            refs_.emplace_back();
+            e = &refs_.back();
+            e->aid = s.currentAID;
+        }
+        e->keyNo   = s.authKeyNo;
+        e->keyType = s.keyType;
+        e->mode    = s.authMode;
+        if (&e->key != &key) {
+            e->wipe();
+            e->key = key;
+        }
+    }
+
+    const DesfireAuthRef* find(const DesfireAID& aid) const {
+        for (const auto& r : refs_)
+            if (r.aid == aid) return &r;
+        return nullptr;
+    }
+
+    void forget(const DesfireAID& aid) {
+        for (size_t i = 0; i < refs_.size(); ++i) {
+            if (refs_[i].aid != aid) continue;
+            refs_[i].wipe();
+            refs_.erase(refs_.begin() + i);
+            return;
+        }
+    }
+
+    void clear() {
+        for (auto& r : refs_) r.wipe();
+        refs_.clear();
+    }
+
+    // Yalnızca aid girdisi kalır (FormatPICC sonrası: PICC)
+    void keepOnly(const DesfireAID& aid) {
+        for (size_t i = refs_.size(); i-- > 0;) {
+            if (refs_[i].aid == aid) continue;
+            refs_[i].wipe();
+            refs_.erase(refs_.begin() + i);
+        }
+    }
+
+    size_t size()  const { return refs_.size(); }
+    bool   empty() const { return refs_.empty(); }
+
+private:
+    DesfireAuthRef* findMutable(const DesfireAID& aid) {
+        for (auto& r : refs_)
+            if (r.aid == aid) return &r;
+        return nullptr;
+    }
+
+    std::vector<DesfireAuthRef> refs_;      // az sayıda app → doğrusal tarama
+};
+
 #endif // DESFIRE_SESSION_H
@@ -0,0 +1,97 @@
+#include "DesfireSnapshot.h"
+#include <cstdio>
+#include <ostream>
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Key Map
+// ════════════════════════════════════════════════════════════════════════════════
+
+void DesfireKeyMap::add(const DesfireAID& aid, BYTE keyNo, const BYTEV& key, DesfireKeyType keyType) {
+	for (auto& e : entries) {
+		if (e.aid == aid && e.keyNo == keyNo) {
+			e.key = key;
+			e.keyType = keyType;
+			return;
+		}
+	}
+	DesfireKeyEntry e;
+	e.aid = aid;
+	e.keyNo = keyNo;
+	e.keyType = keyType;
+	e.key = key;
+	entries.push_back(std::move(e));
+}
+
+const DesfireKeyEntry* DesfireKeyMap::find(const DesfireAID& aid, BYTE keyNo) const {
+	for (const auto& e : entries)
+		if (e.aid == aid && e.keyNo == keyNo) return &e;
+	return nullptr;
+}
+
+BYTE DesfireKeyMap::readKeyFor(const DesfireAID& aid, const DesfireAccessRights& access) const {
+	if (access.readKey == 0x0E || access.readWriteKey == 0x0E) return 0x0E;
+	if (access.readKey < 0x0E && find(aid, access.readKey)) return access.readKey;
+	if (access.readWriteKey < 0x0E && find(aid, access.readWriteKey)) return access.readWriteKey;
+	return 0x0F;
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Rapor
+// ════════════════════════════════════════════════════════════════════════════════
+
+const char* desfireSnapshotStepName(DesfireSnapshotStep step) {
+	switch (step) {
+		case DesfireSnapshotStep::Discover:     return "Discover";
+		case DesfireSnapshotStep::ListApps:     return "ListApps";
+		case DesfireSnapshotStep::FreeMemory:   return "FreeMemory";
+		case DesfireSnapshotStep::Select:       return "Select";
+		case DesfireSnapshotStep::Authenticate: return "Authenticate";
+		case DesfireSnapshotStep::ListFiles:    return "ListFiles";
+		case DesfireSnapshotStep::FileSettings: return "FileSettings";
+		case DesfireSnapshotStep::ReadData:     return "ReadData";
+		default:                                return "?";
+	}
+}
+
+void DesfireSnapshotReport::record(DesfireSnapshotEvent ev) {
+	const size_t i = static_cast<size_t>(ev.step);
+	if (ev.skipped) {
+		++filesSkipped;
+	} else if (i < STEPS) {
+		stepMicros[i] += ev.micros;
+		++stepCount[i];
+		if (ev.step == DesfireSnapshotStep::ReadData && ev.ok) {
+			++filesRead;
+			bytesRead += ev.bytes;
+		}
+	}
+	events.push_back(std::move(ev));
+}
+
+bool DesfireSnapshotReport::allOk() const {
+	for (const auto& e : events)
+		if (!e.ok && !e.skipped) return false;
+	return true;
+}
+
+void DesfireSnapshotReport::print(std::ostream& os) const {
+	char line[128];
+	std::snprintf(line, sizeof(line), "DESFire snapshot: %u apps, %u files (%u read, %u skipped), %llu bytes, %llu us\n",
+				  apps, files, filesRead, filesSkipped,
+				  static_cast<unsigned long long>(bytesRead), static_cast<unsigned long long>(totalMicros));
+	os << line;
+	for (size_t i = 0; i < STEPS; ++i) {
+		if (!stepCount[i]) continue;
+		std::snprintf(line, sizeof(line), "  %-13s %5u cmd %10llu us\n",
+					  desfireSnapshotStepName(static_cast<DesfireSnapshotStep>(i)), stepCount[i],
+					  static_cast<unsigned long long>(stepMicros[i]));
+		os << line;
+	}
+	for (const auto& e : events) {
+		if (e.ok && !e.skipped) continue;
+		std::snprintf(line, sizeof(line), "  %s %06X", e.skipped ? "skip" : "FAIL", static_cast<unsigned>(e.aid.toUint()));
+		os << line;
+		if (e.fileNo != 0xFF) os << " file " << static_cast<int>(e.fileNo);
+		os << " [" << desfireSnapshotStepName(e.step) << "] " << e.error << "\n";
+	}
+}
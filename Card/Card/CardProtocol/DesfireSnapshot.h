@@ -0,0 +1,124 @@
+#ifndef DESFIRESNAPSHOT_H
+#define DESFIRESNAPSHOT_H
+
+#include "../CardModel/DesfireMemoryLayout.h"
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// ════════════════════════════════════════════════════════════════════════════════
+// DESFire Snapshot — Tek Çağrıda Kart Ağacı Taraması (CardIO::snapshotDesfire)
+// ════════════════════════════════════════════════════════════════════════════════
+//
+// GetVersion → GetApplicationIDs → (app başına) Select → GetFileIDs →
+// GetFileSettings → Read/GetValue/ReadRecords zinciri CardIO içinde yürür ve
+// sonuç CardIO'nun DesfireMemoryLayout modeline yazılır (dosya içerikleri
+// DesfireFile::data'ya).
+//
+// Select sayısı en aza indirilir: her app bir kez seçilir; metadata cache'i
+// (bkz. CardIO::invalidateDesfireMetadata) geçerliyse PICC seçimi ve
+// discovery komutları atlanır. Bir app içindeki dosyalar gereken okuma
+// key'ine göre gruplanır → her key için en fazla bir auth.
+//
+// ─── Key Map ───────────────────────────────────────────────────────────────
+//
+//   Dosyanın access rights'ından okuma key numarası çıkarılır (read veya
+//   read&write; 0x0E = serbest). Key map'te (AID, keyNo) girdisi varsa o key
+//   ile auth yapılır; yoksa dosya atlanır ve raporda "no key" olarak görünür.
+//
+//   DesfireSnapshotOptions opt;
+//   opt.keys.add(DesfireAID::fromUint(0x010203), 1, appReadKey);
+//   opt.keys.add(DesfireAID::picc(), 0, piccMaster);   // liste gizliyse
+//   DesfireSnapshotReport rep = io.snapshotDesfire(opt);
+//   const DesfireMemoryLayout& mem = io.card().getDesfireMemory();
+//   rep.print(std::cout);                               // adım süreleri
+//
+// ════════════════════════════════════════════════════════════════════════════════
+
+// ── Key Map ─────────────────────────────────────────────────────────────────
+
+struct DesfireKeyEntry {
+    DesfireAID     aid;
+    BYTE           keyNo   = 0;
+    DesfireKeyType keyType = DesfireKeyType::AES128;
+    BYTEV          key;
+};
+
+struct DesfireKeyMap {
+    std::vector<DesfireKeyEntry> entries;   // az sayıda girdi → doğrusal tarama
+
+    void add(const DesfireAID& aid, BYTE keyNo, const BYTEV& key,
+             DesfireKeyType keyType = DesfireKeyType::AES128);
+
+    const DesfireKeyEntry* find(const DesfireAID& aid, BYTE keyNo) const;
+    bool empty() const { return entries.empty(); }
+
+    // Dosya okumak için gereken key: serbestse 0x0E, map'te karşılığı olan
+    // ilk key (read, sonra read&write), hiçbiri yoksa 0x0F.
+    BYTE readKeyFor(const DesfireAID& aid, const DesfireAccessRights& access) const;
+};
+
+// ── Seçenekler ──────────────────────────────────────────────────────────────
+
+struct DesfireSnapshotOptions {
+    DesfireKeyMap keys;
+    std::vector<DesfireAID> apps;       // boş → karttaki tüm uygulamalar
+    bool     readData     = true;       // false → yalnızca metadata
+    bool     freeMemory   = true;       // GetFreeMemory
+    bool     refresh      = false;      // true → metadata cache'i yok sayılır
+    bool     stopOnError  = false;      // false → hatalı dosya/app atlanır
+    uint32_t maxFileBytes = 0;          // Standard/Backup okuma sınırı (0 = tümü)
+    bool     useEV2Auth   = false;      // AES key'lerde EV2First/NonFirst (EV2/EV3 kart)
+};
+
+// ── Rapor ───────────────────────────────────────────────────────────────────
+
+enum class DesfireSnapshotStep : BYTE {
+    Discover = 0,       // GetVersion
+    ListApps,           // GetApplicationIDs
+    FreeMemory,
+    Select,
+    Authenticate,
+    ListFiles,          // GetFileIDs
+    FileSettings,
+    ReadData,           // ReadData / GetValue / ReadRecords
+    Count
+};
+
+const char* desfireSnapshotStepName(DesfireSnapshotStep step);
+
+struct DesfireSnapshotEvent {
+    DesfireSnapshotStep step = DesfireSnapshotStep::Discover;
+    DesfireAID  aid;
+    BYTE        fileNo = 0xFF;          // 0xFF → dosyaya bağlı değil
+    uint64_t    micros = 0;
+    uint32_t    bytes  = 0;             // ReadData: okunan byte
+    bool        ok      = true;
+    bool        skipped = false;        // komut gönderilmedi (key yok)
+    std::string error;                  // hata veya atlama nedeni
+};
+
+struct DesfireSnapshotReport {
+    static constexpr size_t STEPS = static_cast<size_t>(DesfireSnapshotStep::Count);
+
+    std::vector<DesfireSnapshotEvent> events;  // sıralı, adım adım
+    std::array<uint64_t, STEPS> stepMicros{};  // adım başına toplam süre
+    std::array<uint32_t, STEPS> stepCount{};   // adım başına karta giden komut
+    uint64_t totalMicros  = 0;
+    uint32_t apps         = 0;
+    uint32_t files        = 0;
+    uint32_t filesRead    = 0;
+    uint32_t filesSkipped = 0;                 // key yok
+    uint64_t bytesRead    = 0;
+
+    void record(DesfireSnapshotEvent ev);
+    uint64_t micros(DesfireSnapshotStep s) const { return stepMicros[static_cast<size_t>(s)]; }
+    uint32_t count(DesfireSnapshotStep s) const  { return stepCount[static_cast<size_t>(s)]; }
+    bool     allOk() const;                    // atlanan dosyalar hata sayılmaz
+
+    void print(std::ostream& os) const;
+};
+
+#endif // DESFIRESNAPSHOT_H
@@ -0,0 +1,197 @@
+#include "DesfireTransaction.h"
+#include "DesfireCommands.h"
+#include <cstdio>
+#include <ostream>
+
+namespace {
+
+// Key 0x0E serbest; aksi halde oturum o key ile açılmış olmalı
+bool keyAllows(BYTE key, int authKeyNo)
+{
+	return key == 0x0E || (authKeyNo >= 0 && key == static_cast<BYTE>(authKeyNo));
+}
+
+bool isRecordFile(DesfireFileType t)
+{
+	return t == DesfireFileType::LinearRecord || t == DesfireFileType::CyclicRecord;
+}
+
+} // namespace
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Builder
+// ════════════════════════════════════════════════════════════════════════════════
+
+DesfireTxStep DesfireTransaction::makeControl(DesfireTxOp op)
+{
+	DesfireTxStep s;
+	s.op   = op;
+	s.apdu = op == DesfireTxOp::Commit ? DesfireCommands::commitTransaction()
+									   : DesfireCommands::abortTransaction();
+	return s;
+}
+
+DesfireTxStep& DesfireTransaction::add(DesfireTxOp op, BYTE fileNo, BYTEV apdu, size_t headerLen)
+{
+	prepared_ = false;
+	DesfireTxStep s;
+	s.op        = op;
+	s.fileNo    = fileNo;
+	s.apdu      = std::move(apdu);
+	s.headerLen = headerLen;
+	steps_.push_back(std::move(s));
+	return steps_.back();
+}
+
+DesfireTransaction& DesfireTransaction::credit(BYTE fileNo, int32_t amount)
+{
+	add(DesfireTxOp::Credit, fileNo, DesfireCommands::credit(fileNo, amount), 1).amount = amount;
+	return *this;
+}
+
+DesfireTransaction& DesfireTransaction::debit(BYTE fileNo, int32_t amount)
+{
+	add(DesfireTxOp::Debit, fileNo, DesfireCommands::debit(fileNo, amount), 1).amount = amount;
+	return *this;
+}
+
+DesfireTransaction& DesfireTransaction::writeData(BYTE fileNo, uint32_t offset, const BYTEV& data)
+{
+	DesfireTxStep& s = add(DesfireTxOp::WriteData, fileNo, DesfireCommands::writeData(fileNo, offset, data), 7);
+	s.offset = offset;
+	s.length = static_cast<uint32_t>(data.size());
+	return *this;
+}
+
+DesfireTransaction& DesfireTransaction::appendRecord(BYTE fileNo, const BYTEV& record)
+{
+	add(DesfireTxOp::AppendRecord, fileNo, DesfireCommands::appendRecord(fileNo, record), 7).length =
+		static_cast<uint32_t>(record.size());
+	return *this;
+}
+
+void DesfireTransaction::clear()
+{
+	steps_.clear();
+	prepared_ = false;
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Doğrulama
+// ════════════════════════════════════════════════════════════════════════════════
+
+Result<void, PcscError> DesfireTransaction::validate(const DesfireTxStep& step, const DesfireFileSettings& fs,
+													 int authKeyNo)
+{
+	using R = Result<void, PcscError>;
+	auto invalid = [](const char* what) { return R::Err(Error<PcscError>(CardError::InvalidData).detail(what)); };
+
+	// Dosya tipi ve boyut
+	const DesfireAccessRights& a = fs.access;
+	bool allowed = false;
+	switch (step.op) {
+		case DesfireTxOp::Credit:
+		case DesfireTxOp::Debit:
+			if (fs.fileType != DesfireFileType::Value) return invalid("Credit/Debit needs a value file");
+			if (step.amount < 0) return invalid("Credit/Debit amount must not be negative");
+			// Credit yalnızca read&write key'i; debit read, write veya read&write
+			allowed = keyAllows(a.readWriteKey, authKeyNo) ||
+				(step.op == DesfireTxOp::Debit && (keyAllows(a.readKey, authKeyNo) || keyAllows(a.writeKey, authKeyNo)));
+			break;
+		case DesfireTxOp::WriteData:
+			if (fs.fileType != DesfireFileType::StandardData && fs.fileType != DesfireFileType::BackupData)
+				return invalid("WriteData needs a standard or backup file");
+			if (step.length == 0) return invalid("WriteData with no data");
+			if (static_cast<uint64_t>(step.offset) + step.length > fs.standard.fileSize)
+				return R::Err(Error<PcscError>(CardError::InvalidData)
+					.detail("WriteData exceeds file size")
+					.meta("fileSize", std::to_string(fs.standard.fileSize))
+					.meta("end", std::to_string(static_cast<uint64_t>(step.offset) + step.length)));
+			allowed = keyAllows(a.writeKey, authKeyNo) || keyAllows(a.readWriteKey, authKeyNo);
+			break;
+		case DesfireTxOp::AppendRecord:
+			if (!isRecordFile(fs.fileType)) return invalid("AppendRecord needs a record file");
+			if (step.length != fs.record.recordSize)
+				return R::Err(Error<PcscError>(CardError::InvalidData)
+					.detail("AppendRecord size differs from record size")
+					.meta("recordSize", std::to_string(fs.record.recordSize))
+					.meta("got", std::to_string(step.length)));
+			// Kayıt sayısı yalnızca artar → cache'te dolu görünen linear dosya doludur
+			if (fs.fileType == DesfireFileType::LinearRecord &&
+				fs.record.maxRecords && fs.record.currentRecords >= fs.record.maxRecords)
+				return invalid("Linear record file is full");
+			allowed = keyAllows(a.writeKey, authKeyNo) || keyAllows(a.readWriteKey, authKeyNo);
+			break;
+		default:
+			return invalid("Unexpected transaction step");
+	}
+
+	// Access rights / oturum
+	if (!allowed && authKeyNo < 0)
+		return R::Err(PcscError::make(CardError::NotAuthenticated,
+			"Access rights require a key — authenticate first"));
+	if (!allowed)
+		return R::Err(Error<PcscError>(DesfireError::PermissionDenied)
+			.detail("Session key is not allowed by access rights")
+			.meta("authKeyNo", std::to_string(authKeyNo)));
+	if (fs.commMode != DesfireCommMode::Plain && authKeyNo < 0)
+		return R::Err(PcscError::make(CardError::NotAuthenticated,
+			"File requires MAC/Full communication — authenticate first"));
+	return R::Ok();
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Rapor
+// ════════════════════════════════════════════════════════════════════════════════
+
+const char* desfireTxOpName(DesfireTxOp op)
+{
+	switch (op) {
+		case DesfireTxOp::Credit:       return "Credit";
+		case DesfireTxOp::Debit:        return "Debit";
+		case DesfireTxOp::WriteData:    return "WriteData";
+		case DesfireTxOp::AppendRecord: return "AppendRecord";
+		case DesfireTxOp::Commit:       return "Commit";
+		case DesfireTxOp::Abort:        return "Abort";
+		default:                        return "?";
+	}
+}
+
+uint64_t DesfireTransactionReport::micros(DesfireTxOp op) const
+{
+	uint64_t t = 0;
+	for (const auto& e : events)
+		if (e.op == op) t += e.micros;
+	return t;
+}
+
+uint32_t DesfireTransactionReport::count(DesfireTxOp op) const
+{
+	uint32_t n = 0;
+	for (const auto& e : events)
+		if (e.op == op) ++n;
+	return n;
+}
+
+void DesfireTransactionReport::print(std::ostream& os) const
+{
+	char line[128];
+	std::snprintf(line, sizeof(line), "DESFire transaction: %s, %zu cmd, prepare %llu us, total %llu us\n",
+				  committed ? "committed" : aborted ? "aborted" : "FAILED", events.size(),
+				  static_cast<unsigned long long>(prepareMicros), static_cast<unsigned long long>(totalMicros));
+	os << line;
+	for (const auto& e : events) {
+		std::snprintf(line, sizeof(line), "  %-13s", desfireTxOpName(e.op));
+		os << line;
+		if (e.fileNo != 0xFF) {
+			std::snprintf(line, sizeof(line), " file %-3d", e.fileNo);
+			os << line;
+		} else {
+			os << "         ";
+		}
+		std::snprintf(line, sizeof(line), " %10llu us", static_cast<unsigned long long>(e.micros));
+		os << line;
+		if (!e.ok) os << "  FAIL " << e.error;
+		os << "\n";
+	}
+}
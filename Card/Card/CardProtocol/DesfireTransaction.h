@@ -0,0 +1,214 @@
+#ifndef DESFIRE_TRANSACTION_H
+#define DESFIRE_TRANSACTION_H
+
+#include "CardDataTypes.h"
+#include "Result.h"
+#include "../CardModel/DesfireMemoryLayout.h"
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// ════════════════════════════════════════════════════════════════════════════════
+// DesfireTransaction — Çok Dosyalı Value/Record İşlemi, Tek Commit
+// ════════════════════════════════════════════════════════════════════════════════
+//
+// Tipik ücret işlemi: value dosyasından düş → log kaydı ekle → standart/backup
+// dosyayı güncelle → CommitTransaction. Builder adımları toplar ve her adımın
+// APDU'sunu ekleme anında üretir; yürütmede karta yalnızca bu hazır komutlar
+// arka arkaya gider (arada settings sorgusu / model araması yok).
+//
+//   1. Hazırlık (tryPrepare): her adım dosya ayarlarına (CardIO metadata
+//      cache'i) karşı doğrulanır — dosya tipi, boyut/offset, recordSize,
+//      access rights ve oturum key'i, comm mode. Hata varsa karta hiçbir
+//      komut gitmez.
+//   2. Yürütme (tryRun): adımlar sırayla, sonra tek CommitTransaction.
+//      Herhangi bir adım veya commit başarısızsa AbortTransaction gönderilir
+//      ve hata "transaction step N" bilgisiyle döner.
+//
+// Secure messaging (CMAC / şifreleme) gönderim anında uygulanır: IV zinciri
+// bir önceki yanıta bağlı olduğundan korumalı APDU önceden üretilemez.
+//
+// DİKKAT: StandardData dosyasına WriteData anında yazılır, Abort geri almaz;
+// geri alınabilir güncelleme için Backup dosya kullanılmalı.
+//
+// ─── Kullanım ──────────────────────────────────────────────────────────────
+//
+//   DesfireTransaction tx;
+//   tx.debit(1, fare)
+//     .appendRecord(2, logRecord)
+//     .writeData(3, 0, lastTrip);
+//   DesfireTransactionReport rep;
+//   auto r = io.tryRunDesfireTransaction(tx, rep);     // prepare + run
+//   rep.print(std::cout);                               // adım süreleri
+//
+// ════════════════════════════════════════════════════════════════════════════════
+
+enum class DesfireTxOp : BYTE {
+    Credit = 0,
+    Debit,
+    WriteData,
+    AppendRecord,
+    Commit,
+    Abort,
+    Count
+};
+
+const char* desfireTxOpName(DesfireTxOp op);
+
+struct DesfireTxStep {
+    DesfireTxOp     op        = DesfireTxOp::Commit;
+    BYTE            fileNo    = 0xFF;       // 0xFF → dosyaya bağlı değil
+    BYTEV           apdu;                   // düz komut (wrapCommand çıktısı)
+    size_t          headerLen = 0;          // Full modda açık kalan veri byte'ı
+    uint32_t        offset    = 0;          // WriteData
+    uint32_t        length    = 0;          // WriteData / AppendRecord verisi
+    int32_t         amount    = 0;          // Credit / Debit
+    DesfireCommMode mode      = DesfireCommMode::Plain;   // tryPrepare'de çözülür
+};
+
+// ── Rapor ───────────────────────────────────────────────────────────────────
+
+struct DesfireTxEvent {
+    DesfireTxOp op     = DesfireTxOp::Commit;
+    BYTE        fileNo = 0xFF;
+    uint64_t    micros = 0;
+    bool        ok     = true;
+    std::string error;
+};
+
+struct DesfireTransactionReport {
+    static constexpr size_t OPS = static_cast<size_t>(DesfireTxOp::Count);
+
+    std::vector<DesfireTxEvent> events;     // karta giden her komut, sırayla
+    uint64_t prepareMicros = 0;             // doğrulama (settings cache'ten)
+    uint64_t totalMicros   = 0;             // hazırlık + yürütme
+    int      failedStep    = -1;            // başarısız adım (steps() index'i; commit = size())
+    bool     committed     = false;
+    bool     aborted       = false;         // AbortTransaction kabul edildi
+
+    void     record(DesfireTxEvent ev) { events.push_back(std::move(ev)); }
+    uint64_t micros(DesfireTxOp op) const;
+    uint32_t count(DesfireTxOp op) const;
+
+    void print(std::ostream& os) const;
+};
+
+// ── Builder ─────────────────────────────────────────────────────────────────
+
+class DesfireTransaction {
+public:
+    DesfireTransaction& credit(BYTE fileNo, int32_t amount);
+    DesfireTransaction& debit(BYTE fileNo, int32_t amount);
+    DesfireTransaction& writeData(BYTE fileNo, uint32_t offset, const BYTEV& data);
+    DesfireTransaction& appendRecord(BYTE fileNo, const BYTEV& record);
+
+    const std::vector<DesfireTxStep>& steps() const { return steps_; }
+    size_t size()     const { return steps_.size(); }
+    bool   empty()    const { return steps_.empty(); }
+    bool   prepared() const { return prepared_; }
+    void   clear();
+
+    // settingsOf(BYTE fileNo) → Result<DesfireFileSettings, PcscError>.
+    // authKeyNo: geçerli oturumun key numarası, oturum yoksa -1.
+    // Başarılıysa her adımın comm mode'u sabitlenir.
+    template<typename SettingsFn>
+    Result<void, PcscError> tryPrepare(SettingsFn&& settingsOf, int authKeyNo);
+
+    // send(const DesfireTxStep&) → Result<void, PcscError>. Adımlar + commit;
+    // hata olursa abort gönderilir. rep her durumda doldurulur.
+    template<typename SendFn>
+    Result<void, PcscError> tryRun(SendFn&& send, DesfireTransactionReport& rep) const;
+
+    // Tek adımın settings'e karşı doğrulanması (tryPrepare döngüsü)
+    static Result<void, PcscError> validate(const DesfireTxStep& step, const DesfireFileSettings& fs,
+                                            int authKeyNo);
+
+private:
+    DesfireTxStep& add(DesfireTxOp op, BYTE fileNo, BYTEV apdu, size_t headerLen);
+
+    std::vector<DesfireTxStep> steps_;
+    DesfireTxStep commit_ = makeControl(DesfireTxOp::Commit);
+    DesfireTxStep abort_  = makeControl(DesfireTxOp::Abort);
+    bool          prepared_ = false;
+
+    static DesfireTxStep makeControl(DesfireTxOp op);
+};
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Template implementations
+// ════════════════════════════════════════════════════════════════════════════════
+
+template<typename SettingsFn>
+Result<void, PcscError> DesfireTransaction::tryPrepare(SettingsFn&& settingsOf, int authKeyNo)
+{
+	using R = Result<void, PcscError>;
+	prepared_ = false;
+	if (steps_.empty())
+		return R::Err(Error<PcscError>(CardError::InvalidData).detail("Transaction has no steps"));
+
+	for (size_t i = 0; i < steps_.size(); ++i) {
+		DesfireTxStep& s = steps_[i];
+		auto fs = settingsOf(s.fileNo);
+		Result<void, PcscError> v = fs ? validate(s, fs.unwrap(), authKeyNo)
+			: R::Err(std::move(fs.error()));
+		if (!v) {
+			PcscError e = std::move(v.error());
+			e.detail += " (transaction step " + std::to_string(i) + ": " + desfireTxOpName(s.op) +
+				" file " + std::to_string(s.fileNo) + ")";
+			return R::Err(std::move(e));
+		}
+		s.mode = fs.unwrap().commMode;
+	}
+	prepared_ = true;
+	return R::Ok();
+}
+
+template<typename SendFn>
+Result<void, PcscError> DesfireTransaction::tryRun(SendFn&& send, DesfireTransactionReport& rep) const
+{
+	using R = Result<void, PcscError>;
+	using Clock = std::chrono::steady_clock;
+	if (!prepared_)
+		return R::Err(Error<PcscError>(CardError::InvalidData).detail("Transaction not prepared"));
+
+	const auto start = Clock::now();
+	auto timed = [&](const DesfireTxStep& s) {
+		const auto t = Clock::now();
+		auto r = send(s);
+		DesfireTxEvent ev;
+		ev.op     = s.op;
+		ev.fileNo = s.fileNo;
+		ev.micros = static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t).count());
+		ev.ok = static_cast<bool>(r);
+		if (!r) ev.error = r.error().message();
+		rep.record(std::move(ev));
+		return r;
+	};
+	auto finish = [&] {
+		rep.totalMicros += static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+	};
+
+	// Adımlar + commit tek döngüde: i == size() → commit
+	for (size_t i = 0; i <= steps_.size(); ++i) {
+		const DesfireTxStep& s = i < steps_.size() ? steps_[i] : commit_;
+		auto r = timed(s);
+		if (r) continue;
+
+		rep.failedStep = static_cast<int>(i);
+		rep.aborted    = static_cast<bool>(timed(abort_));
+		finish();
+		PcscError e = std::move(r.error());
+		e.detail += " (transaction step " + std::to_string(i) + ": " + desfireTxOpName(s.op) +
+			(rep.aborted ? ", aborted)" : ", abort failed)");
+		return R::Err(std::move(e));
+	}
+	rep.committed = true;
+	finish();
+	return R::Ok();
+}
+
+#endif // DESFIRE_TRANSACTION_H
@@ -25,8 +25,23 @@ void KeyManagement::registerKey(KeyType kt, const KEYBYTES& key,
 		PcscError::make(CardError::InvalidData, "Invalid key format").throwIfError();
         return;
     }
-    
-    keys_[kt][slot] = makeKeyInfo(key, structure, slot, name);
+    int ti = typeIndex(kt);
+    if (ti < 0) {
+		PcscError::make(CardError::InvalidData, "Only KeyA/KeyB can be registered").throwIfError();
+        return;
+    }
+    KeyInfo info = makeKeyInfo(key, structure, slot, name);
+    info.kt = kt;
+    if (slot >= SLOT_COUNT) {
+        auto it = overflowLowerBound(kt, slot);
+        if (it != overflow_.end() && it->kt == kt && it->slot == slot)
+            overflow_[it - overflow_.begin()] = info;
+        else
+            overflow_.insert(it, info);
+        return;
+    }
+    keys_[ti][slot] = info;
+    occupied_[ti] |= (1u << slot);
 }
 
 void KeyManagement::registerKey(KeyType kt, const BYTE key[6],
@@ -42,61 +57,47 @@ void KeyManagement::registerKey(KeyType kt, const BYTE key[6],
 // ════════════════════════════════════════════════════════════════════════════════
 
 const KEYBYTES& KeyManagement::getKey(KeyType kt, BYTE slot) const {
-    auto ktIt = keys_.find(kt);
-    if (ktIt == keys_.end()) {
-		PcscError::make(CardError::InvalidData, "Key type not found").throwIfError();
-        static const KEYBYTES empty{};
-        return empty;
-    }
-    
-    auto slotIt = ktIt->second.find(slot);
-    if (slotIt == ktIt->second.end()) {
-        PcscError::make(CardError::InvalidData, "Slot not found for key type").throwIfError();
-        static const KEYBYTES empty{};
-        return empty;
-    }
-    
-    return slotIt->second.key;
+    return getKeyInfo(kt, slot).key;
 }
 
 const KeyInfo& KeyManagement::getKeyInfo(KeyType kt, BYTE slot) const {
-    auto ktIt = keys_.find(kt);
-    if (ktIt == keys_.end()) {
+    int ti = typeIndex(kt);
+    if (ti < 0 || !hasKey(kt)) {
 		PcscError::make(CardError::InvalidData, "Key type not found").throwIfError();
         static const KeyInfo empty{};
         return empty;
     }
-    
-    auto slotIt = ktIt->second.find(slot);
-    if (slotIt == ktIt->second.end()) {
+
+    const KeyInfo* info = findEntry(kt, slot);
+    if (!info) {
 		PcscError::make(CardError::InvalidData, "Slot not found for key type").throwIfError();
         static const KeyInfo empty{};
         return empty;
     }
-    
-    return slotIt->second;
+
+    return *info;
 }
 
 bool KeyManagement::hasKey(KeyType kt, BYTE slot) const {
-    auto ktIt = keys_.find(kt);
-    if (ktIt == keys_.end()) return false;
-    return ktIt->second.find(slot) != ktIt->second.end();
+    return findEntry(kt, slot) != nullptr;
 }
 
 bool KeyManagement::hasKey(KeyType kt) const {
-    return keys_.find(kt) != keys_.end();
+    int ti = typeIndex(kt);
+    if (ti < 0) return false;
+    if (occupied_[ti] != 0) return true;
+    auto it = overflowLowerBound(kt, 0);
+    return it != overflow_.end() && it->kt == kt;
 }
 
 const KEYBYTES& KeyManagement::getDefaultKey(KeyType kt) const {
-auto ktIt = keys_.find(kt);
-if (ktIt == keys_.end()) {
-	PcscError::make(CardError::InvalidData, "Key type not found").throwIfError();
-    static const KEYBYTES empty{};
-    return empty;
-}
-    
-    BYTE defaultSlot = getDefaultSlot(kt);
-    return ktIt->second.at(defaultSlot).key;
+    if (!hasKey(kt)) {
+		PcscError::make(CardError::InvalidData, "Key type not found").throwIfError();
+        static const KEYBYTES empty{};
+        return empty;
+    }
+
+    return findEntry(kt, getDefaultSlot(kt))->key;
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -105,33 +106,40 @@ if (ktIt == keys_.end()) {
 
 std::vector<BYTE> KeyManagement::getSlots(KeyType kt) const {
     std::vector<BYTE> slots;
-    auto ktIt = keys_.find(kt);
-    if (ktIt != keys_.end()) {
-        for (const auto& slotPair : ktIt->second) {
-            slots.push_back(slotPair.first);
-        }
+    int ti = typeIndex(kt);
+    if (ti < 0) return slots;
+    for (int slot = 0; slot < SLOT_COUNT; ++slot) {
+        if (occupied_[ti] & (1u << slot))
+            slots.push_back(static_cast<BYTE>(slot));
     }
+    for (const KeyInfo& info : overflow_)
+        if (info.kt == kt) slots.push_back(info.slot);
     return slots;
 }
 
 std::vector<KeyInfo> KeyManagement::getAllKeys() const {
     std::vector<KeyInfo> allKeys;
-    for (const auto& ktPair : keys_) {
-        for (const auto& slotPair : ktPair.second) {
-            allKeys.push_back(slotPair.second);
+    for (int ti = 0; ti < TYPE_COUNT; ++ti) {
+        for (int slot = 0; slot < SLOT_COUNT; ++slot) {
+            if (occupied_[ti] & (1u << slot))
+                allKeys.push_back(keys_[ti][slot]);
         }
+        for (const KeyInfo& info : overflow_)
+            if (typeIndex(info.kt) == ti) allKeys.push_back(info);
     }
     return allKeys;
 }
 
 std::vector<KeyInfo> KeyManagement::getKeys(KeyType kt) const {
     std::vector<KeyInfo> typeKeys;
-    auto ktIt = keys_.find(kt);
-    if (ktIt != keys_.end()) {
-        for (const auto& slotPair : ktIt->second) {
-            typeKeys.push_back(slotPair.second);
-        }
+    int ti = typeIndex(kt);
+    if (ti < 0) return typeKeys;
+    for (int slot = 0; slot < SLOT_COUNT; ++slot) {
+        if (occupied_[ti] & (1u << slot))
+            typeKeys.push_back(keys_[ti][slot]);
     }
+    for (const KeyInfo& info : overflow_)
+        if (info.kt == kt) typeKeys.push_back(info);
     return typeKeys;
 }
 
@@ -202,10 +210,11 @@ std::string KeyManagement::describeKey(KeyType kt, BYTE slot) const {
 
 void KeyManagement::printAllKeys() const {
     std::cout << "=== Registered Keys ===\n";
-    for (const auto& ktPair : keys_) {
-        std::cout << (ktPair.first == KeyType::A ? "Key A" : "Key B") << ":\n";
-        for (const auto& slotPair : ktPair.second) {
-            std::cout << "  " << describeKey(ktPair.first, slotPair.first) << "\n";
+    for (KeyType kt : { KeyType::A, KeyType::B }) {
+        if (!hasKey(kt)) continue;
+        std::cout << (kt == KeyType::A ? "Key A" : "Key B") << ":\n";
+        for (BYTE slot : getSlots(kt)) {
+            std::cout << "  " << describeKey(kt, slot) << "\n";
         }
     }
 }
@@ -215,11 +224,17 @@ void KeyManagement::printAllKeys() const {
 // ════════════════════════════════════════════════════════════════════════════════
 
 void KeyManagement::clearKeys(KeyType kt) {
-    keys_.erase(kt);
+    int ti = typeIndex(kt);
+    if (ti < 0) return;
+    occupied_[ti] = 0;
+    overflow_.erase(std::remove_if(overflow_.begin(), overflow_.end(),
+                                   [kt](const KeyInfo& info) { return info.kt == kt; }),
+                    overflow_.end());
 }
 
 void KeyManagement::clearAllKeys() {
-    keys_.clear();
+    occupied_.fill(0);
+    overflow_.clear();
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
@@ -239,10 +254,42 @@ const MifareBlock& KeyManagement::getTrailer(int sector) const {
 }
 
 BYTE KeyManagement::getDefaultSlot(KeyType kt) const {
-    auto ktIt = keys_.find(kt);
-    if (ktIt == keys_.end() || ktIt->second.empty()) {
+    int ti = typeIndex(kt);
+    if (ti < 0 || !hasKey(kt)) {
 		PcscError::make(CardError::InvalidData, "No keys registered for this type").throwIfError();
         return 0;
     }
-    return ktIt->second.begin()->first;
+    // En düşük dolu slot (map sıralamasıyla aynı davranış); tablo boşsa overflow
+    for (int slot = 0; slot < SLOT_COUNT; ++slot) {
+        if (occupied_[ti] & (1u << slot)) return static_cast<BYTE>(slot);
+    }
+    return overflowLowerBound(kt, 0)->slot;
+}
+
+int KeyManagement::typeIndex(KeyType kt) {
+    switch (kt) {
+        case KeyType::A: return 0;
+        case KeyType::B: return 1;
+        default:         return -1;
+    }
+}
+
+const KeyInfo* KeyManagement::findEntry(KeyType kt, BYTE slot) const {
+    int ti = typeIndex(kt);
+    if (ti < 0) return nullptr;
+    if (slot >= SLOT_COUNT) {
+        auto it = overflowLowerBound(kt, slot);
+        return (it != overflow_.end() && it->kt == kt && it->slot == slot) ? &*it : nullptr;
+    }
+    if (!(occupied_[ti] & (1u << slot))) return nullptr;
+    return &keys_[ti][slot];
+}
+
+std::vector<KeyInfo>::const_iterator KeyManagement::overflowLowerBound(KeyType kt, BYTE slot) const {
+    const int ti = typeIndex(kt);
+    return std::lower_bound(overflow_.begin(), overflow_.end(), std::make_pair(ti, slot),
+        [](const KeyInfo& info, const std::pair<int, BYTE>& key) {
+            const int ii = typeIndex(info.kt);
+            return ii < key.first || (ii == key.first && info.slot < key.second);
+        });
 }
@@ -2,7 +2,8 @@
 #define KEYMANAGEMENT_H
 
 #include "../CardDataTypes.h"
-#include <map>
+#include <array>
+#include <cstdint>
 #include <vector>
 #include <stdexcept>
 
@@ -19,8 +20,10 @@ struct MifareBlock;
 //
 // Key Storage Structure:
 // - Multiple keys per type (KeyA, KeyB)
-// - Each key has a slot number (0x01, 0x02, etc.)
+// - Each key has a slot number (0x00 - 0x1F in the flat table; higher reader
+//   slots such as OMNIKEY volatile 0x20 go to a small sorted overflow list)
 // - Keys can be volatile or non-volatile
+// - Flat table: [type][slot] + occupancy bitmask per type (no heap, O(1) lookup)
 //
 // Usage:
 // 1. Register keys from reader/driver
@@ -139,11 +142,19 @@ public:
     // Clear all keys
     void clearAllKeys();
 
+    static constexpr int SLOT_COUNT = 32;   // reader slot 0x00 - 0x1F
+
 private:
     const CardMemoryLayout& cardMemory_;
 
-    // Storage: KeyType -> (Slot -> KeyInfo)
-    std::map<KeyType, std::map<BYTE, KeyInfo>> keys_;
+    // Storage: [typeIndex][slot] → KeyInfo, geçerlilik occupied_ bitmask'inde
+    //   typeIndex: 0 = KeyA, 1 = KeyB
+    static constexpr int TYPE_COUNT = 2;
+    std::array<std::array<KeyInfo, SLOT_COUNT>, TYPE_COUNT> keys_{};
+    std::array<uint32_t, TYPE_COUNT> occupied_{};
+
+    // Slot >= SLOT_COUNT: nadir → (type, slot) sıralı vektör (yavaş yol)
+    std::vector<KeyInfo> overflow_;
 
     // ────────────────────────────────────────────────────────────────────────────
     // Internal Helpers
@@ -154,6 +165,15 @@ private:
 
     // Helper: find first registered slot for key type
     BYTE getDefaultSlot(KeyType kt) const;
+
+    // Helper: KeyType → table index (-1: desteklenmeyen tür)
+    static int typeIndex(KeyType kt);
+
+    // Helper: kayıtlı entry veya nullptr
+    const KeyInfo* findEntry(KeyType kt, BYTE slot) const;
+
+    // Helper: overflow_ içinde (kt, slot) için lower_bound
+    std::vector<KeyInfo>::const_iterator overflowLowerBound(KeyType kt, BYTE slot) const;
 };
 
 #endif // KEYMANAGEMENT_H
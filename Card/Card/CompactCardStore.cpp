@@ -0,0 +1,223 @@
+#include "CompactCardStore.h"
+#include "CardInterface.h"
+#include "CardModel/CardMemoryLayout.h"
+#include "CardModel/CardTopology.h"
+#include "CardProtocol/AccessControl.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Kart türü başına paylaşılan topoloji (tablo pointer'ları, kopyasız)
+const CardLayoutTopology& topologyOf(CardType ct)
+{
+	static const CardLayoutTopology c1k(CardType::MifareClassic1K);
+	static const CardLayoutTopology c4k(CardType::MifareClassic4K);
+	static const CardLayoutTopology ul(CardType::MifareUltralight);
+	switch (ct) {
+		case CardType::MifareClassic4K:  return c4k;
+		case CardType::MifareUltralight: return ul;
+		default:                         return c1k;
+	}
+}
+
+int permissionSlots(CardType ct)
+{
+	const CardLayoutTopology& t = topologyOf(ct);
+	return t.hasTrailers() ? t.sectorCount() : 0;
+}
+
+} // namespace
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Ekleme
+// ════════════════════════════════════════════════════════════════════════════════
+
+size_t CompactCardStore::recordSize(CardType ct)
+{
+	const size_t bytes = topologyOf(ct).totalMemoryBytes() + permissionSlots(ct) * sizeof(uint16_t);
+	return (bytes + 15) & ~size_t(15);
+}
+
+CompactCardStore::Index CompactCardStore::add(const CardMemoryLayout& mem)
+{
+	return tryAdd(mem).unwrap();
+}
+
+Result<CompactCardStore::Index, PcscError> CompactCardStore::tryAdd(const CardMemoryLayout& mem)
+{
+	return tryAdd(mem.cardType, mem.getRawMemory(), mem.memorySize());
+}
+
+Result<CompactCardStore::Index, PcscError> CompactCardStore::tryAdd(CardType ct, const BYTE* data, size_t size)
+{
+	using R = Result<Index, PcscError>;
+	if (ct == CardType::MifareDesfire)
+		return R::Err(PcscError::make(CardError::NotDesfire, "DESFire has no flat image to store"));
+
+	const CardLayoutTopology& topo = topologyOf(ct);
+	if (!data || size != topo.totalMemoryBytes())
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Invalid memory size for card type")
+			.meta("size", std::to_string(size))
+			.meta("expected", std::to_string(topo.totalMemoryBytes())));
+
+	const size_t offset = arena_.size();                // her kayıt 16'nın katı
+	if (offset / 16 > UINT32_MAX || entries_.size() >= UINT32_MAX)
+		return R::Err(PcscError::make(CardError::InvalidData, "CompactCardStore is full"));
+
+	arena_.resize(offset + recordSize(ct), 0);
+	std::memcpy(arena_.data() + offset, data, size);
+
+	Entry e{};
+	e.offset16 = static_cast<uint32_t>(offset / 16);
+	e.cardType = static_cast<uint8_t>(ct);
+	entries_.push_back(e);
+
+	for (int s = 0; s < permissionSlots(ct); ++s)
+		refreshPermissions(e, s);
+	return R::Ok(static_cast<Index>(entries_.size() - 1));
+}
+
+void CompactCardStore::reserve(size_t cards, CardType typical)
+{
+	arena_.reserve(arena_.size() + cards * recordSize(typical));
+	entries_.reserve(entries_.size() + cards);
+}
+
+void CompactCardStore::clear()
+{
+	arena_.clear();
+	entries_.clear();
+}
+
+void CompactCardStore::shrinkToFit()
+{
+	arena_.shrink_to_fit();
+	entries_.shrink_to_fit();
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Sorgular
+// ════════════════════════════════════════════════════════════════════════════════
+
+const CompactCardStore::Entry& CompactCardStore::entry(Index i) const
+{
+	if (i >= entries_.size())
+		PcscError::make(CardError::InvalidData,
+			"Card index out of range: " + std::to_string(i)).throwIfError();
+	return entries_[i];
+}
+
+CardType CompactCardStore::cardType(Index i) const
+{
+	return static_cast<CardType>(entry(i).cardType);
+}
+
+const BYTE* CompactCardStore::raw(Index i) const
+{
+	return image(entry(i));
+}
+
+CardImageView CompactCardStore::view(Index i) const
+{
+	const Entry& e = entry(i);
+	return CardImageView(static_cast<CardType>(e.cardType), image(e));
+}
+
+size_t CompactCardStore::memoryUsage() const
+{
+	return arena_.capacity() + entries_.capacity() * sizeof(Entry);
+}
+
+// İzinler image'ın hemen arkasında (BYTE arena → strict aliasing için memcpy)
+uint16_t CompactCardStore::permissions(const Entry& e, int sector) const
+{
+	const size_t mem = topologyOf(static_cast<CardType>(e.cardType)).totalMemoryBytes();
+	uint16_t m;
+	std::memcpy(&m, image(e) + mem + sector * sizeof(uint16_t), sizeof(m));
+	return m;
+}
+
+void CompactCardStore::refreshPermissions(const Entry& e, int sector)
+{
+	const CardLayoutTopology& topo = topologyOf(static_cast<CardType>(e.cardType));
+	const BYTE* trailer = image(e) + topo.blockByteOffset(topo.trailerBlockOfSector(sector));
+	ACCESSBYTES bits;
+	std::memcpy(bits.data(), trailer + 6, 4);
+	const uint16_t m = AccessControl::decodePermissions(bits);
+	std::memcpy(image(e) + topo.totalMemoryBytes() + sector * sizeof(uint16_t), &m, sizeof(m));
+}
+
+bool CompactCardStore::allowed(Index i, int block, KeyType kt, bool isWrite) const
+{
+	const Entry& e = entry(i);
+	const CardLayoutTopology& topo = topologyOf(static_cast<CardType>(e.cardType));
+	if (!topo.hasTrailers()) return true;
+	if (!topo.isValidBlock(block)) return false;
+
+	const int slot = topo.isTrailerBlock(block)
+		? AccessControl::TRAILER_SLOT
+		: std::min(topo.blockIndexInSector(block), 2);
+	return AccessControl::maskAllows(permissions(e, topo.sectorFromBlock(block)), slot, kt, isWrite);
+}
+
+bool CompactCardStore::canRead(Index i, int block, KeyType kt) const
+{
+	return allowed(i, block, kt, false);
+}
+
+bool CompactCardStore::canWrite(Index i, int block, KeyType kt) const
+{
+	return allowed(i, block, kt, true);
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Güncelleme
+// ════════════════════════════════════════════════════════════════════════════════
+
+void CompactCardStore::writeBlock(Index i, int block, const BYTE data[16])
+{
+	tryWriteBlock(i, block, data).unwrap();
+}
+
+Result<void, PcscError> CompactCardStore::tryWriteBlock(Index i, int block, const BYTE data[16])
+{
+	using R = Result<void, PcscError>;
+	if (i >= entries_.size())
+		return R::Err(PcscError::make(CardError::InvalidData, "Card index out of range: " + std::to_string(i)));
+
+	const Entry& e = entries_[i];
+	const CardLayoutTopology& topo = topologyOf(static_cast<CardType>(e.cardType));
+	if (!topo.isValidBlock(block))
+		return R::Err(PcscError::make(CardError::InvalidData, "Block index out of range: " + std::to_string(block)));
+
+	std::memcpy(image(e) + topo.blockByteOffset(block), data, 16);
+	if (topo.isTrailerBlock(block))
+		refreshPermissions(e, topo.sectorFromBlock(block));
+	return R::Ok();
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// CardInterface ↔ Store
+// ════════════════════════════════════════════════════════════════════════════════
+
+void CompactCardStore::loadInto(Index i, CardInterface& card) const
+{
+	tryLoadInto(i, card).unwrap();
+}
+
+Result<void, PcscError> CompactCardStore::tryLoadInto(Index i, CardInterface& card) const
+{
+	using R = Result<void, PcscError>;
+	if (i >= entries_.size())
+		return R::Err(PcscError::make(CardError::InvalidData, "Card index out of range: " + std::to_string(i)));
+
+	const Entry& e = entries_[i];
+	const CardType ct = static_cast<CardType>(e.cardType);
+	if (card.getCardType() != ct)
+		return R::Err(PcscError::make(CardError::InvalidData, "Card type mismatch"));
+
+	card.loadMemory(image(e), topologyOf(ct).totalMemoryBytes());
+	return R::Ok();
+}
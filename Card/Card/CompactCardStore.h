@@ -0,0 +1,120 @@
+#ifndef COMPACTCARDSTORE_H
+#define COMPACTCARDSTORE_H
+
+#include "CardDataTypes.h"
+#include "CardModel/CardImageView.h"
+#include "Result.h"
+#include <cstdint>
+#include <vector>
+
+class CardInterface;
+struct CardMemoryLayout;
+
+// ════════════════════════════════════════════════════════════════════════════════
+// CompactCardStore — Büyük Filolar İçin Kompakt, Bellekte Yerleşik Kart Modeli
+// ════════════════════════════════════════════════════════════════════════════════
+//
+// CardInterface düzenleme modelidir: 4K'lık CardMemoryLayout union'ı + beş ayrı
+// heap nesnesi (topology, access, key, auth, DESFire). Yüz binlerce kartı
+// bellekte tutan back-office işleri için bu maliyet kart başına ~5 KB'tır.
+//
+// Store tüm kartları tek bir arena'da, kart türünün gerçek boyutuyla tutar:
+//
+//   entries_[i]  = { offset/16, cardType }                     8 byte
+//   arena_[off]  = image (64 / 1024 / 4096 byte)
+//                + decode edilmiş sektör izinleri (uint16 × sectorCount,
+//                  yalnızca Classic; AccessControl mask formatı)
+//                + 16 byte hizalama dolgusu
+//
+//   Ultralight  →   64 + 8 byte     (CardInterface'te ~5 KB)
+//   Classic 1K  → 1056 + 8 byte
+//   Classic 4K  → 4176 + 8 byte
+//
+// Topoloji kart türünden türetilir (Topology<CT> tabloları, saklanmaz).
+// Key durumu trailer'ların kendisidir; izinler eklemede ve trailer yazımında
+// decode edilir, sorgular tek maske okumasıdır.
+//
+// ─── Kullanım ──────────────────────────────────────────────────────────────
+//
+//   CompactCardStore fleet;
+//   fleet.reserve(1'000'000, CardType::MifareClassic1K);
+//   auto idx = fleet.add(io.card().getMemory());
+//
+//   CardImageView v = fleet.view(idx);          // kopyasız salt-okunur görünüm
+//   if (fleet.canWrite(idx, 8, KeyType::B)) fleet.writeBlock(idx, 8, data);
+//
+//   CardInterface card(fleet.cardType(idx));    // tam modele geri aç
+//   fleet.loadInto(idx, card);
+//
+// DİKKAT: view()/raw() pointer'ları sonraki add()'de (arena büyümesi)
+// geçersiz olabilir; toplu eklemeden önce reserve() çağırın.
+// DESFire desteklenmez (düz imajı yok) — CardImageArchive metadata'sını kullanın.
+//
+// ════════════════════════════════════════════════════════════════════════════════
+
+class CompactCardStore {
+public:
+    using Index = uint32_t;
+
+    // ── Ekleme ──────────────────────────────────────────────────────────────
+
+    Index add(const CardMemoryLayout& mem);
+    Result<Index, PcscError> tryAdd(const CardMemoryLayout& mem);
+    Result<Index, PcscError> tryAdd(CardType ct, const BYTE* data, size_t size);
+
+    // Arena'yı `cards` adet `typical` türünde kart için önceden ayır
+    void reserve(size_t cards, CardType typical = CardType::MifareClassic1K);
+    void clear();
+    void shrinkToFit();
+
+    // ── Sorgular ────────────────────────────────────────────────────────────
+
+    size_t size() const { return entries_.size(); }
+    bool   empty() const { return entries_.empty(); }
+    CardType cardType(Index i) const;
+
+    CardImageView view(Index i) const;
+    const BYTE*   raw(Index i) const;
+
+    // Paketlenmiş izin maskesinden (Ultralight → her zaman true)
+    bool canRead(Index i, int block, KeyType kt) const;
+    bool canWrite(Index i, int block, KeyType kt) const;
+
+    // Arena + index bellek kullanımı (byte)
+    size_t memoryUsage() const;
+
+    // Kart türü başına kayıt boyutu (image + izinler + dolgu)
+    static size_t recordSize(CardType ct);
+
+    // ── Güncelleme ──────────────────────────────────────────────────────────
+
+    // Trailer yazılırsa sektör izinleri yeniden decode edilir
+    void writeBlock(Index i, int block, const BYTE data[16]);
+    Result<void, PcscError> tryWriteBlock(Index i, int block, const BYTE data[16]);
+
+    // ── CardInterface ↔ Store ───────────────────────────────────────────────
+
+    // Kart türleri eşleşmeli
+    void loadInto(Index i, CardInterface& card) const;
+    Result<void, PcscError> tryLoadInto(Index i, CardInterface& card) const;
+
+private:
+    struct Entry {
+        uint32_t offset16;      // arena offset / 16 (≤ 64 GB arena)
+        uint8_t  cardType;
+        uint8_t  reserved[3];
+    };
+    static_assert(sizeof(Entry) == 8, "CompactCardStore::Entry must stay 8 bytes");
+
+    std::vector<BYTE>  arena_;
+    std::vector<Entry> entries_;
+
+    const Entry& entry(Index i) const;
+    BYTE*        image(const Entry& e) { return arena_.data() + size_t(e.offset16) * 16; }
+    const BYTE*  image(const Entry& e) const { return arena_.data() + size_t(e.offset16) * 16; }
+    uint16_t     permissions(const Entry& e, int sector) const;
+    void         refreshPermissions(const Entry& e, int sector);
+    bool         allowed(Index i, int block, KeyType kt, bool isWrite) const;
+};
+
+#endif // COMPACTCARDSTORE_H
@@ -0,0 +1,273 @@
+#include "DesfireMetadataCache.h"
+#include "CardModel/DesfireMemoryLayout.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+constexpr BYTE MAGIC[4] = { 'D', 'F', 'M', 'C' };
+
+void putLE32(BYTEV& out, uint32_t v)
+{
+	for (int i = 0; i < 4; ++i) out.push_back(static_cast<BYTE>(v >> (8 * i)));
+}
+
+// ── Sıralı okuyucu: taşma → ok = false ──────────────────────────────────────
+
+struct ByteReader {
+	const BYTE* p;
+	size_t      left;
+	bool        ok = true;
+
+	BYTE u8()
+	{
+		if (!left) { ok = false; return 0; }
+		--left;
+		return *p++;
+	}
+
+	uint32_t le32()
+	{
+		uint32_t v = 0;
+		for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(u8()) << (8 * i);
+		return v;
+	}
+
+	void bytes(BYTE* out, size_t n)
+	{
+		if (left < n) { ok = false; return; }
+		std::memcpy(out, p, n);
+		p += n;
+		left -= n;
+	}
+};
+
+// Union'ın aktif alanını tipten bağımsız 3 word + flag olarak yaz
+void putSettings(BYTEV& out, const DesfireFileSettings& fs)
+{
+	out.push_back(static_cast<BYTE>(fs.fileType));
+	out.push_back(static_cast<BYTE>(fs.commMode));
+	const auto acc = fs.access.encode();
+	out.push_back(acc[0]);
+	out.push_back(acc[1]);
+	switch (fs.fileType) {
+		case DesfireFileType::Value:
+			putLE32(out, static_cast<uint32_t>(fs.value.lowerLimit));
+			putLE32(out, static_cast<uint32_t>(fs.value.upperLimit));
+			putLE32(out, static_cast<uint32_t>(fs.value.value));
+			out.push_back(fs.value.limitedCreditEnabled ? 1 : 0);
+			break;
+		case DesfireFileType::LinearRecord:
+		case DesfireFileType::CyclicRecord:
+			putLE32(out, fs.record.recordSize);
+			putLE32(out, fs.record.maxRecords);
+			putLE32(out, fs.record.currentRecords);
+			out.push_back(0);
+			break;
+		default:
+			putLE32(out, fs.standard.fileSize);
+			putLE32(out, 0);
+			putLE32(out, 0);
+			out.push_back(0);
+			break;
+	}
+}
+
+DesfireFileSettings getSettings(ByteReader& in)
+{
+	DesfireFileSettings fs;
+	fs.fileType = static_cast<DesfireFileType>(in.u8());
+	fs.commMode = static_cast<DesfireCommMode>(in.u8());
+	const BYTE a0 = in.u8();
+	const BYTE a1 = in.u8();
+	fs.access = DesfireAccessRights::decode(a0, a1);
+	const uint32_t p0 = in.le32();
+	const uint32_t p1 = in.le32();
+	const uint32_t p2 = in.le32();
+	const BYTE flag = in.u8();
+	switch (fs.fileType) {
+		case DesfireFileType::Value:
+			fs.value.lowerLimit = static_cast<int32_t>(p0);
+			fs.value.upperLimit = static_cast<int32_t>(p1);
+			fs.value.value      = static_cast<int32_t>(p2);
+			fs.value.limitedCreditEnabled = flag != 0;
+			break;
+		case DesfireFileType::LinearRecord:
+		case DesfireFileType::CyclicRecord:
+			fs.record.recordSize     = p0;
+			fs.record.maxRecords     = p1;
+			fs.record.currentRecords = p2;
+			break;
+		default:
+			fs.standard.fileSize = p0;
+			break;
+	}
+	return fs;
+}
+
+} // namespace
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Anahtar
+// ════════════════════════════════════════════════════════════════════════════════
+
+DesfireMetadataCache::Key DesfireMetadataCache::keyOf(const DesfireVersionInfo& vi)
+{
+	const BYTE hw[7] = { vi.hwVendorID, vi.hwType, vi.hwSubType, vi.hwMajorVer,
+						 vi.hwMinorVer, vi.hwStorageSize, vi.hwProtocol };
+	const BYTE sw[7] = { vi.swVendorID, vi.swType, vi.swSubType, vi.swMajorVer,
+						 vi.swMinorVer, vi.swStorageSize, vi.swProtocol };
+	Key k{};
+	std::memcpy(k.data(), vi.uid, 7);
+	std::memcpy(k.data() + 7, hw, 7);
+	std::memcpy(k.data() + 14, sw, 7);
+	return k;
+}
+
+bool DesfireMetadataCache::cacheable(const DesfireVersionInfo& vi)
+{
+	return std::any_of(vi.uid, vi.uid + 7, [](BYTE b) { return b != 0; });
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Model ↔ Cache
+// ════════════════════════════════════════════════════════════════════════════════
+
+void DesfireMetadataCache::store(const DesfireMemoryLayout& mem)
+{
+	if (!cacheable(mem.versionInfo)) return;
+	Entry& e = entries_[keyOf(mem.versionInfo)];
+	e.appListKnown = mem.appListKnown;
+	e.apps = mem.applications;
+	for (auto& app : e.apps)
+		for (auto& f : app.files) BYTEV().swap(f.data);    // içerik cache'e girmez
+}
+
+bool DesfireMetadataCache::restore(DesfireMemoryLayout& mem) const
+{
+	if (!cacheable(mem.versionInfo)) return false;
+	auto it = entries_.find(keyOf(mem.versionInfo));
+	if (it == entries_.end()) return false;
+	mem.applications = it->second.apps;
+	mem.appListKnown = it->second.appListKnown;
+	return true;
+}
+
+bool DesfireMetadataCache::contains(const DesfireVersionInfo& vi) const
+{
+	return entries_.count(keyOf(vi)) != 0;
+}
+
+void DesfireMetadataCache::erase(const DesfireVersionInfo& vi)
+{
+	entries_.erase(keyOf(vi));
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Kalıcılık
+// ════════════════════════════════════════════════════════════════════════════════
+
+void DesfireMetadataCache::save(const std::string& path) const
+{
+	trySave(path).unwrap();
+}
+
+void DesfireMetadataCache::load(const std::string& path)
+{
+	tryLoad(path).unwrap();
+}
+
+Result<void, PcscError> DesfireMetadataCache::trySave(const std::string& path) const
+{
+	using R = Result<void, PcscError>;
+	BYTEV out(MAGIC, MAGIC + 4);
+	putLE32(out, FORMAT_VERSION);
+	putLE32(out, static_cast<uint32_t>(entries_.size()));
+	for (const auto& kv : entries_) {
+		out.insert(out.end(), kv.first.begin(), kv.first.end());
+		const Entry& e = kv.second;
+		out.push_back(e.appListKnown ? 1 : 0);
+		out.push_back(static_cast<BYTE>(std::min<size_t>(e.apps.size(), 0xFF)));
+		for (size_t a = 0; a < e.apps.size() && a < 0xFF; ++a) {
+			const DesfireApplication& app = e.apps[a];
+			out.insert(out.end(), app.aid.aid, app.aid.aid + 3);
+			out.push_back(app.keyConfig.keySettings);
+			out.push_back(app.keyConfig.keyCount);
+			out.push_back(static_cast<BYTE>(app.keyConfig.keyType));
+			out.push_back(app.fileListKnown ? 1 : 0);
+			out.push_back(static_cast<BYTE>(std::min<size_t>(app.files.size(), 0xFF)));
+			for (size_t f = 0; f < app.files.size() && f < 0xFF; ++f) {
+				out.push_back(app.files[f].fileNo);
+				out.push_back(app.files[f].settingsKnown ? 1 : 0);
+				putSettings(out, app.files[f].settings);
+			}
+		}
+	}
+
+	std::FILE* fp = std::fopen(path.c_str(), "wb");
+	if (!fp)
+		return R::Err(Error<PcscError>(IoError::WriteFailed).detail("Cannot open metadata cache: " + path));
+	const bool ok = std::fwrite(out.data(), 1, out.size(), fp) == out.size();
+	if (std::fclose(fp) != 0 || !ok)
+		return R::Err(Error<PcscError>(IoError::WriteFailed).detail("Cannot write metadata cache: " + path));
+	return R::Ok();
+}
+
+Result<void, PcscError> DesfireMetadataCache::tryLoad(const std::string& path)
+{
+	using R = Result<void, PcscError>;
+	std::FILE* fp = std::fopen(path.c_str(), "rb");
+	if (!fp)
+		return R::Err(Error<PcscError>(IoError::ReadFailed).detail("Cannot open metadata cache: " + path));
+	BYTEV buf;
+	BYTE chunk[4096];
+	size_t n;
+	while ((n = std::fread(chunk, 1, sizeof(chunk), fp)) > 0)
+		buf.insert(buf.end(), chunk, chunk + n);
+	std::fclose(fp);
+
+	ByteReader in{ buf.data(), buf.size() };
+	BYTE magic[4]{};
+	in.bytes(magic, 4);
+	const uint32_t version = in.le32();
+	if (!in.ok || std::memcmp(magic, MAGIC, 4) != 0 || version != FORMAT_VERSION)
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Not a DESFire metadata cache: " + path)
+			.meta("version", std::to_string(version)));
+
+	// Önce tamamı ayrıştırılır; bozuk dosya mevcut kayıtlara dokunmaz
+	std::map<Key, Entry> loaded;
+	const uint32_t count = in.le32();
+	for (uint32_t i = 0; i < count && in.ok; ++i) {
+		Key k{};
+		in.bytes(k.data(), k.size());
+		Entry e;
+		e.appListKnown = in.u8() != 0;
+		const BYTE apps = in.u8();
+		for (BYTE a = 0; a < apps && in.ok; ++a) {
+			DesfireApplication app;
+			in.bytes(app.aid.aid, 3);
+			app.keyConfig.keySettings = in.u8();
+			app.keyConfig.keyCount    = in.u8();
+			app.keyConfig.keyType     = static_cast<DesfireKeyType>(in.u8());
+			app.fileListKnown = in.u8() != 0;
+			const BYTE files = in.u8();
+			for (BYTE f = 0; f < files && in.ok; ++f) {
+				DesfireFile file;
+				file.fileNo        = in.u8();
+				file.settingsKnown = in.u8() != 0;
+				file.settings      = getSettings(in);
+				app.files.push_back(std::move(file));
+			}
+			e.apps.push_back(std::move(app));
+		}
+		loaded[k] = std::move(e);
+	}
+	if (!in.ok)
+		return R::Err(Error<PcscError>(CardError::InvalidData)
+			.detail("Truncated DESFire metadata cache: " + path));
+
+	for (auto& kv : loaded) entries_[kv.first] = std::move(kv.second);
+	return R::Ok();
+}
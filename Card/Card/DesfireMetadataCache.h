@@ -0,0 +1,89 @@
+#ifndef DESFIREMETADATACACHE_H
+#define DESFIREMETADATACACHE_H
+
+#include "CardDataTypes.h"
+#include "Result.h"
+#include <array>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+struct DesfireApplication;
+struct DesfireMemoryLayout;
+struct DesfireVersionInfo;
+
+// ════════════════════════════════════════════════════════════════════════════════
+// DesfireMetadataCache — UID + Sürüm Başına DESFire Metadata Deposu
+// ════════════════════════════════════════════════════════════════════════════════
+//
+// CardIO, GetApplicationIDs / GetFileIDs / GetFileSettings sonuçlarını
+// DesfireMemoryLayout'ta tutar; bu sınıf o ağacı kart ömrünün ötesine taşır.
+// Aynı kart tekrar okutulduğunda discoverCard() kaydı modele geri yükler ve
+// discovery komutları karta hiç gitmez.
+//
+// Anahtar: UID (7) + HW sürümü (7) + SW sürümü (7). Batch/üretim tarihi dahil
+// edilmez. UID'si sıfır olan (random UID) kartlar saklanmaz.
+//
+// Yalnızca metadata saklanır: app listesi, key config, dosya listesi ve dosya
+// ayarları + geçerlilik bayrakları. Dosya içerikleri (DesfireFile::data)
+// cache'e girmez.
+//
+// ─── Kullanım ──────────────────────────────────────────────────────────────
+//
+//   DesfireMetadataCache cache;
+//   cache.tryLoad("desfire_meta.bin");            // yoksa boş başlar
+//   io.setDesfireMetadataCache(&cache);
+//   io.discoverCard();                             // eşleşen kayıt yüklenir
+//   ...
+//   cache.save("desfire_meta.bin");
+//
+// ─── Dosya Formatı (v1, little-endian) ────────────────────────────────────
+//
+//   "DFMC" u32:version u32:entryCount
+//   entry: key[21] appListKnown appCount
+//     app: aid[3] keySettings keyCount keyType fileListKnown fileCount
+//       file: fileNo settingsKnown fileType commMode access[2] u32 p0 p1 p2 flag
+//
+// ════════════════════════════════════════════════════════════════════════════════
+
+class DesfireMetadataCache {
+public:
+    using Key = std::array<BYTE, 21>;
+
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    static Key  keyOf(const DesfireVersionInfo& vi);
+    static bool cacheable(const DesfireVersionInfo& vi);   // UID sıfır değil
+
+    // ── Model ↔ Cache ───────────────────────────────────────────────────────
+
+    // Modelin metadata'sını kaydet (aynı anahtarın eski kaydı değişir)
+    void store(const DesfireMemoryLayout& mem);
+
+    // Eşleşen kayıt varsa mem.applications + appListKnown yüklenir → true
+    bool restore(DesfireMemoryLayout& mem) const;
+
+    bool   contains(const DesfireVersionInfo& vi) const;
+    void   erase(const DesfireVersionInfo& vi);
+    void   clear() { entries_.clear(); }
+    size_t size() const { return entries_.size(); }
+
+    // ── Kalıcılık ───────────────────────────────────────────────────────────
+
+    void save(const std::string& path) const;
+    void load(const std::string& path);
+
+    Result<void, PcscError> trySave(const std::string& path) const;
+    Result<void, PcscError> tryLoad(const std::string& path);   // mevcut kayıtlarla birleşir
+
+private:
+    struct Entry {
+        bool appListKnown = false;
+        std::vector<DesfireApplication> apps;
+    };
+
+    std::map<Key, Entry> entries_;
+};
+
+#endif // DESFIREMETADATACACHE_H
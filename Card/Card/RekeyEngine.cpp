@@ -0,0 +1,453 @@
+#include "RekeyEngine.h"
+#include "CardIO.h"
+#include "CardModel/CardMemoryLayout.h"
+#include "CardModel/TrailerConfig.h"
+#include "CardProtocol/KeyManagement.h"
+#include "PcscCommands.h"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Hex yardımcıları (journal alanları — boşluksuz)
+// ════════════════════════════════════════════════════════════════════════════════
+
+namespace {
+
+std::string hexCompact(const BYTE* data, size_t len)
+{
+	static constexpr char lut[] = "0123456789ABCDEF";
+	std::string out(len * 2, '0');
+	for (size_t i = 0; i < len; ++i) {
+		out[i * 2]     = lut[data[i] >> 4];
+		out[i * 2 + 1] = lut[data[i] & 0x0F];
+	}
+	return out;
+}
+
+int hexNibble(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+bool parseHex(const std::string& s, BYTE* out, size_t len)
+{
+	if (s.size() != len * 2) return false;
+	for (size_t i = 0; i < len; ++i) {
+		int hi = hexNibble(s[i * 2]);
+		int lo = hexNibble(s[i * 2 + 1]);
+		if (hi < 0 || lo < 0) return false;
+		out[i] = static_cast<BYTE>((hi << 4) | lo);
+	}
+	return true;
+}
+
+} // namespace
+
+// ════════════════════════════════════════════════════════════════════════════════
+// RekeyJournal
+// ════════════════════════════════════════════════════════════════════════════════
+
+RekeyJournal::RekeyJournal(std::string path)
+	: path_(std::move(path))
+{
+}
+
+RekeyJournal::~RekeyJournal()
+{
+	if (out_) std::fclose(out_);
+}
+
+void RekeyJournal::open() { tryOpen().unwrap(); }
+
+Result<void, PcscError> RekeyJournal::tryOpen()
+{
+	using R = Result<void, PcscError>;
+	cards_.clear();
+	if (out_) { std::fclose(out_); out_ = nullptr; }
+
+	bool needsNewline = false;
+	{
+		std::ifstream in(path_, std::ios::binary);
+		if (in) {
+			std::ostringstream ss;
+			ss << in.rdbuf();
+			const std::string content = ss.str();
+
+			size_t pos = 0;
+			while (pos < content.size()) {
+				size_t nl = content.find('\n', pos);
+				if (nl == std::string::npos) {
+					// Son satır newline'sız → crash anında yarım kalmış, yok say
+					needsNewline = true;
+					break;
+				}
+				std::string line = content.substr(pos, nl - pos);
+				if (!line.empty() && line.back() == '\r') line.pop_back();
+				(void)parseLine(line);   // bozuk satırlar atlanır
+				pos = nl + 1;
+			}
+		}
+	}
+
+	out_ = std::fopen(path_.c_str(), "ab");
+	if (!out_)
+		return R::Err(Error<PcscError>(IoError::WriteFailed)
+			.detail("Cannot open rekey journal: " + path_));
+
+	// Yarım satırın arkasına yeni kayıt eklenmesin
+	if (needsNewline) {
+		if (std::fputc('\n', out_) == EOF)
+			return R::Err(Error<PcscError>(IoError::WriteFailed)
+				.detail("Rekey journal write failed: " + path_));
+		return trySync();
+	}
+	return R::Ok();
+}
+
+bool RekeyJournal::isOpen() const { return out_ != nullptr; }
+
+const std::string& RekeyJournal::path() const { return path_; }
+
+std::string RekeyJournal::uidKey(const BYTEV& uid)
+{
+	return hexCompact(uid.data(), uid.size());
+}
+
+bool RekeyJournal::parseLine(const std::string& line)
+{
+	std::istringstream ss(line);
+	std::string tag, uid;
+	if (!(ss >> tag >> uid) || uid.empty()) return false;
+
+	if (tag == "C") {
+		cards_[uid].complete = true;
+		return true;
+	}
+
+	int sector = -1;
+	if (!(ss >> sector) || sector < 0) return false;
+
+	if (tag == "I") {
+		std::string oldA, oldB, trailer;
+		if (!(ss >> oldA >> oldB >> trailer)) return false;
+		Entry e;
+		if (!parseHex(oldA, e.oldKeyA.data(), e.oldKeyA.size())) return false;
+		if (!parseHex(oldB, e.oldKeyB.data(), e.oldKeyB.size())) return false;
+		if (!parseHex(trailer, e.newTrailer.data(), e.newTrailer.size())) return false;
+		e.state = SectorState::Intent;
+		cards_[uid].sectors[sector] = e;
+		return true;
+	}
+
+	if (tag == "D") {
+		auto cit = cards_.find(uid);
+		if (cit == cards_.end()) return false;
+		auto sit = cit->second.sectors.find(sector);
+		if (sit == cit->second.sectors.end()) return false;   // Intent'siz Done geçersiz
+		sit->second.state = SectorState::Done;
+		return true;
+	}
+
+	return false;
+}
+
+Result<void, PcscError> RekeyJournal::tryAppendLine(const std::string& line)
+{
+	using R = Result<void, PcscError>;
+	if (!out_)
+		return R::Err(Error<PcscError>(IoError::WriteFailed).detail("Rekey journal is not open"));
+
+	if (std::fwrite(line.data(), 1, line.size(), out_) != line.size() || std::fputc('\n', out_) == EOF)
+		return R::Err(Error<PcscError>(IoError::WriteFailed)
+			.detail("Rekey journal write failed: " + path_));
+	return trySync();
+}
+
+Result<void, PcscError> RekeyJournal::trySync()
+{
+	using R = Result<void, PcscError>;
+	// flush yalnızca OS cache'ine bırakır; güç kesintisinde kayıt kaybolmasın
+	if (std::fflush(out_) != 0)
+		return R::Err(Error<PcscError>(IoError::WriteFailed)
+			.detail("Rekey journal flush failed: " + path_));
+#ifdef _WIN32
+	const int rc = _commit(_fileno(out_));
+#else
+	const int rc = fsync(fileno(out_));
+#endif
+	if (rc != 0)
+		return R::Err(Error<PcscError>(IoError::WriteFailed)
+			.detail("Rekey journal fsync failed: " + path_));
+	return R::Ok();
+}
+
+Result<void, PcscError> RekeyJournal::tryAppendIntent(const std::string& uid, int sector,
+													  const KEYBYTES& oldKeyA, const KEYBYTES& oldKeyB,
+													  const std::array<BYTE, 16>& newTrailer)
+{
+	std::string line = "I " + uid + " " + std::to_string(sector) + " "
+		+ hexCompact(oldKeyA.data(), oldKeyA.size()) + " "
+		+ hexCompact(oldKeyB.data(), oldKeyB.size()) + " "
+		+ hexCompact(newTrailer.data(), newTrailer.size());
+
+	auto r = tryAppendLine(line);
+	if (!r) return r;
+
+	Entry& e = cards_[uid].sectors[sector];
+	e.state      = SectorState::Intent;
+	e.oldKeyA    = oldKeyA;
+	e.oldKeyB    = oldKeyB;
+	e.newTrailer = newTrailer;
+	return r;
+}
+
+Result<void, PcscError> RekeyJournal::tryAppendDone(const std::string& uid, int sector)
+{
+	auto r = tryAppendLine("D " + uid + " " + std::to_string(sector));
+	if (!r) return r;
+	cards_[uid].sectors[sector].state = SectorState::Done;
+	return r;
+}
+
+Result<void, PcscError> RekeyJournal::tryAppendCardDone(const std::string& uid)
+{
+	auto r = tryAppendLine("C " + uid);
+	if (!r) return r;
+	cards_[uid].complete = true;
+	return r;
+}
+
+RekeyJournal::SectorState RekeyJournal::state(const std::string& uid, int sector) const
+{
+	const Entry* e = find(uid, sector);
+	return e ? e->state : SectorState::None;
+}
+
+const RekeyJournal::Entry* RekeyJournal::find(const std::string& uid, int sector) const
+{
+	auto cit = cards_.find(uid);
+	if (cit == cards_.end()) return nullptr;
+	auto sit = cit->second.sectors.find(sector);
+	return sit == cit->second.sectors.end() ? nullptr : &sit->second;
+}
+
+bool RekeyJournal::isCardDone(const std::string& uid) const
+{
+	auto it = cards_.find(uid);
+	return it != cards_.end() && it->second.complete;
+}
+
+size_t RekeyJournal::cardCount() const { return cards_.size(); }
+
+// ════════════════════════════════════════════════════════════════════════════════
+// RekeyEngine
+// ════════════════════════════════════════════════════════════════════════════════
+
+RekeyEngine::RekeyEngine(RekeyJournal& journal, RekeyPlan plan)
+	: journal_(journal), plan_(std::move(plan))
+{
+}
+
+const RekeyPlan& RekeyEngine::plan() const { return plan_; }
+
+void RekeyEngine::useOldKeys(CardIO& io) const
+{
+	io.setKeys(plan_.oldKeyA, plan_.slotA, plan_.oldKeyB, plan_.slotB, plan_.ks);
+}
+
+void RekeyEngine::useTrailerKeys(CardIO& io, const std::array<BYTE, 16>& trailer) const
+{
+	KEYBYTES keyA{}, keyB{};
+	std::memcpy(keyA.data(), trailer.data(),      6);
+	std::memcpy(keyB.data(), trailer.data() + 10, 6);
+	io.setKeys(keyA, plan_.slotA, keyB, plan_.slotB, plan_.ks);
+}
+
+RekeyCardReport RekeyEngine::rekeyCard(CardIO& io)
+{
+	return tryRekeyCard(io).unwrap();
+}
+
+Result<RekeyCardReport, PcscError> RekeyEngine::tryRekeyCard(CardIO& io)
+{
+	using R = Result<RekeyCardReport, PcscError>;
+	if (!io.card().isClassic())
+		return R::Err(Error<PcscError>(CardError::InvalidData).detail("Rekey requires Mifare Classic"));
+	if (!plan_.keepAccessBits && !AccessBitsCodec::verify(plan_.accessBits))
+		return R::Err(Error<PcscError>(CardError::InvalidData).detail("Rekey plan has invalid access bits"));
+	// setKeys → registerKey sıfır key'de throw eder; journal'a tek satır yazılmadan reddedilir
+	for (const KEYBYTES* k : { &plan_.oldKeyA, &plan_.oldKeyB, &plan_.newKeyA, &plan_.newKeyB })
+		if (!KeyManagement::isValidKey(*k))
+			return R::Err(Error<PcscError>(CardError::InvalidData).detail("Rekey plan has an all-zero key"));
+	if (!journal_.isOpen())
+		return R::Err(Error<PcscError>(IoError::WriteFailed).detail("Rekey journal is not open"));
+
+	// UID: FF CA 00 00 00 — auth gerektirmez, kart yoksa burada düşer
+	auto ur = io.reader().tryTransmit(PcscCommands::getUID());
+	if (!ur) return R::Err(std::move(ur.error()));
+	const ReaderResponse& resp = ur.unwrap();
+	if (!resp.isSuccess() || resp.data.empty())
+		return R::Err(Error<PcscError>(IoError::ReadFailed).detail("GET UID failed"));
+
+	RekeyCardReport report;
+	report.uid = RekeyJournal::uidKey(resp.data);
+	if (journal_.isCardDone(report.uid)) {
+		report.skipped = true;
+		return R::Ok(std::move(report));
+	}
+
+	std::vector<int> sectors = plan_.sectors;
+	if (sectors.empty()) {
+		int total = io.card().getTotalSectors();
+		sectors.reserve(total);
+		for (int s = 0; s < total; ++s) sectors.push_back(s);
+	}
+
+	report.sectors.reserve(sectors.size());
+	for (int s : sectors) {
+		const RekeyJournal::Entry* e = journal_.find(report.uid, s);
+		if (e && e->state == RekeyJournal::SectorState::Done) {
+			report.sectors.push_back({ s, RekeyOutcome::AlreadyDone, {} });
+			continue;
+		}
+		report.sectors.push_back(e ? resumeSector(io, report.uid, s, *e)
+		                           : processSector(io, report.uid, s));
+	}
+
+	if (report.complete()) {
+		auto cr = journal_.tryAppendCardDone(report.uid);
+		if (!cr) return R::Err(std::move(cr.error()));
+	}
+	return R::Ok(std::move(report));
+}
+
+RekeySectorResult RekeyEngine::processSector(CardIO& io, const std::string& uid, int sector)
+{
+	RekeySectorResult res;
+	res.sector = sector;
+
+	// 1) Eski key'lerle erişim doğrula, access bits'i belirle
+	useOldKeys(io);
+	ACCESSBYTES access = plan_.accessBits;
+	if (plan_.keepAccessBits) {
+		auto rr = io.tryReadTrailer(sector);
+		if (!rr) { res.error = "Old keys rejected: " + rr.error().message(); return res; }
+		const MifareBlock& cached = io.card().getBlock(io.card().getTrailerBlockOfSector(sector));
+		std::memcpy(access.data(), cached.trailer.accessBits, 4);
+		if (!AccessBitsCodec::verify(access)) { res.error = "Card access bits are corrupt"; return res; }
+	} else {
+		auto ar = io.tryAuthenticate(sector);
+		if (!ar) { res.error = "Old keys rejected: " + ar.error().message(); return res; }
+	}
+
+	std::array<BYTE, 16> trailer{};
+	std::memcpy(trailer.data(),      plan_.newKeyA.data(), 6);
+	std::memcpy(trailer.data() + 6,  access.data(),        4);
+	std::memcpy(trailer.data() + 10, plan_.newKeyB.data(), 6);
+
+	// 2) Niyet kalıcı olarak kaydedilmeden karta yazılmaz
+	auto jr = journal_.tryAppendIntent(uid, sector, plan_.oldKeyA, plan_.oldKeyB, trailer);
+	if (!jr) { res.error = jr.error().message(); return res; }
+
+	// 3) Yaz + yeni key'lerle doğrula + Done
+	auto wr = tryWriteAndConfirm(io, uid, sector, trailer);
+	if (!wr) { res.error = wr.error().message(); return res; }
+
+	res.outcome = RekeyOutcome::Rekeyed;
+	return res;
+}
+
+RekeySectorResult RekeyEngine::resumeSector(CardIO& io, const std::string& uid, int sector,
+											const RekeyJournal::Entry& entry)
+{
+	RekeySectorResult res;
+	res.sector = sector;
+
+	// Journal başka bir plan/sürümden kalmış olabilir: sıfır key setKeys'te throw eder
+	KEYBYTES newA{}, newB{};
+	std::memcpy(newA.data(), entry.newTrailer.data(),      6);
+	std::memcpy(newB.data(), entry.newTrailer.data() + 10, 6);
+	const KEYBYTES* keys[] = { &entry.oldKeyA, &entry.oldKeyB, &newA, &newB };
+	for (const KEYBYTES* k : keys)
+		if (!KeyManagement::isValidKey(*k)) { res.error = "Journal entry has an all-zero key"; return res; }
+
+	// Önceki yazma karta ulaşmış olabilir → önce journal'daki yeni key'leri dene
+	if (verifyWithTrailerKeys(io, sector, entry.newTrailer)) {
+		auto dr = journal_.tryAppendDone(uid, sector);
+		if (!dr) { res.error = dr.error().message(); return res; }
+		res.outcome = RekeyOutcome::Recovered;
+		return res;
+	}
+
+	// Ulaşmamış → journal'daki eski key'lerle AYNI trailer tekrar yazılır
+	io.setKeys(entry.oldKeyA, plan_.slotA, entry.oldKeyB, plan_.slotB, plan_.ks);
+	auto ar = io.tryAuthenticate(sector);
+	if (!ar) {
+		res.error = "Neither journaled old nor new keys authenticate: " + ar.error().message();
+		return res;
+	}
+
+	auto wr = tryWriteAndConfirm(io, uid, sector, entry.newTrailer);
+	if (!wr) { res.error = wr.error().message(); return res; }
+
+	res.outcome = RekeyOutcome::Recovered;
+	return res;
+}
+
+Result<void, PcscError> RekeyEngine::tryWriteAndConfirm(CardIO& io, const std::string& uid, int sector,
+														const std::array<BYTE, 16>& trailer)
+{
+	using R = Result<void, PcscError>;
+
+	MifareBlock blk;
+	std::memcpy(blk.raw, trailer.data(), 16);
+	auto wr = io.tryWriteTrailer(sector, TrailerConfig::fromBlock(blk));
+	if (!wr) return wr;
+
+	if (!verifyWithTrailerKeys(io, sector, trailer))
+		return R::Err(Error<PcscError>(IoError::WriteFailed)
+			.detail("Trailer written but new keys did not verify")
+			.meta("sector", sector));
+
+	return journal_.tryAppendDone(uid, sector);
+}
+
+bool RekeyEngine::verifyWithTrailerKeys(CardIO& io, int sector, const std::array<BYTE, 16>& trailer)
+{
+	// Yazılan trailer'ın key'leriyle taze auth zorunlu — önceki oturum eski key ile açılmış olabilir
+	useTrailerKeys(io, trailer);
+	if (!io.tryAuthenticate(sector)) return false;
+	if (!io.tryReadTrailer(sector)) return false;
+
+	const MifareBlock& back = io.card().getBlock(io.card().getTrailerBlockOfSector(sector));
+	return std::memcmp(back.trailer.accessBits, trailer.data() + 6, 4) == 0;
+}
+
+RekeyFleetResult RekeyEngine::runFleet(const std::function<CardIO*()>& nextCard,
+									   const std::function<bool(const RekeyCardReport&)>& onCard)
+{
+	RekeyFleetResult result;
+	while (CardIO* io = nextCard()) {
+		auto r = tryRekeyCard(*io);
+		if (!r) {
+			// kart çekildi / UID yok → kaydedilir, sıradaki kart
+			result.cardErrors.push_back(std::move(r.error()));
+			continue;
+		}
+
+		const RekeyCardReport& report = r.unwrap();
+		if (report.complete()) ++result.completed;
+		if (onCard && !onCard(report)) break;
+	}
+	return result;
+}
@@ -0,0 +1,225 @@
+#ifndef REKEYENGINE_H
+#define REKEYENGINE_H
+
+#include "CardDataTypes.h"
+#include "Result.h"
+#include <array>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+class CardIO;
+
+// ════════════════════════════════════════════════════════════════════════════════
+// RekeyJournal / RekeyEngine — Crash-Safe Filo Rekey (Mifare Classic)
+// ════════════════════════════════════════════════════════════════════════════════
+//
+// Binlerce kartın sektör trailer key'lerini değiştirirken yarım kalan bir
+// yazma (tearing, kart çekilmesi, process crash) sektörü bilinmeyen bir key
+// altında bırakabilir. Journal, her trailer yazımından ÖNCE niyeti (eski
+// key'ler + yazılacak 16 byte trailer) kalıcı olarak kaydeder; böylece
+// kurtarma key listesini denemek yerine journal'dan okunur.
+//
+// ─── Journal Formatı (append-only, satır başına 1 kayıt) ──────────────────
+//
+//   I <uid> <sector> <oldKeyA> <oldKeyB> <newTrailer16>   yazmadan önce
+//   D <uid> <sector>                                      verify sonrası
+//   C <uid>                                               kartın tüm sektörleri bitti
+//
+//   Hex alanlar boşluksuz büyük harf (ör. "A0A1A2A3A4A5").
+//   Her satır yazıldıktan sonra flush + fsync edilir (Windows: _commit) —
+//   Intent diske inmeden karta yazılmaz. Crash anında yarım kalmış son
+//   satır (newline yok / parse edilemiyor) yükleme sırasında yok sayılır.
+//
+//   DİKKAT: Journal key'leri açık metin olarak tutar — dosya izinleri ve
+//   saklama süresi operatörün sorumluluğundadır.
+//
+// ─── Sektör Durum Makinesi ────────────────────────────────────────────────
+//
+//   None ──(I yaz)──► Intent ──(trailer yaz + verify, D yaz)──► Done
+//
+//   Resume (Intent kalmış sektör):
+//     1) Journal'daki trailer'ın key'leriyle (byte 0-5 key A, 10-15 key B)
+//        auth + trailer oku → access bits eşleşiyorsa → Done
+//     2) Değilse journal'daki eski key'lerle AYNI trailer tekrar yazılır
+//   Aynı trailer byte'ları yazıldığı için işlem idempotent'tir. Kurtarma
+//   plan'daki key'lere bakmaz — plan çalıştırmalar arasında değişmiş olabilir.
+//
+// ─── Kullanım ──────────────────────────────────────────────────────────────
+//
+//   RekeyJournal journal("rekey_2024Q3.log");
+//   journal.open();                                    // mevcut log yüklenir
+//
+//   RekeyPlan plan;
+//   plan.oldKeyA = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+//   plan.oldKeyB = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+//   plan.newKeyA = {0xA0,0xA1,0xA2,0xA3,0xA4,0xA5};
+//   plan.newKeyB = {0xB0,0xB1,0xB2,0xB3,0xB4,0xB5};
+//
+//   RekeyEngine engine(journal, plan);
+//   RekeyFleetResult fr = engine.runFleet(
+//       [&]() -> CardIO* { return waitForNextCard(); },   // nullptr → dur
+//       [&](const RekeyCardReport& r) { log(r); return true; });
+//   for (const auto& e : fr.cardErrors) log(e.message());
+//
+// ════════════════════════════════════════════════════════════════════════════════
+
+class RekeyJournal {
+public:
+    enum class SectorState { None, Intent, Done };
+
+    struct Entry {
+        SectorState state = SectorState::None;
+        KEYBYTES oldKeyA{};
+        KEYBYTES oldKeyB{};
+        std::array<BYTE, 16> newTrailer{};
+    };
+
+    explicit RekeyJournal(std::string path);
+    ~RekeyJournal();
+
+    RekeyJournal(const RekeyJournal&) = delete;
+    RekeyJournal& operator=(const RekeyJournal&) = delete;
+
+    // Mevcut journal'ı yükle ve append modunda aç
+    void open();
+    Result<void, PcscError> tryOpen();
+
+    bool isOpen() const;
+
+    // Kayıt ekleme — her çağrı satırı yazar, flush + fsync eder
+    Result<void, PcscError> tryAppendIntent(const std::string& uid, int sector,
+                                            const KEYBYTES& oldKeyA, const KEYBYTES& oldKeyB,
+                                            const std::array<BYTE, 16>& newTrailer);
+    Result<void, PcscError> tryAppendDone(const std::string& uid, int sector);
+    Result<void, PcscError> tryAppendCardDone(const std::string& uid);
+
+    // Sorgular (memory index üzerinden)
+    SectorState  state(const std::string& uid, int sector) const;
+    const Entry* find(const std::string& uid, int sector) const;
+    bool         isCardDone(const std::string& uid) const;
+    size_t       cardCount() const;
+
+    const std::string& path() const;
+
+    // UID byte'larını journal anahtarına çevir (boşluksuz hex)
+    static std::string uidKey(const BYTEV& uid);
+
+private:
+    struct CardRecord {
+        bool complete = false;
+        std::map<int, Entry> sectors;
+    };
+
+    std::string path_;
+    std::FILE*  out_ = nullptr;
+    std::map<std::string, CardRecord> cards_;
+
+    bool parseLine(const std::string& line);
+    Result<void, PcscError> tryAppendLine(const std::string& line);
+    Result<void, PcscError> trySync();
+};
+
+// ────────────────────────────────────────────────────────────────────────────
+// Rekey Planı / Raporu
+// ────────────────────────────────────────────────────────────────────────────
+
+struct RekeyPlan {
+    KEYBYTES oldKeyA{ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    KEYBYTES oldKeyB{ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    KEYBYTES newKeyA{ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    KEYBYTES newKeyB{ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+    BYTE         slotA = 0x01;
+    BYTE         slotB = 0x02;
+    KeyStructure ks    = KeyStructure::NonVolatile;
+
+    // true  → mevcut access bits korunur (eski key ile okunur)
+    // false → accessBits yazılır (AccessBitsCodec::verify geçmeli)
+    bool        keepAccessBits = true;
+    ACCESSBYTES accessBits{ 0xFF, 0x07, 0x80, 0x69 };   // factory default
+
+    // Boş → kartın tüm sektörleri
+    std::vector<int> sectors;
+};
+
+enum class RekeyOutcome {
+    Rekeyed,        // bu çalıştırmada yazıldı ve doğrulandı
+    AlreadyDone,    // journal'da Done — karta dokunulmadı
+    Recovered,      // Intent kalmıştı; resume ile tamamlandı
+    Failed          // journal Intent'te kalabilir — sonraki çalıştırmada resume
+};
+
+struct RekeySectorResult {
+    int          sector  = -1;
+    RekeyOutcome outcome = RekeyOutcome::Failed;
+    std::string  error;
+};
+
+struct RekeyCardReport {
+    std::string uid;
+    bool skipped = false;   // kart journal'da zaten tamamlanmış
+    std::vector<RekeySectorResult> sectors;
+
+    bool complete() const {
+        if (skipped) return true;
+        for (const auto& s : sectors)
+            if (s.outcome == RekeyOutcome::Failed) return false;
+        return true;
+    }
+};
+
+// Filo çalıştırmasının sonucu: kart seviyesinde Err dönen kartlar (UID
+// okunamadı, Classic değil, journal yazılamadı) sessizce atlanmaz, burada
+// toplanır. Sektör hataları ilgili RekeyCardReport'tadır.
+struct RekeyFleetResult {
+    int completed = 0;                      // complete() kart sayısı
+    std::vector<PcscError> cardErrors;
+
+    bool ok() const { return cardErrors.empty(); }
+};
+
+// ────────────────────────────────────────────────────────────────────────────
+// RekeyEngine
+// ────────────────────────────────────────────────────────────────────────────
+// Tasarım Notu:
+// Engine kart başına etkileşim istemez: UID okunur, journal'a göre yapılacak
+// sektörler belirlenir ve sırayla işlenir. Sektör hatası kartı durdurmaz;
+// hatalı sektörler Intent'te kalır ve aynı kart tekrar okutulduğunda resume
+// edilir. Kart seviyesinde Err yalnızca UID alınamazsa (kart yok/çekildi)
+// veya kart Classic değilse döner.
+// ────────────────────────────────────────────────────────────────────────────
+
+class RekeyEngine {
+public:
+    RekeyEngine(RekeyJournal& journal, RekeyPlan plan);
+
+    RekeyCardReport                     rekeyCard(CardIO& io);
+    Result<RekeyCardReport, PcscError>  tryRekeyCard(CardIO& io);
+
+    // Back-to-back işleme: nextCard() nullptr dönene veya onCard() false
+    // dönene kadar devam eder. Kart seviyesi hatalar (ör. UID okunamadı)
+    // döngüyü durdurmaz; cardErrors'a eklenip sıradaki karta geçilir.
+    RekeyFleetResult runFleet(const std::function<CardIO*()>& nextCard,
+                 const std::function<bool(const RekeyCardReport&)>& onCard);
+
+    const RekeyPlan& plan() const;
+
+private:
+    RekeyJournal& journal_;
+    RekeyPlan     plan_;
+
+    void useOldKeys(CardIO& io) const;
+    void useTrailerKeys(CardIO& io, const std::array<BYTE, 16>& trailer) const;
+
+    RekeySectorResult processSector(CardIO& io, const std::string& uid, int sector);
+    RekeySectorResult resumeSector(CardIO& io, const std::string& uid, int sector,
+                                   const RekeyJournal::Entry& entry);
+    Result<void, PcscError> tryWriteAndConfirm(CardIO& io, const std::string& uid, int sector,
+                                               const std::array<BYTE, 16>& trailer);
+    bool verifyWithTrailerKeys(CardIO& io, int sector, const std::array<BYTE, 16>& trailer);
+};
+
+#endif // REKEYENGINE_H
@@ -1,8 +1,7 @@
 #include "BlockCipher.h"
+#include "Cmac.h"
 #include "Exceptions/GenericExceptions.h"
 #include <openssl/evp.h>
-#include <openssl/core_names.h>
-#include <openssl/params.h>
 #include <stdexcept>
 #include <cstring>
 
@@ -108,35 +107,61 @@ BYTEV decrypt3K3DesCbc(const BYTEV& key, const BYTEV& iv, const BYTE* data, size
 }
 
 // ════════════════════════════════════════════════════════════════════════════════
-// AES-128 CMAC (OMAC1)
+// Ayrılmasız CBC — thread başına kalıcı context
 // ════════════════════════════════════════════════════════════════════════════════
 
-BYTEV cmacAes128(const BYTEV& key, const BYTE* data, size_t len) {
-	EVP_MAC* mac = EVP_MAC_fetch(nullptr, "CMAC", nullptr);
-	if (!mac) throw pcsc::CipherError("EVP_MAC_fetch(CMAC) failed");
+namespace {
 
-	EVP_MAC_CTX* ctx = EVP_MAC_CTX_new(mac);
-	if (!ctx) { EVP_MAC_free(mac); throw pcsc::CipherError("EVP_MAC_CTX_new failed"); }
+struct ThreadCipherCtx {
+	EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+	~ThreadCipherCtx() { EVP_CIPHER_CTX_free(ctx); }
+};
 
-	OSSL_PARAM params[2];
-	params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_CIPHER,
-	                                              const_cast<char*>("AES-128-CBC"), 0);
-	params[1] = OSSL_PARAM_construct_end();
+} // namespace
 
-	if (EVP_MAC_init(ctx, key.data(), key.size(), params) != 1) {
-		EVP_MAC_CTX_free(ctx); EVP_MAC_free(mac);
-		throw pcsc::CipherError("EVP_MAC_init(CMAC) failed");
+void cbcInto(CbcAlgo algo, bool encrypt, const BYTE* key, size_t keyLen, const BYTE* iv,
+             const BYTE* in, size_t len, BYTE* out) {
+	const size_t bs = (algo == CbcAlgo::AES128) ? AES_BLOCK : DES_BLOCK;
+	if (len == 0 || (len % bs) != 0)
+		throw std::invalid_argument("Data length must be a non-zero multiple of block size");
+
+	BYTE k[24];
+	const EVP_CIPHER* cipher;
+	if (algo == CbcAlgo::AES128) {
+		if (keyLen != 16) throw std::invalid_argument("AES-128 key must be 16 bytes");
+		std::memcpy(k, key, 16);
+		cipher = EVP_aes_128_cbc();
+	} else {
+		switch (keyLen) {
+		case 8:  std::memcpy(k, key, 8); std::memcpy(k + 8, key, 8); std::memcpy(k + 16, key, 8); break;
+		case 16: std::memcpy(k, key, 16); std::memcpy(k + 16, key, 8); break;
+		case 24: std::memcpy(k, key, 24); break;
+		default: throw std::invalid_argument("3DES key must be 8, 16 or 24 bytes");
+		}
+		cipher = EVP_des_ede3_cbc();
 	}
 
-	EVP_MAC_update(ctx, data, len);
+	static const BYTE zeroIV[AES_BLOCK] = {};
+	thread_local ThreadCipherCtx tc;
+	if (!tc.ctx) throw pcsc::CipherError("EVP_CIPHER_CTX_new failed");
+
+	int n = 0;
+	const bool ok = EVP_CipherInit_ex(tc.ctx, cipher, nullptr, k, iv ? iv : zeroIV, encrypt ? 1 : 0) == 1
+		&& EVP_CIPHER_CTX_set_padding(tc.ctx, 0) == 1
+		&& EVP_CipherUpdate(tc.ctx, out, &n, in, static_cast<int>(len)) == 1
+		&& n == static_cast<int>(len);
+	std::memset(k, 0, sizeof(k));
+	if (!ok) throw pcsc::CipherError("EVP_CipherUpdate(CBC) failed");
+}
 
-	BYTEV out(AES_BLOCK);
-	size_t outLen = 0;
-	EVP_MAC_final(ctx, out.data(), &outLen, out.size());
-	out.resize(outLen);
+// ════════════════════════════════════════════════════════════════════════════════
+// AES-128 CMAC (OMAC1)
+// ════════════════════════════════════════════════════════════════════════════════
 
-	EVP_MAC_CTX_free(ctx);
-	EVP_MAC_free(mac);
+BYTEV cmacAes128(const BYTEV& key, const BYTE* data, size_t len) {
+	// Tek seferlik; tekrar eden MAC'ler için Cmac nesnesini saklayın
+	BYTEV out(AES_BLOCK);
+	Cmac(CmacAlgo::AES128, key).compute(nullptr, data, len, out.data());
 	return out;
 }
 
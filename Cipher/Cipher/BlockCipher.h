@@ -24,6 +24,14 @@ BYTEV decrypt3K3DesCbc(const BYTEV& key, const BYTEV& iv, const BYTE* data, size
 inline BYTEV encrypt3K3DesCbc(const BYTEV& key, const BYTEV& iv, const BYTEV& d) { return encrypt3K3DesCbc(key, iv, d.data(), d.size()); }
 inline BYTEV decrypt3K3DesCbc(const BYTEV& key, const BYTEV& iv, const BYTEV& d) { return decrypt3K3DesCbc(key, iv, d.data(), d.size()); }
 
+// ── Ayrılmasız CBC (sıcak yol) ──────────────────────────────────────────────
+// Heap tamponu yok: thread başına tek EVP context'i yeniden kullanılır.
+// in == out olabilir; len blok katı olmalı; iv nullptr → sıfır IV.
+// TDES keyLen: 8 (K K K), 16 (K1 K2 K1) veya 24.
+enum class CbcAlgo { AES128, TDES };
+void cbcInto(CbcAlgo algo, bool encrypt, const BYTE* key, size_t keyLen, const BYTE* iv,
+             const BYTE* in, size_t len, BYTE* out);
+
 BYTEV cmacAes128(const BYTEV& key, const BYTE* data, size_t len);
 inline BYTEV cmacAes128(const BYTEV& key, const BYTEV& d) { return cmacAes128(key, d.data(), d.size()); }
 
@@ -0,0 +1,229 @@
+#include "Cmac.h"
+#include "Exceptions/GenericExceptions.h"
+#include <openssl/evp.h>
+#include <algorithm>
+#include <cstring>
+
+namespace crypto { namespace block {
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Impl — ECB key schedule + K1/K2 + zincir durumu
+// ════════════════════════════════════════════════════════════════════════════════
+
+struct Cmac::Impl {
+	EVP_CIPHER_CTX* ctx = nullptr;
+	CmacAlgo algo = CmacAlgo::AES128;
+	size_t   bs = 16;
+	bool     keyed = false;                 // clear() sonrası ctx/tampon korunur, key yok
+	BYTEV    key;                           // boundTo() karşılaştırması için
+	BYTE     k1[MAX_BLOCK]{};
+	BYTE     k2[MAX_BLOCK]{};
+	BYTE     state[MAX_BLOCK]{};
+	BYTE     buf[MAX_BLOCK]{};
+	size_t   bufLen = 0;
+
+	Impl() = default;
+	Impl(const Impl& o)
+		: algo(o.algo), bs(o.bs), keyed(o.keyed), key(o.key), bufLen(o.bufLen) {
+		std::memcpy(k1, o.k1, sizeof(k1));
+		std::memcpy(k2, o.k2, sizeof(k2));
+		std::memcpy(state, o.state, sizeof(state));
+		std::memcpy(buf, o.buf, sizeof(buf));
+		if (o.ctx) {
+			ctx = EVP_CIPHER_CTX_new();
+			if (!ctx || EVP_CIPHER_CTX_copy(ctx, o.ctx) != 1) {
+				EVP_CIPHER_CTX_free(ctx);
+				throw pcsc::CipherError("EVP_CIPHER_CTX_copy(CMAC) failed");
+			}
+		}
+	}
+	~Impl() { EVP_CIPHER_CTX_free(ctx); }
+
+	void encryptBlock(const BYTE* in, BYTE* out) {
+		int n = 0;
+		if (EVP_EncryptUpdate(ctx, out, &n, in, static_cast<int>(bs)) != 1 || n != static_cast<int>(bs))
+			throw pcsc::CipherError("CMAC block encrypt failed");
+	}
+
+	// Sola 1 bit kaydır, taşma varsa Rb (AES 0x87, 3DES 0x1B) ile XOR
+	void shift(const BYTE* in, BYTE* out) const {
+		const BYTE msb = in[0] & 0x80;
+		for (size_t i = 0; i + 1 < bs; ++i)
+			out[i] = static_cast<BYTE>((in[i] << 1) | (in[i + 1] >> 7));
+		out[bs - 1] = static_cast<BYTE>(in[bs - 1] << 1);
+		if (msb) out[bs - 1] ^= (bs == 16) ? 0x87 : 0x1B;
+	}
+
+	void absorb() {
+		for (size_t i = 0; i < bs; ++i) state[i] ^= buf[i];
+		encryptBlock(state, state);
+		bufLen = 0;
+	}
+};
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Construction
+// ════════════════════════════════════════════════════════════════════════════════
+
+Cmac::Cmac() = default;
+
+Cmac::Cmac(CmacAlgo algo, const BYTEV& key) {
+	setKey(algo, key);
+}
+
+Cmac::~Cmac() = default;
+
+Cmac::Cmac(const Cmac& other)
+	: pImpl(other.pImpl ? std::make_unique<Impl>(*other.pImpl) : nullptr) {}
+
+Cmac& Cmac::operator=(const Cmac& other) {
+	if (this != &other)
+		pImpl = other.pImpl ? std::make_unique<Impl>(*other.pImpl) : nullptr;
+	return *this;
+}
+
+Cmac::Cmac(Cmac&&) noexcept = default;
+Cmac& Cmac::operator=(Cmac&&) noexcept = default;
+
+void Cmac::setKey(CmacAlgo algo, const BYTEV& key) {
+	// Key yığında genişletilir; mevcut Impl/ctx varsa yeniden kullanılır
+	// (oturum başına yeniden bağlanan motor heap'e gitmez)
+	const EVP_CIPHER* cipher = nullptr;
+	BYTE k[24];
+	switch (algo) {
+	case CmacAlgo::AES128:
+		if (key.size() != 16) throw pcsc::CipherError("CMAC: AES key must be 16 bytes");
+		std::memcpy(k, key.data(), 16);
+		cipher = EVP_aes_128_ecb();
+		break;
+	case CmacAlgo::TDES2K:
+		if (key.size() != 8 && key.size() != 16) throw pcsc::CipherError("CMAC: 2K3DES key must be 8 or 16 bytes");
+		std::memcpy(k, key.data(), 8);
+		std::memcpy(k + 8, key.data() + (key.size() == 16 ? 8 : 0), 8);
+		std::memcpy(k + 16, key.data(), 8);                 // K1 K2 K1
+		cipher = EVP_des_ede3_ecb();
+		break;
+	case CmacAlgo::TDES3K:
+		if (key.size() != 24) throw pcsc::CipherError("CMAC: 3K3DES key must be 24 bytes");
+		std::memcpy(k, key.data(), 24);
+		cipher = EVP_des_ede3_ecb();
+		break;
+	}
+
+	if (!pImpl) pImpl = std::make_unique<Impl>();
+	Impl& m = *pImpl;
+	m.keyed = false;
+	if (!m.ctx && !(m.ctx = EVP_CIPHER_CTX_new())) throw pcsc::CipherError("EVP_CIPHER_CTX_new failed");
+	const bool ok = EVP_EncryptInit_ex(m.ctx, cipher, nullptr, k, nullptr) == 1;
+	std::memset(k, 0, sizeof(k));
+	if (!ok) throw pcsc::CipherError("EVP_EncryptInit(CMAC) failed");
+	EVP_CIPHER_CTX_set_padding(m.ctx, 0);
+
+	m.algo = algo;
+	m.bs   = (algo == CmacAlgo::AES128) ? 16 : 8;
+	m.key.assign(key.begin(), key.end());
+	m.bufLen = 0;
+
+	// L = E(K, 0^b) → K1 = L << 1, K2 = K1 << 1
+	BYTE L[MAX_BLOCK]{};
+	m.encryptBlock(L, L);
+	m.shift(L, m.k1);
+	m.shift(m.k1, m.k2);
+	std::memset(L, 0, sizeof(L));
+	m.keyed = true;
+}
+
+void Cmac::clear() {
+	if (!pImpl) return;
+	Impl& m = *pImpl;
+	std::fill(m.key.begin(), m.key.end(), 0);
+	m.key.clear();
+	std::memset(m.k1, 0, sizeof(m.k1));
+	std::memset(m.k2, 0, sizeof(m.k2));
+	std::memset(m.state, 0, sizeof(m.state));
+	std::memset(m.buf, 0, sizeof(m.buf));
+	m.bufLen = 0;
+	m.keyed  = false;
+}
+
+bool Cmac::ready() const noexcept {
+	return pImpl && pImpl->keyed;
+}
+
+bool Cmac::boundTo(CmacAlgo algo, const BYTEV& key) const noexcept {
+	return ready() && pImpl->algo == algo && pImpl->key == key;
+}
+
+size_t Cmac::blockSize() const noexcept {
+	return pImpl ? pImpl->bs : 16;
+}
+
+size_t Cmac::truncatedSize() const noexcept {
+	return 8;
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Artımlı API
+// ════════════════════════════════════════════════════════════════════════════════
+
+void Cmac::reset(const BYTE* iv) {
+	if (!ready()) throw pcsc::CipherError("CMAC: no key");
+	if (iv) std::memcpy(pImpl->state, iv, pImpl->bs);
+	else    std::memset(pImpl->state, 0, sizeof(pImpl->state));
+	pImpl->bufLen = 0;
+}
+
+void Cmac::update(const BYTE* data, size_t len) {
+	if (!ready()) throw pcsc::CipherError("CMAC: no key");
+	Impl& m = *pImpl;
+	// Son blok K1/K2 için tamponda kalır → dolu tampon yalnızca yeni veri gelince işlenir
+	while (len) {
+		if (m.bufLen == m.bs) m.absorb();
+		const size_t n = std::min(m.bs - m.bufLen, len);
+		std::memcpy(m.buf + m.bufLen, data, n);
+		m.bufLen += n;
+		data += n;
+		len  -= n;
+	}
+}
+
+void Cmac::final(BYTE* out) {
+	if (!ready()) throw pcsc::CipherError("CMAC: no key");
+	Impl& m = *pImpl;
+	const BYTE* sub = m.k1;
+	if (m.bufLen < m.bs) {
+		m.buf[m.bufLen] = 0x80;
+		std::memset(m.buf + m.bufLen + 1, 0, m.bs - m.bufLen - 1);
+		sub = m.k2;
+	}
+	for (size_t i = 0; i < m.bs; ++i) m.buf[i] ^= sub[i];
+	m.absorb();
+	std::memcpy(out, m.state, m.bs);
+}
+
+void Cmac::finalPadded(BYTE* out) {
+	if (!ready()) throw pcsc::CipherError("CMAC: no key");
+	Impl& m = *pImpl;
+	if (m.bufLen != m.bs) throw pcsc::CipherError("CMAC: padded message must be block aligned");
+	for (size_t i = 0; i < m.bs; ++i) m.buf[i] ^= m.k2[i];
+	m.absorb();
+	std::memcpy(out, m.state, m.bs);
+}
+
+void Cmac::finalTruncated(BYTE* out) {
+	BYTE full[MAX_BLOCK];
+	final(full);
+	if (pImpl->bs == 16) {
+		for (size_t i = 0; i < 8; ++i) out[i] = full[2 * i + 1];   // tek index'li byte'lar
+	} else {
+		std::memcpy(out, full, 8);
+	}
+}
+
+void Cmac::compute(const BYTE* iv, const BYTE* data, size_t len, BYTE* out) {
+	reset(iv);
+	update(data, len);
+	final(out);
+}
+
+}} // namespace crypto::block
@@ -0,0 +1,76 @@
+#ifndef PCSC_CRYPTO_CMAC_H
+#define PCSC_CRYPTO_CMAC_H
+
+#include "Types.h"
+#include <cstddef>
+#include <memory>
+
+namespace crypto { namespace block {
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Cmac — Anahtara Bağlı, Artımlı CMAC (OMAC1) Motoru
+// ════════════════════════════════════════════════════════════════════════════════
+//
+// cmacAes128() her çağrıda EVP_MAC_fetch + CTX_new + init yapar. Cmac nesnesi
+// key schedule'ı (ECB EVP_CIPHER_CTX) ve K1/K2 alt anahtarlarını bir kez
+// hazırlar; sonraki her MAC yalnızca mesaj bloğu sayısı kadar blok şifrelemedir.
+//
+// Zincir başlangıcı reset(iv) ile verilir (nullptr → sıfır, standart CMAC).
+// DESFire EV1 secure messaging IV'ı önceki MAC'e zincirler.
+//
+//   Cmac mac(CmacAlgo::AES128, sessionKey);
+//   mac.reset(iv);
+//   mac.update(&ins, 1);
+//   mac.update(data, len);
+//   BYTE full[16]; mac.final(full);       // veya finalTruncated(out8)
+//
+// Kopyalanabilir (CTX kopyalanır); boş nesne ready() == false. clear() key
+// materyalini siler ama context'i tutar → sonraki setKey() heap'e gitmez.
+//
+// ════════════════════════════════════════════════════════════════════════════════
+
+enum class CmacAlgo { AES128, TDES2K, TDES3K };
+
+class Cmac {
+public:
+	static constexpr size_t MAX_BLOCK = 16;
+
+	Cmac();
+	Cmac(CmacAlgo algo, const BYTEV& key);
+	~Cmac();
+
+	Cmac(const Cmac& other);
+	Cmac& operator=(const Cmac& other);
+	Cmac(Cmac&&) noexcept;
+	Cmac& operator=(Cmac&&) noexcept;
+
+	// Yeni key: schedule + K1/K2 yeniden hesaplanır. 2K3DES 8 veya 16 byte,
+	// 3K3DES 24 byte, AES 16 byte.
+	void setKey(CmacAlgo algo, const BYTEV& key);
+	void clear();
+
+	bool     ready() const noexcept;
+	bool     boundTo(CmacAlgo algo, const BYTEV& key) const noexcept;
+	size_t   blockSize() const noexcept;       // AES 16, 3DES 8
+	size_t   truncatedSize() const noexcept;   // iletilen MAC: AES 8 (tek byte'lar), 3DES 8
+
+	// ── Artımlı API ─────────────────────────────────────────────────────────
+	void reset(const BYTE* iv = nullptr);      // iv: blockSize() byte
+	void update(const BYTE* data, size_t len);
+	void final(BYTE* out);                     // blockSize() byte; sonra reset() gerekir
+	void finalTruncated(BYTE* out);            // truncatedSize() byte
+	// Mesaj çağıran tarafından 80 00.. ile blok sınırına doldurulduysa: son
+	// blok K2 ile kapanır (NXP AN10922 — dolgu her zaman iki bloğa tamamlanır)
+	void finalPadded(BYTE* out);
+
+	// ── Tek seferlik ────────────────────────────────────────────────────────
+	void compute(const BYTE* iv, const BYTE* data, size_t len, BYTE* out);
+
+private:
+	struct Impl;
+	std::unique_ptr<Impl> pImpl;
+};
+
+}} // namespace crypto::block
+
+#endif // PCSC_CRYPTO_CMAC_H
@@ -9,6 +9,7 @@
 #include "Hmac.h"
 #include "Kdf.h"
 #include "BlockCipher.h"
+#include "Cmac.h"
 #include "AesCbcCipher.h"
 #include "AesCtrCipher.h"
 #include "TripleDesCbcCipher.h"
@@ -6,10 +6,14 @@ namespace crypto {
 
 BYTEV randomBytes(size_t n) {
 	BYTEV buf(n);
-	if (n == 0) return buf;
-	if (RAND_bytes(buf.data(), static_cast<int>(n)) != 1)
-		throw pcsc::CipherError("RAND_bytes failed");
+	randomBytes(buf.data(), n);
 	return buf;
 }
 
+void randomBytes(BYTE* out, size_t n) {
+	if (n == 0) return;
+	if (RAND_bytes(out, static_cast<int>(n)) != 1)
+		throw pcsc::CipherError("RAND_bytes failed");
+}
+
 } // namespace crypto
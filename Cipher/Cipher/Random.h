@@ -6,6 +6,7 @@
 namespace crypto {
 
 BYTEV randomBytes(size_t n);
+void  randomBytes(BYTE* out, size_t n);     // heap'siz: çağıranın tamponuna
 
 } // namespace crypto
 
@@ -114,7 +114,9 @@ public:
 
 	// ── Exception-free alternatifler (Result<T> döner) ────────────────────
 
-	Result<ReaderResponse, PcscError> tryTransmit(const BYTEV& apdu);
+	// Tüm komutların geçtiği tek transport noktası: test simülatörleri ve
+	// PCSC dışı taşıyıcılar bu metodu override eder.
+	virtual Result<ReaderResponse, PcscError> tryTransmit(const BYTEV& apdu);
 	PcscResultByteV tryReadPage(BYTE page, const BYTEV* customApdu = nullptr);
 	PcscResultVoid tryWritePage(BYTE page, const BYTE* data, const BYTEV* customApdu = nullptr);
 	PcscResultVoid tryClearPage(BYTE page);
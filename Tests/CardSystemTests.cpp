@@ -4,24 +4,57 @@
 
 #include "../Card/Card/CardModel/CardMemoryLayout.h"
 #include "../Card/Card/CardModel/CardTopology.h"
+#include "../Card/Card/CardModel/CardImageDiff.h"
+#include "../Card/Card/CardModel/CardImageView.h"
 #include "../Card/Card/CardModel/TrailerConfig.h"
 #include "../Card/Card/CardModel/DesfireMemoryLayout.h"
 #include "../Card/Card/CardProtocol/AccessControl.h"
 #include "../Card/Card/CardProtocol/KeyManagement.h"
 #include "../Card/Card/CardProtocol/AuthenticationState.h"
 #include "../Card/Card/CardProtocol/DesfireCrypto.h"
+#include "../Card/Card/CardProtocol/DesfireKeyDiversification.h"
 #include "../Card/Card/CardProtocol/DesfireAuth.h"
 #include "../Card/Card/CardProtocol/DesfireSession.h"
 #include "../Card/Card/CardProtocol/DesfireCommands.h"
 #include "../Card/Card/CardProtocol/DesfireSecureMessaging.h"
+#include "../Card/Card/CardProtocol/DesfireProfile.h"
+#include "../Card/Card/CardProtocol/DesfireSnapshot.h"
+#include "../Card/Card/CardProtocol/DesfireTransaction.h"
 #include "../Card/Card/CardInterface.h"
+#include "../Card/Card/CardIO.h"
+#include "../Card/Card/RekeyEngine.h"
+#include "../Card/Card/CardImageArchive.h"
+#include "../Card/Card/CompactCardStore.h"
+#include "../Card/Card/DesfireMetadataCache.h"
 #include "Crypto.h"
+#include "ACR1281UReader.h"
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
+#include <new>
 #include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
 #include <thread>
 
 using namespace std;
 
+// ════════════════════════════════════════════════════════════════════════════════
+// Heap Sayacı — allocation-free yolları doğrulamak için (global operator new)
+// ════════════════════════════════════════════════════════════════════════════════
+
+static std::atomic<size_t> g_heapAllocs{ 0 };
+
+void* operator new(size_t n) {
+    ++g_heapAllocs;
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
 // ════════════════════════════════════════════════════════════════════════════════
 // Test Result Tracking
 // ════════════════════════════════════════════════════════════════════════════════
@@ -94,6 +127,38 @@ bool testCardTopology() {
         CardLayoutTopology topo4k(true);
         if (topo4k.sectorCount() != 40) return false;
         if (topo4k.totalBlocks() != 256) return false;
+
+        // Compile-time tablolar
+        using T1K = Topology<CardType::MifareClassic1K>;
+        using T4K = Topology<CardType::MifareClassic4K>;
+        using TUL = Topology<CardType::MifareUltralight>;
+        static_assert(T1K::trailerBlockOfSector(15) == 63, "1K trailer");
+        static_assert(T4K::sectorFromBlock(128) == 32, "4K extended start");
+        static_assert(T4K::firstBlockOfSector(39) == 240, "4K last sector");
+        static_assert(T4K::blocksPerSector(39) == 16, "4K extended size");
+        static_assert(T4K::isTrailerBlock(255) && !T4K::isTrailerBlock(254), "4K trailer");
+        static_assert(TUL::trailerBlockOfSector(0) == -1 && TUL::pageOfBlock(2) == 8, "UL pages");
+
+        // Runtime facade tablolarla birebir aynı olmalı
+        for (int b = 0; b < T4K::TOTAL_BLOCKS; ++b) {
+            if (topo4k.sectorFromBlock(b) != T4K::sectorFromBlock(b)) return false;
+            if (topo4k.isTrailerBlock(b) != T4K::isTrailerBlock(b)) return false;
+        }
+        for (int s = 0; s < T4K::SECTOR_COUNT; ++s) {
+            if (topo4k.firstBlockOfSector(s) != T4K::firstBlockOfSector(s)) return false;
+            if (topo4k.trailerBlockOfSector(s) != T4K::trailerBlockOfSector(s)) return false;
+        }
+
+        // Sınır dışı sorgular tablo dışına taşmaz
+        if (topo.sectorFromBlock(64) != -1 || topo.firstBlockOfSector(16) != -1) return false;
+        if (topo.isTrailerBlock(-1)) return false;
+
+        CardLayoutTopology ul(CardType::MifareUltralight);
+        if (ul.sectorCount() != 1 || ul.totalBlocks() != 4) return false;
+        if (ul.hasTrailers() || ul.isTrailerBlock(3)) return false;
+
+        CardLayoutTopology df(CardType::MifareDesfire);
+        if (df.sectorCount() != 0 || df.sectorFromBlock(0) != -1) return false;
         return true;
     }
     catch (const exception& e) {
@@ -125,6 +190,32 @@ bool testKeyManagement() {
         
         KEYBYTES validKey = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE};
         if (!KeyManagement::isValidKey(validKey)) return false;
+
+        // Flat slot table: sıralı slot listesi, en düşük slot default
+        keyMgr.registerKey(KeyType::B, validKey, KeyStructure::Volatile, 0x1F);
+        keyMgr.registerKey(KeyType::B, testKeyA, KeyStructure::Volatile, 0x00);
+        auto slotsB = keyMgr.getSlots(KeyType::B);
+        if (slotsB.size() != 2 || slotsB[0] != 0x00 || slotsB[1] != 0x1F) return false;
+        if (keyMgr.getDefaultKey(KeyType::B) != testKeyA) return false;
+        if (keyMgr.getAllKeys().size() != 3) return false;
+
+        // 0x1F üstü reader slot'ları (ör. OMNIKEY volatile 0x20) de kabul edilir
+        keyMgr.registerKey(KeyType::A, validKey, KeyStructure::Volatile, 0x20);
+        if (!keyMgr.hasKey(KeyType::A, 0x20) || keyMgr.getKey(KeyType::A, 0x20) != validKey) return false;
+        auto slotsA = keyMgr.getSlots(KeyType::A);
+        if (slotsA.size() != 2 || slotsA[0] != 0x01 || slotsA[1] != 0x20) return false;
+        if (keyMgr.hasKey(KeyType::B, 0x20)) return false;
+        if (keyMgr.getAllKeys().size() != 4) return false;
+
+        keyMgr.clearKeys(KeyType::B);
+        if (keyMgr.hasKey(KeyType::B)) return false;
+        if (!keyMgr.hasKey(KeyType::A, 0x01)) return false;
+
+        keyMgr.clearKeys(KeyType::A);
+        keyMgr.registerKey(KeyType::A, testKeyA, KeyStructure::Volatile, 0x21);
+        if (keyMgr.getDefaultKey(KeyType::A) != testKeyA) return false;   // yalnızca overflow
+        keyMgr.clearAllKeys();
+        if (keyMgr.hasKey(KeyType::A)) return false;
         
         return true;
     }
@@ -165,6 +256,20 @@ bool testAccessControl() {
         if (access.canReadTrailer(0, KeyType::B)) return false;
         if (!access.canWriteTrailer(0, KeyType::A)) return false;
         if (access.canWriteTrailer(0, KeyType::B)) return false;
+
+        // Permission cache: ham trailer değişikliği invalidate ile görünür olur
+        ACCESSBYTES frozen = AccessBitsCodec::encode(sectorModeToConfig(SectorMode::FROZEN));
+        std::memcpy(cardMem.data.card1K.detailed.sector[0].trailerBlock.trailer.accessBits, frozen.data(), 4);
+        if (!access.canReadDataBlock(0, KeyType::A)) return false;   // hâlâ cache'teki izin
+        access.invalidate(0);
+        if (access.canReadDataBlock(0, KeyType::A)) return false;
+        if (access.canWrite(1, KeyType::B)) return false;
+        if (!access.canWriteDataBlock(1, KeyType::A)) return false;  // sektör 1 etkilenmez
+
+        // Kendi yazımları cache'i otomatik günceller
+        access.applySectorMode(1, AccessControl::StandardMode::MODE_1);
+        if (access.canWriteDataBlock(1, KeyType::A)) return false;
+        if (!access.canReadDataBlock(1, KeyType::B)) return false;
         
         return true;
     }
@@ -193,6 +298,35 @@ bool testAuthenticationState() {
         
         authState.invalidate(0);
         if (authState.isAuthenticated(0)) return false;
+
+        // Snapshot sorguları: key B, maske, kalan süre
+        if (authState.getAuthenticatedKey(5) != KeyType::B) return false;
+        if (authState.isAuthenticatedWith(5, KeyType::A)) return false;
+        if (authState.authenticatedMask() != (1ull << 5)) return false;
+        auto session = authState.getSession(5);
+        if (!session || session->sector != 5 || !session->isValid) return false;
+        if (authState.getTimeRemaining(5).count() <= 0) return false;
+
+        // Sınır dışı sektörler sorguda güvenli, markAuthenticated'da hata
+        if (authState.isAuthenticated(-1) || authState.isAuthenticated(40)) return false;
+        bool threw = false;
+        try { authState.markAuthenticated(16, KeyType::A); } catch (const exception&) { threw = true; }
+        if (!threw) return false;
+
+        // milliseconds::max() ("süresiz") deadline'ı taşırıp geçmişe atmaz
+        authState.setSectorTimeout(5, std::chrono::milliseconds::max());
+        if (!authState.isAuthenticated(5) || authState.getTimeRemaining(5).count() <= 0) return false;
+
+        // Sıfır timeout → oturum hemen düşer (monotonic deadline)
+        authState.setSectorTimeout(5, std::chrono::milliseconds(0));
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        if (authState.isAuthenticated(5) || authState.countAuthenticated() != 0) return false;
+        authState.removeExpiredSessions();
+        if (authState.getSession(5)) return false;
+
+        authState.enableCaching(false);
+        authState.markAuthenticated(1, KeyType::A);
+        if (authState.isAuthenticated(1)) return false;
         
         return true;
     }
@@ -1339,7 +1473,7 @@ bool testDesfireManagement() {
         BYTEV cmacInput = responsePayload;
         cmacInput.push_back(0x00);  // status code
         BYTEV respMAC = DesfireSecureMessaging::calculateCMAC(session, cmacInput);
-        BYTEV respTrunc = DesfireSecureMessaging::truncateCMAC(respMAC);
+        BYTEV respTrunc = DesfireSecureMessaging::commandMAC(session, respMAC);   // EV1: ilk 8 byte
 
         // Build complete response: data + truncated CMAC
         BYTEV fullResp = responsePayload;
@@ -1585,7 +1719,7 @@ bool testDesfireIntegration() {
             BYTEV cmacIn = respData;
             cmacIn.push_back(0x00);
             BYTEV fullMAC = DesfireSecureMessaging::calculateCMAC(ses, cmacIn);
-            BYTEV truncMAC = DesfireSecureMessaging::truncateCMAC(fullMAC);
+            BYTEV truncMAC = DesfireSecureMessaging::commandMAC(ses, fullMAC);
 
             // Build response with MAC
             BYTEV fullResp = respData;
@@ -1956,6 +2090,2815 @@ bool testDesfireRecordFiles() {
 }
 
 
+// ════════════════════════════════════════════════════════════════════════════════
+// TEST: Rekey Journal — append-only log, resume state, torn last line
+// ════════════════════════════════════════════════════════════════════════════════
+
+bool testRekeyJournal() {
+    int line = 0;
+    const std::string path = "rekey_journal_test.log";
+    std::remove(path.c_str());
+    try {
+#define RJ_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; std::remove(path.c_str()); return false; } } while(0)
+
+        const std::string uid = RekeyJournal::uidKey(BYTEV{0x04, 0xA1, 0xB2, 0xC3});
+        RJ_CHECK(uid == "04A1B2C3");
+
+        KEYBYTES oldA = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+        KEYBYTES oldB = {0x00,0x11,0x22,0x33,0x44,0x55};
+        std::array<BYTE, 16> trailer = {0xA0,0xA1,0xA2,0xA3,0xA4,0xA5,
+                                        0xFF,0x07,0x80,0x69,
+                                        0xB0,0xB1,0xB2,0xB3,0xB4,0xB5};
+
+        // ── 1. Intent → Done → Card done ────────────────────────────────────
+        {
+            RekeyJournal j(path);
+            RJ_CHECK(j.tryOpen().is_ok());
+            RJ_CHECK(j.cardCount() == 0);
+            RJ_CHECK(j.state(uid, 1) == RekeyJournal::SectorState::None);
+
+            RJ_CHECK(j.tryAppendIntent(uid, 1, oldA, oldB, trailer).is_ok());
+            RJ_CHECK(j.tryAppendIntent(uid, 2, oldA, oldB, trailer).is_ok());
+            RJ_CHECK(j.tryAppendDone(uid, 1).is_ok());
+            RJ_CHECK(j.state(uid, 1) == RekeyJournal::SectorState::Done);
+            RJ_CHECK(j.state(uid, 2) == RekeyJournal::SectorState::Intent);
+            RJ_CHECK(!j.isCardDone(uid));
+        }
+
+        // ── 2. Reopen: state restored, torn last line ignored ───────────────
+        {
+            std::ofstream torn(path, std::ios::app | std::ios::binary);
+            torn << "D " << uid << " 2";          // newline yok → crash simülasyonu
+        }
+        {
+            RekeyJournal j(path);
+            RJ_CHECK(j.tryOpen().is_ok());
+            RJ_CHECK(j.cardCount() == 1);
+            RJ_CHECK(j.state(uid, 1) == RekeyJournal::SectorState::Done);
+            RJ_CHECK(j.state(uid, 2) == RekeyJournal::SectorState::Intent);
+
+            const RekeyJournal::Entry* e = j.find(uid, 2);
+            RJ_CHECK(e != nullptr);
+            RJ_CHECK(e->oldKeyB == oldB);
+            RJ_CHECK(e->newTrailer == trailer);
+
+            // Yarım satırdan sonra eklenen kayıt ayrı satır olmalı
+            RJ_CHECK(j.tryAppendDone(uid, 2).is_ok());
+            RJ_CHECK(j.tryAppendCardDone(uid).is_ok());
+        }
+        {
+            RekeyJournal j(path);
+            RJ_CHECK(j.tryOpen().is_ok());
+            RJ_CHECK(j.state(uid, 2) == RekeyJournal::SectorState::Done);
+            RJ_CHECK(j.isCardDone(uid));
+            RJ_CHECK(!j.isCardDone("DEADBEEF"));
+        }
+
+#undef RJ_CHECK
+        std::remove(path.c_str());
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        std::remove(path.c_str());
+        return false;
+    }
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Mifare Classic 1K reader simülatörü — CardIO'yu gerçek kart olmadan sürer
+// ════════════════════════════════════════════════════════════════════════════════
+//
+// Reader::tryTransmit override'ı: GET UID, LOAD KEY, AUTH (legacy), READ /
+// UPDATE BINARY. Auth slot'taki key'i trailer'daki key A / B ile karşılaştırır;
+// trailer okunurken key A sıfır döner (gerçek kart gibi).
+// tearAtWrite ≥ 0 → o sıradaki yazmada kart "çekilir": tearApplies ise yazma
+// karta ulaşır ama yanıt kaybolur. Sonraki komutlar retap()'e kadar düşer.
+
+class SimClassicReader : public ACR1281UReader {
+public:
+    BYTE     mem[64][16]{};
+    KEYBYTES slots[32]{};
+    BYTEV    uid;
+    int  authSector  = -1;
+    BYTE lastAuthKT  = 0x00;                // son başarılı auth: 0x60 A, 0x61 B
+    int  tearAtWrite = -1;
+    bool tearApplies = false;
+    bool removed     = false;
+    int  writes      = 0;
+
+    SimClassicReader(PCSC& pcsc, BYTEV cardUid)
+        : ACR1281UReader(pcsc, 16), uid(std::move(cardUid))
+    {
+        const MifareBlock factory = TrailerConfig::factoryDefault().toBlock();
+        for (int s = 0; s < 16; ++s) std::memcpy(mem[s * 4 + 3], factory.raw, 16);
+    }
+
+    void retap() { removed = false; authSector = -1; }
+
+    const BYTE* trailer(int sector) const { return mem[sector * 4 + 3]; }
+
+    Result<ReaderResponse, PcscError> tryTransmit(const BYTEV& a) override {
+        using R = Result<ReaderResponse, PcscError>;
+        auto sw = [](BYTE s1, BYTE s2, BYTEV d = {}) { return R::Ok(ReaderResponse{ std::move(d), StatusWord(s1, s2) }); };
+        if (removed || a.size() < 5 || a[0] != 0xFF)
+            return R::Err(Error<PcscError>(ConnectionError::NotConnected));
+
+        switch (a[1]) {
+        case 0xCA:
+            return sw(0x90, 0x00, uid);
+        case 0x82:
+            if (a.size() < 11 || a[3] >= 32) return sw(0x63, 0x00);
+            std::memcpy(slots[a[3]].data(), &a[5], 6);
+            return sw(0x90, 0x00);
+        case 0x88: {
+            const int sector = a[3] / 4;
+            if (a.size() < 6 || sector >= 16 || a[5] >= 32) return sw(0x63, 0x00);
+            const BYTE* key = (a[4] == 0x60) ? trailer(sector) : trailer(sector) + 10;
+            authSector = std::memcmp(slots[a[5]].data(), key, 6) == 0 ? sector : -1;
+            if (authSector >= 0) lastAuthKT = a[4];
+            return authSector < 0 ? sw(0x63, 0x00) : sw(0x90, 0x00);
+        }
+        case 0xB0: {
+            const int b = a[3];
+            if (b >= 64 || b / 4 != authSector) return sw(0x69, 0x82);
+            BYTEV d(mem[b], mem[b] + 16);
+            if (b % 4 == 3) std::fill(d.begin(), d.begin() + 6, 0x00);
+            return sw(0x90, 0x00, d);
+        }
+        case 0xD6: {
+            const int b = a[3];
+            if (b >= 64 || b / 4 != authSector || a.size() < 21) return sw(0x69, 0x82);
+            if (writes++ == tearAtWrite) {
+                if (tearApplies) std::memcpy(mem[b], &a[5], 16);
+                removed = true;
+                return R::Err(Error<PcscError>(ConnectionError::NotConnected));
+            }
+            std::memcpy(mem[b], &a[5], 16);
+            return sw(0x90, 0x00);
+        }
+        default:
+            return sw(0x6D, 0x00);
+        }
+    }
+};
+
+// ════════════════════════════════════════════════════════════════════════════════
+// TEST: Rekey Engine — simülatör üzerinde rekey, crash-resume, filo hataları
+// ════════════════════════════════════════════════════════════════════════════════
+
+bool testRekeyEngine() {
+    int line = 0;
+    const std::string path = "rekey_engine_test.log";
+    std::remove(path.c_str());
+    try {
+#define RE_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; std::remove(path.c_str()); return false; } } while(0)
+
+        const KEYBYTES keyA1 = {0xA0,0xA1,0xA2,0xA3,0xA4,0xA5};
+        const KEYBYTES keyB1 = {0xB0,0xB1,0xB2,0xB3,0xB4,0xB5};
+        const KEYBYTES keyA2 = {0xC0,0xC1,0xC2,0xC3,0xC4,0xC5};
+        auto keyAt = [](const SimClassicReader& r, int sector, int off, const KEYBYTES& k) {
+            return std::memcmp(r.trailer(sector) + off, k.data(), 6) == 0;
+        };
+
+        RekeyPlan plan;
+        plan.newKeyA = keyA1;
+        plan.newKeyB = keyB1;
+        plan.sectors = {1, 2};
+
+        PCSC pcsc;
+
+        // ── 1. Normal rekey + journal'da tamamlanmış kart atlanır ───────────
+        {
+            RekeyJournal j(path);
+            RE_CHECK(j.tryOpen().is_ok());
+            RekeyEngine engine(j, plan);
+
+            SimClassicReader sim(pcsc, BYTEV{0x04, 0x00, 0x00, 0x01});
+            CardIO io(sim);
+            auto r = engine.tryRekeyCard(io);
+            RE_CHECK(r.is_ok());
+            const RekeyCardReport& rep = r.unwrap();
+            RE_CHECK(rep.complete() && rep.sectors.size() == 2);
+            RE_CHECK(rep.sectors[0].outcome == RekeyOutcome::Rekeyed);
+            RE_CHECK(rep.sectors[1].outcome == RekeyOutcome::Rekeyed);
+            RE_CHECK(keyAt(sim, 1, 0, keyA1) && keyAt(sim, 1, 10, keyB1));
+            RE_CHECK(keyAt(sim, 2, 0, keyA1) && keyAt(sim, 2, 10, keyB1));
+            RE_CHECK(std::memcmp(sim.trailer(1) + 6, "\xFF\x07\x80\x69", 4) == 0);
+            RE_CHECK(j.isCardDone("04000001"));
+
+            const int before = sim.writes;
+            auto again = engine.tryRekeyCard(io);
+            RE_CHECK(again.is_ok() && again.unwrap().skipped);
+            RE_CHECK(sim.writes == before);
+        }
+
+        // ── 2. Crash: Intent kaydedildi, yazma karta ulaşmadı ───────────────
+        // Resume yeni process'te, değişmiş plan ile — journal'daki trailer yazılır
+        SimClassicReader lost(pcsc, BYTEV{0x04, 0x00, 0x00, 0x02});
+        lost.tearAtWrite = 0;
+        {
+            RekeyJournal j(path);
+            RE_CHECK(j.tryOpen().is_ok());
+            RekeyEngine engine(j, plan);
+            CardIO io(lost);
+            auto r = engine.tryRekeyCard(io);
+            RE_CHECK(r.is_ok());
+            RE_CHECK(!r.unwrap().complete());
+            RE_CHECK(j.state("04000002", 1) == RekeyJournal::SectorState::Intent);
+            RE_CHECK(j.state("04000002", 2) == RekeyJournal::SectorState::None);
+            RE_CHECK(keyAt(lost, 1, 0, KEYBYTES{0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}));
+        }
+        {
+            RekeyJournal j(path);
+            RE_CHECK(j.tryOpen().is_ok());
+            RE_CHECK(j.state("04000002", 1) == RekeyJournal::SectorState::Intent);
+
+            RekeyPlan changed = plan;
+            changed.newKeyA = keyA2;
+            RekeyEngine engine(j, changed);
+            lost.retap();
+            CardIO io(lost);
+            auto r = engine.tryRekeyCard(io);
+            RE_CHECK(r.is_ok());
+            const RekeyCardReport& rep = r.unwrap();
+            RE_CHECK(rep.complete());
+            RE_CHECK(rep.sectors[0].outcome == RekeyOutcome::Recovered);
+            RE_CHECK(rep.sectors[1].outcome == RekeyOutcome::Rekeyed);
+            RE_CHECK(keyAt(lost, 1, 0, keyA1));     // journal'daki trailer
+            RE_CHECK(keyAt(lost, 2, 0, keyA2));     // yeni plan
+            RE_CHECK(j.state("04000002", 1) == RekeyJournal::SectorState::Done);
+        }
+
+        // ── 3. Crash: yazma karta ulaştı, yanıt kayboldu ────────────────────
+        SimClassicReader torn(pcsc, BYTEV{0x04, 0x00, 0x00, 0x03});
+        torn.tearAtWrite = 0;
+        torn.tearApplies = true;
+        {
+            RekeyJournal j(path);
+            RE_CHECK(j.tryOpen().is_ok());
+            RekeyEngine engine(j, plan);
+            CardIO io(torn);
+            RE_CHECK(engine.tryRekeyCard(io).is_ok());
+            RE_CHECK(j.state("04000003", 1) == RekeyJournal::SectorState::Intent);
+            RE_CHECK(keyAt(torn, 1, 0, keyA1));     // kart yeni key'lerde, journal Intent'te
+        }
+        {
+            RekeyJournal j(path);
+            RE_CHECK(j.tryOpen().is_ok());
+            RekeyPlan changed = plan;
+            changed.newKeyA = keyA2;
+            RekeyEngine engine(j, changed);
+            torn.retap();
+            const int before = torn.writes;
+            CardIO io(torn);
+            auto r = engine.tryRekeyCard(io);
+            RE_CHECK(r.is_ok());
+            RE_CHECK(r.unwrap().sectors[0].outcome == RekeyOutcome::Recovered);
+            RE_CHECK(keyAt(torn, 1, 0, keyA1));
+            RE_CHECK(torn.writes == before + 1);    // yalnızca sektör 2 yazıldı
+            RE_CHECK(j.isCardDone("04000003"));
+        }
+
+        // ── 4. runFleet: kart seviyesi hatalar toplanır ─────────────────────
+        {
+            RekeyJournal j(path);
+            RE_CHECK(j.tryOpen().is_ok());
+            RekeyEngine engine(j, plan);
+
+            SimClassicReader gone(pcsc, BYTEV{0x04, 0x00, 0x00, 0x04});
+            SimClassicReader fresh(pcsc, BYTEV{0x04, 0x00, 0x00, 0x05});
+            gone.removed = true;
+            CardIO ioGone(gone), ioFresh(fresh);
+            std::vector<CardIO*> queue = { &ioGone, &ioFresh };
+            size_t next = 0;
+            int reports = 0;
+
+            RekeyFleetResult fr = engine.runFleet(
+                [&]() -> CardIO* { return next < queue.size() ? queue[next++] : nullptr; },
+                [&](const RekeyCardReport&) { ++reports; return true; });
+            RE_CHECK(fr.completed == 1);
+            RE_CHECK(reports == 1);
+            RE_CHECK(!fr.ok() && fr.cardErrors.size() == 1);
+            RE_CHECK(std::holds_alternative<ConnectionError>(fr.cardErrors[0].kind));
+        }
+
+        // ── 5. Sıfır key'li plan throw etmez, karta/journal'a dokunmadan Err ─
+        {
+            RekeyJournal j(path);
+            RE_CHECK(j.tryOpen().is_ok());
+            RekeyPlan bad = plan;
+            bad.newKeyB = KEYBYTES{};
+            RekeyEngine engine(j, bad);
+            SimClassicReader sim(pcsc, BYTEV{0x04, 0x00, 0x00, 0x06});
+            CardIO io(sim);
+            auto r = engine.tryRekeyCard(io);
+            RE_CHECK(!r.is_ok() && std::holds_alternative<CardError>(r.error().kind));
+            RE_CHECK(sim.writes == 0);
+            RE_CHECK(j.state("04000006", 1) == RekeyJournal::SectorState::None);
+        }
+
+#undef RE_CHECK
+        std::remove(path.c_str());
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        std::remove(path.c_str());
+        return false;
+    }
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// TEST: CardIO Key Plan — model dışarıdan değişince (loadMemory / rollback) yenilenir
+// ════════════════════════════════════════════════════════════════════════════════
+
+bool testCardIOKeyPlan() {
+    int line = 0;
+    try {
+#define KP_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        const KEYBYTES keyA = {0xA0,0xA1,0xA2,0xA3,0xA4,0xA5};
+        const KEYBYTES keyB = {0xB0,0xB1,0xB2,0xB3,0xB4,0xB5};
+
+        // Sektör 1: open → data 000 (A|B okur), keyBOnly → data 011 (yalnızca B okur)
+        TrailerConfig open = TrailerConfig::factoryDefault();
+        open.keyA = keyA;
+        open.keyB = keyB;
+        TrailerConfig keyBOnly = open;
+        for (auto& d : keyBOnly.access.dataBlock) d = {false, true, true};
+        KP_CHECK(keyBOnly.isValid());
+
+        auto imageWith = [](const TrailerConfig& tc) {
+            BYTEV img(1024, 0x00);
+            const MifareBlock blk = tc.toBlock();
+            std::memcpy(img.data() + 7 * 16, blk.raw, 16);
+            return img;
+        };
+        const BYTEV imgOpen = imageWith(open);
+        const BYTEV imgBOnly = imageWith(keyBOnly);
+
+        PCSC pcsc;
+        SimClassicReader sim(pcsc, BYTEV{0x04, 0x10, 0x20, 0x30});
+        std::memcpy(sim.mem[7], open.toBlock().raw, 16);   // sim access bits'e bakmaz
+
+        CardIO io(sim);
+        io.setKeys(keyA, 0x01, keyB, 0x02);
+
+        // ── 1. İlk plan: iki key de okuyabilir → ilk key (A) ───────────────
+        io.card().loadMemory(imgOpen.data(), imgOpen.size());
+        KP_CHECK(io.tryReadBlock(4).is_ok());
+        KP_CHECK(sim.lastAuthKT == 0x60);
+
+        // ── 2. card().loadMemory → plan bayat, B seçilmeli ──────────────────
+        io.card().loadMemory(imgBOnly.data(), imgBOnly.size());
+        KP_CHECK(io.tryReadBlock(5).is_ok());
+        KP_CHECK(sim.lastAuthKT == 0x61);
+
+        // ── 3. rollback → eski trailer geri gelir, plan yine yenilenir ──────
+        auto snap = io.card().snapshot();
+        io.card().loadMemory(imgOpen.data(), imgOpen.size());
+        KP_CHECK(io.tryAuthenticate(1).is_ok());
+        KP_CHECK(sim.lastAuthKT == 0x60);
+        io.card().rollback(snap);
+        KP_CHECK(io.tryReadBlock(6).is_ok());
+        KP_CHECK(sim.lastAuthKT == 0x61);
+
+        // ── 4. 0x1F üstü reader slot'u kabul edilir; geçersiz key tabloyu bozmaz
+        CardIO wide(sim);
+        wide.setKeys(keyA, 0x01, keyB, 0x20);               // OMNIKEY volatile slot
+        bool threw = false;
+        try { io.setKeys(KEYBYTES{}, 0x03, keyA, 0x04); }
+        catch (const exception&) { threw = true; }
+        KP_CHECK(threw);
+        KP_CHECK(io.tryAuthenticate(1).is_ok());            // eski A/B tablosu geçerli
+        KP_CHECK(sim.lastAuthKT == 0x61);
+
+        // ── 5. card().writeBlockData(trailer) → o sektörün planı yenilenir ──
+        io.card().writeBlockData(7, open.toBlock().raw);
+        KP_CHECK(io.tryAuthenticate(1).is_ok());
+        KP_CHECK(sim.lastAuthKT == 0x60);
+        io.card().writeBlockData(7, keyBOnly.toBlock().raw);
+        KP_CHECK(io.tryReadBlock(4).is_ok());
+        KP_CHECK(sim.lastAuthKT == 0x61);
+
+#undef KP_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// TEST: Trailer Batch — readAllTrailers / writeAllTrailers simülatör üzerinde
+// ════════════════════════════════════════════════════════════════════════════════
+
+bool testTrailerBatch() {
+    int line = 0;
+    try {
+#define TB_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        const KEYBYTES ff = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+        const KEYBYTES foreign = {0x11,0x22,0x33,0x44,0x55,0x66};
+
+        PCSC pcsc;
+        SimClassicReader sim(pcsc, BYTEV{0x04, 0x55, 0x66, 0x77});
+        std::memcpy(sim.mem[5 * 4 + 3], foreign.data(), 6);          // sektör 5: bilinmeyen key'ler
+        std::memcpy(sim.mem[5 * 4 + 3] + 10, foreign.data(), 6);
+
+        CardIO io(sim);
+        io.setKeys(ff, 0x01, ff, 0x02);
+
+        // ── 1. Okuma: hatalı sektör batch'i durdurmaz ──────────────────────
+        std::vector<TrailerConfig> tcs;
+        TrailerBatchReport rr = io.readAllTrailers(tcs, true);
+        TB_CHECK(tcs.size() == 16 && rr.sectors.size() == 16);
+        TB_CHECK(rr.okCount() == 15);
+        TB_CHECK(!rr.allOk());
+        TB_CHECK(!rr.sectors[5].authOk && !rr.sectors[5].error.empty());
+        TB_CHECK(rr.sectors[4].ok() && rr.sectors[4].verified);
+        TB_CHECK(tcs[1].accessBitsRaw() == TrailerConfig::factoryDefault().accessBitsRaw());
+        TB_CHECK(tcs[1].keyA == KEYBYTES{});                       // key A kartta okunmaz
+        TB_CHECK(tcs[1].keyB == ff);
+        TB_CHECK(std::memcmp(io.card().getBlock(7).trailer.accessBits, "\xFF\x07\x80\x69", 4) == 0);
+
+        // ── 2. Yazma + read-back verify ────────────────────────────────────
+        std::vector<TrailerConfig> out(16, TrailerConfig::factoryDefault());
+        out[2].keyA = {0xA0,0xA1,0xA2,0xA3,0xA4,0xA5};
+        out[2].keyB = {0xB0,0xB1,0xB2,0xB3,0xB4,0xB5};
+        TrailerBatchReport wr = io.writeAllTrailers(out, true);
+        TB_CHECK(wr.sectors.size() == 16 && wr.okCount() == 15);
+        TB_CHECK(wr.sectors[2].ok() && wr.sectors[2].verified);
+        TB_CHECK(!wr.sectors[5].authOk);
+        TB_CHECK(std::memcmp(sim.trailer(2), out[2].keyA.data(), 6) == 0);
+        TB_CHECK(std::memcmp(sim.trailer(2) + 10, out[2].keyB.data(), 6) == 0);
+        TB_CHECK(std::memcmp(sim.trailer(5), foreign.data(), 6) == 0);
+
+        // ── 3. Kart yazma sırasında çekilir: sonraki sektörler hata raporlar ─
+        sim.tearAtWrite = sim.writes + 1;
+        TrailerBatchReport torn = io.writeAllTrailers(out, false);
+        TB_CHECK(torn.sectors[0].ok());
+        TB_CHECK(!torn.sectors[1].ioOk && !torn.sectors[1].error.empty());
+        TB_CHECK(!torn.sectors[2].authOk);
+        TB_CHECK(torn.okCount() == 1);
+
+        // ── 4. restoreAllTrailers best-effort: erişilemeyen sektörler atlanır ─
+        sim.retap();
+        const int before = sim.writes;
+        io.restoreAllTrailers(out);
+        TB_CHECK(sim.writes == before + 14);                      // sektör 2 (yeni key) ve 5 hariç
+        TB_CHECK(std::memcmp(sim.trailer(15) + 6, "\xFF\x07\x80\x69", 4) == 0);
+
+#undef TB_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// TEST: CardIO writeDiff — okunmuş imajın trailer'ları, hata türü korunur
+// ════════════════════════════════════════════════════════════════════════════════
+
+bool testCardIOWriteDiff() {
+    int line = 0;
+    try {
+#define WD_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        const KEYBYTES ff = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+        const KEYBYTES foreign = {0x11,0x22,0x33,0x44,0x55,0x66};
+
+        PCSC pcsc;
+        SimClassicReader sim(pcsc, BYTEV{0x04, 0x99, 0x88, 0x77});
+        std::memcpy(sim.mem[5 * 4 + 3], foreign.data(), 6);
+        std::memcpy(sim.mem[5 * 4 + 3] + 10, foreign.data(), 6);
+
+        CardIO io(sim);
+        io.setKeys(ff, 0x01, ff, 0x02);
+        WD_CHECK(io.tryReadCard().is_ok());
+        WD_CHECK(io.card().getBlock(7).trailer.keyA[0] == 0x00);   // key A okunmaz
+
+        // ── 1. Okunmuş imajdan trailer: sıfır key A tablodan doldurulur ─────
+        CardMemoryLayout golden = io.card().getMemory();
+        BYTE* g = golden.getRawMemory();
+        g[4 * 16] = 0x5A;
+        TrailerConfig tc = TrailerConfig::fromBlock(io.card().getBlock(7));
+        tc.access = sectorModeToConfig(SectorMode::READ_AB_WRITE_B);
+        std::memcpy(g + 7 * 16 + 6, tc.toBlock().trailer.accessBits, 4);
+
+        CardImageDiff diff = CardImageDiff::compare(io.card().getMemory(), golden);
+        WD_CHECK(diff.size() == 2);
+        auto wr = io.tryWriteDiff(diff, golden, true);
+        WD_CHECK(wr.is_ok() && wr.unwrap() == 2);
+        WD_CHECK(sim.mem[4][0] == 0x5A);
+        WD_CHECK(std::memcmp(sim.trailer(1), ff.data(), 6) == 0);
+        WD_CHECK(std::memcmp(sim.trailer(1) + 6, g + 7 * 16 + 6, 4) == 0);
+
+        // ── 2. Key tablosunda olmayan sıfır key → hiçbir şey yazılmaz ──────
+        CardIO single(sim);
+        single.setDefaultKey(ff);
+        CardMemoryLayout noKeyB = golden;
+        std::memset(noKeyB.getRawMemory() + 11 * 16 + 10, 0x00, 6);     // sektör 2 key B
+        noKeyB.getRawMemory()[8 * 16] = 0x77;
+        CardImageDiff d2 = CardImageDiff::compare(golden, noKeyB);
+        d2.blocks.push_back(BlockDiff{ 11, 0xFFFF });
+        const int writesBefore = sim.writes;
+        auto rejected = single.tryWriteDiff(d2, noKeyB, true);
+        WD_CHECK(!rejected.is_ok());
+        WD_CHECK(std::holds_alternative<CardError>(rejected.error().kind));
+        WD_CHECK(sim.writes == writesBefore);
+        WD_CHECK(single.tryWriteDiff(d2, noKeyB, false).is_ok());     // trailer'sız yol
+
+        // ── 3. Auth hatası IoError'a çevrilmez ──────────────────────────────
+        CardMemoryLayout locked = golden;
+        locked.getRawMemory()[20 * 16] = 0x01;                          // sektör 5
+        auto failed = io.tryWriteDiff(CardImageDiff::compare(golden, locked), locked);
+        WD_CHECK(!failed.is_ok());
+        WD_CHECK(!std::holds_alternative<IoError>(failed.error().kind));
+        WD_CHECK(failed.error().meta.count("block") == 1);
+
+        // ── 4. Sektör başına farklı key A: her trailer kendi key'ini alır ───
+        {
+            const KEYBYTES s2Key = {0x2A,0x2B,0x2C,0x2D,0x2E,0x2F};
+            SimClassicReader sim2(pcsc, BYTEV{0x04, 0x55, 0x66, 0x77});
+            std::memcpy(sim2.mem[2 * 4 + 3], s2Key.data(), 6);
+
+            CardIO multi(sim2);
+            multi.setDefaultKey(ff);
+            KeyInfo k2;
+            k2.key  = s2Key;
+            k2.slot = 0x03;
+            k2.name = "Sector2A";
+            multi.addKey(k2);
+            WD_CHECK(multi.tryReadCard().is_ok());
+
+            CardMemoryLayout target = multi.card().getMemory();
+            for (int sector : {1, 2})
+                std::memcpy(target.getRawMemory() + (sector * 4 + 3) * 16 + 6, tc.toBlock().trailer.accessBits, 4);
+            auto mr = multi.tryWriteDiff(CardImageDiff::compare(multi.card().getMemory(), target), target, true);
+            WD_CHECK(mr.is_ok() && mr.unwrap() == 2);
+            WD_CHECK(std::memcmp(sim2.trailer(1), ff.data(), 6) == 0);
+            WD_CHECK(std::memcmp(sim2.trailer(2), s2Key.data(), 6) == 0);
+            WD_CHECK(std::memcmp(sim2.trailer(2) + 6, tc.toBlock().trailer.accessBits, 4) == 0);
+        }
+
+#undef WD_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Card Image Archive Tests
+// ════════════════════════════════════════════════════════════════════════════════
+
+bool testCardImageArchive() {
+    int line = 0;
+    const std::string path = "card_image_archive_test.img";
+    std::remove(path.c_str());
+    try {
+#define CA_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; std::remove(path.c_str()); return false; } } while(0)
+
+        CardInterface card1k(CardType::MifareClassic1K);
+        BYTEV img1k(1024);
+        for (size_t i = 0; i < img1k.size(); ++i) img1k[i] = static_cast<BYTE>(i * 7);
+        img1k[0] = 0xDE; img1k[1] = 0xAD; img1k[2] = 0xBE; img1k[3] = 0xEF;
+        card1k.loadMemory(img1k.data(), img1k.size());
+
+        CardInterface card4k(CardType::MifareClassic4K);
+        const BYTEV uid4k = {0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+
+        // ── 1. Append + O(1) find ───────────────────────────────────────────
+        {
+            CardImageArchive archive(path);
+            CA_CHECK(archive.tryOpen().is_ok());
+            CA_CHECK(archive.size() == 0);
+
+            auto r1 = archive.tryAppend(card1k);             // UID = NUID (block 0)
+            CA_CHECK(r1.is_ok() && r1.unwrap() == 0);
+            CA_CHECK(archive.tryAppend(uid4k, card4k).is_ok());
+
+            const CardImageRecord* rec = archive.find(BYTEV{0xDE, 0xAD, 0xBE, 0xEF});
+            CA_CHECK(rec != nullptr);
+            CA_CHECK(rec->type() == CardType::MifareClassic1K);
+            CA_CHECK(rec->imageSize == 1024);
+            CA_CHECK(std::memcmp(rec->image, img1k.data(), 1024) == 0);
+            CA_CHECK(archive.find(BYTEV{0x01, 0x02}) == nullptr);
+            CA_CHECK(!archive.tryAppend(BYTEV(11, 0x00), card1k).is_ok());   // UID > 10 byte
+        }
+
+        // ── 2. Kapasite aşımı → büyüme + remap; aynı UID en yeni kaydı gösterir
+        {
+            CardImageArchive archive(path);
+            CA_CHECK(archive.tryOpen().is_ok());
+            CA_CHECK(archive.size() == 2);
+
+            BYTEV uid = {0x00, 0x00, 0x00, 0x00};
+            for (uint32_t i = 0; i < CardImageArchive::INITIAL_CAPACITY; ++i) {
+                uid[0] = static_cast<BYTE>(i); uid[1] = static_cast<BYTE>(i >> 8);
+                CA_CHECK(archive.tryAppend(uid, card4k).is_ok());
+            }
+            CA_CHECK(archive.size() == CardImageArchive::INITIAL_CAPACITY + 2);
+
+            img1k[100] ^= 0xFF;
+            card1k.loadMemory(img1k.data(), img1k.size());
+            auto r = archive.tryAppend(card1k);
+            CA_CHECK(r.is_ok());
+            CA_CHECK(archive.find(BYTEV{0xDE, 0xAD, 0xBE, 0xEF})->sequence == r.unwrap());
+            CA_CHECK(archive.trySync().is_ok());
+        }
+
+        // ── 3. ReadOnly: index yeniden kurulur, tarama + restore ────────────
+        {
+            CardImageArchive archive(path);
+            CA_CHECK(archive.tryOpen(CardImageArchive::Mode::ReadOnly).is_ok());
+            CA_CHECK(archive.size() == CardImageArchive::INITIAL_CAPACITY + 3);
+            CA_CHECK(!archive.tryAppend(card1k).is_ok());
+
+            size_t classic4k = 0;
+            for (const CardImageRecord& rec : archive)
+                if (rec.type() == CardType::MifareClassic4K) ++classic4k;
+            CA_CHECK(classic4k == CardImageArchive::INITIAL_CAPACITY + 1);
+
+            const CardImageRecord* rec = archive.find(BYTEV{0xDE, 0xAD, 0xBE, 0xEF});
+            CA_CHECK(rec != nullptr && rec->image[100] == img1k[100]);
+
+            CardInterface restored(CardType::MifareClassic1K);
+            CA_CHECK(CardImageArchive::tryRestore(*rec, restored).is_ok());
+            CA_CHECK(restored.exportMemory() == img1k);
+            CA_CHECK(!CardImageArchive::tryRestore(*archive.find(uid4k), restored).is_ok());
+        }
+
+        // ── 4. DESFire metadata ─────────────────────────────────────────────
+        {
+            CardInterface df(CardType::MifareDesfire);
+            DesfireMemoryLayout& mem = df.getDesfireMemoryMutable();
+            DesfireVersionInfo vi;
+            vi.hwStorageSize = 0x18;
+            vi.swMajorVer    = 1;
+            const BYTE dfUid[7] = {0x04, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF};
+            std::memcpy(vi.uid, dfUid, 7);
+            mem.initFromVersion(vi);
+            DesfireApplication app;
+            app.aid = DesfireAID::fromUint(0x123456);
+            app.keyConfig.keyCount = 3;
+            mem.applications.push_back(app);
+
+            CardImageArchive archive(path);
+            CA_CHECK(archive.tryOpen().is_ok());
+            CA_CHECK(archive.tryAppend(df).is_ok());
+
+            const CardImageRecord* rec = archive.find(BYTEV(dfUid, dfUid + 7));
+            CA_CHECK(rec != nullptr && (rec->flags & CardImageRecord::FLAG_DESFIRE));
+            CA_CHECK(rec->desfire.totalMemory == 4096 && rec->desfire.appCount == 1);
+
+            CardInterface df2(CardType::MifareDesfire);
+            CA_CHECK(CardImageArchive::tryRestore(*rec, df2).is_ok());
+            const DesfireMemoryLayout& mem2 = df2.getDesfireMemory();
+            CA_CHECK(mem2.totalMemory == 4096);
+            CA_CHECK(mem2.applications.size() == 1);
+            CA_CHECK(mem2.applications[0].aid.toUint() == 0x123456);
+            CA_CHECK(mem2.applications[0].keyConfig.keyCount == 3);
+
+            // MAX_APPS üstü kesilmez, reddedilir; arşive kayıt eklenmez
+            for (uint32_t i = 1; i <= CardImageDesfireMeta::MAX_APPS; ++i) {
+                app.aid = DesfireAID::fromUint(0x123456 + i);
+                mem.applications.push_back(app);
+            }
+            const size_t before = archive.size();
+            auto over = archive.tryAppend(df);
+            CA_CHECK(!over.is_ok() && std::holds_alternative<CardError>(over.error().kind));
+            CA_CHECK(archive.size() == before);
+        }
+
+        // ── 5. Format dışı dosya reddedilir ─────────────────────────────────
+        {
+            std::ofstream junk(path, std::ios::binary | std::ios::trunc);
+            junk << std::string(128, 'x');
+        }
+        {
+            CardImageArchive archive(path);
+            CA_CHECK(!archive.tryOpen(CardImageArchive::Mode::ReadOnly).is_ok());
+            CA_CHECK(!archive.isOpen());
+        }
+
+#undef CA_CHECK
+        std::remove(path.c_str());
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        std::remove(path.c_str());
+        return false;
+    }
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// Card Image Diff Tests
+// ════════════════════════════════════════════════════════════════════════════════
+
+bool testCardImageDiff() {
+    int line = 0;
+    try {
+#define CD_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        CardMemoryLayout golden(CardType::MifareClassic4K);
+        BYTE* g = golden.getRawMemory();
+        for (size_t i = 0; i < golden.memorySize(); ++i) g[i] = static_cast<BYTE>(i * 31 + 7);
+
+        CardMemoryLayout card = golden;
+        CD_CHECK(CardImageDiff::compare(golden, card).empty());
+
+        BYTE* c = card.getRawMemory();
+        c[0] ^= 0xFF;                                   // UID → maskelenir
+        c[5 * 16 + 3] ^= 0x01;                          // data blok 5, byte 3
+        std::memset(c + 7 * 16, 0, 6);                  // trailer 7: Key A okunamadı → maskelenir
+        c[7 * 16 + 9] ^= 0x10;                          //            GPB değişti → rapor
+        std::memset(c + 255 * 16 + 10, 0, 6);           // trailer 255: Key B 00 → maskelenir
+        c[200 * 16 + 15] ^= 0x80;                       // extended sektör data bloğu
+
+        CardImageDiff diff = CardImageDiff::compare(golden, card);
+        CD_CHECK(diff.comparedBlocks == 256);
+        CD_CHECK(diff.size() == 3);
+        CD_CHECK(diff.blocks[0].block == 5   && diff.blocks[0].byteMask == (1u << 3));
+        CD_CHECK(diff.blocks[1].block == 7   && diff.blocks[1].byteMask == (1u << 9));
+        CD_CHECK(diff.blocks[2].block == 200 && diff.blocks[2].byteMask == (1u << 15));
+        CD_CHECK(diff.contains(7) && !diff.contains(0) && !diff.contains(255));
+
+        // Maskeler kapatılınca her şey görünür
+        CardImageDiffOptions raw;
+        raw.maskManufacturer = false;
+        raw.maskZeroKeys     = false;
+        CardImageDiff full = CardImageDiff::compare(golden, card, raw);
+        CD_CHECK(full.size() == 5);
+        CD_CHECK(full.blocks[0].block == 0);
+        CD_CHECK(full.blocks[2].byteMask == static_cast<uint16_t>(0x003F | (1u << 9)));
+
+        // Buffer tekrar kullanımı (ham imaj, ör. arşiv kaydı)
+        CardImageDiff reused;
+        reused.blocks.reserve(16);
+        CD_CHECK(CardImageDiff::compareRaw(CardType::MifareClassic4K, g, c, reused) == 3);
+        CD_CHECK(CardImageDiff::compareRaw(CardType::MifareClassic4K, g, g, reused) == 0);
+        CD_CHECK(reused.blocks.capacity() >= 16);
+
+        // Ultralight: blok 0'da yalnızca UID byte'ları (0-8) maskelenir
+        CardMemoryLayout ulA(CardType::MifareUltralight), ulB(CardType::MifareUltralight);
+        ulB.getRawMemory()[2]  = 0x55;
+        ulB.getRawMemory()[10] = 0x01;                  // lock byte
+        CardImageDiff ul = CardImageDiff::compare(ulA, ulB);
+        CD_CHECK(ul.size() == 1 && ul.blocks[0].block == 0 && ul.blocks[0].byteMask == (1u << 10));
+
+        // Farklı kart türü → hata
+        CardMemoryLayout oneK(CardType::MifareClassic1K);
+        CD_CHECK(!CardImageDiff::tryCompare(golden, oneK).is_ok());
+
+#undef CD_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testCardSnapshots() {
+    int line = 0;
+    try {
+#define SN_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        CardInterface card(false);  // 1K
+        MifareBlock def = TrailerConfig::factoryDefault().toBlock();
+        for (int s = 0; s < 16; ++s) card.writeBlockData(s * 4 + 3, def.raw);
+        SN_CHECK(card.snapshotDepth() == 0);
+
+        BYTE a[16], b[16];
+        std::memset(a, 0xAA, 16);
+        std::memset(b, 0xBB, 16);
+        card.writeBlockData(4, a);
+
+        // ── Tek snapshot: yalnızca dokunulan bloklar, diff ve rollback ──────
+        auto s0 = card.snapshot();
+        card.writeBlockData(4, b);
+        card.writeBlockData(8, b);
+        card.writeBlockData(8, a);                      // ikinci yazım orijinali ezmez
+        card.writeBlockData(9, card.getBlock(9).raw);   // dokunuldu ama değişmedi
+        CardImageDiff d = card.diffSinceSnapshot(s0);
+        SN_CHECK(d.comparedBlocks == 3);
+        SN_CHECK(d.size() == 2);
+        SN_CHECK(d.blocks[0].block == 4 && d.blocks[0].byteMask == 0xFFFF);
+        SN_CHECK(d.blocks[1].block == 8);
+        card.rollback(s0);
+        SN_CHECK(card.snapshotDepth() == 0);
+        SN_CHECK(card.getBlock(4).raw[0] == 0xAA);
+        SN_CHECK(card.getBlock(8).raw[0] == 0x00);
+
+        // ── İç içe: iç rollback dıştakini korur, release değişiklikleri tutar ─
+        auto outer = card.snapshot();
+        card.writeBlockData(5, a);
+        auto inner = card.snapshot();
+        card.writeBlockData(5, b);
+        card.writeBlockData(6, b);
+        SN_CHECK(card.snapshotDepth() == 2);
+        card.rollback(inner);
+        SN_CHECK(card.getBlock(5).raw[0] == 0xAA && card.getBlock(6).raw[0] == 0x00);
+        SN_CHECK(card.diffSinceSnapshot(outer).size() == 1);
+
+        inner = card.snapshot();
+        card.writeBlockData(6, b);
+        card.release(inner);
+        SN_CHECK(card.snapshotDepth() == 1);
+        SN_CHECK(card.diffSinceSnapshot(outer).size() == 2);    // 5 ve 6 dış snapshot'ta
+        card.rollback(outer);
+        SN_CHECK(card.getBlock(5).raw[0] == 0x00 && card.getBlock(6).raw[0] == 0x00);
+        SN_CHECK(!card.tryRollback(outer).is_ok());             // kapandı
+
+        // ── loadMemory ve touchBlock kaydedilir, mutable getBlock okuması değil ─
+        BYTEV before = card.exportMemory();
+        auto s1 = card.snapshot();
+        BYTEV image = before;
+        image[12 * 16] = 0x42;
+        card.loadMemory(image.data(), image.size());
+        SN_CHECK(card.getBlock(14).raw[0] == 0x00);     // non-const okuma
+        card.touchBlock(13);
+        card.getBlock(13).raw[1] = 0x24;
+        SN_CHECK(card.diffSinceSnapshot(s1).comparedBlocks == 2);
+        SN_CHECK(card.diffSinceSnapshot(s1).size() == 2);
+        card.rollback(s1);
+        SN_CHECK(card.exportMemory() == before);
+
+        // ── Trailer rollback access cache'i düşürür ────────────────────────
+        SN_CHECK(card.canWrite(1, KeyType::A));
+        auto s2 = card.snapshot();
+        TrailerConfig frozen = TrailerConfig::factoryDefault();
+        frozen.access = sectorModeToConfig(SectorMode::FROZEN);
+        card.writeBlockData(3, frozen.toBlock().raw);
+        SN_CHECK(!card.canWrite(1, KeyType::A));
+        card.rollback(s2);
+        SN_CHECK(card.canWrite(1, KeyType::A));
+
+        // ── DESFire: model ilk mutable erişimde kopyalanır ─────────────────
+        CardInterface df(CardType::MifareDesfire);
+        auto s3 = df.snapshot();
+        SN_CHECK(!df.desfireTouchedSinceSnapshot(s3));
+        const size_t freeBefore = df.getDesfireMemory().freeMemory;
+        df.getDesfireMemoryMutable().freeMemory = freeBefore + 1234;
+        SN_CHECK(df.desfireTouchedSinceSnapshot(s3));
+
+        // Kopya snapshot başına bir kez: sonraki erişimler kaydı değiştirmez,
+        // iç snapshot'lar ilk erişimdeki hâli paylaşır
+        auto s4 = df.snapshot();
+        auto s5 = df.snapshot();
+        df.getDesfireMemoryMutable().freeMemory = freeBefore + 1;
+        df.getDesfireMemoryMutable().freeMemory = freeBefore + 2;
+        SN_CHECK(df.desfireTouchedSinceSnapshot(s4) && df.desfireTouchedSinceSnapshot(s5));
+        df.rollback(s5);
+        SN_CHECK(df.getDesfireMemory().freeMemory == freeBefore + 1234);
+        df.getDesfireMemoryMutable().freeMemory = freeBefore + 3;
+        df.rollback(s4);
+        SN_CHECK(df.getDesfireMemory().freeMemory == freeBefore + 1234);
+        df.rollback(s3);
+        SN_CHECK(df.getDesfireMemory().freeMemory == freeBefore);
+
+#undef SN_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testCompactCardStore() {
+    int line = 0;
+    try {
+#define CS_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        // Kayıt boyutu kart türünün gerçek belleği kadar
+        CS_CHECK(CompactCardStore::recordSize(CardType::MifareUltralight) == 64);
+        CS_CHECK(CompactCardStore::recordSize(CardType::MifareClassic1K) == 1024 + 16 * 2);
+        CS_CHECK(CompactCardStore::recordSize(CardType::MifareClassic4K) == 4096 + 40 * 2);
+
+        CardMemoryLayout oneK(CardType::MifareClassic1K);
+        MifareBlock def = TrailerConfig::factoryDefault().toBlock();
+        for (int s = 0; s < 16; ++s)
+            std::memcpy(oneK.getRawMemory() + (s * 4 + 3) * 16, def.raw, 16);
+        const BYTE uid[4] = { 0xDE, 0xAD, 0xBE, 0xEF };
+        std::memcpy(oneK.getRawMemory(), uid, 4);
+        oneK.getRawMemory()[5 * 16] = 0x55;
+
+        CardMemoryLayout ul(CardType::MifareUltralight);
+        ul.getRawMemory()[0] = 0x04;
+        ul.getRawMemory()[4] = 0x11;
+
+        CompactCardStore fleet;
+        fleet.reserve(3);
+        auto a = fleet.add(oneK);
+        auto b = fleet.add(ul);
+        CS_CHECK(fleet.size() == 2);
+        CS_CHECK(fleet.cardType(b) == CardType::MifareUltralight);
+        CS_CHECK(std::memcmp(fleet.raw(a), oneK.getRawMemory(), 1024) == 0);
+
+        // View: kopyasız, topoloji + trailer + izinler
+        CardImageView v = fleet.view(a);
+        CS_CHECK(v.raw() == fleet.raw(a));
+        CS_CHECK(v.totalBlocks() == 64 && v.sectorCount() == 16);
+        CS_CHECK(v.block(5).raw[0] == 0x55);
+        CS_CHECK(v.uid()[0] == 0xDE && v.uid()[3] == 0xEF && v.uid()[4] == 0);
+        CS_CHECK(v.keyA(3) == TrailerConfig::factoryDefault().keyA);
+        CS_CHECK(v.canRead(5, KeyType::A) && v.canWrite(5, KeyType::B));
+        CS_CHECK(v.canRead(7, KeyType::A) && !v.canRead(7, KeyType::B));    // trailer 001
+        CS_CHECK(fleet.view(b).uid()[3] == 0x11);
+        CS_CHECK(fleet.canWrite(b, 2, KeyType::A));                        // Ultralight
+
+        // Paketlenmiş izinler CardInterface/AccessControl ile aynı
+        CardInterface full(CardType::MifareClassic1K);
+        fleet.loadInto(a, full);
+        for (int blk = 0; blk < 64; ++blk)
+            for (KeyType kt : { KeyType::A, KeyType::B }) {
+                CS_CHECK(fleet.canRead(a, blk, kt) == full.canRead(blk, kt));
+                CS_CHECK(fleet.canWrite(a, blk, kt) == full.canWrite(blk, kt));
+            }
+
+        // Trailer yazımı izinleri yeniden decode eder
+        TrailerConfig frozen = TrailerConfig::factoryDefault();
+        frozen.access = sectorModeToConfig(SectorMode::FROZEN);
+        fleet.writeBlock(a, 7, frozen.toBlock().raw);
+        CS_CHECK(!fleet.canWrite(a, 5, KeyType::A) && !fleet.canWrite(a, 5, KeyType::B));
+        CS_CHECK(fleet.canWrite(a, 9, KeyType::A));                        // sektör 2 etkilenmez
+        CS_CHECK(fleet.view(a).canWrite(5, KeyType::B) == fleet.canWrite(a, 5, KeyType::B));
+
+        // Hatalar
+        CardInterface wrongType(CardType::MifareClassic4K);
+        CS_CHECK(!fleet.tryLoadInto(a, wrongType).is_ok());
+        CS_CHECK(!fleet.tryAdd(CardType::MifareClassic1K, ul.getRawMemory(), 64).is_ok());
+        CS_CHECK(!fleet.tryAdd(CardType::MifareDesfire, nullptr, 0).is_ok());
+        CS_CHECK(!fleet.tryWriteBlock(a, 64, def.raw).is_ok());
+        CS_CHECK(!CardImageView::tryFrom(CardType::MifareClassic4K, oneK.getRawMemory(), 1024).is_ok());
+
+        // Kompaktlık: 1K + Ultralight < tek CardMemoryLayout
+        CS_CHECK(fleet.memoryUsage() < 2 * sizeof(CardMemoryLayout));
+
+#undef CS_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testDesfireStreamRead() {
+    int line = 0;
+    try {
+#define SR_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        // Simüle kart: 1000 byte'lık std data dosyası, 59 byte'lık frame'ler
+        BYTEV file(1000);
+        for (size_t i = 0; i < file.size(); ++i) file[i] = static_cast<BYTE>(i * 7 + 3);
+
+        using TxResult = Result<BYTEV, PcscError>;
+        BYTEV pending;
+        int calls = 0, failAt = -1;
+        BYTE forcedStatus = 0;
+        auto frameOut = [&]() -> TxResult {
+            const size_t n = std::min<size_t>(59, pending.size());
+            BYTEV resp(pending.begin(), pending.begin() + n);
+            pending.erase(pending.begin(), pending.begin() + n);
+            resp.push_back(0x91);
+            resp.push_back(pending.empty() ? 0x00 : 0xAF);
+            return TxResult::Ok(resp);
+        };
+        auto transmit = [&](const BYTEV& apdu) -> TxResult {
+            if (++calls == failAt || failAt == 0)
+                return TxResult::Err(Error<PcscError>(IoError::ReadFailed).detail("RF field lost"));
+            if (apdu[1] == 0xAF) return frameOut();
+            if (forcedStatus) return TxResult::Ok(BYTEV{ 0x91, forcedStatus });
+            const uint32_t off = DesfireCommands::readLE24(&apdu[6]);
+            const uint32_t len = DesfireCommands::readLE24(&apdu[9]);
+            const uint32_t end = len ? off + len : static_cast<uint32_t>(file.size());
+            pending.assign(file.begin() + off, file.begin() + end);
+            return frameOut();
+        };
+
+        BYTEV got;
+        uint32_t expectOffset = 0;
+        bool contiguous = true;
+        auto sink = [&](uint32_t off, const BYTE* p, size_t n) {
+            contiguous = contiguous && off == expectOffset;
+            expectOffset = off + static_cast<uint32_t>(n);
+            got.insert(got.end(), p, p + n);
+        };
+
+        // ── Chunk'lı okuma: 944 (16 frame) + 56 ────────────────────────────
+        auto r = DesfireCommands::tryReadDataStream(transmit, 0x01, 0, 1000, sink);
+        SR_CHECK(r.is_ok());
+        SR_CHECK(got == file && contiguous);
+        SR_CHECK(r.unwrap().commands == 2 && r.unwrap().frames == 17 && r.unwrap().retries == 0);
+
+        // ── 5. exchange'te RF hatası → onaylı offset'ten (4×59) devam ─────
+        got.clear(); expectOffset = 0; calls = 0; failAt = 5;
+        r = DesfireCommands::tryReadDataStream(transmit, 0x01, 0, 1000, sink);
+        SR_CHECK(r.is_ok());
+        SR_CHECK(got == file && contiguous);
+        SR_CHECK(r.unwrap().retries == 1 && r.unwrap().commands == 2 && r.unwrap().bytesRead == 1000);
+
+        // ── Ofsetli, length = 0 (dosya sonuna kadar) ───────────────────────
+        got.clear(); expectOffset = 900; calls = 0; failAt = -1;
+        r = DesfireCommands::tryReadDataStream(transmit, 0x01, 900, 0, sink);
+        SR_CHECK(r.is_ok() && got.size() == 100 && got[0] == file[900] && contiguous);
+
+        // ── Küçük reader frame'i: chunk = 2 × 16 ───────────────────────────
+        got.clear(); expectOffset = 0;
+        DesfireStreamOptions small;
+        small.frameData = 16;
+        small.framesPerChunk = 2;
+        r = DesfireCommands::tryReadDataStream(transmit, 0x01, 0, 100, sink, small);
+        SR_CHECK(r.is_ok() && r.unwrap().commands == 4 && got.size() == 100);
+
+        // ── Kalıcı RF hatası: retry tükenir, resume offset raporlanır ──────
+        got.clear(); expectOffset = 0; calls = 0; failAt = 0;
+        r = DesfireCommands::tryReadDataStream(transmit, 0x01, 0, 1000, sink);
+        SR_CHECK(!r.is_ok());
+        SR_CHECK(calls == 3);                               // ilk deneme + 2 retry
+        SR_CHECK(r.error().detail.find("resume at offset 0") != std::string::npos);
+
+        // ── Kart status hatası tekrar denenmez ─────────────────────────────
+        calls = 0; failAt = -1; forcedStatus = 0x9D;
+        r = DesfireCommands::tryReadDataStream(transmit, 0x01, 0, 1000, sink);
+        SR_CHECK(!r.is_ok() && calls == 1);
+        forcedStatus = 0;
+
+        // tryTransceive aynı frame döngüsünü kullanır
+        auto whole = DesfireCommands::tryTransceive(transmit, DesfireCommands::readData(0x01, 0, 0));
+        SR_CHECK(whole.is_ok() && whole.unwrap() == file);
+
+#undef SR_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testDesfireCommandChaining() {
+    int line = 0;
+    try {
+#define CC_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        // ── Frame boyutu ───────────────────────────────────────────────────
+        CC_CHECK(DesfireFrameSize::fromIndex(5) == 64 && DesfireFrameSize::fromIndex(8) == 256);
+        DesfireFrameSize fs;
+        CC_CHECK(fs.payload() == 59);
+        fs.fsd = DesfireFrameSize::fromIndex(2);            // reader 32 byte
+        CC_CHECK(fs.frameSize() == 32 && fs.payload() == 27);
+
+        // ── Simüle PICC: zinciri birleştirir, ara frame'lerde 91AF ────────
+        using TxResult = Result<BYTEV, PcscError>;
+        std::vector<BYTEV> frames;
+        BYTEV assembled;
+        size_t expected = 0;
+        bool endEarly = false;
+        auto transmit = [&](const BYTEV& apdu) -> TxResult {
+            frames.push_back(apdu);
+            if (apdu[1] != 0xAF) {
+                assembled.clear();
+                expected = 7 + DesfireCommands::readLE24(&apdu[5 + 4]);   // fileNo+off+len+data
+            }
+            assembled.insert(assembled.end(), apdu.begin() + 5, apdu.end() - 1);
+            if (endEarly) return TxResult::Ok(BYTEV{ 0x91, 0x00 });
+            return TxResult::Ok(BYTEV{ 0x91, assembled.size() < expected ? BYTE(0xAF) : BYTE(0x00) });
+        };
+
+        BYTEV payload(300);
+        for (size_t i = 0; i < payload.size(); ++i) payload[i] = static_cast<BYTE>(i);
+        BYTEV cmd = DesfireCommands::writeData(0x02, 0x10, payload);
+
+        auto r = DesfireCommands::tryTransceiveChained(transmit, cmd, 59);
+        CC_CHECK(r.is_ok());
+        CC_CHECK(frames.size() == 6);                       // 307 = 5 × 59 + 12
+        CC_CHECK(frames[0][1] == 0x3D);
+        for (size_t i = 1; i < frames.size(); ++i) CC_CHECK(frames[i][1] == 0xAF);
+        for (const BYTEV& f : frames) CC_CHECK(f[4] == f.size() - 6 && f[4] <= 59);
+        CC_CHECK(frames.back()[4] == 12);
+        CC_CHECK(assembled == BYTEV(cmd.begin() + 5, cmd.end() - 1));
+
+        // Tek frame'e sığan komut olduğu gibi gönderilir
+        frames.clear();
+        BYTEV small = DesfireCommands::appendRecord(0x03, BYTEV(8, 0xAB));
+        CC_CHECK(DesfireCommands::tryTransceiveChained(transmit, small, 59).is_ok());
+        CC_CHECK(frames.size() == 1 && frames[0] == small);
+
+        // Küçük reader frame'i
+        frames.clear();
+        CC_CHECK(DesfireCommands::tryTransceiveChained(transmit, cmd, fs.payload()).is_ok());
+        CC_CHECK(frames.size() == 12);                      // 307 = 11 × 27 + 10
+
+        // Kart zinciri erken bitirirse hata
+        frames.clear();
+        endEarly = true;
+        CC_CHECK(!DesfireCommands::tryTransceiveChained(transmit, cmd, 59).is_ok());
+        CC_CHECK(frames.size() == 1);
+
+#undef CC_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testDesfireSecureMessagingModes() {
+    int line = 0;
+    try {
+#define SM_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        using SM = DesfireSecureMessaging;
+
+        // ── CRC32 (EV1: final XOR yok → standart CRC32'nin tersi) ─────────
+        const BYTE digits[] = { '1','2','3','4','5','6','7','8','9' };
+        SM_CHECK(SM::crc32(digits, sizeof(digits)) == 0x340BC6D9u);
+
+        // ── CMAC, IV = 0 → RFC 4493 test vektörleri ─────────────────────
+        DesfireSession host;
+        host.authenticated = true;
+        host.keyType = DesfireKeyType::AES128;
+        host.sessionKey = { 0x2B,0x7E,0x15,0x16,0x28,0xAE,0xD2,0xA6,0xAB,0xF7,0x15,0x88,0x09,0xCF,0x4F,0x3C };
+        host.iv = BYTEV(16, 0x00);
+        BYTEV mac0 = SM::calculateCMAC(host, BYTEV{});
+        SM_CHECK(mac0 == BYTEV({ 0xBB,0x1D,0x69,0x29,0xE9,0x59,0x37,0x28,0x7F,0xA3,0x7D,0x12,0x9B,0x75,0x67,0x46 }));
+        host.iv = BYTEV(16, 0x00);
+        BYTEV mac16 = SM::calculateCMAC(host, BYTEV{ 0x6B,0xC1,0xBE,0xE2,0x2E,0x40,0x9F,0x96,0xE9,0x3D,0x7E,0x11,0x73,0x93,0x17,0x2A });
+        SM_CHECK(mac16 == BYTEV({ 0x07,0x0A,0x16,0xB4,0x6B,0x4D,0x41,0x44,0xF7,0x9B,0xDD,0x9D,0xD0,0x4A,0x28,0x7C }));
+        SM_CHECK(host.iv == mac16);
+
+        // ── Full: WriteData komutu, header açık, data || CRC şifreli ──────
+        host.iv = BYTEV(16, 0x00);
+        DesfireSession card = host;                         // PICC tarafı aynı oturum
+
+        BYTEV payload(20);
+        for (size_t i = 0; i < payload.size(); ++i) payload[i] = static_cast<BYTE>(0xA0 + i);
+        BYTEV plainCmd = DesfireCommands::writeData(0x01, 0, payload);
+        BYTEV apdu = plainCmd;
+        SM_CHECK(SM::tryProtectCommand(host, apdu, 7, DesfireCommMode::Full).is_ok());
+        SM_CHECK(apdu.size() == 5 + 7 + 32 + 1);            // 20 + 4 CRC → 32
+        SM_CHECK(apdu[4] == 39 && apdu.back() == 0x00);
+        SM_CHECK(std::equal(plainCmd.begin() + 5, plainCmd.begin() + 12, apdu.begin() + 5));   // header açık
+
+        SM::decipher(card, apdu.data() + 12, 32);
+        SM_CHECK(std::equal(payload.begin(), payload.end(), apdu.begin() + 12));
+        uint32_t crc = SM::crc32(plainCmd.data() + 1, 1);
+        crc = SM::crc32(plainCmd.data() + 5, 7 + payload.size(), crc);
+        SM_CHECK(apdu[32] == BYTE(crc) && apdu[35] == BYTE(crc >> 24));
+        for (size_t i = 36; i < 44; ++i) SM_CHECK(apdu[i] == 0x00);
+        SM_CHECK(card.iv == host.iv);
+
+        // ── Full: şifreli yanıt, uzunluk CRC taramasıyla bulunur ──────────
+        BYTEV data = { 1,2,3,4,5,6,7,8,9,10 };
+        BYTEV resp = data;
+        BYTE status = 0x00;
+        uint32_t rcrc = SM::crc32(&status, 1, SM::crc32(data.data(), data.size()));
+        for (int i = 0; i < 4; ++i) resp.push_back(static_cast<BYTE>(rcrc >> (8 * i)));
+        resp.push_back(0x80);
+        resp.resize(16, 0x00);
+        SM::encipher(card, resp.data(), resp.size());
+
+        BYTEV tampered = resp;
+        DesfireSession hostCopy = host;
+        SM_CHECK(SM::tryUnwrapInPlace(host, resp, 0x00, DesfireCommMode::Full).is_ok());
+        SM_CHECK(resp == data);
+        SM_CHECK(host.iv == card.iv);
+
+        tampered[3] ^= 0x01;
+        SM_CHECK(!SM::tryUnwrapInPlace(hostCopy, tampered, 0x00, DesfireCommMode::Full, 10).is_ok());
+
+        // ── MAC: 3K3DES oturumu, 8 byte tam CMAC ──────────────────────────
+        DesfireSession h3;
+        h3.authenticated = true;
+        h3.keyType = DesfireKeyType::ThreeDES;
+        h3.sessionKey = BYTEV(24);
+        for (size_t i = 0; i < 24; ++i) h3.sessionKey[i] = static_cast<BYTE>(i * 7 + 1);
+        h3.iv = BYTEV(8, 0x00);
+        DesfireSession c3 = h3;
+
+        BYTEV credit = DesfireCommands::credit(0x04, 250);
+        BYTEV macCmd = credit;
+        SM_CHECK(SM::tryProtectCommand(h3, macCmd, 1, DesfireCommMode::MAC).is_ok());
+        SM_CHECK(macCmd.size() == credit.size() + 8 && macCmd[4] == 5 + 8);
+        BYTEV cmacIn = { credit[1] };
+        cmacIn.insert(cmacIn.end(), credit.begin() + 5, credit.end() - 1);
+        BYTEV cardMac = SM::calculateCMAC(c3, cmacIn);
+        SM_CHECK(cardMac.size() == 8);
+        SM_CHECK(std::equal(cardMac.begin(), cardMac.end(), macCmd.begin() + 10));
+
+        BYTEV ok = SM::calculateCMAC(c3, BYTEV{ 0x00 });  // status-only yanıt
+        SM_CHECK(SM::tryUnwrapInPlace(h3, ok, 0x00, DesfireCommMode::MAC).is_ok());
+        SM_CHECK(ok.empty() && h3.iv == c3.iv);
+
+        // ── MAC: EV1 AES, bilinen cevap (RFC 4493 Example 2 girdisi) ──────
+        //   Auth sonrası ilk komut: IV = 0 → CMAC standart AES-CMAC'tir.
+        //   CMAC(INS || data) = 070A16B4 6B4D4144 F79BDD9D D04A287C; kart ve
+        //   host ilk 8 byte'ı iletir (tek index'li MACt EV2'ye özgüdür).
+        {
+            const BYTEV m = { 0x6B,0xC1,0xBE,0xE2,0x2E,0x40,0x9F,0x96,0xE9,0x3D,0x7E,0x11,0x73,0x93,0x17,0x2A };
+            const BYTEV wire = { 0x07,0x0A,0x16,0xB4,0x6B,0x4D,0x41,0x44 };
+            DesfireSession ev1;
+            ev1.authenticated = true;
+            ev1.keyType = DesfireKeyType::AES128;
+            ev1.sessionKey = host.sessionKey;
+            DesfireSession ev1Resp = ev1;
+
+            BYTEV cmd = DesfireCommands::wrapCommand(m[0], BYTEV(m.begin() + 1, m.end()));
+            SM_CHECK(SM::tryProtectCommand(ev1, cmd, 1, DesfireCommMode::MAC).is_ok());
+            SM_CHECK(cmd.size() == 5 + 15 + 8 + 1 && cmd[4] == 23);
+            SM_CHECK(std::equal(wire.begin(), wire.end(), cmd.begin() + 20));
+            SM_CHECK(ev1.iv == BYTEV({ 0x07,0x0A,0x16,0xB4,0x6B,0x4D,0x41,0x44,0xF7,0x9B,0xDD,0x9D,0xD0,0x4A,0x28,0x7C }));
+
+            // Yanıt: data (15) || MAC(8), CMAC(data || status) aynı vektör
+            BYTEV resp = BYTEV(m.begin(), m.end() - 1);
+            resp.insert(resp.end(), wire.begin(), wire.end());
+            BYTEV bad = resp;
+            DesfireSession ev1Bad = ev1Resp;
+            SM_CHECK(SM::tryUnwrapInPlace(ev1Resp, resp, 0x2A, DesfireCommMode::MAC).is_ok());
+            SM_CHECK(resp == BYTEV(m.begin(), m.end() - 1));
+
+            // Tek index'li (EV2) kısaltma EV1'de reddedilir
+            BYTEV odd = SM::truncateCMAC(ev1.iv);
+            std::copy(odd.begin(), odd.end(), bad.end() - 8);
+            SM_CHECK(!SM::tryUnwrapInPlace(ev1Bad, bad, 0x2A, DesfireCommMode::MAC).is_ok());
+        }
+
+        // ── Plain: veri yok → kısa form korunur, IV yine ilerler ──────────
+        BYTEV commit = DesfireCommands::commitTransaction();
+        BYTEV ivBefore = h3.iv;
+        SM_CHECK(SM::tryProtectCommand(h3, commit, 0, DesfireCommMode::Plain).is_ok());
+        SM_CHECK(commit == DesfireCommands::commitTransaction());
+        SM_CHECK(h3.iv != ivBefore);
+
+        // Oturumsuz koruma reddedilir
+        DesfireSession none;
+        BYTEV x = DesfireCommands::readData(1, 0, 16);
+        SM_CHECK(!SM::tryProtectCommand(none, x, 7, DesfireCommMode::MAC).is_ok());
+
+#undef SM_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testCmacEngine() {
+    int line = 0;
+    try {
+#define CE_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        using crypto::block::Cmac;
+        using crypto::block::CmacAlgo;
+
+        // ── RFC 4493 — 40 ve 64 byte mesaj, parçalı update ───────────────
+        const BYTEV key = { 0x2B,0x7E,0x15,0x16,0x28,0xAE,0xD2,0xA6,0xAB,0xF7,0x15,0x88,0x09,0xCF,0x4F,0x3C };
+        const BYTEV msg = {
+            0x6B,0xC1,0xBE,0xE2,0x2E,0x40,0x9F,0x96,0xE9,0x3D,0x7E,0x11,0x73,0x93,0x17,0x2A,
+            0xAE,0x2D,0x8A,0x57,0x1E,0x03,0xAC,0x9C,0x9E,0xB7,0x6F,0xAC,0x45,0xAF,0x8E,0x51,
+            0x30,0xC8,0x1C,0x46,0xA3,0x5C,0xE4,0x11,0xE5,0xFB,0xC1,0x19,0x1A,0x0A,0x52,0xEF,
+            0xF6,0x9F,0x24,0x45,0xDF,0x4F,0x9B,0x17,0xAD,0x2B,0x41,0x7B,0xE6,0x6C,0x37,0x10 };
+        const BYTE mac40[16] = { 0xDF,0xA6,0x67,0x47,0xDE,0x9A,0xE6,0x30,0x30,0xCA,0x32,0x61,0x14,0x97,0xC8,0x27 };
+        const BYTE mac64[16] = { 0x51,0xF0,0xBE,0xBF,0x7E,0x3B,0x9D,0x92,0xFC,0x49,0x74,0x17,0x79,0x36,0x3C,0xFE };
+
+        Cmac mac(CmacAlgo::AES128, key);
+        CE_CHECK(mac.ready() && mac.blockSize() == 16);
+        BYTE out[16];
+        mac.compute(nullptr, msg.data(), 40, out);
+        CE_CHECK(std::memcmp(out, mac40, 16) == 0);
+
+        for (size_t split : { size_t(1), size_t(15), size_t(16), size_t(17), size_t(33) }) {
+            mac.reset();
+            mac.update(msg.data(), split);
+            mac.update(msg.data() + split, 64 - split);
+            mac.final(out);
+            CE_CHECK(std::memcmp(out, mac64, 16) == 0);
+        }
+        CE_CHECK(crypto::block::cmacAes128(key, msg) == BYTEV(mac64, mac64 + 16));
+
+        // Truncation doğrudan caller buffer'ına
+        BYTE t[8];
+        mac.reset();
+        mac.update(msg.data(), 64);
+        mac.finalTruncated(t);
+        for (int i = 0; i < 8; ++i) CE_CHECK(t[i] == mac64[2 * i + 1]);
+
+        // IV zinciri: reset(iv) = CBC başlangıcı
+        BYTE chained[16];
+        mac.compute(mac64, msg.data(), 16, chained);
+        CE_CHECK(std::memcmp(chained, out, 16) != 0);
+        Cmac copy = mac;                                    // CTX kopyalanır
+        BYTE again[16];
+        copy.compute(mac64, msg.data(), 16, again);
+        CE_CHECK(std::memcmp(chained, again, 16) == 0);
+
+        // ── Session sahipliği: key değişince yeniden bağlanır ─────────────
+        DesfireSession s;
+        s.keyType = DesfireKeyType::AES128;
+        s.sessionKey = key;
+        CE_CHECK(!s.cmac.ready());
+        crypto::block::Cmac& e1 = s.macEngine();
+        CE_CHECK(s.cmac.boundTo(CmacAlgo::AES128, key));
+        CE_CHECK(&s.macEngine() == &e1);
+
+        s.keyType = DesfireKeyType::ThreeDES;
+        s.sessionKey = BYTEV(24, 0x11);
+        CE_CHECK(s.macEngine().blockSize() == 8);
+        s.reset();
+        CE_CHECK(!s.cmac.ready());
+
+        // 2K3DES: 8 byte tek DES key'i K1 = K2'ye genişletilir
+        Cmac d8(CmacAlgo::TDES2K, BYTEV(8, 0x5A));
+        Cmac d16(CmacAlgo::TDES2K, BYTEV(16, 0x5A));
+        BYTE m8[8], m16[8];
+        d8.compute(nullptr, msg.data(), 20, m8);
+        d16.compute(nullptr, msg.data(), 20, m16);
+        CE_CHECK(std::memcmp(m8, m16, 8) == 0);
+
+#undef CE_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// TEST: DESFire Metadata Cache — model validity, sync, per-UID persistence
+// ════════════════════════════════════════════════════════════════════════════════
+
+bool testDesfireMetadataCache() {
+    int line = 0;
+    const std::string path = "desfire_meta_test.bin";
+    std::remove(path.c_str());
+    try {
+#define MC_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; std::remove(path.c_str()); return false; } } while(0)
+
+        DesfireMemoryLayout mem;
+        DesfireVersionInfo vi;
+        vi.hwStorageSize = 0x18;
+        vi.swStorageSize = 0x18;
+        const BYTE uid[7] = {0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+        std::memcpy(vi.uid, uid, 7);
+        mem.initFromVersion(vi);
+        MC_CHECK(!mem.appListKnown);
+
+        // GetApplicationIDs sonucu ile eşitleme: fazlalık silinir, yeni eklenir
+        mem.ensureApp(DesfireAID::fromUint(0x999999));
+        mem.syncAppIDs({DesfireAID::fromUint(0x010203), DesfireAID::fromUint(0x040506)});
+        MC_CHECK(mem.appListKnown);
+        MC_CHECK(mem.applications.size() == 2);
+        MC_CHECK(!mem.hasApp(DesfireAID::fromUint(0x999999)));
+
+        DesfireApplication& app = mem.ensureApp(DesfireAID::fromUint(0x010203));
+        MC_CHECK(&app == mem.findApp(DesfireAID::fromUint(0x010203)));
+        MC_CHECK(!app.fileListKnown);
+        app.syncFileIDs(BYTEV{1, 2});
+        MC_CHECK(app.fileListKnown);
+        MC_CHECK(app.fileIDs() == (BYTEV{1, 2}));
+        MC_CHECK(!app.findFile(1)->settingsKnown);
+
+        DesfireFile& f1 = app.ensureFile(1);
+        f1.settings.fileType = DesfireFileType::Value;
+        f1.settings.commMode = DesfireCommMode::Full;
+        f1.settings.value.lowerLimit = -10;
+        f1.settings.value.upperLimit = 1000;
+        f1.settings.value.value = 42;
+        f1.settings.value.limitedCreditEnabled = true;
+        f1.settingsKnown = true;
+        f1.data = BYTEV(4, 0xEE);
+
+        DesfireFile& f2 = app.ensureFile(2);
+        f2.settings.fileType = DesfireFileType::CyclicRecord;
+        f2.settings.commMode = DesfireCommMode::MAC;
+        f2.settings.record.recordSize = 16;
+        f2.settings.record.maxRecords = 5;
+        f2.settings.record.currentRecords = 3;
+        f2.settingsKnown = true;
+
+        // Bilinen settings yeniden sync'te korunur; listeden çıkan dosya silinir
+        app.syncFileIDs(BYTEV{1, 2, 3});
+        MC_CHECK(app.findFile(1)->settingsKnown);
+        MC_CHECK(!app.findFile(3)->settingsKnown);
+        MC_CHECK(app.removeFile(3));
+        MC_CHECK(!app.removeFile(3));
+
+        // ── store / restore ─────────────────────────────────────────────────
+        DesfireMetadataCache cache;
+        cache.store(mem);
+        MC_CHECK(cache.size() == 1);
+        MC_CHECK(cache.contains(vi));
+
+        DesfireMemoryLayout other;
+        other.initFromVersion(vi);
+        MC_CHECK(cache.restore(other));
+        MC_CHECK(other.appListKnown);
+        MC_CHECK(other.applications.size() == 2);
+        const DesfireFile* r1 = other.findApp(DesfireAID::fromUint(0x010203))->findFile(1);
+        MC_CHECK(r1 && r1->settingsKnown);
+        MC_CHECK(r1->settings.commMode == DesfireCommMode::Full);
+        MC_CHECK(r1->data.empty());                       // içerik cache'lenmez
+
+        // Farklı sürüm → farklı anahtar
+        DesfireVersionInfo vi2 = vi;
+        vi2.swMajorVer = 2;
+        DesfireMemoryLayout ev2;
+        ev2.initFromVersion(vi2);
+        MC_CHECK(!cache.restore(ev2));
+
+        // Random UID (sıfır) saklanmaz
+        DesfireMemoryLayout anon;
+        anon.ensureApp(DesfireAID::fromUint(1));
+        cache.store(anon);
+        MC_CHECK(cache.size() == 1);
+
+        // ── invalidate ──────────────────────────────────────────────────────
+        other.invalidateMetadata();
+        MC_CHECK(!other.appListKnown);
+        MC_CHECK(!other.applications[0].fileListKnown);
+        MC_CHECK(other.applications.size() == 2);         // girdiler ipucu olarak kalır
+        other.resetApplications();
+        MC_CHECK(other.appListKnown && other.applications.empty());
+
+        // ── save / load ─────────────────────────────────────────────────────
+        cache.save(path);
+        DesfireMetadataCache loaded;
+        MC_CHECK(loaded.tryLoad(path).is_ok());
+        MC_CHECK(loaded.size() == 1);
+        DesfireMemoryLayout back;
+        back.initFromVersion(vi);
+        MC_CHECK(loaded.restore(back));
+        const DesfireApplication* ba = back.findApp(DesfireAID::fromUint(0x010203));
+        MC_CHECK(ba && ba->fileListKnown);
+        MC_CHECK(ba->fileIDs() == (BYTEV{1, 2}));
+        const DesfireFileSettings& v = ba->findFile(1)->settings;
+        MC_CHECK(v.fileType == DesfireFileType::Value);
+        MC_CHECK(v.value.lowerLimit == -10 && v.value.upperLimit == 1000);
+        MC_CHECK(v.value.value == 42 && v.value.limitedCreditEnabled);
+        const DesfireFileSettings& c = ba->findFile(2)->settings;
+        MC_CHECK(c.commMode == DesfireCommMode::MAC);
+        MC_CHECK(c.record.recordSize == 16 && c.record.maxRecords == 5 && c.record.currentRecords == 3);
+
+        // Bozuk / kesik dosya reddedilir, mevcut kayıtlara dokunulmaz
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write("DFMC\x01\x00\x00\x00\x05\x00\x00\x00", 12);
+        }
+        MC_CHECK(!loaded.tryLoad(path).is_ok());
+        MC_CHECK(loaded.size() == 1);
+        MC_CHECK(!loaded.tryLoad("does_not_exist_meta.bin").is_ok());
+
+        std::remove(path.c_str());
+#undef MC_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        std::remove(path.c_str());
+        return false;
+    }
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// TEST: DESFire Snapshot — key map planning, step timing report
+// ════════════════════════════════════════════════════════════════════════════════
+
+bool testDesfireSnapshotReport() {
+    int line = 0;
+    try {
+#define SN_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        const DesfireAID app = DesfireAID::fromUint(0x010203);
+        DesfireKeyMap keys;
+        SN_CHECK(keys.empty());
+        keys.add(app, 1, BYTEV(16, 0x11));
+        keys.add(app, 2, BYTEV(16, 0x22), DesfireKeyType::TwoDES);
+        keys.add(app, 1, BYTEV(16, 0x33));                   // aynı girdi güncellenir
+        SN_CHECK(keys.entries.size() == 2);
+        SN_CHECK(keys.find(app, 1)->key == BYTEV(16, 0x33));
+        SN_CHECK(keys.find(app, 2)->keyType == DesfireKeyType::TwoDES);
+        SN_CHECK(keys.find(app, 3) == nullptr);
+        SN_CHECK(keys.find(DesfireAID::picc(), 1) == nullptr);
+
+        DesfireAccessRights ar;
+        ar.readKey = 0x0E; ar.readWriteKey = 0x03;
+        SN_CHECK(keys.readKeyFor(app, ar) == 0x0E);            // serbest okuma
+        ar.readKey = 0x01; ar.readWriteKey = 0x02;
+        SN_CHECK(keys.readKeyFor(app, ar) == 0x01);            // read key önce
+        ar.readKey = 0x05;
+        SN_CHECK(keys.readKeyFor(app, ar) == 0x02);            // read&write key'e düş
+        ar.readWriteKey = 0x0F;
+        SN_CHECK(keys.readKeyFor(app, ar) == 0x0F);            // key yok → atla
+        SN_CHECK(keys.readKeyFor(DesfireAID::fromUint(0x999999), DesfireAccessRights::decode(0x12, 0x00)) == 0x0F);
+
+        // ── Rapor ───────────────────────────────────────────────────────────
+        DesfireSnapshotReport rep;
+        DesfireSnapshotEvent sel;
+        sel.step = DesfireSnapshotStep::Select;
+        sel.aid = app;
+        sel.micros = 1500;
+        rep.record(sel);
+        sel.micros = 500;
+        rep.record(sel);
+
+        DesfireSnapshotEvent rd;
+        rd.step = DesfireSnapshotStep::ReadData;
+        rd.aid = app;
+        rd.fileNo = 1;
+        rd.micros = 7000;
+        rd.bytes = 32;
+        rep.record(rd);
+
+        DesfireSnapshotEvent skip = rd;
+        skip.fileNo = 2;
+        skip.skipped = true;
+        skip.error = "no key for read access";
+        rep.record(skip);
+
+        SN_CHECK(rep.count(DesfireSnapshotStep::Select) == 2);
+        SN_CHECK(rep.micros(DesfireSnapshotStep::Select) == 2000);
+        SN_CHECK(rep.count(DesfireSnapshotStep::ReadData) == 1);   // atlanan sayılmaz
+        SN_CHECK(rep.filesRead == 1 && rep.bytesRead == 32);
+        SN_CHECK(rep.filesSkipped == 1);
+        SN_CHECK(rep.events.size() == 4);
+        SN_CHECK(rep.allOk());
+
+        DesfireSnapshotEvent fail;
+        fail.step = DesfireSnapshotStep::Authenticate;
+        fail.aid = app;
+        fail.ok = false;
+        fail.error = "auth mismatch";
+        rep.record(fail);
+        SN_CHECK(!rep.allOk());
+        SN_CHECK(rep.count(DesfireSnapshotStep::Authenticate) == 1);
+        SN_CHECK(rep.filesRead == 1);
+
+        std::ostringstream os;
+        rep.print(os);
+        const std::string out = os.str();
+        SN_CHECK(out.find("Select") != std::string::npos);
+        SN_CHECK(out.find("skip 010203 file 2") != std::string::npos);
+        SN_CHECK(out.find("FAIL 010203 [Authenticate] auth mismatch") != std::string::npos);
+        SN_CHECK(std::string(desfireSnapshotStepName(DesfireSnapshotStep::FileSettings)) == "FileSettings");
+
+#undef SN_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// TEST: DESFire Snapshot Refresh — refresh, bağlı metadata cache'i de aşar
+// ════════════════════════════════════════════════════════════════════════════════
+
+// Plain DESFire kartı: GetVersion (3 frame), GetApplicationIDs, Select, boş
+// GetFileIDs. Auth / dosya komutları desteklenmez.
+class SimDesfireReader : public ACR1281UReader {
+public:
+    std::vector<uint32_t> apps;
+    int versionFrame = 0;
+    int listApps     = 0;
+
+    explicit SimDesfireReader(PCSC& pcsc) : ACR1281UReader(pcsc, 16) {}
+
+    Result<ReaderResponse, PcscError> tryTransmit(const BYTEV& a) override {
+        using R = Result<ReaderResponse, PcscError>;
+        auto sw = [](BYTE s2, BYTEV d = {}) { return R::Ok(ReaderResponse{ std::move(d), StatusWord(0x91, s2) }); };
+        if (a.size() < 5 || a[0] != 0x90) return R::Ok(ReaderResponse{ {}, StatusWord(0x6E, 0x00) });
+
+        switch (a[1]) {
+        case 0x60:
+            versionFrame = 1;
+            return sw(0xAF, BYTEV{0x04, 0x01, 0x01, 0x01, 0x00, 0x18, 0x05});
+        case 0xAF:
+            if (versionFrame == 1) { versionFrame = 2; return sw(0xAF, BYTEV{0x04, 0x01, 0x01, 0x01, 0x00, 0x18, 0x05}); }
+            versionFrame = 0;
+            return sw(0x00, BYTEV{0x04, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0xBA, 0x00, 0x00, 0x00, 0x00, 0x12, 0x24});
+        case 0x6A: {
+            ++listApps;
+            BYTEV d;
+            for (uint32_t aid : apps) { d.push_back(BYTE(aid)); d.push_back(BYTE(aid >> 8)); d.push_back(BYTE(aid >> 16)); }
+            return sw(0x00, d);
+        }
+        case 0x5A:
+        case 0x6F:
+            return sw(0x00);
+        default:
+            return sw(0x1C);
+        }
+    }
+};
+
+bool testDesfireSnapshotRefresh() {
+    int line = 0;
+    try {
+#define SF_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        PCSC pcsc;
+        SimDesfireReader sim(pcsc);
+        sim.apps = {0x010203};
+
+        DesfireMetadataCache cache;
+        CardIO io(sim, CardType::MifareDesfire);
+        io.setDesfireMetadataCache(&cache);
+
+        DesfireSnapshotOptions opts;
+        opts.readData   = false;
+        opts.freeMemory = false;
+
+        // ── 1. İlk tarama cache'i doldurur ──────────────────────────────────
+        auto r1 = io.trySnapshotDesfire(opts);
+        SF_CHECK(r1.is_ok() && r1.unwrap().apps == 1);
+        SF_CHECK(sim.listApps == 1 && cache.size() == 1);
+
+        // ── 2. Kartta yeni app; refresh yoksa cache'ten cevaplanır ──────────
+        sim.apps.push_back(0x040506);
+        auto r2 = io.trySnapshotDesfire(opts);
+        SF_CHECK(r2.is_ok() && r2.unwrap().apps == 1);
+        SF_CHECK(r2.unwrap().count(DesfireSnapshotStep::ListApps) == 0);
+        SF_CHECK(sim.listApps == 1);
+
+        // ── 3. refresh: discovery'deki cache restore'u aşılır, cache güncellenir
+        opts.refresh = true;
+        auto r3 = io.trySnapshotDesfire(opts);
+        SF_CHECK(r3.is_ok() && r3.unwrap().apps == 2);
+        SF_CHECK(r3.unwrap().count(DesfireSnapshotStep::ListApps) == 1);
+        SF_CHECK(sim.listApps == 2);
+        SF_CHECK(io.card().getDesfireMemory().hasApp(DesfireAID::fromUint(0x040506)));
+
+        DesfireMemoryLayout back;
+        back.initFromVersion(io.card().getDesfireMemory().versionInfo);
+        SF_CHECK(cache.restore(back) && back.applications.size() == 2);
+
+#undef SF_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testDesfireEV2Auth() {
+    int line = 0;
+    try {
+#define E2_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        using SM = DesfireSecureMessaging;
+
+        // ── AN12343 vektörleri (key = 00..00) ─────────────────────────────
+        const BYTEV key(16, 0x00);
+        const BYTEV zeroIV(16, 0x00);
+        const BYTEV ekRndB = { 0xA0,0x4C,0x12,0x42,0x13,0xC1,0x86,0xF2,0x23,0x99,0xD3,0x3A,0xC2,0xA3,0x02,0x15 };
+        const BYTEV rndB   = { 0xB9,0xE2,0xFC,0x78,0x9B,0x64,0xBF,0x23,0x7C,0xCC,0xAA,0x20,0xEC,0x7E,0x6E,0x48 };
+        const BYTEV rndA   = { 0x13,0xC5,0xDB,0x8A,0x59,0x30,0x43,0x9F,0xC3,0xDE,0xF9,0xA4,0xC6,0x75,0x36,0x0F };
+
+        E2_CHECK(DesfireAuth::decryptNonce(ekRndB, key, DesfireKeyType::AES128) == rndB);
+        E2_CHECK(DesfireAuth::buildAuthEV2Payload(rndA, rndB, key) == BYTEV({
+            0x35,0xC3,0xE0,0x5A,0x75,0x2E,0x01,0x44,0xBA,0xC0,0xDE,0x51,0xC1,0xF2,0x2C,0x56,
+            0xB3,0x44,0x08,0xA2,0x3D,0x8A,0xEA,0x26,0x6C,0xAB,0x94,0x7E,0xA8,0xE0,0x11,0x8D }));
+
+        const BYTEV finalResp = {
+            0x3F,0xA6,0x4D,0xB5,0x44,0x6D,0x1F,0x34,0xCD,0x6E,0xA3,0x11,0x16,0x7F,0x5E,0x49,
+            0x85,0xB8,0x96,0x90,0xC0,0x4A,0x05,0xF1,0x7F,0xA7,0xAB,0x2F,0x08,0x12,0x06,0x63 };
+        std::array<BYTE, 4> ti{};
+        E2_CHECK(DesfireAuth::verifyAuthEV2Response(finalResp, rndA, key, true, ti));
+        E2_CHECK((ti == std::array<BYTE, 4>{ 0x9D,0x00,0xC4,0xDF }));
+        BYTEV wrongA = rndA;
+        wrongA[0] ^= 0x01;
+        E2_CHECK(!DesfireAuth::verifyAuthEV2Response(finalResp, wrongA, key, true, ti));
+
+        BYTEV encKey, macKey;
+        DesfireCrypto::deriveSessionKeysEV2(rndA, rndB, key, encKey, macKey);
+        E2_CHECK(encKey == BYTEV({ 0x13,0x09,0xC8,0x77,0x50,0x9E,0x5A,0x21,0x50,0x07,0xFF,0x0E,0xD1,0x9C,0xA5,0x64 }));
+        E2_CHECK(macKey == BYTEV({ 0x4C,0x66,0x26,0xF5,0xE7,0x2E,0xA6,0x94,0x20,0x21,0x39,0x29,0x5C,0x7A,0x7F,0xC7 }));
+
+        E2_CHECK(DesfireAuth::buildAuthEV2Cmd(0x03, true)  == BYTEV({ 0x90,0x71,0x00,0x00,0x02,0x03,0x00,0x00 }));
+        E2_CHECK(DesfireAuth::buildAuthEV2Cmd(0x03, false) == BYTEV({ 0x90,0x77,0x00,0x00,0x01,0x03,0x00 }));
+
+        // ── Simüle kart: First → NonFirst ─────────────────────────────────
+        const std::array<BYTE, 4> cardTI = { 0x11,0x22,0x33,0x44 };
+        BYTEV cardKey(16);
+        for (size_t i = 0; i < 16; ++i) cardKey[i] = static_cast<BYTE>(0x40 + i);
+        BYTEV cardRndB(16);
+        for (size_t i = 0; i < 16; ++i) cardRndB[i] = static_cast<BYTE>(0xB0 ^ i);
+        BYTEV seenRndA;
+        bool expectFirst = true;
+        int step = 0;
+
+        auto card = [&](const BYTEV& apdu) -> PcscResult<BYTEV> {
+            BYTEV resp;
+            if (++step == 1) {
+                if (apdu[1] != (expectFirst ? 0x71 : 0x77))
+                    return PcscResult<BYTEV>::Ok(BYTEV{ 0x91, 0x1C });
+                resp = crypto::block::encryptAesCbc(cardKey, zeroIV, cardRndB);
+                resp.push_back(0x91);
+                resp.push_back(0xAF);
+                return PcscResult<BYTEV>::Ok(resp);
+            }
+            BYTEV dec = crypto::block::decryptAesCbc(cardKey, zeroIV, apdu.data() + 5, apdu[4]);
+            seenRndA.assign(dec.begin(), dec.begin() + 16);
+            if (!std::equal(dec.begin() + 16, dec.end(), DesfireCrypto::rotateLeft(cardRndB).begin()))
+                return PcscResult<BYTEV>::Ok(BYTEV{ 0x91, 0xAE });
+            BYTEV plain;
+            if (expectFirst) plain.assign(cardTI.begin(), cardTI.end());
+            BYTEV rot = DesfireCrypto::rotateLeft(seenRndA);
+            plain.insert(plain.end(), rot.begin(), rot.end());
+            if (expectFirst) plain.resize(32, 0x00);         // PDcap2 || PCDcap2
+            resp = crypto::block::encryptAesCbc(cardKey, zeroIV, plain);
+            resp.push_back(0x91);
+            resp.push_back(0x00);
+            return PcscResult<BYTEV>::Ok(resp);
+        };
+
+        DesfireAuth auth;
+        DesfireSession host;
+        E2_CHECK(!auth.tryAuthenticateEV2NonFirst(host, cardKey, 0, card).is_ok());   // EV2 oturumu yok
+        E2_CHECK(step == 0);
+        E2_CHECK(!auth.tryAuthenticateEV2First(host, BYTEV(24, 0), 0, card).is_ok()); // AES değil
+        E2_CHECK(step == 0);
+
+        E2_CHECK(auth.tryAuthenticateEV2First(host, cardKey, 1, card).is_ok());
+        E2_CHECK(host.authenticated && host.isEV2());
+        E2_CHECK(host.authKeyNo == 1 && host.keyType == DesfireKeyType::AES128);
+        E2_CHECK(host.ti == cardTI && host.cmdCounter == 0);
+        BYTEV expEnc, expMac;
+        DesfireCrypto::deriveSessionKeysEV2(seenRndA, cardRndB, cardKey, expEnc, expMac);
+        E2_CHECK(host.sessionKey == expEnc && host.sessionMacKey == expMac);
+        E2_CHECK(host.macKey() == expMac);
+
+        // ── EV2 secure messaging: komut MAC'i ─────────────────────────────
+        auto cardMac = [&](BYTE head, uint16_t ctr, const BYTE* data, size_t len) {
+            BYTEV in = { head, static_cast<BYTE>(ctr), static_cast<BYTE>(ctr >> 8) };
+            in.insert(in.end(), cardTI.begin(), cardTI.end());
+            in.insert(in.end(), data, data + len);
+            return SM::truncateCMAC(crypto::block::cmacAes128(expMac, in));
+        };
+        auto cardIV = [&](BYTE l0, BYTE l1, uint16_t ctr) {
+            BYTEV blk = { l0, l1, cardTI[0], cardTI[1], cardTI[2], cardTI[3],
+                          static_cast<BYTE>(ctr), static_cast<BYTE>(ctr >> 8) };
+            blk.resize(16, 0x00);
+            return crypto::block::encryptAesCbc(expEnc, zeroIV, blk);
+        };
+
+        BYTEV getValue = DesfireCommands::getValue(0x04);
+        BYTEV apdu = getValue;
+        E2_CHECK(SM::tryProtectCommand(host, apdu, 1, DesfireCommMode::MAC).is_ok());
+        E2_CHECK(apdu.size() == getValue.size() + 8 && apdu[4] == 1 + 8);
+        BYTEV m0 = cardMac(0x6C, 0, getValue.data() + 5, 1);
+        E2_CHECK(std::equal(m0.begin(), m0.end(), apdu.begin() + 6));
+        E2_CHECK(host.cmdCounter == 0);
+
+        // Yanıt: MAC(status || ctr+1 || TI || data), sayaç önce artar
+        BYTEV value = { 0x10, 0x00, 0x00, 0x00 };
+        BYTEV resp = value;
+        BYTEV rm = cardMac(0x00, 1, value.data(), value.size());
+        resp.insert(resp.end(), rm.begin(), rm.end());
+        BYTEV badResp = resp;
+        E2_CHECK(SM::tryUnwrapInPlace(host, resp, 0x00, DesfireCommMode::MAC).is_ok());
+        E2_CHECK(resp == value && host.cmdCounter == 1);
+
+        DesfireSession stale = host;                        // aynı yanıt tekrar → sayaç tutmaz
+        E2_CHECK(!SM::tryUnwrapInPlace(stale, badResp, 0x00, DesfireCommMode::MAC).is_ok());
+
+        // ── Full: header açık, data M2 dolgulu ve IV = E(A55A||TI||ctr) ──
+        BYTEV payload(20);
+        for (size_t i = 0; i < payload.size(); ++i) payload[i] = static_cast<BYTE>(0xC0 + i);
+        BYTEV write = DesfireCommands::writeData(0x02, 0, payload);
+        apdu = write;
+        E2_CHECK(SM::tryProtectCommand(host, apdu, 7, DesfireCommMode::Full).is_ok());
+        E2_CHECK(apdu.size() == 5 + 7 + 32 + 8 + 1);
+        E2_CHECK(std::equal(write.begin() + 5, write.begin() + 12, apdu.begin() + 5));
+        BYTEV plainBody = crypto::block::decryptAesCbc(expEnc, cardIV(0xA5, 0x5A, 1), apdu.data() + 12, 32);
+        E2_CHECK(std::equal(payload.begin(), payload.end(), plainBody.begin()));
+        E2_CHECK(plainBody[20] == 0x80 && plainBody[31] == 0x00);
+        BYTEV m1 = cardMac(0x3D, 1, apdu.data() + 5, 7 + 32);
+        E2_CHECK(std::equal(m1.begin(), m1.end(), apdu.begin() + 44));
+
+        BYTEV ack = cardMac(0x00, 2, nullptr, 0);
+        E2_CHECK(SM::tryUnwrapInPlace(host, ack, 0x00, DesfireCommMode::MAC).is_ok());
+        E2_CHECK(ack.empty() && host.cmdCounter == 2);
+
+        // Full yanıt: IV = E(5AA5||TI||ctr+1), dolgu atılır
+        BYTEV data = { 1,2,3,4,5,6,7,8,9,10 };
+        BYTEV padded = data;
+        padded.push_back(0x80);
+        padded.resize(16, 0x00);
+        BYTEV enc = crypto::block::encryptAesCbc(expEnc, cardIV(0x5A, 0xA5, 3), padded);
+        BYTEV fm = cardMac(0x00, 3, enc.data(), enc.size());
+        enc.insert(enc.end(), fm.begin(), fm.end());
+        E2_CHECK(SM::tryUnwrapInPlace(host, enc, 0x00, DesfireCommMode::Full, data.size()).is_ok());
+        E2_CHECK(enc == data && host.cmdCounter == 3);
+
+        // Plain: MAC yok, sayaç yine artar
+        BYTEV plainResp = { 0xAA };
+        E2_CHECK(SM::tryUnwrapInPlace(host, plainResp, 0x00, DesfireCommMode::Plain).is_ok());
+        E2_CHECK(plainResp == BYTEV{ 0xAA } && host.cmdCounter == 4);
+
+        // ── NonFirst: TI ve sayaç korunur, session key'ler yenilenir ─────
+        step = 0;
+        expectFirst = false;
+        E2_CHECK(auth.tryAuthenticateEV2NonFirst(host, cardKey, 2, card).is_ok());
+        E2_CHECK(host.isEV2() && host.authKeyNo == 2);
+        E2_CHECK(host.ti == cardTI && host.cmdCounter == 4);
+        DesfireCrypto::deriveSessionKeysEV2(seenRndA, cardRndB, cardKey, expEnc, expMac);
+        E2_CHECK(host.sessionKey == expEnc && host.sessionMacKey == expMac);
+
+        // Yanlış key → mismatch, oturum düşer
+        step = 0;
+        expectFirst = true;
+        BYTEV wrongKey = cardKey;
+        wrongKey[15] ^= 0xFF;
+        E2_CHECK(!auth.tryAuthenticateEV2First(host, wrongKey, 1, card).is_ok());
+        E2_CHECK(!host.authenticated && !host.isEV2());
+
+#undef E2_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testDesfireKeyDiversification() {
+    int line = 0;
+    try {
+#define KD_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        const BYTEV master = { 0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77,0x88,0x99,0xAA,0xBB,0xCC,0xDD,0xEE,0xFF };
+        const BYTEV uid    = { 0x04,0x78,0x2E,0x21,0x80,0x1D,0x80 };
+        const DesfireAID aid = DesfireAID::fromUint(0xF54230);    // 30 42 F5
+        const BYTEV sysId  = { 0x4E,0x58,0x50,0x20,0x41,0x62,0x75 };  // "NXP Abu"
+
+        // ── AES-128: AN10922 örneği (M 17 byte → K2, iki blok) ───────────
+        DesfireKeyDiversifier aes(master, DesfireKeyType::AES128, sysId);
+        KD_CHECK(aes.keySize() == 16);
+        KD_CHECK(aes.diversify(uid, aid) == BYTEV({
+            0xA8,0xDD,0x63,0xA3,0xB8,0x9D,0x54,0xB3,0x7C,0xA8,0x02,0x47,0x3F,0xDA,0x91,0x75 }));
+
+        // Kısa M (10 byte): dolgu standart CMAC'ten farklı olarak iki bloğa tamamlanır
+        DesfireKeyDiversifier aesShort(master, DesfireKeyType::AES128);
+        BYTEV kShort = aesShort.diversify(uid, aid);
+        KD_CHECK(kShort == BYTEV({
+            0x0D,0xAA,0x19,0xEE,0xEA,0x04,0x34,0x0D,0xE3,0x8A,0x20,0x33,0x00,0x13,0x09,0x0D }));
+        BYTEV d = { 0x01 };
+        d.insert(d.end(), uid.begin(), uid.end());
+        d.insert(d.end(), aid.aid, aid.aid + 3);
+        KD_CHECK(kShort != crypto::block::cmacAes128(master, d));
+
+        // ── 2K3DES / 3K3DES: C = 21,22 / 31,32,33 ────────────────────────
+        const BYTEV nxp = { 0x4E,0x58,0x50 };
+        DesfireKeyDiversifier tdes2(master, DesfireKeyType::TwoDES, nxp);
+        KD_CHECK(tdes2.diversify(uid, aid) == BYTEV({
+            0xBC,0x5C,0xFA,0x33,0x44,0x11,0x7C,0x93,0xFE,0x0F,0x1E,0xC7,0xE5,0xD0,0xF8,0xD4 }));
+
+        BYTEV m7 = uid;
+        BYTEV k7(16);
+        tdes2.diversifyInput(m7.data(), m7.size(), k7.data());   // D 8 byte → 16'ya dolgu
+        KD_CHECK(k7 == BYTEV({
+            0x79,0xB9,0x59,0x40,0x3F,0xE2,0x7B,0x58,0x85,0x12,0x9A,0xBF,0xE1,0xE5,0x9A,0x05 }));
+
+        BYTEV master3 = master;
+        for (BYTE b = 1; b <= 8; ++b) master3.push_back(b);
+        DesfireKeyDiversifier tdes3(master3, DesfireKeyType::ThreeDES, nxp);
+        KD_CHECK(tdes3.keySize() == 24);
+        KD_CHECK(tdes3.diversify(uid, aid) == BYTEV({
+            0x2F,0x0D,0xD0,0x36,0x75,0xD3,0xFB,0x9A,0x57,0x05,0xAB,0x0B,0xDA,0x91,0xCA,0x0B,
+            0x55,0xB8,0xE0,0x7F,0xCD,0xBF,0x10,0xEC }));
+
+        // ── Toplu türetme = tek tek türetme ───────────────────────────────
+        std::vector<BYTEV> uids;
+        BYTEV flat;
+        for (int i = 0; i < 200; ++i) {
+            BYTEV u = uid;
+            u[5] = static_cast<BYTE>(i);
+            u[6] = static_cast<BYTE>(i * 7);
+            uids.push_back(u);
+            flat.insert(flat.end(), u.begin(), u.end());
+        }
+        std::vector<BYTEV> batch = aes.diversifyBatch(uids, aid);
+        KD_CHECK(batch.size() == uids.size());
+        BYTEV flatKeys(uids.size() * aes.keySize());
+        aes.diversifyBatch(flat.data(), uids.size(), aid, flatKeys.data());
+        for (size_t i = 0; i < uids.size(); i += 37) {
+            KD_CHECK(batch[i] == aes.diversify(uids[i], aid));
+            KD_CHECK(std::equal(batch[i].begin(), batch[i].end(), flatKeys.begin() + i * 16));
+        }
+        KD_CHECK(batch[0] != batch[1]);
+
+        // ── Hatalar ────────────────────────────────────────────────────────
+        KD_CHECK(!aes.tryDiversify(BYTEV(4, 0x01), aid).is_ok());
+        std::vector<BYTEV> bad = uids;
+        bad[3].pop_back();
+        KD_CHECK(!aes.tryDiversifyBatch(bad, aid).is_ok());
+        DesfireKeyDiversifier none;
+        KD_CHECK(!none.ready() && !none.tryDiversify(uid, aid).is_ok());
+        KD_CHECK(!none.trySetMasterKey(BYTEV(8, 0x00), DesfireKeyType::DES).is_ok());
+        KD_CHECK(!none.trySetMasterKey(BYTEV(24, 0x00), DesfireKeyType::AES128).is_ok());
+        KD_CHECK(!none.trySetMasterKey(master, DesfireKeyType::TwoDES, BYTEV(6, 0x00)).is_ok());   // M > 15
+        KD_CHECK(none.trySetMasterKey(master, DesfireKeyType::TwoDES, BYTEV(5, 0x00)).is_ok());
+        KD_CHECK(DesfireKeyDiversifier::maxInputSize(DesfireKeyType::AES128) == 31);
+
+#undef KD_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testDesfireAllocationFreeAuth() {
+    int line = 0;
+    try {
+#define NA_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        // ── Sabit tamponlar = BYTEV API ───────────────────────────────────
+        BYTEV a16(16), b16(16);
+        for (size_t i = 0; i < 16; ++i) { a16[i] = static_cast<BYTE>(0x30 + i); b16[i] = static_cast<BYTE>(0xC0 ^ i); }
+        DesfireNonce a, b;
+        a.assign(a16.data(), a16.size());
+        b.assign(b16.data(), b16.size());
+
+        DesfireNonce r = a;
+        DesfireCrypto::rotateLeft(r.data(), r.size());
+        NA_CHECK(r.toBytes() == DesfireCrypto::rotateLeft(a16));
+        DesfireCrypto::rotateRight(r.data(), r.size());
+        NA_CHECK(r.equals(a16.data(), a16.size()));
+
+        const DesfireKeyType types[] = { DesfireKeyType::AES128, DesfireKeyType::TwoDES, DesfireKeyType::ThreeDES };
+        for (DesfireKeyType kt : types) {
+            const size_t n = DesfireCrypto::nonceSize(kt);
+            BYTEV ka(a16.begin(), a16.begin() + n), kb(b16.begin(), b16.begin() + n);
+            DesfireNonce fa, fb;
+            fa.assign(ka.data(), n);
+            fb.assign(kb.data(), n);
+            DesfireSessionKey sk;
+            DesfireCrypto::deriveSessionKey(fa, fb, kt, sk);
+            NA_CHECK(sk.toBytes() == DesfireCrypto::deriveSessionKey(ka, kb, kt));
+
+            BYTEV key(DesfireCrypto::keySize(kt));
+            for (size_t i = 0; i < key.size(); ++i) key[i] = static_cast<BYTE>(i * 11 + 3);
+            BYTEV iv(DesfireCrypto::blockSize(kt), 0x5A);
+            DesfireAuthBlock payload;
+            DesfireCrypto::buildAuthPayload(fa, fb, key, kt, iv.data(), payload);
+            NA_CHECK(payload.size() == 2 * n);
+            NA_CHECK(payload.toBytes() == DesfireCrypto::buildAuthPayload(ka, kb, key, kt, iv));
+        }
+        r.wipe();
+        NA_CHECK(r.size() == 0 && r[0] == 0 && r[15] == 0);
+
+        // ── El sıkışma: ısınmadan sonra host tarafında sıfır heap ─────────
+        const BYTEV key(16, 0x2B);
+        const BYTEV zeroIV(16, 0x00);
+        BYTEV cardRndB(16);
+        for (size_t i = 0; i < 16; ++i) cardRndB[i] = static_cast<BYTE>(0x90 + i);
+        const BYTEV encRndB = crypto::block::encryptAesCbc(key, zeroIV, cardRndB);
+
+        size_t cardAllocs = 0;                  // kart simülasyonunun kendi ayırmaları
+        BYTEV seenRndA;
+        auto card = [&](const BYTEV& apdu) -> PcscResult<BYTEV> {
+            const size_t before = g_heapAllocs;
+            BYTEV resp;
+            if (apdu[1] == 0xAA) {
+                resp = encRndB;
+                resp.push_back(0x91);
+                resp.push_back(0xAF);
+            } else {
+                BYTEV iv(encRndB.end() - 16, encRndB.end());
+                BYTEV enc(apdu.begin() + 5, apdu.begin() + 5 + apdu[4]);
+                BYTEV dec = crypto::block::decryptAesCbc(key, iv, enc);
+                seenRndA.assign(dec.begin(), dec.begin() + 16);
+                BYTEV iv2(enc.end() - 16, enc.end());
+                resp = crypto::block::encryptAesCbc(key, iv2, DesfireCrypto::rotateLeft(seenRndA));
+                resp.push_back(0x91);
+                resp.push_back(0x00);
+            }
+            PcscResult<BYTEV> out = PcscResult<BYTEV>::Ok(std::move(resp));
+            cardAllocs += g_heapAllocs - before;
+            return out;
+        };
+
+        DesfireAuth auth;
+        DesfireSession session;
+        NA_CHECK(auth.tryAuthenticate(session, key, 0, DesfireKeyType::AES128, card).is_ok());   // ısınma
+
+        cardAllocs = 0;
+        const size_t before = g_heapAllocs;
+        const bool ok = auth.tryAuthenticate(session, key, 0, DesfireKeyType::AES128, card).is_ok();
+        const size_t hostAllocs = g_heapAllocs - before - cardAllocs;
+        NA_CHECK(ok);
+        NA_CHECK(cardAllocs > 0);                   // sayaç gerçekten çalışıyor
+        NA_CHECK(hostAllocs == 0);
+        NA_CHECK(session.authenticated && session.iv == BYTEV(16, 0x00));
+        NA_CHECK(session.sessionKey == DesfireCrypto::deriveSessionKey(seenRndA, cardRndB, DesfireKeyType::AES128));
+        NA_CHECK(session.cmac.boundTo(crypto::block::CmacAlgo::AES128, session.sessionKey));
+
+        // Yanlış key: SW hatası değil, doğrulama hatası → AuthMismatch
+        BYTEV wrong = key;
+        wrong[0] ^= 0x01;
+        auto bad = auth.tryAuthenticate(session, wrong, 0, DesfireKeyType::AES128, card);
+        NA_CHECK(!bad.is_ok() && !session.authenticated);
+
+        // Kart hata SW'si → hata kartın SW'sinden gelir (önceden Ok sonucun error'ü okunuyordu)
+        auto denied = [](const BYTEV&) { return PcscResult<BYTEV>::Ok(BYTEV{ 0x91, 0xAE }); };
+        auto e = auth.tryAuthenticate(session, key, 0, DesfireKeyType::AES128, denied);
+        NA_CHECK(!e.is_ok());
+
+        // Cmac.clear() context'i tutar: yeniden bağlanma aynı MAC'i verir
+        crypto::block::Cmac mac(crypto::block::CmacAlgo::AES128, key);
+        BYTE m1[16], m2[16];
+        mac.compute(nullptr, cardRndB.data(), cardRndB.size(), m1);
+        mac.clear();
+        NA_CHECK(!mac.ready());
+        mac.setKey(crypto::block::CmacAlgo::AES128, key);
+        mac.compute(nullptr, cardRndB.data(), cardRndB.size(), m2);
+        NA_CHECK(std::memcmp(m1, m2, 16) == 0);
+
+#undef NA_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testDesfireIndexedLookups() {
+    int line = 0;
+    try {
+#define IX_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        // ── 28 app × 32 dosya: tüm girdiler bulunur ───────────────────────
+        DesfireMemoryLayout mem;
+        for (uint32_t a = 0; a < 28; ++a) {
+            DesfireApplication& app = mem.ensureApp(DesfireAID::fromUint(0x100000 + a * 0x40));   // sık çakışan AID'ler
+            for (BYTE f = 0; f < 32; ++f) {
+                DesfireFile& file = app.ensureFile(static_cast<BYTE>(31 - f));
+                file.data.assign(48, static_cast<BYTE>(a ^ f));
+            }
+        }
+        IX_CHECK(mem.applications.size() == 28);
+        for (uint32_t a = 0; a < 28; ++a) {
+            const DesfireAID aid = DesfireAID::fromUint(0x100000 + a * 0x40);
+            const DesfireApplication* app = mem.findApp(aid);
+            IX_CHECK(app && app->aid == aid && app == &mem.applications[a]);
+            for (BYTE f = 0; f < 32; ++f) {
+                const DesfireFile* file = app->findFile(f);
+                IX_CHECK(file && file->fileNo == f);
+            }
+        }
+        IX_CHECK(!mem.findApp(DesfireAID::fromUint(0x100001)));
+        IX_CHECK(!mem.applications[0].findFile(0x20));
+
+        // ── Listeyi doğrudan değiştiren kod: indeks kendini onarır ────────
+        DesfireApplication extra;
+        extra.aid = DesfireAID::fromUint(0xABCDEF);
+        DesfireFile f40;
+        f40.fileNo = 40;                                    // tablo dışı → tarama
+        extra.files.push_back(f40);
+        mem.applications.push_back(extra);
+        IX_CHECK(mem.findApp(DesfireAID::fromUint(0xABCDEF)));
+        IX_CHECK(mem.findApp(DesfireAID::fromUint(0xABCDEF))->findFile(40));
+
+        IX_CHECK(mem.removeApp(DesfireAID::fromUint(0x100000)));
+        IX_CHECK(!mem.findApp(DesfireAID::fromUint(0x100000)));
+        IX_CHECK(mem.findApp(DesfireAID::fromUint(0x100040)) == &mem.applications[0]);
+
+        // Aynı boyutta yerinde atama (tampon yeniden kullanılır)
+        std::vector<DesfireApplication> swapped = mem.applications;
+        for (auto& app : swapped) app.aid = DesfireAID::fromUint(app.aid.toUint() + 1);
+        mem.applications = swapped;
+        IX_CHECK(!mem.findApp(DesfireAID::fromUint(0x100040)));
+        IX_CHECK(mem.findApp(DesfireAID::fromUint(0x100041)));
+
+        DesfireApplication& app0 = mem.applications[0];
+        app0.files[0].fileNo = 0x25;                        // yerinde yeniden adlandırma (31 → tablo dışı)
+        IX_CHECK(!app0.findFile(0x1F));
+        IX_CHECK(app0.findFile(0x25) == &app0.files[0]);
+        IX_CHECK(app0.findFile(0x1E) == &app0.files[1]);
+
+        // ── Aktif dosya önbelleği ─────────────────────────────────────────
+        DesfireMemoryLayout card;
+        DesfireApplication& a1 = card.ensureApp(DesfireAID::fromUint(0x010203));
+        for (BYTE f = 0; f < 4; ++f) {
+            DesfireFile& file = a1.ensureFile(f);
+            file.data.resize(40);
+            for (size_t i = 0; i < file.data.size(); ++i) file.data[i] = static_cast<BYTE>(f * 0x10 + i);
+        }
+        card.selectApplication(DesfireAID::fromUint(0x010203));
+        card.selectFile(2);
+        IX_CHECK(card.activeFile() == a1.findFile(2));
+        IX_CHECK(card.virtualBlockCount() == 3);
+        BYTE blk[16];
+        IX_CHECK(card.readVirtualBlock(2, blk) && blk[0] == 0x20 + 32 && blk[8] == 0x00);
+        BYTE in[16];
+        std::memset(in, 0xEE, sizeof(in));
+        IX_CHECK(card.writeVirtualBlock(1, in));
+        IX_CHECK(a1.findFile(2)->data[16] == 0xEE && a1.findFile(2)->data[31] == 0xEE);
+
+        card.currentFile = 3;                               // doğrudan alan ataması da izlenir
+        IX_CHECK(card.activeFile() && card.activeFile()->fileNo == 3);
+        IX_CHECK(a1.removeFile(3));
+        IX_CHECK(!card.activeFile());
+        card.selectFile(1);
+        a1.files.insert(a1.files.begin(), DesfireFile{});   // konumlar kayar
+        a1.files[0].fileNo = 9;
+        IX_CHECK(card.activeFile() && card.activeFile()->fileNo == 1);
+
+        DesfireMemoryLayout copy = card;                    // kopya kendi vector'üne bağlanır
+        copy.applications[0].findFile(1)->data[0] = 0x77;
+        IX_CHECK(copy.activeFile()->data[0] == 0x77);
+        IX_CHECK(card.activeFile()->data[0] == 0x10);
+
+        card.selectApplication(DesfireAID::picc());
+        IX_CHECK(!card.activeFile() && card.virtualBlockCount() == 0);
+
+#undef IX_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testDesfireDataViews() {
+    int line = 0;
+    try {
+#define DV_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        DesfireMemoryLayout mem;
+        DesfireApplication& app = mem.ensureApp(DesfireAID::fromUint(0x0A0B0C));
+        DesfireFile& file = app.ensureFile(1);
+        file.data.resize(70);                               // 4 tam + 1 kısa (6 byte) blok
+        for (size_t i = 0; i < file.data.size(); ++i) file.data[i] = static_cast<BYTE>(i);
+
+        // ── Dosya görünümü: aynı bellek, kopya yok ────────────────────────
+        DesfireDataView v = file.view();
+        DV_CHECK(v.data() == file.data.data() && v.size() == 70);
+        DV_CHECK(v.blockCount() == 5);
+        DV_CHECK(v.block(4).size() == 6 && v.block(4)[0] == 64);
+        DV_CHECK(v.block(5).empty());
+        DV_CHECK(v.subspan(60, 100).size() == 10);          // kırpılır
+        DV_CHECK(v.subspan(70).empty());
+
+        // ── Aktif dosya blok aralıkları ───────────────────────────────────
+        DV_CHECK(mem.activeView().empty());                 // bağlam yok
+        mem.selectApplication(app.aid);
+        mem.selectFile(1);
+        DV_CHECK(mem.activeView().data() == file.data.data());
+        DV_CHECK(mem.virtualBlockCount() == 5);
+
+        DesfireDataView mid = mem.virtualBlockView(1, 2);
+        DV_CHECK(mid.data() == file.data.data() + 16 && mid.size() == 32);
+        DV_CHECK(mem.virtualBlockView(3, 10).size() == 16 + 6);
+        DV_CHECK(mem.virtualBlockView(5).empty() && mem.virtualBlockView(-1).empty());
+        DV_CHECK(mem.virtualBlockView(0, 0).empty());
+
+        // readVirtualBlock dolgulu kopya davranışını korur
+        BYTE blk[16];
+        std::memset(blk, 0xCC, sizeof(blk));
+        DV_CHECK(mem.readVirtualBlock(4, blk) && blk[5] == 69 && blk[6] == 0x00 && blk[15] == 0x00);
+        DV_CHECK(!mem.readVirtualBlock(5, blk));
+
+        // ── Yerinde işleme: 4 tam blok AES-CBC ile şifrele / çöz ──────────
+        const BYTEV key(16, 0x42);
+        DesfireDataSpan whole = mem.virtualBlockSpan(0, 4);
+        DV_CHECK(whole.size() == 64);
+        const BYTEV before = whole.toBytes();
+        crypto::block::cbcInto(crypto::block::CbcAlgo::AES128, true, key.data(), key.size(), nullptr,
+                               whole.data(), whole.size(), whole.data());
+        DV_CHECK(std::equal(file.data.begin(), file.data.begin() + 64,
+                            crypto::block::encryptAesCbc(key, BYTEV(16, 0), before).begin()));
+        DV_CHECK(file.data[64] == 64);                      // aralık dışı dokunulmadı
+        crypto::block::cbcInto(crypto::block::CbcAlgo::AES128, false, key.data(), key.size(), nullptr,
+                               whole.data(), whole.size(), whole.data());
+        DV_CHECK(whole.toBytes() == before);
+
+        // Mutable → const dönüşümü ve kısa son bloğa yazma
+        DesfireDataSpan last = mem.virtualBlockSpan(4);
+        DesfireDataView lastView = last;
+        std::fill(last.begin(), last.end(), 0xAB);
+        DV_CHECK(lastView.size() == 6 && file.data[69] == 0xAB);
+        BYTE in[16];
+        std::memset(in, 0x5C, sizeof(in));
+        DV_CHECK(mem.writeVirtualBlock(4, in) && file.data.size() == 70 && file.data[69] == 0x5C);
+
+#undef DV_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testDesfireRecordPages() {
+    int line = 0;
+    try {
+#define RP_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        // Simüle kart: 20 × 12 byte cyclic record; kayıt = ts(4 LE) + tutar(4 LE) + 4 byte
+        // Offset 0 en yeni kayıt → ts offset arttıkça azalır.
+        const uint32_t RS = 12, N = 20;
+        auto recordAt = [&](uint32_t off) {
+            BYTEV r(RS, 0);
+            const uint32_t ts = 1000 - off * 10, amount = off * 3;
+            for (int i = 0; i < 4; ++i) { r[i] = static_cast<BYTE>(ts >> (8 * i)); r[4 + i] = static_cast<BYTE>(amount >> (8 * i)); }
+            r[8] = static_cast<BYTE>(off);
+            return r;
+        };
+
+        using TxResult = Result<BYTEV, PcscError>;
+        BYTEV pending;
+        int commands = 0, failAt = -1;
+        size_t maxResp = 0;
+        auto frameOut = [&]() -> TxResult {
+            const size_t n = std::min<size_t>(59, pending.size());
+            BYTEV resp(pending.begin(), pending.begin() + n);
+            pending.erase(pending.begin(), pending.begin() + n);
+            resp.push_back(0x91);
+            resp.push_back(pending.empty() ? 0x00 : 0xAF);
+            return TxResult::Ok(resp);
+        };
+        auto transmit = [&](const BYTEV& apdu) -> TxResult {
+            if (apdu[1] == 0xAF) return frameOut();
+            if (++commands == failAt)
+                return TxResult::Err(Error<PcscError>(IoError::ReadFailed).detail("RF field lost"));
+            const uint32_t off = DesfireCommands::readLE24(&apdu[6]);
+            uint32_t cnt = DesfireCommands::readLE24(&apdu[9]);
+            if (cnt == 0) cnt = N - off;
+            if (off + cnt > N) return TxResult::Ok(BYTEV{ 0x91, 0xBE });     // BOUNDARY
+            pending.clear();
+            for (uint32_t i = 0; i < cnt; ++i) {
+                const BYTEV r = recordAt(off + i);
+                pending.insert(pending.end(), r.begin(), r.end());
+            }
+            maxResp = std::max(maxResp, pending.size());
+            return frameOut();
+        };
+        auto fetch = [&](const BYTEV& cmd, size_t) { return DesfireCommands::tryTransceive(transmit, cmd); };
+
+        DesfireFileSettings fs;
+        fs.fileType = DesfireFileType::CyclicRecord;
+        fs.commMode = DesfireCommMode::Plain;
+        fs.record.recordSize = RS;
+        fs.record.maxRecords = 24;
+        fs.record.currentRecords = N;
+
+        // ── Sayfa boyutu: frame payload'ına sığan kayıt ───────────────────
+        RP_CHECK(DesfireCommands::recordsPerPage(12, 59, DesfireCommMode::Plain) == 4);
+        RP_CHECK(DesfireCommands::recordsPerPage(12, 59, DesfireCommMode::MAC) == 4);
+        RP_CHECK(DesfireCommands::recordsPerPage(12, 59, DesfireCommMode::Full) == 3);
+        RP_CHECK(DesfireCommands::recordsPerPage(200, 59, DesfireCommMode::Plain) == 1);
+
+        // ── Tüm kayıtlar: 5 sayfa, her yanıt tek frame, sıralı view'lar ───
+        std::vector<uint32_t> seen;
+        bool sized = true;
+        auto all = DesfireCommands::tryReadRecordPages(fetch, 0x03, fs,
+            [&](uint32_t off, DesfireDataView rec) {
+                sized = sized && rec.size() == RS && rec.toBytes() == recordAt(off);
+                seen.push_back(off);
+                return true;
+            });
+        RP_CHECK(all.is_ok());
+        RP_CHECK(all.unwrap().records == N && all.unwrap().pages == 5 && !all.unwrap().stopped);
+        RP_CHECK(all.unwrap().nextOffset == N);
+        RP_CHECK(sized && seen.size() == N && seen.front() == 0 && seen.back() == N - 1);
+        RP_CHECK(maxResp <= 59);
+
+        // ── Erken durma: ts < 905 olan ilk kayıtta dur (offset 10) ────────
+        commands = 0;
+        uint32_t olderAt = 0xFFFFFF;
+        auto early = DesfireCommands::tryReadRecordPages(fetch, 0x03, fs,
+            [&](uint32_t off, DesfireDataView rec) {
+                const uint32_t ts = rec[0] | (rec[1] << 8) | (rec[2] << 16) | (static_cast<uint32_t>(rec[3]) << 24);
+                if (ts >= 905) return true;
+                olderAt = off;
+                return false;
+            });
+        RP_CHECK(early.is_ok() && early.unwrap().stopped);
+        RP_CHECK(olderAt == 10 && early.unwrap().records == 11 && early.unwrap().nextOffset == 11);
+        RP_CHECK(commands == 3 && early.unwrap().pages == 3);        // 4 + 4 + 3'üncü sayfada dur
+
+        // ── Offset / count / sabit sayfa boyutu ───────────────────────────
+        DesfireRecordOptions opt;
+        opt.offset = 15;
+        opt.count = 100;                                 // kalan 5'e kırpılır
+        opt.recordsPerPage = 2;
+        seen.clear();
+        auto tail = DesfireCommands::tryReadRecordPages(fetch, 0x03, fs,
+            [&](uint32_t off, DesfireDataView) { seen.push_back(off); return true; }, opt);
+        RP_CHECK(tail.is_ok() && tail.unwrap().pages == 3 && seen == std::vector<uint32_t>({ 15, 16, 17, 18, 19 }));
+
+        opt.offset = N;
+        auto none = DesfireCommands::tryReadRecordPages(fetch, 0x03, fs,
+            [&](uint32_t, DesfireDataView) { return true; }, opt);
+        RP_CHECK(none.is_ok() && none.unwrap().pages == 0 && none.unwrap().nextOffset == N);
+
+        // ── Kopma: onaylı kayıtlar teslim edilmiş, hata devam noktasını verir
+        commands = 0; failAt = 3;
+        uint32_t delivered = 0;
+        auto torn = DesfireCommands::tryReadRecordPages(fetch, 0x03, fs,
+            [&](uint32_t, DesfireDataView) { ++delivered; return true; });
+        RP_CHECK(!torn.is_ok() && delivered == 8);
+        RP_CHECK(torn.unwrap_error().detail.find("resume at record 8") != std::string::npos);
+        failAt = -1;
+
+        // Önbellekteki sayı eski (karttakinden fazla) → BOUNDARY kart hatası
+        DesfireFileSettings stale = fs;
+        stale.record.currentRecords = N + 1;
+        opt = DesfireRecordOptions{};
+        opt.offset = 16;
+        auto bad = DesfireCommands::tryReadRecordPages(fetch, 0x03, stale,
+            [&](uint32_t, DesfireDataView) { return true; }, opt);
+        RP_CHECK(!bad.is_ok());
+
+        // Record olmayan dosya reddedilir
+        DesfireFileSettings std_;
+        std_.fileType = DesfireFileType::StandardData;
+        RP_CHECK(!DesfireCommands::tryReadRecordPages(fetch, 0x01, std_,
+            [&](uint32_t, DesfireDataView) { return true; }).is_ok());
+
+#undef RP_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testDesfireTransaction() {
+    int line = 0;
+    try {
+#define TX_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        using VoidResult = Result<void, PcscError>;
+        using FsResult   = Result<DesfireFileSettings, PcscError>;
+
+        // Uygulama: 1 = value (debit key 1), 2 = cyclic log 16 byte, 3 = backup 32 byte, 4 = std (key 2)
+        std::map<BYTE, DesfireFileSettings> files;
+        DesfireFileSettings v;
+        v.fileType = DesfireFileType::Value;
+        v.commMode = DesfireCommMode::MAC;
+        v.access   = DesfireAccessRights{ 0x01, 0x0F, 0x02, 0x00 };
+        v.value.upperLimit = 10000;
+        files[1] = v;
+        DesfireFileSettings log;
+        log.fileType = DesfireFileType::CyclicRecord;
+        log.commMode = DesfireCommMode::Full;
+        log.access   = DesfireAccessRights{ 0x01, 0x01, 0x01, 0x00 };
+        log.record.recordSize = 16;
+        log.record.maxRecords = 10;
+        log.record.currentRecords = 10;
+        files[2] = log;
+        DesfireFileSettings bk;
+        bk.fileType = DesfireFileType::BackupData;
+        bk.access   = DesfireAccessRights{ 0x0E, 0x0E, 0x0E, 0x00 };
+        bk.standard.fileSize = 32;
+        files[3] = bk;
+        DesfireFileSettings lin = log;
+        lin.fileType = DesfireFileType::LinearRecord;
+        lin.commMode = DesfireCommMode::Plain;
+        files[5] = lin;                                 // dolu linear
+
+        int lookups = 0;
+        auto settingsOf = [&](BYTE fileNo) {
+            ++lookups;
+            auto it = files.find(fileNo);
+            if (it == files.end())
+                return FsResult::Err(Error<PcscError>(DesfireError::FileNotFound).detail("no such file"));
+            return FsResult::Ok(it->second);
+        };
+
+        std::vector<BYTE> sent;                         // INS sırası
+        int failIns = -1;
+        auto send = [&](const DesfireTxStep& s) {
+            sent.push_back(s.apdu[1]);
+            if (s.apdu[1] == failIns)
+                return VoidResult::Err(Error<PcscError>(DesfireError::Generic).detail("card said no"));
+            return VoidResult::Ok();
+        };
+
+        DesfireTransaction tx;
+        tx.debit(1, 250)
+          .appendRecord(2, BYTEV(16, 0x11))
+          .writeData(3, 4, BYTEV(8, 0x22));
+        TX_CHECK(tx.size() == 3 && !tx.prepared());
+        TX_CHECK(tx.steps()[0].apdu == DesfireCommands::debit(1, 250));
+        TX_CHECK(tx.steps()[1].apdu == DesfireCommands::appendRecord(2, BYTEV(16, 0x11)));
+        TX_CHECK(tx.steps()[2].headerLen == 7 && tx.steps()[2].length == 8);
+
+        // ── Hazırlık: oturumsuz → MAC/Full dosyalar reddedilir, karta gidilmez
+        DesfireTransactionReport rep;
+        TX_CHECK(!tx.tryPrepare(settingsOf, -1).is_ok());
+        TX_CHECK(!tx.tryRun(send, rep).is_ok() && sent.empty());
+
+        // Yanlış key (2): debit read key 1 / rw 2 → izinli; log write key 1 → red
+        auto wrongKey = tx.tryPrepare(settingsOf, 2);
+        TX_CHECK(!wrongKey.is_ok());
+        TX_CHECK(wrongKey.error().detail.find("transaction step 1: AppendRecord") != std::string::npos);
+
+        // Key 1 ile hazır; comm mode'lar sabitlenir
+        lookups = 0;
+        TX_CHECK(tx.tryPrepare(settingsOf, 1).is_ok() && tx.prepared());
+        TX_CHECK(lookups == 3);
+        TX_CHECK(tx.steps()[0].mode == DesfireCommMode::MAC && tx.steps()[1].mode == DesfireCommMode::Full);
+
+        // ── Başarılı yürütme: 3 adım + tek commit, arada sorgu yok ──────────
+        lookups = 0;
+        TX_CHECK(tx.tryRun(send, rep).is_ok());
+        TX_CHECK(lookups == 0);
+        TX_CHECK(sent == std::vector<BYTE>({ 0xDC, 0x3B, 0x3D, 0xC7 }));
+        TX_CHECK(rep.committed && !rep.aborted && rep.failedStep == -1);
+        TX_CHECK(rep.events.size() == 4 && rep.count(DesfireTxOp::Commit) == 1);
+        TX_CHECK(rep.events[2].op == DesfireTxOp::WriteData && rep.events[2].fileNo == 3);
+        std::ostringstream os;
+        rep.print(os);
+        TX_CHECK(os.str().find("committed") != std::string::npos && os.str().find("AppendRecord") != std::string::npos);
+
+        // ── Ortadaki adım hatası → kalanlar gönderilmez, abort gönderilir ──
+        sent.clear(); rep = DesfireTransactionReport{}; failIns = 0x3B;
+        auto mid = tx.tryRun(send, rep);
+        TX_CHECK(!mid.is_ok());
+        TX_CHECK(sent == std::vector<BYTE>({ 0xDC, 0x3B, 0xA7 }));
+        TX_CHECK(rep.failedStep == 1 && rep.aborted && !rep.committed);
+        TX_CHECK(!rep.events[1].ok && rep.events.back().op == DesfireTxOp::Abort);
+        TX_CHECK(mid.error().detail.find("step 1: AppendRecord, aborted") != std::string::npos);
+
+        // Commit hatası da abort ile kapanır
+        sent.clear(); rep = DesfireTransactionReport{}; failIns = 0xC7;
+        TX_CHECK(!tx.tryRun(send, rep).is_ok());
+        TX_CHECK(sent.back() == 0xA7 && rep.failedStep == 3 && rep.aborted);
+
+        // Abort da başarısız → rapor bunu söyler
+        sent.clear(); rep = DesfireTransactionReport{}; failIns = 0xDC;
+        auto sendAbortFails = [&](const DesfireTxStep& s) {
+            sent.push_back(s.apdu[1]);
+            if (s.apdu[1] == 0xDC || s.apdu[1] == 0xA7)
+                return VoidResult::Err(Error<PcscError>(IoError::ReadFailed).detail("RF field lost"));
+            return VoidResult::Ok();
+        };
+        auto lost = tx.tryRun(sendAbortFails, rep);
+        TX_CHECK(!lost.is_ok() && !rep.aborted && sent.size() == 2);
+        TX_CHECK(lost.error().detail.find("abort failed") != std::string::npos);
+
+        // ── Doğrulama kuralları ────────────────────────────────────────────
+        auto rejects = [&](DesfireTransaction t) { return !t.tryPrepare(settingsOf, 1).is_ok(); };
+        TX_CHECK(rejects(DesfireTransaction{}));                                  // boş
+        TX_CHECK(rejects(DesfireTransaction{}.credit(1, 10)));                    // credit: rw key 2 gerekir
+        TX_CHECK(DesfireTransaction{}.credit(1, 10).tryPrepare(settingsOf, 2).is_ok());
+        TX_CHECK(rejects(DesfireTransaction{}.debit(1, -5)));                     // negatif
+        TX_CHECK(rejects(DesfireTransaction{}.debit(3, 5)));                      // value değil
+        TX_CHECK(rejects(DesfireTransaction{}.appendRecord(2, BYTEV(15))));       // recordSize
+        TX_CHECK(rejects(DesfireTransaction{}.appendRecord(5, BYTEV(16))));       // linear dolu
+        TX_CHECK(rejects(DesfireTransaction{}.writeData(3, 30, BYTEV(4))));       // taşma
+        TX_CHECK(rejects(DesfireTransaction{}.writeData(9, 0, BYTEV(4))));        // dosya yok
+        TX_CHECK(!rejects(DesfireTransaction{}.writeData(3, 28, BYTEV(4))));      // sınırda
+
+        // Adım eklemek hazırlığı düşürür
+        tx.debit(1, 1);
+        TX_CHECK(!tx.prepared());
+        tx.clear();
+        TX_CHECK(tx.empty());
+
+#undef TX_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool testDesfireAuthCache() {
+    int line = 0;
+    try {
+#define AC_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        const DesfireAID app1 = DesfireAID::fromUint(0x010203);
+        const DesfireAID app2 = DesfireAID::fromUint(0x040506);
+
+        DesfireSession s;
+        s.currentAID = app1;
+        s.authKeyNo  = 1;
+        s.keyType    = DesfireKeyType::AES128;
+        s.authMode   = DesfireAuthMode::Legacy;
+
+        DesfireAuthCache cache;
+        AC_CHECK(cache.empty() && !cache.find(app1));
+
+        // ── Başarılı auth → app başına tek girdi ─────────────────────────
+        cache.remember(s, BYTEV(16, 0x11));
+        const DesfireAuthRef* r = cache.find(app1);
+        AC_CHECK(r && r->keyNo == 1 && r->keyType == DesfireKeyType::AES128);
+        AC_CHECK(r->mode == DesfireAuthMode::Legacy && r->key == BYTEV(16, 0x11));
+
+        // Aynı app'te farklı key ile yeni auth girdiyi günceller
+        s.authKeyNo = 2;
+        s.authMode  = DesfireAuthMode::EV2;
+        cache.remember(s, BYTEV(16, 0x22));
+        AC_CHECK(cache.size() == 1);
+        r = cache.find(app1);
+        AC_CHECK(r->keyNo == 2 && r->mode == DesfireAuthMode::EV2 && r->key == BYTEV(16, 0x22));
+
+        // Kendi key'i ile yeniden remember (CardIO yeniden auth yolu) bozulmaz
+        cache.remember(s, r->key);
+        AC_CHECK(cache.find(app1)->key == BYTEV(16, 0x22));
+
+        // Farklı app ve PICC
+        s.currentAID = app2;
+        s.authKeyNo  = 0;
+        s.keyType    = DesfireKeyType::TwoDES;
+        s.authMode   = DesfireAuthMode::Legacy;
+        cache.remember(s, BYTEV(16, 0x33));
+        s.currentAID = DesfireAID::picc();
+        cache.remember(s, BYTEV(16, 0x44));
+        AC_CHECK(cache.size() == 3);
+        AC_CHECK(cache.find(app2)->keyType == DesfireKeyType::TwoDES);
+
+        // ── forget / keepOnly / clear ────────────────────────────────────
+        cache.forget(app2);
+        AC_CHECK(cache.size() == 2 && !cache.find(app2));
+        cache.forget(app2);                                 // yoksa etkisiz
+        AC_CHECK(cache.size() == 2);
+        cache.keepOnly(DesfireAID::picc());                 // FormatPICC sonrası
+        AC_CHECK(cache.size() == 1 && cache.find(DesfireAID::picc()) && !cache.find(app1));
+        cache.clear();
+        AC_CHECK(cache.empty());
+
+        // Silinen key byte'ları üzerine yazılır
+        DesfireAuthRef ref;
+        ref.key = BYTEV(16, 0x55);
+        const BYTE* raw = ref.key.data();              // clear() kapasiteyi bırakmaz
+        ref.wipe();
+        AC_CHECK(ref.key.empty() && raw[0] == 0 && raw[15] == 0);
+
+#undef AC_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+// ════════════════════════════════════════════════════════════════════════════════
+// TEST: DESFire Profile — declarative personalisation compiled to an APDU script
+// ════════════════════════════════════════════════════════════════════════════════
+
+bool testDesfireProfile() {
+    int line = 0;
+    try {
+#define PR_CHECK(cond) do { line = __LINE__; if (!(cond)) { cout << "    FAIL at line " << line << ": " #cond "\n"; return false; } } while(0)
+
+        using VoidResult = Result<void, PcscError>;
+        const DesfireAID aid = DesfireAID::fromUint(0x010203);
+        const DesfireAccessRights freeAcc{ 0x0E, 0x0E, 0x0E, 0x00 };
+        const DesfireAccessRights keyed{ 0x01, 0x02, 0x00, 0x00 };
+        const BYTEV header = { 0xCA, 0xFE, 0x01 };
+        const BYTEV readKey(16, 0x11), appMaster(16, 0x22), piccKey(16, 0x33);
+
+        DesfireMemoryLayout target;
+        target.totalMemory = 4096;
+        target.freeMemory  = 512;
+
+        DesfireProfile p;
+        p.piccKey = piccKey;
+        p.format  = true;
+        p.addApp(aid, 0x0B, 3)
+            .addStdDataFile(1, DesfireCommMode::Full, keyed, 40, header)
+            .addBackupDataFile(2, DesfireCommMode::Plain, freeAcc, 16, BYTEV(16, 0x5A))
+            .addValueFile(3, DesfireCommMode::MAC, keyed, 0, 10000, 100)
+            .addCyclicRecordFile(4, DesfireCommMode::Plain, freeAcc, 8, 4)
+            .addKey(0, appMaster, 1)
+            .addKey(1, readKey, 1);
+
+        // ── 1. Derleme: sıra ve hazır APDU'lar ──────────────────────────────
+
+        auto c = DesfireScript::tryCompile(p, target);
+        PR_CHECK(c.is_ok());
+        const DesfireScript& sc = c.unwrap();
+        const std::vector<DesfireScriptOp> ops = {
+            DesfireScriptOp::Select, DesfireScriptOp::Authenticate, DesfireScriptOp::Format,
+            DesfireScriptOp::CreateApp, DesfireScriptOp::Select, DesfireScriptOp::Authenticate,
+            DesfireScriptOp::CreateFile, DesfireScriptOp::CreateFile, DesfireScriptOp::CreateFile,
+            DesfireScriptOp::CreateFile, DesfireScriptOp::WriteData, DesfireScriptOp::WriteData,
+            DesfireScriptOp::Commit, DesfireScriptOp::ChangeKey, DesfireScriptOp::ChangeKey };
+        PR_CHECK(sc.size() == ops.size());
+        for (size_t i = 0; i < ops.size(); ++i) PR_CHECK(sc.steps()[i].op == ops[i]);
+
+        const auto& st = sc.steps();
+        PR_CHECK(st[1].key == piccKey && st[1].aid.isPICC());
+        PR_CHECK(st[3].apdu == DesfireCommands::createApplication(aid, 0x0B, 3, DesfireKeyType::AES128));
+        PR_CHECK(st[5].aid == aid && st[5].fileNo == 0 && st[5].key == BYTEV(16, 0x00));   // fabrika key'i
+        PR_CHECK(st[6].apdu == DesfireCommands::createStdDataFile(1, DesfireCommMode::Full, keyed, 40));
+        PR_CHECK(st[8].apdu == DesfireCommands::createValueFile(3, DesfireCommMode::MAC, keyed, 0, 10000, 100, false));
+        PR_CHECK(st[9].apdu == DesfireCommands::createCyclicRecordFile(4, DesfireCommMode::Plain, freeAcc, 8, 4));
+        PR_CHECK(st[10].apdu == DesfireCommands::writeData(1, 0, header));
+        PR_CHECK(st[10].mode == DesfireCommMode::Full && st[10].headerLen == 7);
+        PR_CHECK(st[13].fileNo == 1 && st[13].key == readKey);         // master en son
+        PR_CHECK(st[14].fileNo == 0 && st[14].key == appMaster && st[14].keyVersion == 1);
+        PR_CHECK(!sc.needsDiversifier() && sc.formats());
+
+        // Beklenen model + kapasite (32 byte bloklar, backup iki kopya)
+        PR_CHECK(sc.applications().size() == 1);
+        const DesfireApplication& m = sc.applications()[0];
+        PR_CHECK(m.keyConfig.keyCount == 3 && m.fileListKnown && m.files.size() == 4);
+        PR_CHECK(m.findFile(2) && m.findFile(2)->settingsKnown && m.findFile(2)->settings.standard.fileSize == 16);
+        PR_CHECK(DesfireScript::footprint(m.findFile(1)->settings) == 64);
+        PR_CHECK(DesfireScript::footprint(m.findFile(2)->settings) == 64);
+        PR_CHECK(sc.requiredMemory() == 64 + 64 + 32 + 32);
+
+        // ── 2. Doğrulama hataları ───────────────────────────────────────────
+
+        auto fails = [&](const DesfireProfile& bad, const char* needle) {
+            auto r = DesfireScript::tryCompile(bad, target);
+            return !r.is_ok() && r.error().detail.find(needle) != std::string::npos;
+        };
+        {
+            DesfireProfile bad = p;
+            bad.piccKey.clear();
+            PR_CHECK(fails(bad, "FormatPICC"));
+        }
+        {
+            DesfireProfile bad = p;
+            bad.apps[0].addStdDataFile(9, DesfireCommMode::Plain, DesfireAccessRights{ 0x05, 0x0E, 0x0E, 0x00 }, 8);
+            PR_CHECK(fails(bad, "Access rights"));
+        }
+        {
+            DesfireProfile bad = p;
+            bad.apps[0].addStdDataFile(1, DesfireCommMode::Plain, freeAcc, 8);
+            PR_CHECK(fails(bad, "Duplicate file"));
+        }
+        {
+            DesfireProfile bad = p;
+            bad.apps[0].addValueFile(9, DesfireCommMode::Plain, freeAcc, 10, 5, 7);
+            PR_CHECK(fails(bad, "lower..upper"));
+        }
+        {
+            DesfireProfile bad = p;
+            bad.apps[0].addStdDataFile(9, DesfireCommMode::Plain, DesfireAccessRights{ 0x0E, 0x01, 0x01, 0x00 }, 8, header);
+            auto r = DesfireScript::tryCompile(bad, target);
+            PR_CHECK(!r.is_ok());
+            PR_CHECK(std::get_if<DesfireError>(&r.error().kind) &&
+                     *std::get_if<DesfireError>(&r.error().kind) == DesfireError::PermissionDenied);
+        }
+        {
+            DesfireProfile bad = p;
+            bad.apps[0].keyConfig.keySettings = 0x1B;        // ChangeKey hakkı key 1'de
+            PR_CHECK(fails(bad, "master key change"));
+        }
+        {
+            DesfireProfile bad = p;
+            bad.apps[0].keys[1].newKey.resize(8);
+            PR_CHECK(fails(bad, "Key size"));
+        }
+        {
+            DesfireProfile bad = p;
+            bad.addApp(aid, 0x0F, 1);
+            PR_CHECK(fails(bad, "Duplicate application"));
+        }
+        {
+            DesfireProfile big = p;
+            big.apps[0].addLinearRecordFile(9, DesfireCommMode::Plain, freeAcc, 64, 64);   // 4096 byte
+            PR_CHECK(fails(big, "exceeds card memory"));
+            big.format = false;                               // boş alan 512
+            big.apps[0].files.pop_back();
+            big.apps[0].addStdDataFile(9, DesfireCommMode::Plain, freeAcc, 400);
+            PR_CHECK(fails(big, "exceeds card memory"));
+            target.freeMemory = 0;                            // bilinmiyor → denetlenmez
+            PR_CHECK(DesfireScript::tryCompile(big, target).is_ok());
+            target.freeMemory = 512;
+        }
+        {
+            DesfireMemoryLayout existing = target;            // app zaten kartta
+            existing.syncAppIDs({ aid });
+            DesfireProfile noFormat = p;
+            noFormat.format = false;
+            PR_CHECK(!DesfireScript::tryCompile(noFormat, existing).is_ok());
+            PR_CHECK(DesfireScript::tryCompile(p, existing).is_ok());    // format siler
+        }
+
+        // ── 3. Yürütme: ilk hatada durur, adım bilgisi eklenir ───────────────
+
+        {
+            DesfireScriptReport rep;
+            size_t sent = 0;
+            auto ok = sc.tryRun([&](const DesfireScriptStep&) { ++sent; return VoidResult::Ok(); }, rep);
+            PR_CHECK(ok.is_ok() && rep.completed && sent == sc.size());
+            PR_CHECK(rep.events.size() == sc.size() && rep.count(DesfireScriptOp::CreateFile) == 4);
+            PR_CHECK(rep.failedStep == -1);
+
+            DesfireScriptReport rep2;
+            sent = 0;
+            auto bad = sc.tryRun([&](const DesfireScriptStep& s) {
+                ++sent;
+                return s.op == DesfireScriptOp::WriteData
+                    ? VoidResult::Err(Error<PcscError>(DesfireError::PermissionDenied))
+                    : VoidResult::Ok();
+            }, rep2);
+            PR_CHECK(!bad.is_ok() && !rep2.completed && rep2.failedStep == 10 && sent == 11);
+            PR_CHECK(bad.error().detail.find("script step 10: WriteData") != std::string::npos);
+            PR_CHECK(!rep2.events.back().ok);
+            std::ostringstream os;
+            rep2.print(os);
+            PR_CHECK(os.str().find("FAILED") != std::string::npos);
+        }
+
+        // ── 4. ChangeKey kriptogramı (legacy AES, sıfır IV) ─────────────────
+
+        {
+            const BYTEV sk = { 0x10,0x21,0x32,0x43,0x54,0x65,0x76,0x87,0x98,0xA9,0xBA,0xCB,0xDC,0xED,0xFE,0x0F };
+            const BYTEV zero16(16, 0x00);
+            auto session = [&] {
+                DesfireSession s;
+                s.authenticated = true;
+                s.authKeyNo  = 0;
+                s.keyType    = DesfireKeyType::AES128;
+                s.sessionKey = sk;
+                s.touchAuthTime();
+                return s;
+            };
+            auto crcLE = [](const BYTEV& d, uint32_t init = 0xFFFFFFFF) {
+                uint32_t c = DesfireSecureMessaging::crc32(d.data(), d.size(), init);
+                return BYTEV{ BYTE(c), BYTE(c >> 8), BYTE(c >> 16), BYTE(c >> 24) };
+            };
+
+            // Başka key: (new ^ old) || ver || CRC32(C4 || 01 || ..) || CRC32(new) || 0-pad
+            DesfireSession s1 = session();
+            const BYTEV oldKey(16, 0x0F);
+            auto a1 = DesfireSecureMessaging::tryChangeKeyCommand(s1, 1, DesfireKeyType::AES128, readKey, 7, oldKey);
+            PR_CHECK(a1.is_ok());
+            const BYTEV& apdu1 = a1.unwrap();
+            PR_CHECK(apdu1[1] == 0xC4 && apdu1[5] == 0x01 && apdu1[4] == 33 && apdu1.size() == 39);
+            BYTEV enc1(apdu1.begin() + 6, apdu1.end() - 1);
+            BYTEV plain1 = crypto::block::decryptAesCbc(sk, zero16, enc1);
+            BYTEV expect1(16);
+            for (int i = 0; i < 16; ++i) expect1[i] = readKey[i] ^ oldKey[i];
+            expect1.push_back(7);
+            BYTEV crcIn = { 0xC4, 0x01 };
+            crcIn.insert(crcIn.end(), expect1.begin(), expect1.end());
+            BYTEV c1 = crcLE(crcIn), c2 = crcLE(readKey);
+            expect1.insert(expect1.end(), c1.begin(), c1.end());
+            expect1.insert(expect1.end(), c2.begin(), c2.end());
+            expect1.resize(32, 0x00);
+            PR_CHECK(plain1 == expect1);
+            PR_CHECK(s1.iv == BYTEV(enc1.end() - 16, enc1.end()));     // IV ← son blok
+
+            // Auth key'i: new || ver || CRC32(C4 || 00 || new || ver) || 0-pad
+            DesfireSession s0 = session();
+            auto a0 = DesfireSecureMessaging::tryChangeKeyCommand(s0, 0, DesfireKeyType::AES128, appMaster, 1);
+            PR_CHECK(a0.is_ok());
+            BYTEV enc0(a0.unwrap().begin() + 6, a0.unwrap().end() - 1);
+            PR_CHECK(enc0.size() == 32);
+            BYTEV plain0 = crypto::block::decryptAesCbc(sk, zero16, enc0);
+            BYTEV expect0 = appMaster;
+            expect0.push_back(1);
+            BYTEV crc0In = { 0xC4, 0x00 };
+            crc0In.insert(crc0In.end(), expect0.begin(), expect0.end());
+            BYTEV c0 = crcLE(crc0In);
+            expect0.insert(expect0.end(), c0.begin(), c0.end());
+            expect0.resize(32, 0x00);
+            PR_CHECK(plain0 == expect0);
+
+            // Oturumsuz / yanlış boyut
+            DesfireSession none;
+            PR_CHECK(!DesfireSecureMessaging::tryChangeKeyCommand(none, 1, DesfireKeyType::AES128, readKey, 0).is_ok());
+            DesfireSession s2 = session();
+            PR_CHECK(!DesfireSecureMessaging::tryChangeKeyCommand(s2, 1, DesfireKeyType::AES128, BYTEV(8, 1), 0).is_ok());
+        }
+
+#undef PR_CHECK
+        return true;
+    }
+    catch (const exception& e) {
+        cout << "    Exception at line " << line << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
 // ════════════════════════════════════════════════════════════════════════════════
 // MAIN TEST RUNNER
 // ════════════════════════════════════════════════════════════════════════════════
@@ -1983,6 +4926,31 @@ int runCardSystemTests() {
     recordTest("DESFire Integration", testDesfireIntegration());
     recordTest("DESFire 3K3DES", testDesfire3K3DES());
     recordTest("DESFire Record Files", testDesfireRecordFiles());
+    recordTest("Rekey Journal", testRekeyJournal());
+    recordTest("Rekey Engine", testRekeyEngine());
+    recordTest("CardIO Key Plan", testCardIOKeyPlan());
+    recordTest("Trailer Batch", testTrailerBatch());
+    recordTest("CardIO Write Diff", testCardIOWriteDiff());
+    recordTest("Card Image Archive", testCardImageArchive());
+    recordTest("Card Image Diff", testCardImageDiff());
+    recordTest("Card Snapshots", testCardSnapshots());
+    recordTest("Compact Card Store", testCompactCardStore());
+    recordTest("DESFire Stream Read", testDesfireStreamRead());
+    recordTest("DESFire Command Chaining", testDesfireCommandChaining());
+    recordTest("DESFire Secure Messaging Modes", testDesfireSecureMessagingModes());
+    recordTest("CMAC Engine", testCmacEngine());
+    recordTest("DESFire Metadata Cache", testDesfireMetadataCache());
+    recordTest("DESFire Snapshot Report", testDesfireSnapshotReport());
+    recordTest("DESFire Snapshot Refresh", testDesfireSnapshotRefresh());
+    recordTest("DESFire EV2 Auth", testDesfireEV2Auth());
+    recordTest("DESFire Key Diversification", testDesfireKeyDiversification());
+    recordTest("DESFire Allocation-Free Auth", testDesfireAllocationFreeAuth());
+    recordTest("DESFire Indexed Lookups", testDesfireIndexedLookups());
+    recordTest("DESFire Data Views", testDesfireDataViews());
+    recordTest("DESFire Record Pages", testDesfireRecordPages());
+    recordTest("DESFire Transaction", testDesfireTransaction());
+    recordTest("DESFire Auth Cache", testDesfireAuthCache());
+    recordTest("DESFire Profile", testDesfireProfile());
     
     // Summary
     cout << "\n=== Test Summary ===\n";
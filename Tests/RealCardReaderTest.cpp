@@ -324,6 +324,20 @@ int testRealCardReader()
     catch (const exception& e) { cout << "    HATA: " << e.what() << '\n'; }
     cout << '\n';
 
+    cout << "[18] io.readAllTrailers(verify) — batch rapor...\n";
+    try {
+        vector<TrailerConfig> tcs;
+        TrailerBatchReport rep = io.readAllTrailers(tcs, true);
+        cout << "    " << rep.okCount() << "/" << rep.sectors.size() << " sektor okundu"
+             << (rep.allOk() ? " (tumu dogrulandi)" : "") << ".\n";
+        for (const auto& sr : rep.sectors)
+            if (!sr.ok() || !sr.verified)
+                cout << "    Sektor " << sr.sector << " key"
+                     << (sr.keyType == KeyType::A ? 'A' : 'B') << ": " << sr.error << '\n';
+    }
+    catch (const exception& e) { cout << "    HATA: " << e.what() << '\n'; }
+    cout << '\n';
+
     // ── Özet ────────────────────────────────────────────────────────────────
 
     cout << "========================================================\n";
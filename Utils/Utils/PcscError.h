@@ -74,6 +74,7 @@ inline std::string describeKind(const PcscErrorKind& k){
 				case DesfireError::AppNotFound: return "DESFire application not found";
 				case DesfireError::FileNotFound: return "DESFire file not found";
 				case DesfireError::AuthMismatch: return "DESFire auth verification failed";
+				case DesfireError::TransactionLost: return "DESFire transaction lost (session dropped)";
 				case DesfireError::Unknown: return "Unknown DESFire error";
 				default: return "DESFire error";
 			}
@@ -204,6 +205,8 @@ inline PcscErrorCode mapKindToCode(DesfireError e)
 		return PcscErrorCode::DesfireFileNotFound;
 	case DesfireError::AuthMismatch:
 		return PcscErrorCode::DesfireAuthMismatch;
+	case DesfireError::TransactionLost:
+		return PcscErrorCode::DesfireTransactionLost;
 	default:
 		break;
 	}
@@ -272,6 +275,8 @@ inline PcscErrorKind mapCodeToKind(PcscErrorCode c)
 		return DesfireError::FileNotFound;
 	case PcscErrorCode::DesfireAuthMismatch:
 		return DesfireError::AuthMismatch;
+	case PcscErrorCode::DesfireTransactionLost:
+		return DesfireError::TransactionLost;
 
 	default:
 		return ConnectionError::Unknown;
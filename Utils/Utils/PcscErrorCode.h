@@ -50,6 +50,7 @@ enum class PcscErrorCode : uint8_t
 	DesfireAppNotFound,
 	DesfireFileNotFound,
 	DesfireAuthMismatch,
+	DesfireTransactionLost,
 
 	Unknown = static_cast<uint8_t>(~0)
 };
@@ -112,6 +113,8 @@ inline std::string describe(PcscErrorCode code)
 		return "DESFire file not found";
 	case PcscErrorCode::DesfireAuthMismatch:
 		return "DESFire auth verification failed";
+	case PcscErrorCode::DesfireTransactionLost:
+		return "DESFire transaction lost (session dropped)";
 	default:
 		return "Unknown error";
 	}
@@ -166,6 +169,7 @@ enum class DesfireError : uint8_t {
 	AppNotFound,
 	FileNotFound,
 	AuthMismatch,
+	TransactionLost,        // açık işlem sırasında oturum düştü → işlem baştan
 	Unknown = static_cast<uint8_t>(~0)
 };
 